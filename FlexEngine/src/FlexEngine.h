@@ -66,6 +66,15 @@
 // Uses a simple key-value pair system to store metadata in files.
 #include "FlexEngine/flexformatter.h"
 
+// Binary variant of the FlexFormat, sections of raw bytes for fast loading.
+#include "FlexEngine/flexformatterbinary.h"
+
+// Compressed container for FlexFormat files, detected transparently by File::Read().
+#include "FlexEngine/flexcompression.h"
+
+// Hardware accelerated CRC32C checksums, FlexFormat files use them to detect corruption.
+#include "FlexEngine/Wrapper/checksum.h"
+
 // UUID class for generating unique identifiers.
 #include "FlexEngine/uuid.h"
 
@@ -127,6 +136,10 @@
 #include "FlexEngine/Wrapper/file.h"
 #include "FlexEngine/Wrapper/filelist.h"
 
+// Maps a file into memory as a copy-on-write view instead of reading it.
+// Used for zero-copy loading of binary FlexFormat files.
+#include "FlexEngine/Wrapper/mappedfile.h"
+
 
 /* |-----------------------------| */
 /* |---------- Renderer ---------| */
@@ -172,6 +185,30 @@
 // This uses the Archetype-based Entity-Component-System architecture.
 #include "FlexEngine/FlexECS/datastructures.h"
 
+// World partitioning for FlexECS.
+// Streams entities in grid cells to and from disk around a focus point.
+#include "FlexEngine/FlexECS/worldpartition.h"
+
+// Time-sliced iteration for FlexECS.
+// Spreads a system over several frames with a per-frame entity or time budget.
+#include "FlexEngine/FlexECS/timeslice.h"
+
+// Incremental autosave journal for FlexECS.
+// Appends the changes since the last save next to the scene and compacts them into a snapshot.
+#include "FlexEngine/FlexECS/scenejournal.h"
+
+// Scene replication for FlexECS.
+// Sends delta compressed snapshots of the replicated components from a server scene to client scenes.
+#include "FlexEngine/FlexECS/replication.h"
+
+// Fixed-step simulation with rollback for FlexECS.
+// Keeps the simulation state of the last frames in a ring buffer to rewind, re-simulate and detect desyncs.
+#include "FlexEngine/FlexECS/rollback.h"
+
+// Cached component handles for FlexECS.
+// Skips the index lookups of GetComponent until the entity's archetype changes.
+#include "FlexEngine/FlexECS/componentref.h"
+
 // Two way queue for storing and executing functions.
 #include "FlexEngine/DataStructures/functionqueue.h"
 
@@ -184,3 +221,6 @@
 // The number that is generated is inclusive of the min and max values.
 // Can also be used to store a range of values by getting min and max.
 #include "FlexEngine/DataStructures/range.h"
+
+// Runs a loop body on several threads, used by scene serialization.
+#include "FlexEngine/DataStructures/parallelfor.h"
@@ -4,6 +4,7 @@
 
 #include "StateManager/statemanager.h"
 #include "input.h"
+#include "FlexECS/datastructures.h"
 
 namespace FlexEngine
 {
@@ -125,6 +126,9 @@ namespace FlexEngine
       // input cleanup (updates key states and mouse delta for the next frame)
       Input::Cleanup();
     }
+
+    // autosaves run on their own thread, let them finish before anything they use is destroyed
+    FlexECS::Scene::WaitForAsyncSaves();
   }
 
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm> // std::min, std::max
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace FlexEngine
+{
+
+  // Calls fn(index) for every index in [0, count) on up to max_threads threads,
+  // the calling thread being one of them. Returns once every index is done.
+  // Indices are handed out one at a time, so a few large items and many small ones
+  // still keep every thread busy.
+  // A max_threads of 0 uses one thread per hardware thread.
+  // fn must be safe to call from several threads at once and must not throw.
+  //
+  // Usage:
+  // std::vector<std::string> buffers(archetypes.size());
+  // ParallelFor(archetypes.size(), [&](std::size_t i) { buffers[i] = Encode(archetypes[i]); });
+  template <typename Fn>
+  void ParallelFor(std::size_t count, Fn&& fn, std::size_t max_threads = 0)
+  {
+    if (max_threads == 0) max_threads = (std::max)(1u, std::thread::hardware_concurrency());
+    std::size_t thread_count = (std::min)(count, max_threads);
+
+    // not worth a thread
+    if (thread_count <= 1)
+    {
+      for (std::size_t i = 0; i < count; i++) fn(i);
+      return;
+    }
+
+    std::atomic<std::size_t> next{ 0 };
+    auto work = [&]()
+    {
+      for (std::size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) fn(i);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (std::size_t i = 1; i < thread_count; i++) threads.emplace_back(work);
+    work();
+    for (std::thread& thread : threads) thread.join();
+  }
+
+}
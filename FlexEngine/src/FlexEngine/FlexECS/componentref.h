@@ -0,0 +1,104 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "datastructures.h" // <algorithm> <typeindex> <memory>
+
+// Cached handle to a component of a known entity
+//
+// Entity::GetComponent does an entity_index lookup and two component_index lookups on
+// every call. ComponentRef does those lookups once and keeps the component pointer
+// together with the structural version of the entity's archetype.
+// While the version and the active scene are unchanged, Get() is a compare and a load.
+//
+// The cache is dropped when
+// - any row is removed from the entity's archetype (DestroyEntity, Add/RemoveComponent
+//   on any entity in the archetype), since that can move or free the component
+// - the active scene changes
+// Adding entities to the archetype doesn't invalidate it.
+//
+// Usage:
+// FlexECS::ComponentRef<Camera> camera = main_camera; // keep this around, e.g. as a member
+// camera->is_dirty = true;                            // every frame
+// if (camera) { ... }                                 // false if the entity doesn't have it
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    template <typename T>
+    class ComponentRef
+    {
+    public:
+      ComponentRef() = default;
+      ComponentRef(Entity entity) : m_entity(entity) {}
+
+      // Returns nullptr if the entity doesn't exist or doesn't have the component
+      T* Get()
+      {
+        if (
+          m_archetype != nullptr &&
+          m_scene_version == Scene::GetActiveSceneVersion() &&
+          m_version == m_archetype->version
+        ) return m_data;
+
+        return Internal_Resolve();
+      }
+
+      T* operator->() { return Get(); }
+      T& operator*() { return *Get(); }
+      explicit operator bool() { return Get() != nullptr; }
+
+      Entity GetEntity() const { return m_entity; }
+
+      // Points the handle at another entity
+      void Reset(Entity entity = Entity::Null)
+      {
+        m_entity = entity;
+        m_archetype = nullptr;
+        m_data = nullptr;
+      }
+
+    private:
+      // The same lookups as Entity::GetComponent, using find() so that the
+      // indexes are never modified and no errors are logged
+      T* Internal_Resolve()
+      {
+        m_archetype = nullptr;
+        m_data = nullptr;
+
+        auto entity_it = ENTITY_INDEX.find(m_entity);
+        if (entity_it == ENTITY_INDEX.end()) return nullptr;
+        Archetype& archetype = *entity_it->second.archetype;
+
+        // remember the archetype even when the component is missing,
+        // so that the miss is cached as well
+        m_archetype = &archetype;
+        m_version = archetype.version;
+        m_scene_version = Scene::GetActiveSceneVersion();
+
+        auto component_it = COMPONENT_INDEX.find(Reflection::TypeResolver<T>::Get()->name);
+        if (component_it == COMPONENT_INDEX.end()) return nullptr;
+
+        auto archetype_it = component_it->second.find(archetype.id);
+        if (archetype_it == component_it->second.end()) return nullptr;
+
+        const ComponentData<void>& component_data = archetype.archetype_table[archetype_it->second.column][entity_it->second.row];
+        m_data = reinterpret_cast<T*>(Internal_GetComponentDataPtr(component_data));
+        return m_data;
+      }
+
+      Entity m_entity = Entity::Null;
+
+      // Cache
+      // The component data is owned by a shared_ptr in the column, so the pointer
+      // stays valid when other rows are appended or the column reallocates.
+      T* m_data = nullptr;
+      const Archetype* m_archetype = nullptr;
+      std::size_t m_version = 0;
+      std::size_t m_scene_version = 0;
+    };
+
+  }
+}
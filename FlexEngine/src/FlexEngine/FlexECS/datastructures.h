@@ -6,14 +6,26 @@
 #include "flexformatter.h"  // "Wrapper/datetime.h" "Wrapper/file.h" <sstream>
                             // <RapidJSON/document.h> <RapidJSON/istreamwrapper.h> <RapidJSON/ostreamwrapper.h>
                             // <RapidJSON/writer.h> <RapidJSON/prettywriter.h>
+#include "flexformatterbinary.h" // <cstdint> <cstring> <string> <vector>
+#include "flexcompression.h"
 #include "flexlogger.h" // <filesystem> <fstream> <string>
 #include "Reflection/base.h"  // "Wrapper/flexassert.h" <rapidjson/document.h>
                               // <cstddef> <iostream> <string> <sstream> <vector> <map> <unordered_map> <functional>
 #include "Wrapper/file.h" // "Wrapper/path.h" <fstream>
+#include "Wrapper/mappedfile.h"
 
 #include <algorithm> // std::sort
 #include <typeindex> // std::type_index
 #include <memory> // std::shared_ptr
+#include <future> // std::future
+
+// Marks a component member that holds a Scene::StringIndex.
+// Scene::Merge() copies the string into the scene it merges into, the index alone would
+// point at a different string there. Entity names are always copied.
+// Place in the .cpp file after FLX_REFL_REGISTER_END for the type.
+#define FLX_ECS_REGISTER_STRING_MEMBER(TYPE, MEMBER) \
+  static const bool _flx_ecs_string_member_##TYPE##_##MEMBER = \
+    FlexEngine::FlexECS::Internal_RegisterStringMember(&FlexEngine::Reflection::TypeResolver<TYPE>::Get, offsetof(TYPE, MEMBER));
 
 namespace FlexEngine
 {
@@ -49,7 +61,7 @@ namespace FlexEngine
     using EntityID = uint64_t;
 
     // Stringified type descriptor for components
-    // Use TYPE_DESCRIPTOR_LOOKUP to convert the string back to the TypeDescriptor
+    // Use Reflection::TypeDescriptor::FindByName to convert the string back to the TypeDescriptor
     using ComponentID = std::string;
 
     // Just a unique identifier for an archetype counting up from 0
@@ -121,6 +133,17 @@ namespace FlexEngine
     // Get the size and data pointer from a ComponentData<void>
     __FLX_API std::pair<std::size_t, void*> Internal_GetComponentData(ComponentData<void> data);
 
+    // Get the data pointer from a ComponentData<void> without copying the shared_ptr.
+    // Prefer this in hot loops since Internal_GetComponentData bumps the reference count.
+    inline void* Internal_GetComponentDataPtr(const ComponentData<void>& data)
+    {
+      return reinterpret_cast<std::size_t*>(data.get()) + 1;
+    }
+
+    // Registers a StringIndex member of a component. Use FLX_ECS_REGISTER_STRING_MEMBER instead.
+    // Takes the resolver instead of the type, see FLX_REFL_REGISTER_START.
+    __FLX_API bool Internal_RegisterStringMember(Reflection::TypeDescriptor* (*get_type)(), std::size_t offset);
+
 
     using Column = std::vector<ComponentData<void>>;
     using Row = std::vector<Column>;
@@ -135,6 +158,12 @@ namespace FlexEngine
       ArchetypeTable archetype_table; // This is where the components are stored
       std::vector<EntityID> entities;
       std::unordered_map<ComponentID, ArchetypeEdge> edges;
+
+      // Structural version, incremented whenever a row is removed from the archetype.
+      // Removing a row swaps the last row into its place, so any cached row or component
+      // pointer into this archetype has to be resolved again. See componentref.h
+      // Not serialized.
+      std::size_t version = 0;
     };
 
     // Edges to other archetypes
@@ -174,6 +203,54 @@ namespace FlexEngine
     // Used to lookup components in archetypes
     using ArchetypeMap = std::unordered_map<ArchetypeID, ArchetypeRecord>;
 
+    // Differences between two states of a scene, made by Scene::Diff(), see scenepatch.cpp.
+    // Only the rows and component cells that changed are stored,
+    // so an undo step or an autosave is a few bytes per edit instead of a scene copy.
+    struct __FLX_API ScenePatch
+    {
+      // Component bytes of one column, without the size prefix
+      struct ColumnDelta
+      {
+        std::vector<EntityID> entities;
+        std::vector<std::string> data;
+      };
+
+      struct ArchetypeDelta
+      {
+        ComponentIDList type;
+        std::vector<EntityID> added;      // new rows, their components are in the columns
+        std::vector<ColumnDelta> columns; // one per component in type
+      };
+
+      // Entities that are gone or moved to another archetype, moved entities are added back
+      std::vector<EntityID> removed;
+      std::vector<ArchetypeDelta> archetypes;
+
+      // Changed string storage slots
+      std::vector<std::pair<std::size_t, std::string>> strings;
+      std::size_t string_storage_size = 0;
+      std::vector<std::size_t> string_storage_free_list;
+
+      // FLX_ID_SETUP state
+      uint64_t id_next = 1;
+      std::vector<uint64_t> id_unused;
+
+      // True if no entity, component or string changed
+      bool IsEmpty() const;
+
+      std::string Serialize() const;
+
+      // Returns false if the data isn't a serialized scene patch
+      static bool Deserialize(std::string_view data, ScenePatch& out);
+    };
+
+    // Outcome of Scene::SaveAsync(), the error is set by the save thread and can be logged by the caller
+    struct __FLX_API SceneSaveResult
+    {
+      bool success = false;
+      std::string error;
+    };
+
     #pragma endregion
 
 
@@ -200,6 +277,9 @@ namespace FlexEngine
 
       static std::shared_ptr<Scene> s_active_scene;
 
+      // Incremented every time the active scene changes
+      static std::size_t s_active_scene_version;
+
     public:
 
       // Null scene for when the active scene is set to null
@@ -236,6 +316,42 @@ namespace FlexEngine
 
       #pragma endregion
 
+      #pragma region Entity Names
+
+    private:
+      // Name to entity lookup, not serialized.
+      // Rebuilt from the name components on first use after loading or merging.
+      // Entries are checked against the current name when they are looked up, so an entry
+      // left behind by a destroyed or moved entity never gives a wrong result.
+      std::unordered_multimap<std::string, EntityID> name_index;
+      bool is_name_index_dirty = true;
+
+      // Returns the entity's name component in this scene, or nullptr
+      StringIndex* Internal_GetNameComponent(EntityID entity);
+      void Internal_RebuildNameIndex();
+      void Internal_RemoveFromNameIndex(EntityID entity, const std::string& name);
+
+    public:
+      // Returns the name of the entity, or an empty string if the entity doesn't exist.
+      const std::string& GetEntityName(EntityID entity);
+
+      // Renames the entity and updates the name index.
+      // Use this instead of writing to the string storage so that FindByName stays correct.
+      void SetEntityName(EntityID entity, const std::string& name);
+
+      // Returns the first entity with the name, or Entity::Null.
+      // Usage: Entity main_camera = scene->FindByName("Main Camera");
+      Entity FindByName(const std::string& name);
+
+      // Returns every entity with the name
+      std::vector<Entity> FindAllByName(const std::string& name);
+
+      // Sorts the entities by name.
+      // Each name is looked up once before sorting instead of on every comparison.
+      void SortByName(std::vector<Entity>& entities);
+
+      #pragma endregion
+
       #pragma region ECS View
 
     public:
@@ -254,6 +370,10 @@ namespace FlexEngine
       static void SetActiveScene(const Scene& scene);
       static void SetActiveScene(std::shared_ptr<Scene> scene);
 
+      // Changes every time the active scene is set.
+      // Used by ComponentRef to detect that its cached pointers belong to another scene.
+      static std::size_t GetActiveSceneVersion();
+
       #pragma endregion
 
       #pragma region Entity management functions
@@ -278,10 +398,182 @@ namespace FlexEngine
       // This is the interface for the reflection system to serialize and deserialize
       // the ECS data structures. Use this interface to save and load scenes.
 
+      // Save() keeps the format (json or binary), the metadata and the compression of an
+      // existing file, see Internal_SerializeFile(). New files are saved as json.
       void Save(File& file);
       static std::shared_ptr<Scene> Load(File& file);
       static void SaveActiveScene(File& file);
 
+      // Saves the scene on a background thread without blocking the frame.
+      // A snapshot is taken before this returns, later changes to the scene aren't saved.
+      // The file is written next to the old one and renamed over it, so a crash never leaves
+      // a half written scene. Saves run one after the other in the order they were requested.
+      // An existing binary file is saved as binary, the same as SaveBinary().
+      // file.data isn't updated, Read() the file after the save to get its contents.
+      // Usage:
+      // std::future<SceneSaveResult> autosave = scene->SaveAsync(file);
+      // // later, without waiting
+      // if (autosave.valid() && autosave.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      // {
+      //   SceneSaveResult result = autosave.get();
+      //   if (!result.success) Log::Error(result.error);
+      // }
+      std::future<SceneSaveResult> SaveAsync(File& file);
+      static std::future<SceneSaveResult> SaveActiveSceneAsync(File& file);
+
+      // Blocks until every async save has finished.
+      // Called by Application::Run() before the engine shuts down.
+      static void WaitForAsyncSaves();
+
+      // Copies the scene, with its own copy of every component.
+      // Column data is copied into one allocation per column, so this costs about as much as
+      // a memcpy of the components. Archetype edges are rebuilt on demand.
+      std::shared_ptr<Scene> Internal_Snapshot() const;
+
+      // Copies a column the same way as Internal_Snapshot(), the rows share one allocation.
+      static Column Internal_CopyColumn(const Column& column);
+
+      // Serializes the scene into a complete FlexFormat file, keeping the format (json or binary),
+      // the metadata and the compression of the file at path if there is one.
+      // Doesn't touch the file registry or the logger, so it can run on a snapshot on another thread.
+      std::string Internal_SerializeFile(const std::filesystem::path& path);
+
+      // The file the scene was mapped from by LoadMapped(), rows that weren't modified point into it. Not serialized.
+      std::weak_ptr<MappedFile> mapped_file;
+
+      // INTERNAL FUNCTION
+      // Copies the rows that point into the mapping of the file at path out of it, so that the file can be replaced.
+      // Called before the scene is saved, a mapped file can't be written on Windows.
+      // Other scenes that still have rows in the mapping, like scenes extracted from this one, keep the file mapped.
+      void Internal_ReleaseMappedFile(const std::filesystem::path& path);
+
+      // Writes the data next to path and renames it over path, so a crash never leaves
+      // a half written file. Returns the error, or an empty string on success.
+      // Doesn't touch the file registry or the logger.
+      static std::string Internal_WriteFileAtomic(const std::filesystem::path& path, const std::string& data);
+
+      // Serializes the scene into the json that is stored as the data of a FlexFormat file.
+      // Save() wraps this, use it directly when the FlexFormat file is handled elsewhere.
+      // Archetypes are encoded in parallel for large scenes, the output is the same either way.
+      std::string Internal_Serialize();
+
+      // Deserializes a scene from the data of a FlexFormat file.
+      // Returns nullptr if the data can't be parsed, without logging.
+      static std::shared_ptr<Scene> Internal_Deserialize(std::string_view data);
+
+      // Same as Internal_Deserialize but parses the data in place instead of copying it.
+      // The data is overwritten. It must be null terminated at or after size,
+      // a view into a std::string always is (see FlexFormatter::ParseView).
+      static std::shared_ptr<Scene> Internal_DeserializeInSitu(char* data, std::size_t size);
+
+      // Binary FlexFormat (flexformatterbinary.h), implemented in scenebinary.cpp
+      // The component columns are stored as raw bytes, so loading is a few bulk copies
+      // instead of a json parse and base64 decode per component.
+      // Load() detects binary files by their magic bytes.
+      void SaveBinary(File& file);
+
+      // Serializes the scene into a complete binary FlexFormat file.
+      // Archetype sections are encoded in parallel for large scenes.
+      std::string Internal_SerializeBinary(const Date& created = Date::Now(), uint32_t previous_save_version = 0, FlxFmtFileType file_type = FlxFmtFileType::Scene);
+
+      // Returns nullptr if the data isn't a valid binary scene.
+      // Archetype sections are decoded in parallel for large scenes.
+      // Without a backing the columns are copied out of the data.
+      // With a backing the rows point straight into the data and keep the backing alive,
+      // the data must stay valid and writable for as long as the backing is (see LoadMapped).
+      // With a previous scene, archetype sections with the same checksum as when previous
+      // was loaded are copied from previous instead of decoded, unless previous changed them (see Reload).
+      // The file type in the header has to match, scenes and prefabs are both FlexECS scenes.
+      static std::shared_ptr<Scene> Internal_DeserializeBinary(const char* data, std::size_t size, std::shared_ptr<void> backing = nullptr, const Scene* previous = nullptr, FlxFmtFileType file_type = FlxFmtFileType::Scene);
+
+      // The part of Load() after the file is read, for contents that were read another way (see SceneJournal).
+      // Json or binary, already decompressed. Returns nullptr if the data can't be loaded.
+      // The data is overwritten by the in situ parse.
+      static std::shared_ptr<Scene> Internal_LoadFromData(std::string& file_data, FlxFmtFileType file_type, const Scene* previous = nullptr);
+
+      // Maps a binary scene file into memory and loads it without copying the component data.
+      // Pages are read on first access and are copy-on-write, so modifying a component never
+      // touches the file. The mapping is released when the last row that points into it is gone.
+      // Json scenes fall back to Load().
+      static std::shared_ptr<Scene> LoadMapped(const Path& path);
+
+      // Loads a scene file again after it changed on disk, skipping what didn't change since
+      // previous was loaded from it. FlexFormat files carry CRC32C checksums of their contents:
+      // a json scene whose data checksum is the same isn't parsed at all, a binary scene only
+      // decodes the archetype sections whose checksum changed.
+      // The parts that didn't change are copied from previous, the reloaded scene never shares
+      // component data with it. Parts of previous that were edited since it was loaded are
+      // decoded again, so this is meant for a scene that is mostly left as it was loaded,
+      // like a prefab or a level that is reloaded when its file changes.
+      // Falls back to a full load when previous wasn't loaded from a file with checksums.
+      // Usage: scene = FlexECS::Scene::Reload(*scene, file);
+      static std::shared_ptr<Scene> Reload(const Scene& previous, File& file);
+
+      // Number of threads to (de)serialize archetypes with, 0 for one per hardware thread.
+      // Scenes with fewer rows than PARALLEL_SERIALIZATION_MIN_ROWS stay on the calling thread,
+      // starting threads would take longer than encoding them.
+      static constexpr std::size_t PARALLEL_SERIALIZATION_MIN_ROWS = 4096;
+      static std::size_t Internal_GetSerializationThreadCount(std::size_t row_count);
+
+      // Diff and patch, implemented in scenepatch.cpp
+      // Usage:
+      // ScenePatch undo = after.Diff(before);
+      // after.Apply(undo); // after == before
+
+      // Records what changed from this scene to the other scene.
+      // Component cells are compared by their bytes, cells that share their data are skipped.
+      ScenePatch Diff(const Scene& other) const;
+
+      // Applies a patch made by Diff() on a scene in the same state as this one.
+      // Changed components get new data instead of being written in place,
+      // the old data may be shared with a copy of the scene.
+      void Apply(const ScenePatch& patch);
+
+      #pragma endregion
+
+      #pragma region Bulk entity functions
+
+    public:
+      // These functions work on this scene instead of the active scene.
+      // They move whole rows between scenes without going through AddComponent,
+      // which is what world streaming uses to load and unload cells.
+
+      // The logger isn't thread-safe. Pass skipped to get the ids that were skipped
+      // instead of logging them, world streaming does this on its worker thread.
+
+      // Moves the entities and their components out of this scene into a new scene.
+      // The entity ids are kept and are not recycled, so the entities can be merged back later.
+      // Entities that don't exist in this scene are skipped.
+      std::shared_ptr<Scene> Internal_ExtractEntities(const std::vector<EntityID>& entities, std::vector<EntityID>* skipped = nullptr);
+
+      // Moves every entity of the other scene into this scene, keeping their ids.
+      // Rows are appended per archetype. Entities that already exist in this scene are skipped.
+      // The other scene is left without entities.
+      void Internal_MergeEntities(Scene& other, std::vector<EntityID>* skipped = nullptr);
+
+      // Finds the archetype with the given type in this scene or creates it.
+      // The type must be sorted.
+      Archetype& Internal_FindOrCreateArchetype(const ComponentIDList& type);
+
+      // Additive loading, implemented in scenemerge.cpp
+      // Usage:
+      // File& file = File::Open(Path::current("assets/prefabs/pawn.flxprefab"));
+      // std::vector<Entity> pawns = scene->InstantiatePrefab(file, 8);
+
+      // Copies every entity of the other scene into this scene count times, with new ids.
+      // Entity references inside components that point at an entity of the other scene
+      // are remapped to its copy, other references are kept. Entity names and members
+      // registered with FLX_ECS_REGISTER_STRING_MEMBER get their own string in this scene.
+      // Each column is filled from one allocation, every instance is a memcpy of the
+      // other scene's rows followed by the remap.
+      // Returns the new entities, instance by instance, in the same order for every instance.
+      std::vector<Entity> Merge(const Scene& other, std::size_t count = 1);
+
+      // Loads a .flxprefab or .flxscene file, json or binary, and merges it into this scene count times.
+      // file.data is overwritten by the in situ parse, the same as Load().
+      // Returns no entities if the file can't be loaded.
+      std::vector<Entity> InstantiatePrefab(File& file, std::size_t count = 1);
+
       #pragma endregion
 
     private:
@@ -290,6 +582,58 @@ namespace FlexEngine
       // need to be reconnected to the archetype_index.
       void Internal_RelinkEntityArchetypePointers();
 
+      // INTERNAL FUNCTION
+      // Shared by Internal_Deserialize and Internal_DeserializeInSitu.
+      static std::shared_ptr<Scene> Internal_DeserializeFromReader(Reflection::JsonReader& reader);
+
+      // INTERNAL FUNCTION
+      // Shared by Load(), Reload() and InstantiatePrefab(). Returns nullptr if the file can't be loaded.
+      static std::shared_ptr<Scene> Internal_Load(File& file, FlxFmtFileType file_type, const Scene* previous = nullptr);
+
+      // INTERNAL FUNCTION
+      // Prefab for a .flxprefab file, Scene otherwise.
+      static FlxFmtFileType Internal_GetFileType(const std::filesystem::path& path);
+
+
+      // Checksums of the file the scene was loaded from, see Reload(). Not serialized.
+      // Only set when the file had checksums and nothing was migrated while loading.
+      struct Internal_LoadChecksums
+      {
+        bool is_binary = false;
+
+        // json: the data
+        // binary: the ComponentTypes and Schemas sections, archetype sections refer to them
+        uint32_t data = 0;
+
+        // binary: the type of the archetype loaded from the section with this checksum
+        std::unordered_map<uint32_t, ComponentIDList> archetypes;
+
+        // the entities and component bytes of every archetype and the string storage right
+        // after loading, the scene could have been edited since and only what still matches is reused
+        std::unordered_map<ArchetypeID, uint32_t> contents;
+        uint32_t strings = 0;
+      };
+      std::shared_ptr<const Internal_LoadChecksums> load_checksums;
+
+      // INTERNAL FUNCTION
+      // Fills in the contents of the checksums from the scene as it is now and keeps them as load_checksums.
+      void Internal_SetLoadChecksums(std::shared_ptr<Internal_LoadChecksums> checksums);
+
+      // INTERNAL FUNCTION
+      // True if the archetype has the same contents as when the scene was loaded, see Reload().
+      bool Internal_IsUnchangedSinceLoad(const Archetype& archetype) const;
+      // True if every archetype and the string storage are the same as when the scene was loaded.
+      bool Internal_IsUnchangedSinceLoad() const;
+
+      // INTERNAL FUNCTION
+      // Adds the schemas of the component types in the scene. They are saved with the scene
+      // so that it still loads after a component changed, see Reflection/schema.h.
+      void Internal_CollectComponentSchemas(Reflection::SchemaSet& schemas) const;
+
+      // INTERNAL FUNCTION
+      // Converts the components of types that changed since the scene was saved to their current layout.
+      void Internal_MigrateComponents(const Reflection::SchemaSet& schemas);
+
 #ifdef _DEBUG
     public:
       void Dump() const;
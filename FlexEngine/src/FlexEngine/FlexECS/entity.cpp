@@ -45,11 +45,10 @@ namespace FlexEngine
 
     bool Entity::operator<(const Entity& other) const
     {
-      // compare their names (in std::string component)
-      // makes a copy because GetComponent is not const, gets the name component, and compares the strings
-      Entity lhs = *this;
-      Entity rhs = other;
-      return *(lhs.GetComponent<std::string>()) < *(rhs.GetComponent<std::string>());
+      // compare their names (the StringIndex component)
+      // This looks up both names on every call, use Scene::SortByName to sort many entities.
+      std::shared_ptr<Scene> scene = Scene::GetActiveScene();
+      return scene->GetEntityName(entity_id) < scene->GetEntityName(other.entity_id);
     }
 
     Entity::operator EntityID() const
@@ -164,6 +163,7 @@ namespace FlexEngine
 
       // Pop the entity from the entities vector
       from.entities.pop_back();
+      from.version++;
 
       #pragma endregion
 
@@ -0,0 +1,812 @@
+#include "replication.h"
+
+#include "Wrapper/checksum.h"
+
+#include <cmath>   // std::isfinite, std::round
+#include <cstring> // std::memcpy, std::memcmp
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    // Replicated components of every entity, one column per replicated type.
+    // Rows are sorted by entity id so that two snapshots can be compared in one pass.
+    struct ReplicationSnapshot
+    {
+      struct Column
+      {
+        std::vector<EntityID> entities;
+        std::vector<int64_t> values; // member count values per entity
+      };
+
+      uint32_t tick = 0;
+      std::vector<Column> columns; // in the order of Internal_GetReplicatedTypes()
+    };
+
+    #pragma region Internal Functions
+
+    // A bool, integer or floating point member of a replicated type
+    struct Internal_ReplicatedMember
+    {
+      Reflection::Program::OpCode op;
+      std::size_t offset;
+    };
+
+    struct Internal_ReplicatedType
+    {
+      Reflection::TypeDescriptor* (*get_type)() = nullptr;
+      double precision = 1.0;
+
+      // resolved on first use
+      Reflection::TypeDescriptor* type_desc = nullptr;
+      void (*construct)(void*) = nullptr; // default value of a struct, primitives start at 0
+      std::vector<Internal_ReplicatedMember> members{};
+    };
+
+    struct Internal_ReplicatedTypes
+    {
+      std::vector<Internal_ReplicatedType> types;          // sorted by name, the same order on every end
+      std::unordered_map<ComponentID, std::size_t> lookup;  // component to index in types
+      uint32_t layout_checksum = 0;                        // names and members, both ends must agree
+    };
+
+    // Registered with FLX_ECS_REGISTER_REPLICATED
+    static std::vector<Internal_ReplicatedType>& Internal_GetRegisteredTypes()
+    {
+      static std::vector<Internal_ReplicatedType> registered_types;
+      return registered_types;
+    }
+
+    // Primitive components have no program, they are a single member at offset 0
+    static bool Internal_GetPrimitiveOp(const Reflection::TypeDescriptor* type_desc, Reflection::Program::OpCode& op)
+    {
+      if (type_desc == Reflection::TypeResolver<bool>::Get()) op = Reflection::Program::Op_Bool;
+      else if (type_desc == Reflection::TypeResolver<int>::Get()) op = Reflection::Program::Op_Int;
+      else if (type_desc == Reflection::TypeResolver<unsigned>::Get()) op = Reflection::Program::Op_Uint;
+      else if (type_desc == Reflection::TypeResolver<int64_t>::Get()) op = Reflection::Program::Op_Int64;
+      else if (type_desc == Reflection::TypeResolver<uint64_t>::Get()) op = Reflection::Program::Op_Uint64;
+      else if (type_desc == Reflection::TypeResolver<float>::Get()) op = Reflection::Program::Op_Float;
+      else if (type_desc == Reflection::TypeResolver<double>::Get()) op = Reflection::Program::Op_Double;
+      else return false;
+      return true;
+    }
+
+    static const Internal_ReplicatedTypes& Internal_GetReplicatedTypes()
+    {
+      static const Internal_ReplicatedTypes replicated_types = []()
+      {
+        Internal_ReplicatedTypes result;
+        for (Internal_ReplicatedType type : Internal_GetRegisteredTypes())
+        {
+          type.type_desc = type.get_type();
+
+          // the compiled program lists every member of nested structs with its offset,
+          // strings and containers are calls into their descriptor and aren't replicated
+          Reflection::Program::OpCode op;
+          if (auto* struct_desc = dynamic_cast<Reflection::TypeDescriptor_Struct*>(type.type_desc))
+          {
+            type.construct = struct_desc->construct;
+            for (const Reflection::Program::Instruction& instruction : struct_desc->GetProgram().GetInstructions())
+            {
+              if (instruction.op >= Reflection::Program::Op_Bool && instruction.op <= Reflection::Program::Op_Double)
+              {
+                type.members.push_back({ instruction.op, instruction.offset });
+              }
+            }
+          }
+          else if (Internal_GetPrimitiveOp(type.type_desc, op))
+          {
+            type.members.push_back({ op, 0 });
+          }
+
+          result.types.push_back(type);
+        }
+
+        std::sort(result.types.begin(), result.types.end(), [](const Internal_ReplicatedType& a, const Internal_ReplicatedType& b)
+        {
+          return a.type_desc->name < b.type_desc->name;
+        });
+
+        for (std::size_t i = 0; i < result.types.size(); i++)
+        {
+          const Internal_ReplicatedType& type = result.types[i];
+          result.lookup[type.type_desc->name] = i;
+
+          result.layout_checksum = Checksum::CRC32C(type.type_desc->name, result.layout_checksum);
+          for (const Internal_ReplicatedMember& member : type.members)
+          {
+            uint64_t packed = (static_cast<uint64_t>(member.offset) << 8) | member.op;
+            result.layout_checksum = Checksum::CRC32C(&packed, sizeof(packed), result.layout_checksum);
+          }
+        }
+
+        return result;
+      }();
+      return replicated_types;
+    }
+
+    static int64_t Internal_Quantize(const char* data, const Internal_ReplicatedMember& member, double precision)
+    {
+      auto read = [&](auto value) { std::memcpy(&value, data + member.offset, sizeof(value)); return value; };
+
+      double real = 0.0;
+      switch (member.op)
+      {
+      case Reflection::Program::Op_Bool: return read(bool{}) ? 1 : 0;
+      case Reflection::Program::Op_Int: return read(int{});
+      case Reflection::Program::Op_Uint: return read(unsigned{});
+      case Reflection::Program::Op_Int64: return read(int64_t{});
+      case Reflection::Program::Op_Uint64: return static_cast<int64_t>(read(uint64_t{}));
+      case Reflection::Program::Op_Float: real = read(float{}); break;
+      case Reflection::Program::Op_Double: real = read(double{}); break;
+      default: return 0;
+      }
+
+      // guard: values that don't fit, nan and infinity become 0
+      real = std::round(real / precision);
+      if (!std::isfinite(real) || std::abs(real) > 4.0e18) return 0;
+      return static_cast<int64_t>(real);
+    }
+
+    static void Internal_Dequantize(char* data, const Internal_ReplicatedMember& member, double precision, int64_t value)
+    {
+      auto write = [&](auto typed) { std::memcpy(data + member.offset, &typed, sizeof(typed)); };
+
+      switch (member.op)
+      {
+      case Reflection::Program::Op_Bool: write(value != 0); break;
+      case Reflection::Program::Op_Int: write(static_cast<int>(value)); break;
+      case Reflection::Program::Op_Uint: write(static_cast<unsigned>(value)); break;
+      case Reflection::Program::Op_Int64: write(value); break;
+      case Reflection::Program::Op_Uint64: write(static_cast<uint64_t>(value)); break;
+      case Reflection::Program::Op_Float: write(static_cast<float>(static_cast<double>(value) * precision)); break;
+      case Reflection::Program::Op_Double: write(static_cast<double>(value) * precision); break;
+      default: break;
+      }
+    }
+
+    static std::shared_ptr<ReplicationSnapshot> Internal_TakeSnapshot(const Scene& scene, uint32_t tick)
+    {
+      const Internal_ReplicatedTypes& replicated = Internal_GetReplicatedTypes();
+
+      auto snapshot = std::make_shared<ReplicationSnapshot>();
+      snapshot->tick = tick;
+      snapshot->columns.resize(replicated.types.size());
+
+      // the rows of every replicated component, in archetype order
+      std::vector<std::vector<std::pair<EntityID, const ComponentData<void>*>>> rows(replicated.types.size());
+      for (const auto& [type, archetype] : scene.archetype_index)
+      {
+        for (std::size_t i = 0; i < type.size(); i++)
+        {
+          auto it = replicated.lookup.find(type[i]);
+          if (it == replicated.lookup.end()) continue;
+
+          for (std::size_t row = 0; row < archetype.entities.size(); row++)
+          {
+            rows[it->second].push_back({ archetype.entities[row], &archetype.archetype_table[i][row] });
+          }
+        }
+      }
+
+      for (std::size_t t = 0; t < replicated.types.size(); t++)
+      {
+        const Internal_ReplicatedType& type = replicated.types[t];
+        std::vector<std::pair<EntityID, const ComponentData<void>*>>& type_rows = rows[t];
+        std::sort(type_rows.begin(), type_rows.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        ReplicationSnapshot::Column& column = snapshot->columns[t];
+        column.entities.reserve(type_rows.size());
+        column.values.resize(type_rows.size() * type.members.size(), 0);
+
+        int64_t* out = column.values.data();
+        for (const auto& [entity, data] : type_rows)
+        {
+          column.entities.push_back(entity);
+
+          // guard: a component smaller than its type, the members stay 0
+          std::size_t size = *reinterpret_cast<const std::size_t*>(data->get());
+          const char* component = reinterpret_cast<const char*>(Internal_GetComponentDataPtr(*data));
+          if (size >= type.type_desc->size)
+          {
+            for (std::size_t m = 0; m < type.members.size(); m++) out[m] = Internal_Quantize(component, type.members[m], type.precision);
+          }
+          out += type.members.size();
+        }
+      }
+
+      return snapshot;
+    }
+
+    // Packs bits into bytes, least significant bit first
+    class Internal_BitWriter
+    {
+    public:
+      // count is at most 32
+      void Write(uint64_t value, int count)
+      {
+        m_buffer |= (value & ((uint64_t(1) << count) - 1)) << m_bit_count;
+        m_bit_count += count;
+        while (m_bit_count >= 8)
+        {
+          m_data.push_back(static_cast<char>(m_buffer & 0xFF));
+          m_buffer >>= 8;
+          m_bit_count -= 8;
+        }
+      }
+
+      // groups of 4 bits with a continuation bit
+      void WriteVarint(uint64_t value)
+      {
+        while (value >= 16)
+        {
+          Write((value & 15) | 16, 5);
+          value >>= 4;
+        }
+        Write(value, 5);
+      }
+
+      void WriteSigned(int64_t value)
+      {
+        // zigzag, small negative numbers stay small
+        WriteVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+      }
+
+      // Appends the bits to out, the last byte is padded with zeros
+      void Finish(std::string& out)
+      {
+        if (m_bit_count > 0) Write(0, 8 - m_bit_count);
+        out += m_data;
+      }
+
+    private:
+      std::string m_data;
+      uint64_t m_buffer = 0;
+      int m_bit_count = 0;
+    };
+
+    // Reading past the end sets ok to false and returns zeros
+    class Internal_BitReader
+    {
+    public:
+      Internal_BitReader(const char* data, std::size_t size) : m_data(reinterpret_cast<const uint8_t*>(data)), m_size(size) {}
+
+      uint64_t Read(int count)
+      {
+        uint64_t value = 0;
+        for (int i = 0; i < count; i++)
+        {
+          if (m_bit >= m_size * 8)
+          {
+            ok = false;
+            return 0;
+          }
+          value |= static_cast<uint64_t>((m_data[m_bit >> 3] >> (m_bit & 7)) & 1) << i;
+          m_bit++;
+        }
+        return value;
+      }
+
+      uint64_t ReadVarint()
+      {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64 && ok; shift += 4)
+        {
+          uint64_t group = Read(5);
+          value |= (group & 15) << shift;
+          if ((group & 16) == 0) return value;
+        }
+        ok = false;
+        return 0;
+      }
+
+      int64_t ReadSigned()
+      {
+        uint64_t value = ReadVarint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+      }
+
+      // A count can't be larger than the bits left, which guards the reserves against corrupted data
+      std::size_t ReadCount()
+      {
+        uint64_t count = ReadVarint();
+        if (count > m_size * 8 - m_bit)
+        {
+          ok = false;
+          return 0;
+        }
+        return static_cast<std::size_t>(count);
+      }
+
+      bool ok = true;
+
+    private:
+      const uint8_t* m_data;
+      std::size_t m_size;
+      std::size_t m_bit = 0;
+    };
+
+    static constexpr std::size_t PACKET_HEADER_SIZE = 3 * sizeof(uint32_t);
+
+    // Writes the changes from one column to the other, nothing if there are none
+    static void Internal_EncodeColumn(std::size_t type_index, std::size_t member_count, const ReplicationSnapshot::Column& from, const ReplicationSnapshot::Column& to, Internal_BitWriter& out)
+    {
+      std::vector<EntityID> removed;
+      std::vector<std::pair<std::size_t, std::size_t>> changed; // row in to, row in from or -1 if new
+      const std::size_t NEW_ROW = static_cast<std::size_t>(-1);
+
+      std::size_t i = 0, j = 0;
+      while (i < from.entities.size() || j < to.entities.size())
+      {
+        if (j == to.entities.size() || (i < from.entities.size() && from.entities[i] < to.entities[j]))
+        {
+          removed.push_back(from.entities[i++]);
+        }
+        else if (i == from.entities.size() || to.entities[j] < from.entities[i])
+        {
+          changed.push_back({ j++, NEW_ROW });
+        }
+        else
+        {
+          if (member_count > 0 && std::memcmp(&from.values[i * member_count], &to.values[j * member_count], member_count * sizeof(int64_t)) != 0)
+          {
+            changed.push_back({ j, i });
+          }
+          i++;
+          j++;
+        }
+      }
+
+      if (removed.empty() && changed.empty()) return;
+
+      out.WriteVarint(type_index + 1);
+
+      out.WriteVarint(removed.size());
+      EntityID previous = 0;
+      for (EntityID entity : removed)
+      {
+        out.WriteVarint(entity - previous);
+        previous = entity;
+      }
+
+      out.WriteVarint(changed.size());
+      previous = 0;
+      for (const auto& [to_row, from_row] : changed)
+      {
+        EntityID entity = to.entities[to_row];
+        out.WriteVarint(entity - previous);
+        previous = entity;
+
+        const int64_t* values = &to.values[to_row * member_count];
+        out.Write((from_row == NEW_ROW) ? 1 : 0, 1);
+        if (from_row == NEW_ROW)
+        {
+          for (std::size_t m = 0; m < member_count; m++) out.WriteSigned(values[m]);
+          continue;
+        }
+
+        const int64_t* old_values = &from.values[from_row * member_count];
+        for (std::size_t m = 0; m < member_count; m++) out.Write((values[m] != old_values[m]) ? 1 : 0, 1);
+        for (std::size_t m = 0; m < member_count; m++)
+        {
+          if (values[m] != old_values[m]) out.WriteSigned(static_cast<int64_t>(static_cast<uint64_t>(values[m]) - static_cast<uint64_t>(old_values[m])));
+        }
+      }
+    }
+
+    // Reads the changes of a column and merges them into a copy of the baseline column.
+    // The entities that were removed or changed are added to touched.
+    static bool Internal_DecodeColumn(std::size_t member_count, const ReplicationSnapshot::Column& from, Internal_BitReader& in, ReplicationSnapshot::Column& to, std::vector<EntityID>& touched)
+    {
+      std::size_t removed_count = in.ReadCount();
+      std::vector<EntityID> removed;
+      removed.reserve(removed_count);
+      EntityID previous = 0;
+      for (std::size_t i = 0; i < removed_count && in.ok; i++)
+      {
+        previous += in.ReadVarint();
+        removed.push_back(previous);
+      }
+
+      std::size_t changed_count = in.ReadCount();
+      std::vector<EntityID> changed;
+      std::vector<int64_t> changed_values;
+      changed.reserve(changed_count);
+      changed_values.reserve(changed_count * member_count);
+      previous = 0;
+      for (std::size_t i = 0; i < changed_count && in.ok; i++)
+      {
+        previous += in.ReadVarint();
+        changed.push_back(previous);
+
+        bool is_new = in.Read(1) != 0;
+        if (is_new)
+        {
+          for (std::size_t m = 0; m < member_count; m++) changed_values.push_back(in.ReadSigned());
+          continue;
+        }
+
+        // guard: a delta against a row the baseline doesn't have
+        auto it = std::lower_bound(from.entities.begin(), from.entities.end(), previous);
+        if (it == from.entities.end() || *it != previous) return false;
+        const int64_t* old_values = &from.values[static_cast<std::size_t>(it - from.entities.begin()) * member_count];
+
+        std::vector<bool> mask(member_count);
+        for (std::size_t m = 0; m < member_count; m++) mask[m] = in.Read(1) != 0;
+        for (std::size_t m = 0; m < member_count; m++)
+        {
+          int64_t delta = mask[m] ? in.ReadSigned() : 0;
+          changed_values.push_back(static_cast<int64_t>(static_cast<uint64_t>(old_values[m]) + static_cast<uint64_t>(delta)));
+        }
+      }
+      if (!in.ok) return false;
+
+      touched.insert(touched.end(), removed.begin(), removed.end());
+      touched.insert(touched.end(), changed.begin(), changed.end());
+
+      // merge the baseline with the changes, all three are sorted by entity
+      to.entities.reserve(from.entities.size() + changed.size());
+      to.values.reserve((from.entities.size() + changed.size()) * member_count);
+      auto emit_changed = [&](std::size_t c)
+      {
+        to.entities.push_back(changed[c]);
+        to.values.insert(to.values.end(), changed_values.begin() + c * member_count, changed_values.begin() + (c + 1) * member_count);
+      };
+
+      std::size_t r = 0, c = 0;
+      for (std::size_t i = 0; i < from.entities.size(); i++)
+      {
+        EntityID entity = from.entities[i];
+        while (c < changed.size() && changed[c] < entity) emit_changed(c++);
+        if (r < removed.size() && removed[r] == entity)
+        {
+          r++;
+          continue;
+        }
+        if (c < changed.size() && changed[c] == entity)
+        {
+          emit_changed(c++);
+          continue;
+        }
+        to.entities.push_back(entity);
+        to.values.insert(to.values.end(), from.values.begin() + i * member_count, from.values.begin() + (i + 1) * member_count);
+      }
+      while (c < changed.size()) emit_changed(c++);
+
+      return true;
+    }
+
+    // Returns the row of the entity in the column, or -1
+    static std::size_t Internal_FindRow(const ReplicationSnapshot::Column& column, EntityID entity)
+    {
+      auto it = std::lower_bound(column.entities.begin(), column.entities.end(), entity);
+      if (it == column.entities.end() || *it != entity) return static_cast<std::size_t>(-1);
+      return static_cast<std::size_t>(it - column.entities.begin());
+    }
+
+    #pragma endregion
+
+    bool Internal_RegisterReplicated(Reflection::TypeDescriptor* (*get_type)(), double precision)
+    {
+      Internal_GetRegisteredTypes().push_back({ get_type, (precision > 0.0) ? precision : 1.0 });
+      return true;
+    }
+
+    #pragma region LoopbackTransport
+
+    std::pair<std::shared_ptr<LoopbackTransport>, std::shared_ptr<LoopbackTransport>> LoopbackTransport::CreatePair()
+    {
+      auto a_to_b = std::make_shared<Queue>();
+      auto b_to_a = std::make_shared<Queue>();
+
+      auto a = std::make_shared<LoopbackTransport>();
+      auto b = std::make_shared<LoopbackTransport>();
+      a->m_outgoing = a_to_b;
+      a->m_incoming = b_to_a;
+      b->m_outgoing = b_to_a;
+      b->m_incoming = a_to_b;
+      return { a, b };
+    }
+
+    void LoopbackTransport::Send(const std::string& packet)
+    {
+      m_bytes_sent += packet.size();
+      if (m_drop_every != 0 && ++m_packets_sent % m_drop_every == 0) return;
+
+      std::lock_guard<std::mutex> lock(m_outgoing->mutex);
+      m_outgoing->packets.push_back(packet);
+    }
+
+    bool LoopbackTransport::Receive(std::string& packet)
+    {
+      std::lock_guard<std::mutex> lock(m_incoming->mutex);
+      if (m_incoming->packets.empty()) return false;
+      packet = std::move(m_incoming->packets.front());
+      m_incoming->packets.pop_front();
+      return true;
+    }
+
+    #pragma endregion
+
+    #pragma region ReplicationServer
+
+    ReplicationServer::ReplicationServer(std::size_t history_size)
+      : m_history_size((history_size > 0) ? history_size : 1)
+    {
+    }
+
+    ReplicationServer::ClientID ReplicationServer::AddClient(std::shared_ptr<ReplicationTransport> transport)
+    {
+      ClientID client = m_next_client++;
+      m_clients[client].transport = transport;
+      return client;
+    }
+
+    void ReplicationServer::RemoveClient(ClientID client)
+    {
+      m_clients.erase(client);
+    }
+
+    std::size_t ReplicationServer::GetLastPacketSize(ClientID client) const
+    {
+      auto it = m_clients.find(client);
+      return (it != m_clients.end()) ? it->second.last_packet_size : 0;
+    }
+
+    void ReplicationServer::Tick(const Scene& scene)
+    {
+      FLX_FLOW_FUNCTION();
+
+      // acknowledgements, a client never goes back to an older baseline
+      for (auto& [id, client] : m_clients)
+      {
+        std::string packet;
+        while (client.transport->Receive(packet))
+        {
+          if (packet.size() != sizeof(uint32_t)) continue;
+          uint32_t tick;
+          std::memcpy(&tick, packet.data(), sizeof(tick));
+          if (tick <= m_tick && tick > client.acknowledged_tick) client.acknowledged_tick = tick;
+        }
+      }
+
+      m_tick++;
+      std::shared_ptr<const ReplicationSnapshot> snapshot = Internal_TakeSnapshot(scene, m_tick);
+      m_history.push_back(snapshot);
+      if (m_history.size() > m_history_size) m_history.pop_front();
+
+      const Internal_ReplicatedTypes& replicated = Internal_GetReplicatedTypes();
+      ReplicationSnapshot empty;
+      empty.columns.resize(replicated.types.size());
+
+      // one packet per baseline
+      std::unordered_map<uint32_t, std::string> packets;
+
+      for (auto& [id, client] : m_clients)
+      {
+        // a baseline that is no longer in the history sends the full state
+        const ReplicationSnapshot* baseline = &empty;
+        for (const std::shared_ptr<const ReplicationSnapshot>& old : m_history)
+        {
+          if (old->tick == client.acknowledged_tick && old != snapshot) baseline = old.get();
+        }
+
+        std::string& packet = packets[baseline->tick];
+        if (packet.empty())
+        {
+          FlxBinWriter::Append<uint32_t>(packet, m_tick);
+          FlxBinWriter::Append<uint32_t>(packet, baseline->tick);
+          FlxBinWriter::Append<uint32_t>(packet, replicated.layout_checksum);
+
+          Internal_BitWriter out;
+          for (std::size_t t = 0; t < replicated.types.size(); t++)
+          {
+            Internal_EncodeColumn(t, replicated.types[t].members.size(), baseline->columns[t], snapshot->columns[t], out);
+          }
+          out.WriteVarint(0);
+          out.Finish(packet);
+        }
+
+        client.transport->Send(packet);
+        client.last_packet_size = packet.size();
+      }
+    }
+
+    #pragma endregion
+
+    #pragma region ReplicationClient
+
+    ReplicationClient::ReplicationClient(std::shared_ptr<ReplicationTransport> transport, std::shared_ptr<Scene> scene, std::size_t history_size)
+      : m_transport(transport), m_scene(scene), m_history_size((history_size > 0) ? history_size : 1)
+    {
+    }
+
+    std::size_t ReplicationClient::Update()
+    {
+      FLX_FLOW_FUNCTION();
+
+      std::size_t applied = 0;
+      std::string packet;
+      while (m_transport->Receive(packet))
+      {
+        if (!Internal_ApplyPacket(packet)) continue;
+        applied++;
+
+        std::string ack;
+        FlxBinWriter::Append<uint32_t>(ack, m_tick);
+        m_transport->Send(ack);
+      }
+      return applied;
+    }
+
+    bool ReplicationClient::Internal_ApplyPacket(const std::string& packet)
+    {
+      const Internal_ReplicatedTypes& replicated = Internal_GetReplicatedTypes();
+
+      FlxBinCursor cursor(packet.data(), packet.size());
+      uint32_t tick = cursor.Read<uint32_t>();
+      uint32_t baseline_tick = cursor.Read<uint32_t>();
+      uint32_t layout_checksum = cursor.Read<uint32_t>();
+      if (!cursor.ok) return false;
+
+      // guard: an old packet
+      if (tick <= m_tick) return false;
+
+      // guard: the server replicates different types
+      if (layout_checksum != replicated.layout_checksum)
+      {
+        Log::Warning("Replication packet skipped, the server registered different replicated components.");
+        return false;
+      }
+
+      ReplicationSnapshot empty;
+      empty.columns.resize(replicated.types.size());
+      const ReplicationSnapshot* baseline = (baseline_tick == 0) ? &empty : nullptr;
+      for (const std::shared_ptr<const ReplicationSnapshot>& old : m_history)
+      {
+        if (old->tick == baseline_tick) baseline = old.get();
+      }
+
+      // guard: the baseline was dropped, the server sends the full state once it stops being acknowledged
+      if (baseline == nullptr) return false;
+
+      auto snapshot = std::make_shared<ReplicationSnapshot>();
+      snapshot->tick = tick;
+      snapshot->columns.resize(replicated.types.size());
+
+      // columns without changes are the same as in the baseline
+      std::vector<bool> is_decoded(replicated.types.size(), false);
+      std::vector<EntityID> touched;
+
+      Internal_BitReader in(packet.data() + PACKET_HEADER_SIZE, packet.size() - PACKET_HEADER_SIZE);
+      while (in.ok)
+      {
+        // 0 ends the list, every type is in it at most once
+        uint64_t index = in.ReadVarint();
+        if (index == 0) break;
+        std::size_t t = static_cast<std::size_t>(index - 1);
+        if (index > replicated.types.size() || is_decoded[t]) in.ok = false;
+        if (!in.ok) break;
+
+        if (!Internal_DecodeColumn(replicated.types[t].members.size(), baseline->columns[t], in, snapshot->columns[t], touched)) in.ok = false;
+        is_decoded[t] = true;
+      }
+      if (!in.ok)
+      {
+        Log::Warning("Replication packet for tick " + std::to_string(tick) + " is corrupted.");
+        return false;
+      }
+      for (std::size_t t = 0; t < replicated.types.size(); t++)
+      {
+        if (!is_decoded[t]) snapshot->columns[t] = baseline->columns[t];
+      }
+
+      // a full state replaces the state the scene is at, every entity it had is touched so that
+      // the entities and components missing from the new state are removed
+      if (baseline_tick == 0 && !m_history.empty())
+      {
+        for (const ReplicationSnapshot::Column& column : m_history.back()->columns)
+        {
+          touched.insert(touched.end(), column.entities.begin(), column.entities.end());
+        }
+      }
+
+      // apply the touched entities to the scene
+      std::sort(touched.begin(), touched.end());
+      touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+      Scene& scene = *m_scene;
+      std::vector<EntityID> removed;
+      struct AddedRow
+      {
+        EntityID entity;
+        ComponentIDList type;
+        std::vector<ComponentData<void>> components;
+      };
+      std::vector<AddedRow> added;
+
+      for (EntityID entity : touched)
+      {
+        // the replicated types are sorted by name, the same order as an archetype type
+        ComponentIDList type;
+        std::vector<std::pair<std::size_t, std::size_t>> rows; // type index, row
+        for (std::size_t t = 0; t < replicated.types.size(); t++)
+        {
+          std::size_t row = Internal_FindRow(snapshot->columns[t], entity);
+          if (row == static_cast<std::size_t>(-1)) continue;
+          type.push_back(replicated.types[t].type_desc->name);
+          rows.push_back({ t, row });
+        }
+
+        auto record_it = scene.entity_index.find(entity);
+        Archetype* archetype = (record_it != scene.entity_index.end()) ? record_it->second.archetype : nullptr;
+        std::size_t archetype_row = (archetype != nullptr) ? record_it->second.row : 0;
+
+        // new component data, starting from the current data so that members that aren't replicated are kept
+        std::vector<ComponentData<void>> components;
+        components.reserve(rows.size());
+        for (std::size_t k = 0; k < rows.size(); k++)
+        {
+          const Internal_ReplicatedType& replicated_type = replicated.types[rows[k].first];
+          std::vector<char> buffer(replicated_type.type_desc->size, '\0');
+
+          bool has_current = false;
+          if (archetype != nullptr)
+          {
+            auto column_it = std::lower_bound(archetype->type.begin(), archetype->type.end(), type[k]);
+            if (column_it != archetype->type.end() && *column_it == type[k])
+            {
+              const ComponentData<void>& current = archetype->archetype_table[static_cast<std::size_t>(column_it - archetype->type.begin())][archetype_row];
+              std::size_t size = *reinterpret_cast<const std::size_t*>(current.get());
+              buffer.resize((std::max)(buffer.size(), size));
+              std::memcpy(buffer.data(), Internal_GetComponentDataPtr(current), size);
+              has_current = true;
+            }
+          }
+          if (!has_current && replicated_type.construct != nullptr) replicated_type.construct(buffer.data());
+
+          const int64_t* values = &snapshot->columns[rows[k].first].values[rows[k].second * replicated_type.members.size()];
+          for (std::size_t m = 0; m < replicated_type.members.size(); m++)
+          {
+            Internal_Dequantize(buffer.data(), replicated_type.members[m], replicated_type.precision, values[m]);
+          }
+          components.push_back(Internal_CreateComponentData(buffer.size(), buffer.data()));
+        }
+
+        // same components, replace the data in place
+        if (archetype != nullptr && archetype->type == type)
+        {
+          for (std::size_t k = 0; k < components.size(); k++) archetype->archetype_table[k][archetype_row] = components[k];
+          archetype->version++;
+          continue;
+        }
+
+        // gone, or moved to another archetype
+        if (archetype != nullptr) removed.push_back(entity);
+        if (!type.empty()) added.push_back({ entity, std::move(type), std::move(components) });
+      }
+
+      if (!removed.empty()) scene.Internal_ExtractEntities(removed);
+
+      for (AddedRow& row : added)
+      {
+        Archetype& archetype = scene.Internal_FindOrCreateArchetype(row.type);
+        for (std::size_t k = 0; k < row.components.size(); k++) archetype.archetype_table[k].push_back(std::move(row.components[k]));
+        archetype.entities.push_back(row.entity);
+        scene.entity_index[row.entity] = { &archetype, archetype.id, archetype.entities.size() - 1 };
+        archetype.version++;
+      }
+
+      // the server never sends a delta against a snapshot older than the baseline of this one
+      m_tick = tick;
+      m_history.push_back(snapshot);
+      while (!m_history.empty() && (m_history.front()->tick < baseline_tick || m_history.size() > m_history_size)) m_history.pop_front();
+
+      return true;
+    }
+
+    #pragma endregion
+
+  }
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "datastructures.h" // <algorithm> <typeindex> <memory>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Scene replication
+//
+// An authoritative server scene is mirrored into client scenes over a transport.
+// Every tick the server snapshots the components that are registered with
+// FLX_ECS_REGISTER_REPLICATED and sends each client the changes since the last snapshot
+// that client acknowledged. A client that missed packets still gets everything it needs,
+// the next delta is against an older snapshot. A client that fell further behind than
+// the history gets the full state, which replaces everything the client had.
+//
+// Members are found through reflection, every bool, integer and floating point member of
+// the component is replicated, strings and containers aren't. Floats are quantized to
+// multiples of the precision the type was registered with.
+// Packets are bit-packed: per changed component type, the removed entities and the
+// entities whose quantized values changed, with a bit mask of the changed members and
+// their zigzag encoded deltas. Entity ids are written as the gap to the previous one.
+// Numbers are written in groups of 4 bits with a continuation bit, so a small delta is 5 bits.
+// An entity that didn't change costs nothing, the bandwidth scales with the changes.
+//
+// Server packet:
+// uint32 tick, uint32 baseline tick (0 = full state), uint32 layout checksum
+// per changed type, ended by a 0:
+//   varint type index + 1
+//   varint removed count, varint id gap * count
+//   varint changed count, per entity: varint id gap, bit is new,
+//     new: varint value * member count
+//     else: bit * member count, varint delta per set bit
+//
+// Client packet: uint32 acknowledged tick
+//
+// The client scene only holds the replicated entities, with the server's entity ids.
+// Members that aren't replicated keep their default value.
+//
+// Usage:
+// auto [server_end, client_end] = FlexECS::LoopbackTransport::CreatePair();
+// FlexECS::ReplicationServer server;
+// server.AddClient(server_end);
+// FlexECS::ReplicationClient client(client_end, std::make_shared<FlexECS::Scene>());
+// server.Tick(*simulation); // every fixed update
+// client.Update();          // every frame on the viewer
+
+// Replicates the component type. Float and double members are quantized to multiples of PRECISION.
+// Place in the .cpp file after FLX_REFL_REGISTER_END for the type.
+#define FLX_ECS_REGISTER_REPLICATED(TYPE, PRECISION) \
+  static const bool _flx_ecs_replicated_##TYPE = \
+    FlexEngine::FlexECS::Internal_RegisterReplicated(&FlexEngine::Reflection::TypeResolver<TYPE>::Get, PRECISION);
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    // Registers a replicated component type. Use FLX_ECS_REGISTER_REPLICATED instead.
+    // Takes the resolver instead of the type, see FLX_REFL_REGISTER_START.
+    __FLX_API bool Internal_RegisterReplicated(Reflection::TypeDescriptor* (*get_type)(), double precision);
+
+    // Quantized replicated components of a scene at one tick, see replication.cpp
+    struct ReplicationSnapshot;
+
+    #pragma region Transport
+
+    // Delivers packets between a server and one client.
+    // Packets may be dropped, but must arrive whole and in order.
+    class __FLX_API ReplicationTransport
+    {
+    public:
+      virtual ~ReplicationTransport() = default;
+
+      virtual void Send(const std::string& packet) = 0;
+
+      // Returns false if there is no packet waiting
+      virtual bool Receive(std::string& packet) = 0;
+    };
+
+    // In process transport, for a server and viewers in the same process and for tests.
+    class __FLX_API LoopbackTransport : public ReplicationTransport
+    {
+    public:
+      // Two connected ends, what one sends the other receives
+      static std::pair<std::shared_ptr<LoopbackTransport>, std::shared_ptr<LoopbackTransport>> CreatePair();
+
+      void Send(const std::string& packet) override;
+      bool Receive(std::string& packet) override;
+
+      // Drops every nth packet sent from this end to simulate a lossy network, 0 drops nothing
+      void SetDropEvery(std::size_t n) { m_drop_every = n; }
+
+      // Bytes sent from this end, including dropped packets
+      std::size_t GetBytesSent() const { return m_bytes_sent; }
+
+    private:
+      struct Queue
+      {
+        std::mutex mutex;
+        std::deque<std::string> packets;
+      };
+
+      std::shared_ptr<Queue> m_incoming;
+      std::shared_ptr<Queue> m_outgoing;
+      std::size_t m_drop_every = 0;
+      std::size_t m_packets_sent = 0;
+      std::size_t m_bytes_sent = 0;
+    };
+
+    #pragma endregion
+
+    #pragma region ReplicationServer
+
+    class __FLX_API ReplicationServer
+    {
+    public:
+      using ClientID = std::size_t;
+
+      // Snapshots kept as baselines, a client that didn't acknowledge any of them gets the full state
+      static constexpr std::size_t DEFAULT_HISTORY_SIZE = 32;
+
+      explicit ReplicationServer(std::size_t history_size = DEFAULT_HISTORY_SIZE);
+
+      ClientID AddClient(std::shared_ptr<ReplicationTransport> transport);
+      void RemoveClient(ClientID client);
+
+      // Reads the acknowledgements, snapshots the replicated components of the scene
+      // and sends every client the changes since the last snapshot it acknowledged.
+      // Clients that acknowledged the same snapshot share one encoded packet.
+      void Tick(const Scene& scene);
+
+      uint32_t GetTick() const { return m_tick; }
+
+      // Size of the last packet sent to the client in bytes, 0 if the client doesn't exist
+      std::size_t GetLastPacketSize(ClientID client) const;
+
+    private:
+      struct Client
+      {
+        std::shared_ptr<ReplicationTransport> transport;
+        uint32_t acknowledged_tick = 0;
+        std::size_t last_packet_size = 0;
+      };
+
+      std::size_t m_history_size;
+      uint32_t m_tick = 0;
+      std::deque<std::shared_ptr<const ReplicationSnapshot>> m_history;
+      std::unordered_map<ClientID, Client> m_clients;
+      ClientID m_next_client = 0;
+    };
+
+    #pragma endregion
+
+    #pragma region ReplicationClient
+
+    class __FLX_API ReplicationClient
+    {
+    public:
+      // The scene is kept in sync with the server, don't create entities in it.
+      // Use the history size of the server, a smaller one drops baselines the server still sends deltas against.
+      ReplicationClient(std::shared_ptr<ReplicationTransport> transport, std::shared_ptr<Scene> scene, std::size_t history_size = ReplicationServer::DEFAULT_HISTORY_SIZE);
+
+      // Applies every packet that arrived and acknowledges them.
+      // Returns the number of packets applied.
+      std::size_t Update();
+
+      // The server tick the scene is at, 0 before the first packet
+      uint32_t GetTick() const { return m_tick; }
+
+      std::shared_ptr<Scene> GetScene() const { return m_scene; }
+
+    private:
+      bool Internal_ApplyPacket(const std::string& packet);
+
+      std::shared_ptr<ReplicationTransport> m_transport;
+      std::shared_ptr<Scene> m_scene;
+      uint32_t m_tick = 0;
+      std::size_t m_history_size;
+
+      // Received snapshots the server may still send deltas against
+      std::deque<std::shared_ptr<const ReplicationSnapshot>> m_history;
+    };
+
+    #pragma endregion
+
+  }
+}
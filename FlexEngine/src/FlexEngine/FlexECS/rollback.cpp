@@ -0,0 +1,406 @@
+#include "rollback.h"
+
+#include "Wrapper/checksum.h"
+
+#include <cmath>   // std::fmod
+#include <cstring> // std::memcpy
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    #pragma region Internal Functions
+
+    struct Internal_SimulationType
+    {
+      Reflection::TypeDescriptor* (*get_type)() = nullptr;
+
+      // Bytes of the reflected members, merged where they touch.
+      // The padding between them isn't hashed.
+      std::vector<std::pair<std::size_t, std::size_t>> hash_ranges{}; // offset, size
+    };
+
+    // Registered with FLX_ECS_REGISTER_SIMULATION_STATE
+    static std::vector<Reflection::TypeDescriptor* (*)()>& Internal_GetRegisteredTypes()
+    {
+      static std::vector<Reflection::TypeDescriptor* (*)()> registered_types;
+      return registered_types;
+    }
+
+    // Resolved on first use, the types are initialized by then
+    static const std::unordered_map<ComponentID, Internal_SimulationType>& Internal_GetSimulationTypes()
+    {
+      static const std::unordered_map<ComponentID, Internal_SimulationType> simulation_types = []()
+      {
+        std::unordered_map<ComponentID, Internal_SimulationType> result;
+        for (auto get_type : Internal_GetRegisteredTypes())
+        {
+          Reflection::TypeDescriptor* type_desc = get_type();
+
+          // guard: copying the bytes of a string or a container would share its memory
+          if (!type_desc->IsTriviallyCopyable())
+          {
+            Log::Warning("Simulation state component " + type_desc->name + " isn't trivially copyable and won't be rolled back.");
+            continue;
+          }
+
+          Internal_SimulationType type{ get_type };
+          if (auto* struct_desc = dynamic_cast<Reflection::TypeDescriptor_Struct*>(type_desc))
+          {
+            for (const Reflection::Program::Instruction& instruction : struct_desc->GetProgram().GetInstructions())
+            {
+              if (instruction.op == Reflection::Program::Op_BeginStruct || instruction.op == Reflection::Program::Op_EndStruct) continue;
+
+              std::size_t size = instruction.type->size;
+              if (!type.hash_ranges.empty() && type.hash_ranges.back().first + type.hash_ranges.back().second == instruction.offset)
+              {
+                type.hash_ranges.back().second += size;
+              }
+              else
+              {
+                type.hash_ranges.push_back({ instruction.offset, size });
+              }
+            }
+          }
+          if (type.hash_ranges.empty()) type.hash_ranges.push_back({ 0, type_desc->size });
+
+          result[type_desc->name] = type;
+        }
+        return result;
+      }();
+      return simulation_types;
+    }
+
+    #pragma endregion
+
+    bool Internal_RegisterSimulationState(Reflection::TypeDescriptor* (*get_type)())
+    {
+      Internal_GetRegisteredTypes().push_back(get_type);
+      return true;
+    }
+
+    uint32_t HashSimulationState(const Scene& scene)
+    {
+      RollbackBuffer buffer(1);
+      return buffer.Save(scene, 0);
+    }
+
+    #pragma region RollbackBuffer
+
+    RollbackBuffer::RollbackBuffer(std::size_t capacity)
+      : m_slots((capacity > 0) ? capacity : 1)
+    {
+    }
+
+    uint32_t RollbackBuffer::Save(const Scene& scene, uint64_t frame)
+    {
+      const auto& simulation_types = Internal_GetSimulationTypes();
+
+      // a frame that was saved before is simulated again, the frames after it are stale
+      while (m_count > 0 && m_slots[(m_begin + m_count - 1) % m_slots.size()].frame >= frame) m_count--;
+
+      std::size_t slot = (m_begin + m_count) % m_slots.size();
+      if (m_count == m_slots.size()) m_begin = (m_begin + 1) % m_slots.size();
+      else m_count++;
+
+      Snapshot& snapshot = m_slots[slot];
+      snapshot.frame = frame;
+
+      // archetypes with simulation state, sorted so that the hash doesn't depend on the map order
+      m_archetypes.clear();
+      for (const auto& [type, archetype] : scene.archetype_index)
+      {
+        if (archetype.entities.empty()) continue;
+        for (const ComponentID& component : type)
+        {
+          if (simulation_types.count(component) != 0)
+          {
+            m_archetypes.push_back(&archetype);
+            break;
+          }
+        }
+      }
+      std::sort(m_archetypes.begin(), m_archetypes.end(), [](const Archetype* a, const Archetype* b) { return a->type < b->type; });
+
+      // the slot's vectors keep their capacity, so the steady state doesn't allocate
+      snapshot.blocks.resize(m_archetypes.size());
+      std::size_t data_size = 0;
+      for (std::size_t b = 0; b < m_archetypes.size(); b++)
+      {
+        const Archetype& archetype = *m_archetypes[b];
+        Block& block = snapshot.blocks[b];
+        block.type = archetype.type;
+        block.entities = archetype.entities;
+        block.columns.clear();
+        block.sizes.clear();
+        block.offsets.clear();
+
+        for (std::size_t i = 0; i < archetype.type.size(); i++)
+        {
+          if (simulation_types.count(archetype.type[i]) == 0) continue;
+          std::size_t size = *reinterpret_cast<const std::size_t*>(archetype.archetype_table[i][0].get());
+          block.columns.push_back(i);
+          block.sizes.push_back(size);
+          block.offsets.push_back(data_size);
+          data_size += size * archetype.entities.size();
+        }
+      }
+      snapshot.data.resize(data_size);
+
+      uint32_t hash = 0;
+      for (std::size_t b = 0; b < m_archetypes.size(); b++)
+      {
+        const Archetype& archetype = *m_archetypes[b];
+        const Block& block = snapshot.blocks[b];
+        hash = Checksum::CRC32C(block.entities.data(), block.entities.size() * sizeof(EntityID), hash);
+
+        for (std::size_t c = 0; c < block.columns.size(); c++)
+        {
+          const Column& column = archetype.archetype_table[block.columns[c]];
+          const Internal_SimulationType& type = simulation_types.at(archetype.type[block.columns[c]]);
+          std::size_t size = block.sizes[c];
+          char* out = snapshot.data.data() + block.offsets[c];
+
+          hash = Checksum::CRC32C(archetype.type[block.columns[c]], hash);
+          for (std::size_t row = 0; row < column.size(); row++, out += size)
+          {
+            // guard: a component of a different size than the first one in the column
+            std::size_t row_size = (std::min)(size, *reinterpret_cast<const std::size_t*>(column[row].get()));
+            std::memcpy(out, Internal_GetComponentDataPtr(column[row]), row_size);
+
+            for (const auto& [offset, range_size] : type.hash_ranges)
+            {
+              if (offset + range_size <= row_size) hash = Checksum::CRC32C(out + offset, range_size, hash);
+            }
+          }
+        }
+      }
+
+      snapshot.hash = hash;
+      return hash;
+    }
+
+    bool RollbackBuffer::Rewind(Scene& scene, uint64_t frame)
+    {
+      FLX_FLOW_FUNCTION();
+
+      const Snapshot* snapshot = Internal_Find(frame);
+      if (snapshot == nullptr) return false;
+
+      const auto& simulation_types = Internal_GetSimulationTypes();
+
+      auto restore_row = [&](const Block& block, std::size_t from_row, Archetype& archetype, std::size_t to_row)
+      {
+        for (std::size_t c = 0; c < block.columns.size(); c++)
+        {
+          ComponentData<void>& data = archetype.archetype_table[block.columns[c]][to_row];
+          std::size_t size = (std::min)(block.sizes[c], *reinterpret_cast<const std::size_t*>(data.get()));
+          std::memcpy(Internal_GetComponentDataPtr(data), snapshot->data.data() + block.offsets[c] + from_row * block.sizes[c], size);
+        }
+      };
+
+      auto has_simulation_state = [&](const ComponentIDList& type)
+      {
+        for (const ComponentID& component : type)
+        {
+          if (simulation_types.count(component) != 0) return true;
+        }
+        return false;
+      };
+
+      std::size_t restored = 0;
+      std::size_t mismatched = 0;
+      std::size_t moved = 0; // mismatched entities that still have simulation state
+      for (const Block& block : snapshot->blocks)
+      {
+        // same rows as when the frame was saved, the common case
+        auto archetype_it = scene.archetype_index.find(block.type);
+        if (archetype_it != scene.archetype_index.end() && archetype_it->second.entities == block.entities)
+        {
+          for (std::size_t row = 0; row < block.entities.size(); row++) restore_row(block, row, archetype_it->second, row);
+          restored += block.entities.size();
+          continue;
+        }
+
+        // rows were moved, look the entities up
+        for (std::size_t row = 0; row < block.entities.size(); row++)
+        {
+          auto it = scene.entity_index.find(block.entities[row]);
+          if (it == scene.entity_index.end() || it->second.archetype->type != block.type)
+          {
+            mismatched++;
+            if (it != scene.entity_index.end() && has_simulation_state(it->second.archetype->type)) moved++;
+            continue;
+          }
+          restore_row(block, row, *it->second.archetype, it->second.row);
+          restored++;
+        }
+      }
+
+      // entities with simulation state that didn't exist at the frame
+      std::size_t current = 0;
+      for (const auto& [type, archetype] : scene.archetype_index)
+      {
+        if (has_simulation_state(type)) current += archetype.entities.size();
+      }
+      mismatched += current - restored - moved;
+
+      // the restored frame is the newest
+      std::size_t slot = static_cast<std::size_t>(snapshot - m_slots.data());
+      m_count = (slot + m_slots.size() - m_begin) % m_slots.size() + 1;
+
+      if (mismatched > 0)
+      {
+        Log::Warning("Rewind to frame " + std::to_string(frame) + " skipped " + std::to_string(mismatched) + " entities that were created, destroyed or changed components since.");
+        return false;
+      }
+      return true;
+    }
+
+    const RollbackBuffer::Snapshot* RollbackBuffer::Internal_Find(uint64_t frame) const
+    {
+      // frames are in increasing order, but may skip numbers
+      for (std::size_t i = m_count; i > 0; i--)
+      {
+        const Snapshot& snapshot = m_slots[(m_begin + i - 1) % m_slots.size()];
+        if (snapshot.frame == frame) return &snapshot;
+        if (snapshot.frame < frame) break;
+      }
+      return nullptr;
+    }
+
+    bool RollbackBuffer::HasFrame(uint64_t frame) const
+    {
+      return Internal_Find(frame) != nullptr;
+    }
+
+    bool RollbackBuffer::GetHash(uint64_t frame, uint32_t& hash) const
+    {
+      const Snapshot* snapshot = Internal_Find(frame);
+      if (snapshot == nullptr) return false;
+      hash = snapshot->hash;
+      return true;
+    }
+
+    uint64_t RollbackBuffer::GetOldestFrame() const
+    {
+      return m_slots[m_begin].frame;
+    }
+
+    uint64_t RollbackBuffer::GetNewestFrame() const
+    {
+      return m_slots[(m_begin + m_count + m_slots.size() - 1) % m_slots.size()].frame;
+    }
+
+    std::size_t RollbackBuffer::GetMemoryUsage() const
+    {
+      std::size_t size = m_slots.capacity() * sizeof(Snapshot);
+      for (const Snapshot& snapshot : m_slots)
+      {
+        size += snapshot.data.capacity() + snapshot.blocks.capacity() * sizeof(Block);
+        for (const Block& block : snapshot.blocks)
+        {
+          size += block.entities.capacity() * sizeof(EntityID);
+          size += (block.columns.capacity() + block.sizes.capacity() + block.offsets.capacity()) * sizeof(std::size_t);
+        }
+      }
+      return size;
+    }
+
+    #pragma endregion
+
+    #pragma region FixedStepSimulation
+
+    FixedStepSimulation::FixedStepSimulation(std::shared_ptr<Scene> scene, double step, std::size_t history)
+      : m_scene(scene), m_history(history), m_step((step > 0.0) ? step : 1.0 / 60.0)
+    {
+      m_hash = m_history.Save(*m_scene, m_frame);
+    }
+
+    std::size_t FixedStepSimulation::Update(double delta_time)
+    {
+      m_accumulator += delta_time;
+
+      std::size_t steps = 0;
+      while (m_accumulator >= m_step && (m_max_steps == 0 || steps < m_max_steps))
+      {
+        Step();
+        m_accumulator -= m_step;
+        steps++;
+      }
+
+      // guard: the simulation can't keep up, drop the time it is behind
+      if (m_max_steps != 0 && steps == m_max_steps && m_accumulator >= m_step) m_accumulator = std::fmod(m_accumulator, m_step);
+
+      return steps;
+    }
+
+    void FixedStepSimulation::Step()
+    {
+      FLX_FLOW_FUNCTION();
+
+      m_frame++;
+      if (m_step_function) m_step_function(*m_scene, m_frame, m_step);
+      m_hash = m_history.Save(*m_scene, m_frame);
+    }
+
+    bool FixedStepSimulation::Rewind(uint64_t frame)
+    {
+      if (!m_history.HasFrame(frame)) return false;
+
+      bool result = m_history.Rewind(*m_scene, frame);
+      m_frame = frame;
+      m_history.GetHash(frame, m_hash);
+      return result;
+    }
+
+    bool FixedStepSimulation::Resimulate(uint64_t frame)
+    {
+      uint64_t current = m_frame;
+      if (frame > current || !m_history.HasFrame(frame)) return false;
+
+      bool result = Rewind(frame);
+      while (m_frame < current) Step();
+      return result;
+    }
+
+    bool FixedStepSimulation::CheckHash(uint64_t frame, uint32_t hash) const
+    {
+      uint32_t local_hash;
+      if (!m_history.GetHash(frame, local_hash)) return true;
+
+      if (local_hash != hash)
+      {
+        Log::Warning("Simulation desync at frame " + std::to_string(frame) + ", the state hash doesn't match.");
+        return false;
+      }
+      return true;
+    }
+
+    uint64_t FixedStepSimulation::VerifyDeterminism(uint64_t frame)
+    {
+      if (frame > m_frame || !m_history.HasFrame(frame)) return 0;
+
+      // hashes of the first run, overwritten by the re-simulation
+      std::vector<uint32_t> hashes;
+      for (uint64_t f = frame + 1; f <= m_frame; f++)
+      {
+        uint32_t hash = 0;
+        m_history.GetHash(f, hash);
+        hashes.push_back(hash);
+      }
+
+      Resimulate(frame);
+
+      for (std::size_t i = 0; i < hashes.size(); i++)
+      {
+        if (!CheckHash(frame + 1 + i, hashes[i])) return frame + 1 + i;
+      }
+      return 0;
+    }
+
+    #pragma endregion
+
+  }
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "datastructures.h" // <algorithm> <typeindex> <memory>
+
+#include <cstdint>
+#include <functional> // std::function
+#include <vector>
+
+// Fixed-step simulation with rollback
+//
+// Components registered with FLX_ECS_REGISTER_SIMULATION_STATE are the simulation state.
+// After every fixed step the columns of those components are copied into a ring buffer
+// of the last N frames, the rest of the scene (names, rendering, editor data) is not.
+// A snapshot is one buffer with the rows of every flagged column back to back,
+// the slots of the ring are reused, so after warm-up saving a frame doesn't allocate and
+// the memory is bounded by the snapshot size times N.
+//
+// Rewind() copies the saved rows back into the components in place, which makes it cheap
+// to roll back a few frames and re-simulate them, e.g. when late input arrives.
+// Only component values are rolled back. An entity that was created, destroyed or had
+// components added or removed since the frame keeps its current structure and Rewind()
+// reports it, so simulations that roll back should reuse pooled entities instead.
+//
+// Every snapshot is hashed with CRC32C over the reflected members of the flagged components,
+// in the order of the archetype types and rows, so padding bytes never cause false desyncs.
+// Two peers running the same inputs must get the same hash for the same frame,
+// CheckHash() compares a hash from a peer or a replay and VerifyDeterminism() re-simulates
+// saved frames and compares them to the first run.
+//
+// Flagged components must be trivially copyable, they are copied as bytes.
+//
+// Usage:
+// FLX_ECS_REGISTER_SIMULATION_STATE(RigidBody) // in the .cpp, after FLX_REFL_REGISTER_END
+//
+// FlexECS::FixedStepSimulation simulation(scene, 1.0 / 60.0);
+// simulation.SetStepFunction([](FlexECS::Scene& scene, uint64_t frame, double step)
+// {
+//   ApplyInput(GetInput(frame));
+//   StepPhysics(step);
+// });
+// simulation.Update(delta_time); // every frame
+// simulation.Resimulate(late_input_frame - 1); // after correcting the input of a past frame
+
+// Flags the component type as simulation state.
+// Place in the .cpp file after FLX_REFL_REGISTER_END for the type.
+#define FLX_ECS_REGISTER_SIMULATION_STATE(TYPE) \
+  static const bool _flx_ecs_simulation_state_##TYPE = \
+    FlexEngine::FlexECS::Internal_RegisterSimulationState(&FlexEngine::Reflection::TypeResolver<TYPE>::Get);
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    // Registers a simulation state component type. Use FLX_ECS_REGISTER_SIMULATION_STATE instead.
+    // Takes the resolver instead of the type, see FLX_REFL_REGISTER_START.
+    __FLX_API bool Internal_RegisterSimulationState(Reflection::TypeDescriptor* (*get_type)());
+
+    // Hashes the simulation state of the scene, the same hash RollbackBuffer stores for a frame
+    __FLX_API uint32_t HashSimulationState(const Scene& scene);
+
+    #pragma region RollbackBuffer
+
+    // Ring buffer of the simulation state of the last frames
+    class __FLX_API RollbackBuffer
+    {
+    public:
+      static constexpr std::size_t DEFAULT_CAPACITY = 64;
+
+      explicit RollbackBuffer(std::size_t capacity = DEFAULT_CAPACITY);
+
+      // Saves the simulation state as the frame, overwriting the oldest frame when the buffer is full.
+      // Frames must be saved in increasing order, saved frames after this one are dropped.
+      // Returns the hash of the state.
+      uint32_t Save(const Scene& scene, uint64_t frame);
+
+      // Copies the simulation state of the frame back into the scene and drops the frames after it.
+      // Returns false if the frame isn't in the buffer or an entity's structure changed since the
+      // frame, the components of the other entities are still restored.
+      bool Rewind(Scene& scene, uint64_t frame);
+
+      bool HasFrame(uint64_t frame) const;
+
+      // Returns false if the frame isn't in the buffer
+      bool GetHash(uint64_t frame, uint32_t& hash) const;
+
+      // Frame range in the buffer, only valid when not empty
+      uint64_t GetOldestFrame() const;
+      uint64_t GetNewestFrame() const;
+
+      std::size_t GetFrameCount() const { return m_count; }
+      std::size_t GetCapacity() const { return m_slots.size(); }
+
+      // Bytes reserved by the snapshots
+      std::size_t GetMemoryUsage() const;
+
+      void Clear() { m_count = 0; }
+
+    private:
+      // Rows of one archetype, each flagged column is stored back to back in the snapshot data
+      struct Block
+      {
+        ComponentIDList type;
+        std::vector<EntityID> entities;
+        std::vector<std::size_t> columns;   // column index in the archetype
+        std::vector<std::size_t> sizes;     // component size of each column
+        std::vector<std::size_t> offsets;   // start of each column in the snapshot data
+      };
+
+      struct Snapshot
+      {
+        uint64_t frame = 0;
+        uint32_t hash = 0;
+        std::vector<Block> blocks; // sorted by type
+        std::vector<char> data;
+      };
+
+      // Slot of the frame, or nullptr
+      const Snapshot* Internal_Find(uint64_t frame) const;
+
+      std::vector<Snapshot> m_slots;
+      std::size_t m_begin = 0; // slot of the oldest frame
+      std::size_t m_count = 0;
+
+      std::vector<const Archetype*> m_archetypes; // reused by Save()
+    };
+
+    #pragma endregion
+
+    #pragma region FixedStepSimulation
+
+    class __FLX_API FixedStepSimulation
+    {
+    public:
+      // Runs one step of the simulation, frame is the number of the frame being simulated
+      using StepFunction = std::function<void(Scene& scene, uint64_t frame, double step)>;
+
+      // Steps run by one Update() at most, a slow frame drops time instead of falling further behind
+      static constexpr std::size_t DEFAULT_MAX_STEPS_PER_UPDATE = 8;
+
+      // Saves the current state of the scene as frame 0
+      FixedStepSimulation(std::shared_ptr<Scene> scene, double step = 1.0 / 60.0, std::size_t history = RollbackBuffer::DEFAULT_CAPACITY);
+
+      void SetStepFunction(StepFunction step_function) { m_step_function = step_function; }
+      void SetMaxStepsPerUpdate(std::size_t max_steps) { m_max_steps = max_steps; }
+
+      // Adds the time and runs every whole step that fits.
+      // Returns the number of steps run.
+      std::size_t Update(double delta_time);
+
+      // Runs one step and saves the new frame
+      void Step();
+
+      // Restores the state of the frame, the next Step() simulates the frame after it.
+      // See RollbackBuffer::Rewind()
+      bool Rewind(uint64_t frame);
+
+      // Rewinds to the frame and steps forward to the current frame again, e.g. after the input
+      // of the frame after it was corrected. Returns false if the frame can't be rewound to.
+      bool Resimulate(uint64_t frame);
+
+      // Compares the hash of a frame from a peer or a replay with the local one.
+      // Logs a desync and returns false if they differ, returns true if the frame isn't saved anymore.
+      bool CheckHash(uint64_t frame, uint32_t hash) const;
+
+      // Re-simulates the frames after the frame and compares them with the hashes of the first run.
+      // Inputs must be the same, so this catches systems that aren't deterministic.
+      // Returns the first frame that differs, or 0 if every frame matched or the frame isn't saved.
+      uint64_t VerifyDeterminism(uint64_t frame);
+
+      uint64_t GetFrame() const { return m_frame; }
+      double GetStep() const { return m_step; }
+
+      // Fraction of a step left in the accumulator, for interpolating between the last two frames
+      double GetAlpha() const { return m_accumulator / m_step; }
+
+      // Hash of the current frame
+      uint32_t GetHash() const { return m_hash; }
+
+      RollbackBuffer& GetHistory() { return m_history; }
+      std::shared_ptr<Scene> GetScene() const { return m_scene; }
+
+    private:
+      std::shared_ptr<Scene> m_scene;
+      StepFunction m_step_function;
+      RollbackBuffer m_history;
+
+      double m_step;
+      double m_accumulator = 0.0;
+      std::size_t m_max_steps = DEFAULT_MAX_STEPS_PER_UPDATE;
+
+      uint64_t m_frame = 0;
+      uint32_t m_hash = 0;
+    };
+
+    #pragma endregion
+
+  }
+}
@@ -1,5 +1,14 @@
 #include "datastructures.h"
 
+#include "DataStructures/parallelfor.h" // ParallelFor
+#include "Wrapper/checksum.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional> // std::function
+#include <mutex>
+#include <thread>
+
 namespace FlexEngine
 {
   namespace FlexECS
@@ -7,6 +16,7 @@ namespace FlexEngine
 
     // static member initialization
     std::shared_ptr<Scene> Scene::s_active_scene = nullptr;
+    std::size_t Scene::s_active_scene_version = 0;
     Scene Scene::Null = Scene();
 
 
@@ -51,6 +61,138 @@ namespace FlexEngine
     #pragma endregion
 
 
+    #pragma region Entity Names
+
+    Scene::StringIndex* Scene::Internal_GetNameComponent(EntityID entity)
+    {
+      auto entity_it = entity_index.find(entity);
+      if (entity_it == entity_index.end()) return nullptr;
+
+      auto component_it = component_index.find(Reflection::TypeResolver<StringIndex>::Get()->name);
+      if (component_it == component_index.end()) return nullptr;
+
+      Archetype& archetype = *entity_it->second.archetype;
+      auto archetype_it = component_it->second.find(archetype.id);
+      if (archetype_it == component_it->second.end()) return nullptr;
+
+      const ComponentData<void>& data = archetype.archetype_table[archetype_it->second.column][entity_it->second.row];
+      return reinterpret_cast<StringIndex*>(Internal_GetComponentDataPtr(data));
+    }
+
+    void Scene::Internal_RebuildNameIndex()
+    {
+      name_index.clear();
+      name_index.reserve(entity_index.size());
+
+      auto component_it = component_index.find(Reflection::TypeResolver<StringIndex>::Get()->name);
+      if (component_it != component_index.end())
+      {
+        // walk the name columns directly instead of looking up every entity
+        for (auto& [type, archetype] : archetype_index)
+        {
+          auto archetype_it = component_it->second.find(archetype.id);
+          if (archetype_it == component_it->second.end()) continue;
+
+          const Column& column = archetype.archetype_table[archetype_it->second.column];
+          for (std::size_t row = 0; row < archetype.entities.size(); row++)
+          {
+            StringIndex name = *reinterpret_cast<StringIndex*>(Internal_GetComponentDataPtr(column[row]));
+            name_index.emplace(string_storage[name], archetype.entities[row]);
+          }
+        }
+      }
+
+      is_name_index_dirty = false;
+    }
+
+    void Scene::Internal_RemoveFromNameIndex(EntityID entity, const std::string& name)
+    {
+      auto [begin, end] = name_index.equal_range(name);
+      for (auto it = begin; it != end; ++it)
+      {
+        if (it->second == entity)
+        {
+          name_index.erase(it);
+          return;
+        }
+      }
+    }
+
+    const std::string& Scene::GetEntityName(EntityID entity)
+    {
+      static const std::string empty_name = "";
+
+      StringIndex* name = Internal_GetNameComponent(entity);
+      if (name == nullptr) return empty_name;
+
+      return string_storage[*name];
+    }
+
+    void Scene::SetEntityName(EntityID entity, const std::string& name)
+    {
+      StringIndex* name_component = Internal_GetNameComponent(entity);
+      if (name_component == nullptr)
+      {
+        Log::Warning("Attempted to rename an entity that does not exist.");
+        return;
+      }
+
+      if (!is_name_index_dirty)
+      {
+        Internal_RemoveFromNameIndex(entity, string_storage[*name_component]);
+        name_index.emplace(name, entity);
+      }
+
+      string_storage[*name_component] = name;
+    }
+
+    Entity Scene::FindByName(const std::string& name)
+    {
+      if (is_name_index_dirty) Internal_RebuildNameIndex();
+
+      auto [begin, end] = name_index.equal_range(name);
+      for (auto it = begin; it != end; ++it)
+      {
+        // skip entries of entities that were destroyed or renamed behind the index's back
+        StringIndex* current_name = Internal_GetNameComponent(it->second);
+        if (current_name != nullptr && string_storage[*current_name] == name) return Entity(it->second);
+      }
+
+      return Entity::Null;
+    }
+
+    std::vector<Entity> Scene::FindAllByName(const std::string& name)
+    {
+      if (is_name_index_dirty) Internal_RebuildNameIndex();
+
+      std::vector<Entity> entities;
+
+      auto [begin, end] = name_index.equal_range(name);
+      for (auto it = begin; it != end; ++it)
+      {
+        StringIndex* current_name = Internal_GetNameComponent(it->second);
+        if (current_name != nullptr && string_storage[*current_name] == name) entities.push_back(Entity(it->second));
+      }
+
+      return entities;
+    }
+
+    void Scene::SortByName(std::vector<Entity>& entities)
+    {
+      // decorate, sort, undecorate
+      // Sorting with Entity::operator< would look up both names on every comparison.
+      std::vector<std::pair<const std::string*, Entity>> keys;
+      keys.reserve(entities.size());
+      for (Entity entity : entities) keys.emplace_back(&GetEntityName(entity), entity);
+
+      std::stable_sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) { return *a.first < *b.first; });
+
+      for (std::size_t i = 0; i < entities.size(); i++) entities[i] = keys[i].second;
+    }
+
+    #pragma endregion
+
+
     #pragma region Scene Management Functions
 
     std::shared_ptr<Scene> Scene::CreateScene()
@@ -61,6 +203,7 @@ namespace FlexEngine
       if (s_active_scene == nullptr)
       {
         s_active_scene = std::make_shared<Scene>(Scene::Null);
+        s_active_scene_version++;
         return s_active_scene;
       }
       else
@@ -97,6 +240,12 @@ namespace FlexEngine
       }
 
       s_active_scene = scene;
+      s_active_scene_version++;
+    }
+
+    std::size_t Scene::GetActiveSceneVersion()
+    {
+      return s_active_scene_version;
     }
 
     #pragma endregion
@@ -146,6 +295,11 @@ namespace FlexEngine
       //archetype.archetype_table[archetype_record.column].push_back(data_ptr);
       archetype.archetype_table[0].push_back(data_ptr); // there is only one component in this archetype
 
+      // update the name index
+      // if it is dirty, the entity will be picked up when it is rebuilt
+      std::shared_ptr<Scene> scene = Scene::GetActiveScene();
+      if (!scene->is_name_index_dirty) scene->name_index.emplace(name, entity_id);
+
       return entity_id;
     }
 
@@ -160,6 +314,10 @@ namespace FlexEngine
         return;
       }
 
+      // remove the entity from the name index
+      std::shared_ptr<Scene> scene = Scene::GetActiveScene();
+      if (!scene->is_name_index_dirty) scene->Internal_RemoveFromNameIndex(entity, scene->GetEntityName(entity));
+
       // Get the important data
       // The entity's archetype and row are needed to remove the entity from the archetype
       EntityRecord& entity_record = ENTITY_INDEX[entity];
@@ -203,6 +361,7 @@ namespace FlexEngine
 
       // Pop the entity from the entities vector
       archetype.entities.pop_back();
+      archetype.version++;
 
       // Remove the entity from the entity index
       ENTITY_INDEX.erase(entity);
@@ -235,62 +394,733 @@ namespace FlexEngine
     #pragma region Scene Serialization Functions
 
     // save the scene to a File
-    // the flx formatter is wrapped here
+    // the same serialization as SaveAsync(), on the calling thread
     void Scene::Save(File& file)
     {
-      Reflection::TypeDescriptor* type_desc = Reflection::TypeResolver<FlexECS::Scene>::Get();
+      FLX_FLOW_FUNCTION();
 
-      std::stringstream ss;
-      type_desc->Serialize(this, ss);
+      std::filesystem::path path = file.path;
+      Internal_ReleaseMappedFile(path);
 
-      // check if we need to create a new flx file or overwrite the existing one
-      FlxFmtFile flxfmtfile = FlexFormatter::Parse(file, FlxFmtFileType::Scene);
-      if (flxfmtfile == FlxFmtFile::Null)
+      std::string data = Internal_SerializeFile(path);
+      std::string error = Internal_WriteFileAtomic(path, data);
+      if (!error.empty())
       {
-        // make a new flx file
-        flxfmtfile = FlexFormatter::Create(ss.str(), true);
-      }
-      else
-      {
-        // update the data
-        flxfmtfile.data = ss.str();
+        Log::Error(error);
+        return;
       }
 
-      file.Write(flxfmtfile.Save());
+      // the same as File::Write(), data is never compressed
+      file.is_compressed = FlxCompression::IsCompressed(data);
+      if (file.is_compressed) FlxCompression::Decompress(data, data);
+      file.data = std::move(data);
     }
 
     // static function
     std::shared_ptr<Scene> Scene::Load(File& file)
     {
-      Reflection::TypeDescriptor* type_desc = Reflection::TypeResolver<FlexECS::Scene>::Get();
+      std::shared_ptr<Scene> loaded_scene = Internal_Load(file, FlxFmtFileType::Scene);
+      if (loaded_scene == nullptr) return std::make_shared<Scene>(Scene::Null);
+      return loaded_scene;
+    }
+
+    // static function
+    std::shared_ptr<Scene> Scene::Reload(const Scene& previous, File& file)
+    {
+      FLX_FLOW_FUNCTION();
+
+      std::shared_ptr<Scene> reloaded_scene = Internal_Load(file, FlxFmtFileType::Scene, &previous);
+      if (reloaded_scene == nullptr) return std::make_shared<Scene>(Scene::Null);
+      return reloaded_scene;
+    }
+
+    // static function
+    std::shared_ptr<Scene> Scene::Internal_Load(File& file, FlxFmtFileType file_type, const Scene* previous)
+    {
+      // the extension checks are the same for both formats
+      file.Read();
+      if (!FlexFormatter::ValidateFile(file, file_type)) return nullptr;
+
+      // file.data is overwritten by the in situ parse, Read() it again to get the contents
+      return Internal_LoadFromData(file.data, file_type, previous);
+    }
+
+    // static function
+    std::shared_ptr<Scene> Scene::Internal_LoadFromData(std::string& file_data, FlxFmtFileType file_type, const Scene* previous)
+    {
+      // binary scenes are detected by their magic bytes
+      if (FlxBinReader::IsBinary(file_data))
+      {
+        return Internal_DeserializeBinary(file_data.data(), file_data.size(), nullptr, previous, file_type);
+      }
 
       // get scene data
-      FlxFmtFile flxfmtfile = FlexFormatter::Parse(file, FlxFmtFileType::Scene);
-      if (flxfmtfile == FlxFmtFile::Null) return std::make_shared<Scene>(Scene::Null);
+      // the data is a view into file_data and is parsed in place, the file is only tokenized once
+      FlxFmtFileView flxfmtfile = FlexFormatter::ParseView(file_data, file_type);
+      if (flxfmtfile.IsNull()) return nullptr;
+
+      // guard: the data didn't change since previous was loaded from it, and neither did previous
+      if (
+        previous != nullptr && flxfmtfile.has_checksum &&
+        previous->load_checksums != nullptr && !previous->load_checksums->is_binary &&
+        previous->load_checksums->data == flxfmtfile.checksum &&
+        previous->Internal_IsUnchangedSinceLoad()
+      )
+      {
+        std::shared_ptr<Scene> copy = previous->Internal_Snapshot();
+        copy->load_checksums = previous->load_checksums;
+        return copy;
+      }
+
+      char* data = file_data.data() + (flxfmtfile.data.data() - file_data.data());
+      std::shared_ptr<Scene> loaded_scene = Internal_DeserializeInSitu(data, flxfmtfile.data.size());
+      if (loaded_scene == nullptr) Log::Error("Failed to parse scene data.");
 
-      // deserialize
-      Document document;
-      document.Parse(flxfmtfile.data.c_str());
-      if (document.HasParseError())
+      if (loaded_scene != nullptr && flxfmtfile.has_checksum)
       {
-        Log::Error("Failed to parse scene data.");
-        return std::make_shared<Scene>(Scene::Null);
+        auto checksums = std::make_shared<Internal_LoadChecksums>();
+        checksums->data = flxfmtfile.checksum;
+        loaded_scene->Internal_SetLoadChecksums(checksums);
+      }
+
+      return loaded_scene;
+    }
+
+    // static function
+    FlxFmtFileType Scene::Internal_GetFileType(const std::filesystem::path& path)
+    {
+      return (path.extension() == ".flxprefab") ? FlxFmtFileType::Prefab : FlxFmtFileType::Scene;
+    }
+
+    // static function
+    std::size_t Scene::Internal_GetSerializationThreadCount(std::size_t row_count)
+    {
+      return (row_count < PARALLEL_SERIALIZATION_MIN_ROWS) ? 1 : 0;
+    }
+
+    // Writes the same json as the Scene type descriptor, but encodes the archetypes
+    // on several threads and splices them into the archetype_index array.
+    static void Internal_WriteSceneData(const Scene& scene, const Reflection::TypeDescriptor_Struct* type_desc, Reflection::JsonWriter& writer)
+    {
+      writer.StartArray();
+      for (const Reflection::TypeDescriptor_Struct::Member& member : type_desc->members)
+      {
+        const void* ptr = reinterpret_cast<const char*>(&scene) + member.offset;
+        if (ptr != &scene.archetype_index)
+        {
+          member.type->WriteData(ptr, writer);
+          continue;
+        }
+
+        // in the iteration order of the map, the same as the serial writer
+        std::vector<const std::pair<const ComponentIDList, Archetype>*> archetypes;
+        archetypes.reserve(scene.archetype_index.size());
+        for (const auto& pair : scene.archetype_index) archetypes.push_back(&pair);
+
+        Reflection::TypeDescriptor* key_type = Reflection::TypeResolver<ComponentIDList>::Get();
+        Reflection::TypeDescriptor* value_type = Reflection::TypeResolver<Archetype>::Get();
+        std::vector<std::string> encoded(archetypes.size());
+        ParallelFor(archetypes.size(), [&](std::size_t i)
+        {
+          Reflection::JsonWriter archetype_writer;
+          archetype_writer.StartArray();
+          key_type->WriteData(&archetypes[i]->first, archetype_writer);
+          value_type->WriteData(&archetypes[i]->second, archetype_writer);
+          archetype_writer.EndArray();
+          encoded[i] = archetype_writer.ToString();
+        }, Scene::Internal_GetSerializationThreadCount(scene.entity_index.size()));
+
+        writer.StartArray();
+        for (const std::string& archetype : encoded) writer.RawValue(archetype);
+        writer.EndArray();
       }
+      writer.EndArray();
+    }
+
+    std::string Scene::Internal_Serialize()
+    {
+      Reflection::TypeDescriptor* type_desc = Reflection::TypeResolver<FlexECS::Scene>::Get();
+
+      Reflection::SchemaSet schemas;
+      schemas.Collect(type_desc);
+      Internal_CollectComponentSchemas(schemas);
+
+      // the wrapper with the schemas before the data, readers that don't know them skip them
+      Reflection::JsonWriter writer;
+      writer.StartObject();
+      writer.Key("type");
+      writer.String(type_desc->ToString());
+      writer.Key("schemas");
+      schemas.WriteJson(writer);
+      writer.Key("data");
+      Internal_WriteSceneData(*this, static_cast<Reflection::TypeDescriptor_Struct*>(type_desc), writer);
+      writer.EndObject();
+      return writer.ToString();
+    }
 
+    // static function
+    std::shared_ptr<Scene> Scene::Internal_Deserialize(std::string_view data)
+    {
+      Reflection::JsonReader reader(data);
+      return Internal_DeserializeFromReader(reader);
+    }
+
+    // static function
+    std::shared_ptr<Scene> Scene::Internal_DeserializeInSitu(char* data, std::size_t size)
+    {
+      Reflection::JsonReader reader(data, size);
+      return Internal_DeserializeFromReader(reader);
+    }
+
+    // static function
+    std::shared_ptr<Scene> Scene::Internal_DeserializeFromReader(Reflection::JsonReader& reader)
+    {
+      Reflection::TypeDescriptor* type_desc = Reflection::TypeResolver<FlexECS::Scene>::Get();
+
+      // deserialize straight from the json tokens, no DOM is built
       std::shared_ptr<Scene> deserialized_scene = std::make_shared<Scene>();
-      type_desc->Deserialize(deserialized_scene.get(), document);
+      Reflection::SchemaSet schemas;
+      if (reader.Next())
+      {
+        if (reader.GetType() == Reflection::JsonReader::Token_StartObject)
+        {
+          // scenes saved before schemas were added only have the type and the data
+          while (reader.Next() && reader.GetType() == Reflection::JsonReader::Token_Key)
+          {
+            std::string_view key = reader.GetString();
+            if (!reader.Next()) break;
+
+            if (key == "schemas")
+            {
+              if (!schemas.ReadJson(reader)) reader.Fail();
+              else if (schemas.Resolve()) reader.SetSchemas(&schemas);
+            }
+            else if (key == "data") type_desc->DeserializeStream(deserialized_scene.get(), reader);
+            else reader.Skip();
+          }
+        }
+        else
+        {
+          type_desc->DeserializeStream(deserialized_scene.get(), reader);
+        }
+      }
+      reader.SetSchemas(nullptr);
+
+      // logged by the caller, world streaming deserializes on its worker thread
+      if (reader.HasError() || reader.GetType() == Reflection::JsonReader::Token_None) return nullptr;
 
       // relink entity archetype pointers
       deserialized_scene->Internal_RelinkEntityArchetypePointers();
 
+      if (schemas.HasChanges()) deserialized_scene->Internal_MigrateComponents(schemas);
+
       return deserialized_scene;
     }
 
+    void Scene::Internal_CollectComponentSchemas(Reflection::SchemaSet& schemas) const
+    {
+      for (const auto& [component, archetype_map] : component_index)
+      {
+        Reflection::TypeDescriptor* type_desc = Reflection::TypeDescriptor::FindByName(component);
+        if (type_desc != nullptr) schemas.Collect(type_desc);
+      }
+    }
+
+    void Scene::Internal_MigrateComponents(const Reflection::SchemaSet& schemas)
+    {
+      for (auto& [type, archetype] : archetype_index)
+      {
+        bool has_migrated = false;
+
+        for (std::size_t i = 0; i < type.size(); i++)
+        {
+          Reflection::TypeDescriptor* type_desc = Reflection::TypeDescriptor::FindByName(type[i]);
+          if (type_desc == nullptr || !schemas.NeedsMigration(type_desc)) continue;
+
+          // components are plain bytes, every row can be converted in the same buffer
+          // the column is only replaced if every row converts, so it never mixes old and new layouts
+          Column& column = archetype.archetype_table[i];
+          Column migrated;
+          migrated.reserve(column.size());
+          std::vector<char> buffer(type_desc->size);
+          for (const ComponentData<void>& data : column)
+          {
+            std::size_t size = *reinterpret_cast<const std::size_t*>(data.get());
+            if (!schemas.Migrate(type_desc, Internal_GetComponentDataPtr(data), size, buffer.data())) break;
+            migrated.push_back(Internal_CreateComponentData(buffer.size(), buffer.data()));
+          }
+
+          if (migrated.size() != column.size())
+          {
+            Log::Warning("Component " + type[i] + " doesn't match the schema it was saved with and wasn't converted.");
+            continue;
+          }
+
+          column.swap(migrated);
+          has_migrated = true;
+        }
+
+        // the replaced components invalidate cached component pointers
+        if (has_migrated) archetype.version++;
+      }
+    }
+
     void Scene::SaveActiveScene(File& file)
     {
       Scene::GetActiveScene()->Save(file);
     }
 
+    #pragma region Async Save
+
+    // One thread runs every async save in the order they were requested,
+    // so two saves of the same file can't overtake each other.
+    class Internal_SaveQueue
+    {
+    public:
+      // Statics are destroyed in reverse order of construction, the type descriptors the save
+      // thread uses are constructed before the queue finishes constructing so that they outlive it.
+      // Initializing every struct resolves the containers and primitives of their members too.
+      Internal_SaveQueue()
+      {
+        Reflection::TypeDescriptor::InitializeAll();
+        Reflection::TypeResolver<FlexECS::Scene>::Get();
+      }
+
+      // The running save is finished, saves that haven't started are dropped and their
+      // futures report a broken promise. Scene::WaitForAsyncSaves() finishes all of them.
+      ~Internal_SaveQueue()
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_stop = true;
+          m_tasks.clear();
+        }
+        m_condition.notify_one();
+        if (m_thread.joinable()) m_thread.join();
+      }
+
+      void Push(std::function<void()> task)
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_tasks.push_back(std::move(task));
+          if (!m_thread.joinable()) m_thread = std::thread(&Internal_SaveQueue::Run, this);
+        }
+        m_condition.notify_one();
+      }
+
+      void WaitUntilIdle()
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle_condition.wait(lock, [this]() { return m_tasks.empty() && !m_is_busy; });
+      }
+
+    private:
+      void Run()
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+          m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+          if (m_stop) return;
+
+          std::function<void()> task = std::move(m_tasks.front());
+          m_tasks.pop_front();
+          m_is_busy = true;
+
+          lock.unlock();
+          task();
+          lock.lock();
+
+          m_is_busy = false;
+          if (m_tasks.empty()) m_idle_condition.notify_all();
+        }
+      }
+
+      std::mutex m_mutex;
+      std::condition_variable m_condition;
+      std::condition_variable m_idle_condition;
+      std::deque<std::function<void()>> m_tasks;
+      std::thread m_thread;
+      bool m_is_busy = false;
+      bool m_stop = false;
+    };
+
+    static Internal_SaveQueue& Internal_GetSaveQueue()
+    {
+      static Internal_SaveQueue save_queue;
+      return save_queue;
+    }
+
+    // Runs on the save thread
+    static SceneSaveResult Internal_SaveSnapshot(Scene& snapshot, const std::filesystem::path& path)
+    {
+      SceneSaveResult result;
+      result.error = Scene::Internal_WriteFileAtomic(path, snapshot.Internal_SerializeFile(path));
+      result.success = result.error.empty();
+      return result;
+    }
+
+    std::string Scene::Internal_SerializeFile(const std::filesystem::path& path)
+    {
+      // keep the format, the metadata and the compression of an existing file
+      // SaveBinary() keeps the metadata of a binary file the same way, but always writes binary
+      std::string existing_data;
+      std::ifstream stream(path, std::ios::binary);
+      if (stream) existing_data.assign((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+      bool is_compressed = FlxCompression::IsCompressed(existing_data);
+      if (is_compressed) FlxCompression::Decompress(existing_data, existing_data);
+
+      std::string data;
+      if (FlxBinReader::IsBinary(existing_data))
+      {
+        FlxFmtFileType file_type = Internal_GetFileType(path);
+        Date created = Date::Now();
+        uint32_t previous_save_version = 0;
+        FlxBinReader reader;
+        if (reader.Parse(existing_data.data(), existing_data.size(), file_type, true))
+        {
+          created = reader.GetCreated();
+          previous_save_version = reader.GetHeader().save_version;
+        }
+        data = Internal_SerializeBinary(created, previous_save_version, file_type);
+      }
+      else
+      {
+        FlxFmtFile flxfmtfile = FlexFormatter::Create(Internal_Serialize(), true);
+        if (!existing_data.empty())
+        {
+          FlxFmtFileView existing = FlexFormatter::ParseView(existing_data, FlxFmtFileType::Scene, true);
+          if (!existing.IsNull()) flxfmtfile.metadata = existing.metadata;
+        }
+        data = flxfmtfile.Save();
+      }
+
+      return is_compressed ? FlxCompression::Compress(data) : data;
+    }
+
+    // static function
+    std::string Scene::Internal_WriteFileAtomic(const std::filesystem::path& path, const std::string& data)
+    {
+      // write to a temporary file first so that a crash doesn't leave a half written file
+      std::filesystem::path temp_path = path;
+      temp_path += ".tmp";
+      {
+        std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+        stream << data;
+        if (!stream) return "Failed to write " + temp_path.string();
+      }
+
+      std::error_code ec;
+      std::filesystem::rename(temp_path, path, ec);
+      if (ec) return "Failed to replace " + path.string() + ": " + ec.message();
+
+      return "";
+    }
+
+    std::future<SceneSaveResult> Scene::SaveAsync(File& file)
+    {
+      FLX_FLOW_FUNCTION();
+
+      // the only work on the calling thread
+      std::filesystem::path path = file.path;
+      Internal_ReleaseMappedFile(path);
+      std::shared_ptr<Scene> snapshot = Internal_Snapshot();
+
+      // std::function has to be copyable, the task isn't
+      auto task = std::make_shared<std::packaged_task<SceneSaveResult()>>(
+        [snapshot, path]() { return Internal_SaveSnapshot(*snapshot, path); }
+      );
+      std::future<SceneSaveResult> future = task->get_future();
+      Internal_GetSaveQueue().Push([task]() { (*task)(); });
+      return future;
+    }
+
+    std::future<SceneSaveResult> Scene::SaveActiveSceneAsync(File& file)
+    {
+      return Scene::GetActiveScene()->SaveAsync(file);
+    }
+
+    void Scene::WaitForAsyncSaves()
+    {
+      FLX_FLOW_FUNCTION();
+
+      Internal_GetSaveQueue().WaitUntilIdle();
+    }
+
+    std::shared_ptr<Scene> Scene::Internal_Snapshot() const
+    {
+      std::shared_ptr<Scene> snapshot = std::make_shared<Scene>();
+      snapshot->_flx_id_next = _flx_id_next;
+      snapshot->_flx_id_unused = _flx_id_unused;
+      snapshot->string_storage = string_storage;
+      snapshot->string_storage_free_list = string_storage_free_list;
+      snapshot->component_index = component_index;
+
+      std::unordered_map<const Archetype*, Archetype*> archetype_map;
+      archetype_map.reserve(archetype_index.size());
+
+      for (const auto& [type, archetype] : archetype_index)
+      {
+        Archetype& copy = snapshot->archetype_index[type];
+        copy.id = archetype.id;
+        copy.type = archetype.type;
+        copy.entities = archetype.entities;
+        copy.archetype_table.reserve(archetype.archetype_table.size());
+        for (const Column& column : archetype.archetype_table) copy.archetype_table.push_back(Internal_CopyColumn(column));
+        archetype_map[&archetype] = &copy;
+      }
+
+      // the records point into this scene's archetypes
+      snapshot->entity_index.reserve(entity_index.size());
+      for (const auto& [entity, record] : entity_index)
+      {
+        EntityRecord& copy = snapshot->entity_index[entity];
+        copy = record;
+        copy.archetype = archetype_map[record.archetype];
+      }
+
+      return snapshot;
+    }
+
+    // static function
+    Column Scene::Internal_CopyColumn(const Column& column)
+    {
+      // every row keeps the layout of ComponentData<void>, [std::size_t size][data],
+      // padded so that the next size prefix is aligned
+      std::size_t slab_size = 0;
+      for (const ComponentData<void>& data : column)
+      {
+        slab_size += sizeof(std::size_t) + (*reinterpret_cast<const std::size_t*>(data.get()) + 7) / 8 * 8;
+      }
+      std::shared_ptr<char> slab(new char[slab_size + 1], std::default_delete<char[]>());
+
+      Column column_copy;
+      column_copy.reserve(column.size());
+      char* out = slab.get();
+      for (const ComponentData<void>& data : column)
+      {
+        std::size_t size = *reinterpret_cast<const std::size_t*>(data.get());
+        std::memcpy(out, data.get(), sizeof(std::size_t) + size);
+
+        // aliasing constructor, every row shares the lifetime of the slab
+        column_copy.push_back(ComponentData<void>(slab, out));
+        out += sizeof(std::size_t) + (size + 7) / 8 * 8;
+      }
+      return column_copy;
+    }
+
+    void Scene::Internal_ReleaseMappedFile(const std::filesystem::path& path)
+    {
+      std::shared_ptr<MappedFile> mapped = mapped_file.lock();
+      if (mapped == nullptr) return;
+
+      // guard: saved somewhere else, the mapping doesn't get in the way
+      std::error_code ec;
+      if (!std::filesystem::equivalent(mapped->GetPath(), path, ec)) return;
+
+      const char* begin = mapped->Data();
+      const char* end = begin + mapped->Size();
+      auto is_mapped = [&](const ComponentData<void>& data)
+      {
+        const char* row = reinterpret_cast<const char*>(data.get());
+        return !std::less<const char*>()(row, begin) && std::less<const char*>()(row, end);
+      };
+
+      for (auto& [type, archetype] : archetype_index)
+      {
+        bool is_copied = false;
+        for (Column& column : archetype.archetype_table)
+        {
+          if (std::none_of(column.begin(), column.end(), is_mapped)) continue;
+          column = Internal_CopyColumn(column);
+          is_copied = true;
+        }
+
+        // the rows moved, cached component pointers have to look them up again
+        if (is_copied) archetype.version++;
+      }
+
+      mapped_file.reset();
+    }
+
+    // The entities and the component bytes of the archetype, in row order
+    static uint32_t Internal_ChecksumArchetype(const Archetype& archetype)
+    {
+      uint32_t crc = Checksum::CRC32C(archetype.entities.data(), archetype.entities.size() * sizeof(EntityID));
+      for (const Column& column : archetype.archetype_table)
+      {
+        for (const ComponentData<void>& data : column)
+        {
+          crc = Checksum::CRC32C(data.get(), sizeof(std::size_t) + *reinterpret_cast<const std::size_t*>(data.get()), crc);
+        }
+      }
+      return crc;
+    }
+
+    void Scene::Internal_SetLoadChecksums(std::shared_ptr<Internal_LoadChecksums> checksums)
+    {
+      checksums->contents.clear();
+      for (const auto& [type, archetype] : archetype_index) checksums->contents[archetype.id] = Internal_ChecksumArchetype(archetype);
+
+      checksums->strings = 0;
+      for (const std::string& string : string_storage) checksums->strings = Checksum::CRC32C(string.c_str(), string.size() + 1, checksums->strings);
+
+      load_checksums = checksums;
+    }
+
+    bool Scene::Internal_IsUnchangedSinceLoad(const Archetype& archetype) const
+    {
+      if (load_checksums == nullptr) return false;
+      auto it = load_checksums->contents.find(archetype.id);
+      return it != load_checksums->contents.end() && it->second == Internal_ChecksumArchetype(archetype);
+    }
+
+    bool Scene::Internal_IsUnchangedSinceLoad() const
+    {
+      if (load_checksums == nullptr || load_checksums->contents.size() != archetype_index.size()) return false;
+
+      uint32_t strings = 0;
+      for (const std::string& string : string_storage) strings = Checksum::CRC32C(string.c_str(), string.size() + 1, strings);
+      if (strings != load_checksums->strings) return false;
+
+      for (const auto& [type, archetype] : archetype_index)
+      {
+        if (!Internal_IsUnchangedSinceLoad(archetype)) return false;
+      }
+      return true;
+    }
+
+    #pragma endregion
+
+    #pragma endregion
+
+
+    #pragma region Bulk Entity Functions
+
+    // Doesn't use FLX_FLOW_FUNCTION, world streaming calls this from its worker thread
+    std::shared_ptr<Scene> Scene::Internal_ExtractEntities(const std::vector<EntityID>& entities, std::vector<EntityID>* skipped)
+    {
+      std::shared_ptr<Scene> extracted_scene = std::make_shared<Scene>();
+
+      for (EntityID entity : entities)
+      {
+        // guard: entity does not exist
+        auto entity_it = entity_index.find(entity);
+        if (entity_it == entity_index.end())
+        {
+          if (skipped != nullptr) skipped->push_back(entity);
+          else Log::Warning("Attempted to extract entity that does not exist.");
+          continue;
+        }
+
+        Archetype& from = *entity_it->second.archetype;
+        std::size_t row = entity_it->second.row;
+
+        // the archetype has the same type in both scenes, so the column order is the same
+        Archetype& to = extracted_scene->Internal_FindOrCreateArchetype(from.type);
+        for (std::size_t i = 0; i < from.archetype_table.size(); i++)
+        {
+          to.archetype_table[i].push_back(std::move(from.archetype_table[i][row]));
+        }
+        to.entities.push_back(entity);
+        extracted_scene->entity_index[entity] = { &to, to.id, to.entities.size() - 1 };
+
+        // swap-and-pop the row out of the source archetype
+        // The same code is being used in DestroyEntity and Internal_MoveEntity
+        std::size_t last_row_index = from.entities.size() - 1;
+        if (row != last_row_index)
+        {
+          for (std::size_t i = 0; i < from.archetype_table.size(); i++)
+          {
+            from.archetype_table[i][row] = std::move(from.archetype_table[i][last_row_index]);
+          }
+
+          EntityID swapped_entity = from.entities[last_row_index];
+          entity_index[swapped_entity].row = row;
+          from.entities[row] = swapped_entity;
+        }
+        for (std::size_t i = 0; i < from.archetype_table.size(); i++)
+        {
+          from.archetype_table[i].pop_back();
+        }
+        from.entities.pop_back();
+        from.version++;
+
+        // the id is not destroyed, the entity still exists, just not in this scene
+        entity_index.erase(entity_it);
+      }
+
+      return extracted_scene;
+    }
+
+    // Doesn't use FLX_FLOW_FUNCTION, world streaming calls this from its worker thread
+    void Scene::Internal_MergeEntities(Scene& other, std::vector<EntityID>* skipped)
+    {
+      // the merged entities are picked up when the name index is rebuilt
+      is_name_index_dirty = true;
+      other.is_name_index_dirty = true;
+
+      for (auto& [type, from] : other.archetype_index)
+      {
+        if (from.entities.empty()) continue;
+
+        Archetype& to = Internal_FindOrCreateArchetype(type);
+
+        // reserve once per archetype instead of growing per entity
+        for (Column& column : to.archetype_table) column.reserve(column.size() + from.entities.size());
+        to.entities.reserve(to.entities.size() + from.entities.size());
+
+        for (std::size_t row = 0; row < from.entities.size(); row++)
+        {
+          EntityID entity = from.entities[row];
+
+          // guard: id collision
+          if (entity_index.count(entity) != 0)
+          {
+            if (skipped != nullptr) skipped->push_back(entity);
+            else Log::Warning("Skipped merging entity " + std::to_string(entity) + " because it already exists in the scene.");
+            continue;
+          }
+
+          for (std::size_t i = 0; i < from.archetype_table.size(); i++)
+          {
+            to.archetype_table[i].push_back(std::move(from.archetype_table[i][row]));
+          }
+          to.entities.push_back(entity);
+          entity_index[entity] = { &to, to.id, to.entities.size() - 1 };
+        }
+
+        // leave the other scene consistent
+        for (Column& column : from.archetype_table) column.clear();
+        from.entities.clear();
+      }
+
+      other.entity_index.clear();
+    }
+
+    Archetype& Scene::Internal_FindOrCreateArchetype(const ComponentIDList& type)
+    {
+      auto it = archetype_index.find(type);
+      if (it != archetype_index.end()) return it->second;
+
+      // Same as Entity::Internal_CreateArchetype, but for this scene
+      Archetype& archetype = archetype_index[type];
+
+      archetype.id = archetype_index.size() - 1;
+      archetype.type = type;
+      archetype.archetype_table.reserve(type.size());
+
+      for (std::size_t i = 0; i < archetype.type.size(); i++)
+      {
+        component_index[archetype.type[i]][archetype.id] = { i };
+        archetype.archetype_table.push_back(Column());
+      }
+
+      return archetype;
+    }
+
     #pragma endregion
 
 
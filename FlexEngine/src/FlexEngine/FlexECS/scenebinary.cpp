@@ -0,0 +1,441 @@
+#include "datastructures.h"
+
+#include "DataStructures/parallelfor.h" // ParallelFor
+#include "Wrapper/checksum.h"
+
+// Binary FlexFormat scene serialization
+//
+// Sections:
+// SceneInfo        _flx_id_next, _flx_id_unused
+// Strings          string_storage, string_storage_free_list
+// ComponentTypes   table of component names, archetypes refer to them by index
+// Schemas          layouts of the component types, see Reflection/schema.h
+// Archetype        one per archetype
+//
+// Archetype section:
+// uint64 id, entity_count, component_count
+// uint64 component type index * component_count
+// uint64 stride * component_count
+// EntityID * entity_count
+// padding to FLXBIN_ALIGNMENT
+// columns, each entity_count * stride bytes and padded to FLXBIN_ALIGNMENT
+//
+// Every row of a column has the same layout as ComponentData<void> in memory,
+// [std::size_t size][data][padding to 8 bytes], so a whole column can be copied in one go
+// and every row can point straight into the copy.
+//
+// entity_index and component_index aren't stored, they are rebuilt from the archetypes.
+// Archetype sections don't refer to each other, so large scenes encode and decode them
+// on several threads (see Scene::Internal_GetSerializationThreadCount).
+//
+// Components of a type whose layout changed since the file was saved are converted
+// after loading. Files without a Schemas section are loaded as they are.
+//
+// Every section has a CRC32C checksum that FlxBinReader::Parse() verifies before decoding.
+// Scene::Reload() keeps the archetypes whose section checksum didn't change. An archetype
+// section only refers to the component types by index and the layouts by the Schemas
+// section, so it can only be kept if those two sections didn't change either.
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    enum SceneBinarySection : uint32_t
+    {
+      SceneBinarySection_SceneInfo = 1,
+      SceneBinarySection_Strings = 2,
+      SceneBinarySection_ComponentTypes = 3,
+      SceneBinarySection_Archetype = 4,
+      SceneBinarySection_Schemas = 5
+    };
+
+    static_assert(sizeof(std::size_t) == sizeof(uint64_t), "The binary scene format stores std::size_t as uint64");
+
+    // Rows are padded so that the size prefix of every row stays aligned
+    static std::size_t Internal_GetStride(const Column& column)
+    {
+      std::size_t max_size = 0;
+      for (const ComponentData<void>& data : column)
+      {
+        max_size = (std::max)(max_size, *reinterpret_cast<const std::size_t*>(data.get()));
+      }
+      return sizeof(std::size_t) + (max_size + 7) / 8 * 8;
+    }
+
+    static void Internal_WriteArchetypeSection(const Archetype& archetype, const std::unordered_map<ComponentID, uint64_t>& component_type_index, std::string& section)
+    {
+      std::size_t entity_count = archetype.entities.size();
+      std::size_t component_count = archetype.type.size();
+
+      std::vector<std::size_t> strides(component_count);
+      std::size_t columns_size = 0;
+      for (std::size_t i = 0; i < component_count; i++)
+      {
+        strides[i] = Internal_GetStride(archetype.archetype_table[i]);
+        columns_size += (entity_count * strides[i] + FLXBIN_ALIGNMENT - 1) / FLXBIN_ALIGNMENT * FLXBIN_ALIGNMENT;
+      }
+
+      section.reserve(sizeof(uint64_t) * (3 + component_count * 2 + entity_count) + FLXBIN_ALIGNMENT + columns_size);
+
+      FlxBinWriter::Append<uint64_t>(section, archetype.id);
+      FlxBinWriter::Append<uint64_t>(section, entity_count);
+      FlxBinWriter::Append<uint64_t>(section, component_count);
+      for (const ComponentID& component : archetype.type) FlxBinWriter::Append<uint64_t>(section, component_type_index.at(component));
+      for (std::size_t stride : strides) FlxBinWriter::Append<uint64_t>(section, stride);
+      FlxBinWriter::AppendBytes(section, archetype.entities.data(), entity_count * sizeof(EntityID));
+      FlxBinWriter::Pad(section);
+
+      // columns
+      for (std::size_t i = 0; i < component_count; i++)
+      {
+        std::size_t column_start = section.size();
+        section.resize(column_start + entity_count * strides[i], '\0');
+        char* out = section.data() + column_start;
+
+        for (const ComponentData<void>& data : archetype.archetype_table[i])
+        {
+          std::size_t size = *reinterpret_cast<const std::size_t*>(data.get());
+          std::memcpy(out, data.get(), sizeof(std::size_t) + size);
+          out += strides[i];
+        }
+
+        FlxBinWriter::Pad(section);
+      }
+    }
+
+    // An archetype section decoded on a worker, merged into the scene afterwards
+    struct Internal_DecodedArchetype
+    {
+      const FlxBinSectionEntry* entry = nullptr;
+      Archetype archetype{};
+      bool ok = false;
+      bool is_shared = false; // unchanged since the previous load, see Scene::Reload()
+    };
+
+    // Decodes an archetype section, the counterpart of Internal_WriteArchetypeSection.
+    // Only touches the decoded archetype, so sections can be decoded in parallel.
+    static bool Internal_ReadArchetypeSection(FlxBinCursor& cursor, std::size_t section_size, const std::vector<ComponentID>& component_types, const std::shared_ptr<void>& backing, Archetype& archetype)
+    {
+      ArchetypeID id = cursor.Read<uint64_t>();
+      std::size_t entity_count = static_cast<std::size_t>(cursor.Read<uint64_t>());
+      std::size_t component_count = static_cast<std::size_t>(cursor.Read<uint64_t>());
+      if (entity_count > section_size || component_count > section_size) return false;
+
+      ComponentIDList type(component_count);
+      for (std::size_t i = 0; i < component_count; i++)
+      {
+        uint64_t type_index = cursor.Read<uint64_t>();
+        if (type_index >= component_types.size()) return false;
+        type[i] = component_types[static_cast<std::size_t>(type_index)];
+      }
+      std::vector<std::size_t> strides(component_count);
+      for (std::size_t i = 0; i < component_count; i++) strides[i] = static_cast<std::size_t>(cursor.Read<uint64_t>());
+
+      const char* entities = cursor.ReadBytes(entity_count * sizeof(EntityID));
+      cursor.Align();
+      if (!cursor.ok) return false;
+
+      // one allocation and one copy for every column of the archetype,
+      // or no copy at all when the rows can point into the backing
+      std::size_t columns_size = static_cast<std::size_t>(cursor.end - cursor.current);
+      const char* columns = cursor.ReadBytes(columns_size);
+      std::shared_ptr<char> slab;
+      if (backing != nullptr)
+      {
+        slab = std::shared_ptr<char>(backing, const_cast<char*>(columns));
+      }
+      else
+      {
+        slab = std::shared_ptr<char>(new char[columns_size + 1], std::default_delete<char[]>());
+        std::memcpy(slab.get(), columns, columns_size);
+      }
+
+      archetype.id = id;
+      archetype.type = type;
+      archetype.entities.resize(entity_count);
+      std::memcpy(archetype.entities.data(), entities, entity_count * sizeof(EntityID));
+      archetype.archetype_table.resize(component_count);
+
+      std::size_t column_offset = 0;
+      for (std::size_t i = 0; i < component_count; i++)
+      {
+        // guard: column is within the section and rows can hold their size prefix
+        if (strides[i] < sizeof(std::size_t) || entity_count * strides[i] > columns_size - column_offset) return false;
+
+        Column& column = archetype.archetype_table[i];
+        column.reserve(entity_count);
+        for (std::size_t row = 0; row < entity_count; row++)
+        {
+          // aliasing constructor, every row shares the lifetime of the slab
+          char* row_data = slab.get() + column_offset + row * strides[i];
+          if (*reinterpret_cast<std::size_t*>(row_data) > strides[i] - sizeof(std::size_t)) return false;
+          column.push_back(ComponentData<void>(slab, row_data));
+        }
+
+        column_offset += (entity_count * strides[i] + FLXBIN_ALIGNMENT - 1) / FLXBIN_ALIGNMENT * FLXBIN_ALIGNMENT;
+      }
+
+      return true;
+    }
+
+    void Scene::SaveBinary(File& file)
+    {
+      Internal_ReleaseMappedFile(file.path.get());
+
+      // keep the creation date and save version of an existing binary file
+      FlxFmtFileType file_type = Internal_GetFileType(file.path.get());
+      Date created = Date::Now();
+      uint32_t previous_save_version = 0;
+
+      file.Read();
+      FlxBinReader reader;
+      if (FlxBinReader::IsBinary(file.data) && reader.Parse(file.data.data(), file.data.size(), file_type))
+      {
+        created = reader.GetCreated();
+        previous_save_version = reader.GetHeader().save_version;
+      }
+
+      file.Write(Internal_SerializeBinary(created, previous_save_version, file_type));
+    }
+
+    std::string Scene::Internal_SerializeBinary(const Date& created, uint32_t previous_save_version, FlxFmtFileType file_type)
+    {
+      FLX_FLOW_FUNCTION();
+
+      FlxBinWriter writer(file_type);
+      writer.SetPreviousMetadata(created, previous_save_version);
+
+      // scene info
+      {
+        std::string& section = writer.AddSection(SceneBinarySection_SceneInfo);
+        FlxBinWriter::Append<uint64_t>(section, _flx_id_next);
+        FlxBinWriter::Append<uint64_t>(section, _flx_id_unused.size());
+        FlxBinWriter::AppendBytes(section, _flx_id_unused.data(), _flx_id_unused.size() * sizeof(uint64_t));
+      }
+
+      // strings
+      {
+        std::string& section = writer.AddSection(SceneBinarySection_Strings);
+        FlxBinWriter::Append<uint64_t>(section, string_storage.size());
+        for (const std::string& str : string_storage) FlxBinWriter::AppendString(section, str);
+        FlxBinWriter::Append<uint64_t>(section, string_storage_free_list.size());
+        FlxBinWriter::AppendBytes(section, string_storage_free_list.data(), string_storage_free_list.size() * sizeof(StringIndex));
+      }
+
+      // component types
+      std::unordered_map<ComponentID, uint64_t> component_type_index;
+      {
+        std::string& section = writer.AddSection(SceneBinarySection_ComponentTypes);
+        FlxBinWriter::Append<uint64_t>(section, component_index.size());
+        for (auto& [component, archetype_map] : component_index)
+        {
+          uint64_t index = component_type_index.size();
+          component_type_index[component] = index;
+          FlxBinWriter::AppendString(section, component);
+        }
+      }
+
+      // schemas
+      {
+        Reflection::SchemaSet schemas;
+        Internal_CollectComponentSchemas(schemas);
+        schemas.WriteBinary(writer.AddSection(SceneBinarySection_Schemas));
+      }
+
+      // archetypes, each section is encoded on its own and added in the order of the map
+      std::vector<const Archetype*> archetypes;
+      archetypes.reserve(archetype_index.size());
+      for (auto& [type, archetype] : archetype_index) archetypes.push_back(&archetype);
+
+      std::vector<std::string> sections(archetypes.size());
+      ParallelFor(archetypes.size(), [&](std::size_t index)
+      {
+        Internal_WriteArchetypeSection(*archetypes[index], component_type_index, sections[index]);
+      }, Internal_GetSerializationThreadCount(entity_index.size()));
+
+      for (std::string& section : sections) writer.AddSection(SceneBinarySection_Archetype) = std::move(section);
+
+      return writer.Save();
+    }
+
+    // static function
+    std::shared_ptr<Scene> Scene::Internal_DeserializeBinary(const char* data, std::size_t size, std::shared_ptr<void> backing, const Scene* previous, FlxFmtFileType file_type)
+    {
+      FLX_FLOW_FUNCTION();
+
+      FlxBinReader reader;
+      if (!reader.Parse(data, size, file_type)) return nullptr;
+
+      std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+      std::vector<ComponentID> component_types;
+      Reflection::SchemaSet schemas;
+      std::vector<Internal_DecodedArchetype> archetypes;
+
+      for (const FlxBinSectionEntry& entry : reader.GetSections())
+      {
+        FlxBinCursor cursor = reader.GetSection(entry);
+
+        switch (entry.type)
+        {
+        case SceneBinarySection_SceneInfo:
+        {
+          scene->_flx_id_next = cursor.Read<uint64_t>();
+          std::size_t unused_count = static_cast<std::size_t>(cursor.Read<uint64_t>());
+          if (unused_count > entry.size) { cursor.ok = false; break; }
+          scene->_flx_id_unused.resize(unused_count);
+          const char* unused = cursor.ReadBytes(scene->_flx_id_unused.size() * sizeof(uint64_t));
+          if (unused != nullptr) std::memcpy(scene->_flx_id_unused.data(), unused, scene->_flx_id_unused.size() * sizeof(uint64_t));
+          break;
+        }
+        case SceneBinarySection_Strings:
+        {
+          std::size_t string_count = static_cast<std::size_t>(cursor.Read<uint64_t>());
+          if (string_count > entry.size) { cursor.ok = false; break; } // can't have more strings than bytes
+          scene->string_storage.reserve(string_count);
+          for (std::size_t i = 0; i < string_count && cursor.ok; i++) scene->string_storage.push_back(cursor.ReadString());
+
+          std::size_t free_count = static_cast<std::size_t>(cursor.Read<uint64_t>());
+          if (free_count > entry.size) { cursor.ok = false; break; }
+          scene->string_storage_free_list.resize(free_count);
+          const char* free_list = cursor.ReadBytes(scene->string_storage_free_list.size() * sizeof(StringIndex));
+          if (free_list != nullptr) std::memcpy(scene->string_storage_free_list.data(), free_list, scene->string_storage_free_list.size() * sizeof(StringIndex));
+          break;
+        }
+        case SceneBinarySection_ComponentTypes:
+        {
+          std::size_t type_count = static_cast<std::size_t>(cursor.Read<uint64_t>());
+          if (type_count > entry.size) { cursor.ok = false; break; }
+          component_types.reserve(type_count);
+          for (std::size_t i = 0; i < type_count && cursor.ok; i++) component_types.push_back(cursor.ReadString());
+          break;
+        }
+        case SceneBinarySection_Schemas:
+          schemas.ReadBinary(cursor);
+          break;
+        case SceneBinarySection_Archetype:
+          // decoded below once the component types are known
+          archetypes.push_back({ &entry });
+          break;
+        default:
+          // unknown sections are skipped
+          break;
+        }
+
+        if (!cursor.ok)
+        {
+          Log::Error("Binary scene section " + std::to_string(entry.type) + " is corrupted.");
+          return nullptr;
+        }
+      }
+
+      // the sections the archetype sections depend on
+      uint32_t layout_checksum = 0;
+      for (const FlxBinSectionEntry& entry : reader.GetSections())
+      {
+        if (entry.type == SceneBinarySection_ComponentTypes || entry.type == SceneBinarySection_Schemas)
+        {
+          layout_checksum = Checksum::CRC32C(&entry.checksum, sizeof(entry.checksum), layout_checksum);
+        }
+      }
+
+      // share the archetypes that didn't change since previous was loaded
+      if (
+        previous != nullptr && reader.HasChecksums() &&
+        previous->load_checksums != nullptr && previous->load_checksums->is_binary &&
+        previous->load_checksums->data == layout_checksum
+      )
+      {
+        for (Internal_DecodedArchetype& decoded : archetypes)
+        {
+          auto type_it = previous->load_checksums->archetypes.find(decoded.entry->checksum);
+          if (type_it == previous->load_checksums->archetypes.end()) continue;
+          auto archetype_it = previous->archetype_index.find(type_it->second);
+          if (archetype_it == previous->archetype_index.end()) continue;
+          const Archetype& from = archetype_it->second;
+
+          // guard: previous was edited after loading
+          FlxBinCursor cursor = reader.GetSection(*decoded.entry);
+          ArchetypeID id = cursor.Read<uint64_t>();
+          std::size_t entity_count = static_cast<std::size_t>(cursor.Read<uint64_t>());
+          if (!cursor.ok || id != from.id || entity_count != from.entities.size()) continue;
+
+          if (!previous->Internal_IsUnchangedSinceLoad(from)) continue;
+
+          // copied, edits to either scene don't show up in the other
+          decoded.archetype.id = from.id;
+          decoded.archetype.type = from.type;
+          decoded.archetype.entities = from.entities;
+          decoded.archetype.archetype_table.reserve(from.archetype_table.size());
+          for (const Column& column : from.archetype_table) decoded.archetype.archetype_table.push_back(Internal_CopyColumn(column));
+          decoded.ok = true;
+          decoded.is_shared = true;
+        }
+      }
+
+      // the row count isn't known before decoding, the section size stands in for it
+      std::size_t estimated_rows = 0;
+      for (const Internal_DecodedArchetype& decoded : archetypes) estimated_rows += static_cast<std::size_t>(decoded.entry->size) / sizeof(EntityID);
+
+      ParallelFor(archetypes.size(), [&](std::size_t index)
+      {
+        Internal_DecodedArchetype& decoded = archetypes[index];
+        if (decoded.is_shared) return;
+
+        FlxBinCursor cursor = reader.GetSection(*decoded.entry);
+        decoded.ok = Internal_ReadArchetypeSection(cursor, static_cast<std::size_t>(decoded.entry->size), component_types, backing, decoded.archetype) && cursor.ok;
+      }, Internal_GetSerializationThreadCount(estimated_rows));
+
+      auto checksums = std::make_shared<Internal_LoadChecksums>();
+      checksums->is_binary = true;
+      checksums->data = layout_checksum;
+
+      for (Internal_DecodedArchetype& decoded : archetypes)
+      {
+        if (!decoded.ok)
+        {
+          Log::Error("Binary scene section " + std::to_string(decoded.entry->type) + " is corrupted.");
+          return nullptr;
+        }
+
+        checksums->archetypes[decoded.entry->checksum] = decoded.archetype.type;
+
+        ComponentIDList type = decoded.archetype.type;
+        ArchetypeID id = decoded.archetype.id;
+        Archetype& archetype = scene->archetype_index[type];
+        archetype = std::move(decoded.archetype);
+
+        for (std::size_t i = 0; i < type.size(); i++) scene->component_index[type[i]][id] = { i };
+        for (std::size_t row = 0; row < archetype.entities.size(); row++)
+        {
+          scene->entity_index[archetype.entities[row]] = { &archetype, id, row };
+        }
+      }
+
+      // migrated components no longer match their sections, nothing can be shared with this scene
+      if (schemas.Resolve()) scene->Internal_MigrateComponents(schemas);
+      else if (reader.HasChecksums()) scene->Internal_SetLoadChecksums(checksums);
+
+      return scene;
+    }
+
+    // static function
+    std::shared_ptr<Scene> Scene::LoadMapped(const Path& path)
+    {
+      FLX_FLOW_FUNCTION();
+
+      std::shared_ptr<MappedFile> mapped = MappedFile::Open(path);
+      if (mapped == nullptr || !FlxBinReader::IsBinary(mapped->Data(), mapped->Size()))
+      {
+        return Load(File::Open(path));
+      }
+
+      // the rows share ownership of the mapping through the aliasing constructor
+      std::shared_ptr<Scene> scene = Internal_DeserializeBinary(mapped->Data(), mapped->Size(), mapped, nullptr, Internal_GetFileType(path.get()));
+      if (scene == nullptr) return std::make_shared<Scene>(Scene::Null);
+      scene->mapped_file = mapped;
+      return scene;
+    }
+
+  }
+}
@@ -0,0 +1,208 @@
+#include "scenejournal.h"
+
+#include <cstring> // std::memcmp
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    #pragma region Internal Functions
+
+    static constexpr char JOURNAL_MAGIC[8] = { 'F', 'L', 'X', 'J', 'R', 'N', 'L', '1' };
+    static constexpr std::size_t JOURNAL_HEADER_SIZE = sizeof(JOURNAL_MAGIC) + 2 * sizeof(uint64_t);
+    static constexpr std::size_t JOURNAL_RECORD_HEADER_SIZE = 2 * sizeof(uint64_t);
+
+    // FNV-1a
+    static uint64_t Internal_Hash(const char* data, std::size_t size)
+    {
+      uint64_t hash = 14695981039346656037ull;
+      for (std::size_t i = 0; i < size; i++)
+      {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+      }
+      return hash;
+    }
+
+    static std::string Internal_ReadFile(const std::filesystem::path& path, bool& exists)
+    {
+      std::ifstream stream(path, std::ios::binary);
+      exists = static_cast<bool>(stream);
+      if (!exists) return "";
+      return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    }
+
+    #pragma endregion
+
+    SceneJournal::SceneJournal(const std::filesystem::path& scene_path, std::size_t compact_percent)
+      : m_scene_path(scene_path), m_journal_path(scene_path), m_compact_percent(compact_percent)
+    {
+      m_journal_path += ".journal";
+    }
+
+    std::shared_ptr<Scene> SceneJournal::Load()
+    {
+      FLX_FLOW_FUNCTION();
+
+      m_baseline = nullptr;
+      m_journal_size = 0;
+      m_record_count = 0;
+
+      bool exists = false;
+      std::string data = Internal_ReadFile(m_scene_path, exists);
+      if (!exists)
+      {
+        Log::Error("Failed to open scene " + m_scene_path.string());
+        return std::make_shared<Scene>(Scene::Null);
+      }
+
+      m_snapshot_size = data.size();
+      m_snapshot_hash = Internal_Hash(data.data(), data.size());
+
+      // the hash is of the file as it is on disk
+      if (FlxCompression::IsCompressed(data) && !FlxCompression::Decompress(data, data))
+      {
+        Log::Error("Failed to decompress scene " + m_scene_path.string());
+        return std::make_shared<Scene>(Scene::Null);
+      }
+
+      // the same as Scene::Load(), the hash is taken before the in situ parse overwrites the data
+      std::shared_ptr<Scene> scene = Scene::Internal_LoadFromData(data, FlxFmtFileType::Scene);
+      if (scene == nullptr) return std::make_shared<Scene>(Scene::Null);
+
+      // a bad tail that couldn't be cut off, records can't be appended after it
+      bool is_tail_kept = false;
+
+      std::string journal = Internal_ReadFile(m_journal_path, exists);
+      if (exists && journal.size() >= JOURNAL_HEADER_SIZE)
+      {
+        FlxBinCursor cursor(journal.data(), journal.size());
+        const char* magic = cursor.ReadBytes(sizeof(JOURNAL_MAGIC));
+        uint64_t snapshot_size = cursor.Read<uint64_t>();
+        uint64_t snapshot_hash = cursor.Read<uint64_t>();
+
+        // guard: the journal of an older snapshot, left behind by a crash during compaction
+        if (std::memcmp(magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || snapshot_size != m_snapshot_size || snapshot_hash != m_snapshot_hash)
+        {
+          Log::Warning("Ignored scene journal " + m_journal_path.string() + " because it doesn't belong to the scene.");
+        }
+        else
+        {
+          m_journal_size = JOURNAL_HEADER_SIZE;
+
+          while (cursor.current < cursor.end)
+          {
+            uint64_t size = cursor.Read<uint64_t>();
+            uint64_t hash = cursor.Read<uint64_t>();
+            const char* record = cursor.ReadBytes(static_cast<std::size_t>(size));
+
+            // a record that was cut off or corrupted ends the journal
+            ScenePatch patch;
+            if (record == nullptr || Internal_Hash(record, static_cast<std::size_t>(size)) != hash || !ScenePatch::Deserialize(std::string_view(record, static_cast<std::size_t>(size)), patch))
+            {
+              Log::Warning("Scene journal " + m_journal_path.string() + " ends in an incomplete record, the changes in it are lost.");
+
+              // later records are appended after the last good one
+              std::error_code ec;
+              std::filesystem::resize_file(m_journal_path, m_journal_size, ec);
+              is_tail_kept = static_cast<bool>(ec);
+              break;
+            }
+
+            scene->Apply(patch);
+            m_journal_size += JOURNAL_RECORD_HEADER_SIZE + static_cast<std::size_t>(size);
+            m_record_count++;
+          }
+        }
+      }
+
+      // without a baseline the next Save() writes a full snapshot
+      if (!is_tail_kept) m_baseline = scene->Internal_Snapshot();
+      return scene;
+    }
+
+    bool SceneJournal::Save(Scene& scene)
+    {
+      FLX_FLOW_FUNCTION();
+
+      if (m_baseline == nullptr) return Compact(scene);
+
+      // compares the component bytes, but only the changes are encoded and written
+      ScenePatch patch = m_baseline->Diff(scene);
+      if (patch.IsEmpty()) return true;
+
+      std::string record = patch.Serialize();
+
+      std::size_t journal_size = m_journal_size + JOURNAL_RECORD_HEADER_SIZE + record.size();
+      if (journal_size > (std::max)(MIN_COMPACT_SIZE, m_snapshot_size / 100 * m_compact_percent)) return Compact(scene);
+
+      if (!Internal_Append(record)) return false;
+
+      // the patch copies the changed components, the baseline stays independent of the scene
+      m_baseline->Apply(patch);
+      return true;
+    }
+
+    bool SceneJournal::Compact(Scene& scene)
+    {
+      FLX_FLOW_FUNCTION();
+
+      scene.Internal_ReleaseMappedFile(m_scene_path);
+      std::string data = scene.Internal_SerializeFile(m_scene_path);
+      std::string error = Scene::Internal_WriteFileAtomic(m_scene_path, data);
+      if (!error.empty())
+      {
+        Log::Error(error);
+        return false;
+      }
+
+      m_snapshot_size = data.size();
+      m_snapshot_hash = Internal_Hash(data.data(), data.size());
+      m_baseline = scene.Internal_Snapshot();
+
+      // the old journal doesn't match the new snapshot, a crash before this point ignores it on load
+      m_journal_size = 0;
+      m_record_count = 0;
+      error = Scene::Internal_WriteFileAtomic(m_journal_path, "");
+      if (!error.empty())
+      {
+        Log::Error(error);
+        return false;
+      }
+
+      return true;
+    }
+
+    bool SceneJournal::Internal_Append(const std::string& record)
+    {
+      std::string out;
+
+      // the journal is started by the first record after a load or compaction
+      if (m_journal_size == 0)
+      {
+        FlxBinWriter::AppendBytes(out, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        FlxBinWriter::Append<uint64_t>(out, m_snapshot_size);
+        FlxBinWriter::Append<uint64_t>(out, m_snapshot_hash);
+      }
+      FlxBinWriter::Append<uint64_t>(out, record.size());
+      FlxBinWriter::Append<uint64_t>(out, Internal_Hash(record.data(), record.size()));
+      out += record;
+
+      std::ios::openmode mode = std::ios::binary | ((m_journal_size == 0) ? std::ios::trunc : std::ios::app);
+      std::ofstream stream(m_journal_path, mode);
+      stream.write(out.data(), out.size());
+      stream.flush();
+      if (!stream)
+      {
+        Log::Error("Failed to append to scene journal " + m_journal_path.string());
+        return false;
+      }
+
+      m_journal_size += out.size();
+      m_record_count++;
+      return true;
+    }
+
+  }
+}
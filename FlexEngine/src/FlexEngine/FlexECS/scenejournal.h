@@ -0,0 +1,88 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "datastructures.h" // <algorithm> <typeindex> <memory>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Incremental autosave journal
+//
+// The scene file is a full snapshot, the journal next to it (scene.flxscene.journal)
+// is an append-only list of scene patches made since that snapshot.
+// Save() diffs the scene against its state at the last save and appends the patch,
+// so the bytes written scale with the edits and not with the size of the scene.
+// When the journal grows past a fraction of the snapshot it is compacted:
+// the scene is written as a new snapshot and the journal starts over.
+//
+// Load() reads the snapshot and applies every patch in the journal after it.
+// The journal stores a hash of the snapshot it belongs to, a journal that was left behind
+// by a crash during compaction doesn't match the new snapshot and is ignored.
+// Each record has its own hash, a record that was cut off by a crash ends the replay.
+//
+// Journal file:
+// char[8] "FLXJRNL1"
+// uint64 snapshot size, uint64 snapshot hash
+// per record: uint64 size, uint64 hash, ScenePatch::Serialize()
+//
+// Usage:
+// FlexECS::SceneJournal journal(Path::current("saves/level.flxscene"));
+// std::shared_ptr<FlexECS::Scene> scene = journal.Load();
+// journal.Save(*scene); // every autosave
+// journal.Compact(*scene); // on an explicit save
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    class __FLX_API SceneJournal
+    {
+    public:
+      // The journal is compacted when it is larger than this percentage of the snapshot.
+      static constexpr std::size_t DEFAULT_COMPACT_PERCENT = 50;
+
+      // The journal is never compacted below this size, small scenes would compact every save.
+      static constexpr std::size_t MIN_COMPACT_SIZE = 64 * 1024;
+
+      explicit SceneJournal(const std::filesystem::path& scene_path, std::size_t compact_percent = DEFAULT_COMPACT_PERCENT);
+
+      // Loads the snapshot and replays the journal.
+      // Returns a null scene if the snapshot can't be loaded.
+      // The loaded state is the baseline of the next Save().
+      std::shared_ptr<Scene> Load();
+
+      // Appends the changes since the last Save(), Load() or Compact().
+      // Without a baseline, or when the journal is due for compaction, writes a full snapshot instead.
+      // Nothing is written if nothing changed.
+      bool Save(Scene& scene);
+
+      // Writes the scene as a full snapshot and starts a new, empty journal.
+      bool Compact(Scene& scene);
+
+      const std::filesystem::path& GetScenePath() const { return m_scene_path; }
+      const std::filesystem::path& GetJournalPath() const { return m_journal_path; }
+
+      // Number of patches in the journal
+      std::size_t GetRecordCount() const { return m_record_count; }
+
+    private:
+      bool Internal_Append(const std::string& record);
+
+      std::filesystem::path m_scene_path;
+      std::filesystem::path m_journal_path;
+      std::size_t m_compact_percent;
+
+      // The scene as of the last save, patches are diffed against it
+      std::shared_ptr<Scene> m_baseline;
+
+      std::size_t m_snapshot_size = 0;
+      uint64_t m_snapshot_hash = 0;
+      std::size_t m_journal_size = 0;
+      std::size_t m_record_count = 0;
+    };
+
+  }
+}
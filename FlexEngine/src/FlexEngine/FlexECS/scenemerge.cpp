@@ -0,0 +1,253 @@
+#include "datastructures.h"
+
+// Additive loading
+//
+// Merge() copies the rows of another scene into this one, archetype by archetype.
+// Every column of the other scene is packed once into an image with the same layout as
+// the rows, [std::size_t size][data] padded to 8 bytes, and every instance is a memcpy of
+// that image into one allocation for the column. The rows alias the allocation.
+//
+// The copied components are then patched in place:
+// - Entity members, found through reflection, are remapped through a table from the ids
+//   of the other scene to the new ids. The table ignores the flags of the id, a reference
+//   keeps its own flags.
+// - Entity names and registered StringIndex members get a new string in this scene.
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    #pragma region Internal Functions
+
+    static constexpr uint64_t ID_FLAGS_MASK = static_cast<uint64_t>(ID::MASK_FLAGS) << ID::SHIFT_FLAGS;
+
+    // Registered with FLX_ECS_REGISTER_STRING_MEMBER, resolved on first use
+    struct Internal_StringMember
+    {
+      Reflection::TypeDescriptor* (*get_type)();
+      std::size_t offset;
+    };
+
+    static std::vector<Internal_StringMember>& Internal_StringMembers()
+    {
+      static std::vector<Internal_StringMember> string_members;
+      return string_members;
+    }
+
+    // Where the references in a component are
+    struct Internal_RemapLayout
+    {
+      std::vector<std::size_t> entity_offsets;
+      std::vector<std::size_t> string_offsets;
+    };
+
+    static void Internal_FindEntityMembers(const Reflection::TypeDescriptor* type_desc, std::size_t base, std::vector<std::size_t>& offsets, int depth)
+    {
+      if (type_desc == Reflection::TypeResolver<Entity>::Get())
+      {
+        offsets.push_back(base);
+        return;
+      }
+
+      // guard: runaway recursion
+      if (depth > 16) return;
+
+      auto* struct_desc = dynamic_cast<const Reflection::TypeDescriptor_Struct*>(type_desc);
+      if (struct_desc == nullptr) return;
+
+      for (const Reflection::TypeDescriptor_Struct::Member& member : struct_desc->members)
+      {
+        Internal_FindEntityMembers(member.type, base + member.offset, offsets, depth + 1);
+      }
+    }
+
+    static Internal_RemapLayout Internal_GetRemapLayout(const ComponentID& component)
+    {
+      Internal_RemapLayout layout;
+
+      Reflection::TypeDescriptor* type_desc = Reflection::TypeDescriptor::FindByName(component);
+      if (type_desc == nullptr) return layout;
+
+      // the name component is a bare StringIndex
+      if (type_desc == Reflection::TypeResolver<Scene::StringIndex>::Get())
+      {
+        layout.string_offsets.push_back(0);
+        return layout;
+      }
+
+      Internal_FindEntityMembers(type_desc, 0, layout.entity_offsets, 0);
+      for (const Internal_StringMember& member : Internal_StringMembers())
+      {
+        if (member.get_type() == type_desc) layout.string_offsets.push_back(member.offset);
+      }
+
+      return layout;
+    }
+
+    #pragma endregion
+
+    bool Internal_RegisterStringMember(Reflection::TypeDescriptor* (*get_type)(), std::size_t offset)
+    {
+      Internal_StringMembers().push_back({ get_type, offset });
+      return true;
+    }
+
+    std::vector<Entity> Scene::Merge(const Scene& other, std::size_t count)
+    {
+      FLX_FLOW_FUNCTION();
+
+      std::vector<Entity> merged;
+      if (count == 0 || other.entity_index.empty()) return merged;
+
+      // guard: merging a scene into itself would read the rows while appending to them
+      if (&other == this)
+      {
+        std::shared_ptr<Scene> copy = Internal_Snapshot();
+        return Merge(*copy, count);
+      }
+
+      // the entities of the other scene in archetype order, the order the rows are copied in
+      std::vector<EntityID> sources;
+      sources.reserve(other.entity_index.size());
+      for (const auto& [type, archetype] : other.archetype_index)
+      {
+        sources.insert(sources.end(), archetype.entities.begin(), archetype.entities.end());
+      }
+
+      std::unordered_map<uint64_t, std::size_t> source_index;
+      source_index.reserve(sources.size());
+      for (std::size_t i = 0; i < sources.size(); i++) source_index[sources[i] & ~ID_FLAGS_MASK] = i;
+
+      // the copy of sources[i] in instance n is merged[n * sources.size() + i]
+      merged.reserve(sources.size() * count);
+      for (std::size_t instance = 0; instance < count; instance++)
+      {
+        for (EntityID source : sources)
+        {
+          merged.push_back(Entity(ID::Create(ID::GetFlags(source), _flx_id_next, _flx_id_unused)));
+        }
+      }
+      entity_index.reserve(entity_index.size() + merged.size());
+
+      std::unordered_map<ComponentID, Internal_RemapLayout> layouts;
+      std::size_t source_offset = 0;
+
+      for (const auto& [type, from] : other.archetype_index)
+      {
+        std::size_t row_count = from.entities.size();
+        if (row_count == 0) continue;
+
+        Archetype& to = Internal_FindOrCreateArchetype(type);
+
+        for (std::size_t i = 0; i < from.archetype_table.size(); i++)
+        {
+          const Column& column = from.archetype_table[i];
+
+          auto layout_it = layouts.find(type[i]);
+          if (layout_it == layouts.end()) layout_it = layouts.emplace(type[i], Internal_GetRemapLayout(type[i])).first;
+          const Internal_RemapLayout& layout = layout_it->second;
+
+          // pack the rows once, the offsets are relative to the start of an instance
+          std::vector<std::size_t> row_offsets(row_count);
+          std::size_t image_size = 0;
+          for (std::size_t row = 0; row < row_count; row++)
+          {
+            row_offsets[row] = image_size;
+            image_size += sizeof(std::size_t) + (*reinterpret_cast<const std::size_t*>(column[row].get()) + 7) / 8 * 8;
+          }
+
+          std::shared_ptr<char> slab(new char[image_size * count + 1], std::default_delete<char[]>());
+          for (std::size_t row = 0; row < row_count; row++)
+          {
+            std::size_t size = *reinterpret_cast<const std::size_t*>(column[row].get());
+            std::memcpy(slab.get() + row_offsets[row], column[row].get(), sizeof(std::size_t) + size);
+          }
+          for (std::size_t instance = 1; instance < count; instance++)
+          {
+            std::memcpy(slab.get() + instance * image_size, slab.get(), image_size);
+          }
+
+          Column& to_column = to.archetype_table[i];
+          to_column.reserve(to_column.size() + row_count * count);
+
+          for (std::size_t instance = 0; instance < count; instance++)
+          {
+            char* image = slab.get() + instance * image_size;
+            Entity* instance_entities = merged.data() + instance * sources.size();
+
+            for (std::size_t row = 0; row < row_count; row++)
+            {
+              char* cell = image + row_offsets[row];
+              std::size_t size = *reinterpret_cast<const std::size_t*>(cell);
+              char* data = cell + sizeof(std::size_t);
+
+              for (std::size_t offset : layout.entity_offsets)
+              {
+                // guard: the component is smaller than its current type
+                if (offset + sizeof(EntityID) > size) continue;
+
+                EntityID reference;
+                std::memcpy(&reference, data + offset, sizeof(EntityID));
+                auto it = source_index.find(reference & ~ID_FLAGS_MASK);
+                if (it == source_index.end()) continue;
+
+                EntityID remapped = (instance_entities[it->second].Get() & ~ID_FLAGS_MASK) | (reference & ID_FLAGS_MASK);
+                std::memcpy(data + offset, &remapped, sizeof(EntityID));
+              }
+
+              for (std::size_t offset : layout.string_offsets)
+              {
+                if (offset + sizeof(StringIndex) > size) continue;
+
+                StringIndex index;
+                std::memcpy(&index, data + offset, sizeof(StringIndex));
+                if (index >= other.string_storage.size()) continue;
+
+                index = Internal_StringStorage_New(other.string_storage[index]);
+                std::memcpy(data + offset, &index, sizeof(StringIndex));
+              }
+
+              // aliasing constructor, every row shares the lifetime of the slab
+              to_column.push_back(ComponentData<void>(slab, cell));
+            }
+          }
+        }
+
+        to.entities.reserve(to.entities.size() + row_count * count);
+        for (std::size_t instance = 0; instance < count; instance++)
+        {
+          Entity* instance_entities = merged.data() + instance * sources.size() + source_offset;
+          for (std::size_t row = 0; row < row_count; row++)
+          {
+            EntityID entity = instance_entities[row].Get();
+            to.entities.push_back(entity);
+            entity_index[entity] = { &to, to.id, to.entities.size() - 1 };
+          }
+        }
+
+        source_offset += row_count;
+      }
+
+      // the merged entities are picked up when the name index is rebuilt
+      is_name_index_dirty = true;
+
+      return merged;
+    }
+
+    std::vector<Entity> Scene::InstantiatePrefab(File& file, std::size_t count)
+    {
+      FLX_FLOW_FUNCTION();
+
+      std::shared_ptr<Scene> prefab = Internal_Load(file, Internal_GetFileType(file.path.get()));
+      if (prefab == nullptr)
+      {
+        Log::Error("Failed to load prefab " + file.path.string());
+        return {};
+      }
+
+      return Merge(*prefab, count);
+    }
+
+  }
+}
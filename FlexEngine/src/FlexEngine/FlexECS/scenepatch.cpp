@@ -0,0 +1,331 @@
+#include "datastructures.h"
+
+// Scene diff and patch
+//
+// Entities are matched by id. An entity whose archetype changed is removed and added again,
+// every other entity only records the component cells whose bytes changed.
+// Cells are compared column by column, the archetype has the same type in both scenes
+// so the column order is the same.
+//
+// Serialized patch:
+// uint64 count, EntityID * count                      removed
+// uint64 archetype count, per archetype:
+//   uint64 component count, string * component count  type
+//   uint64 count, EntityID * count                    added
+//   per column: uint64 count, (EntityID, string) * count
+// uint64 count, (uint64 index, string) * count        strings
+// uint64 string storage size
+// uint64 count, uint64 * count                        string storage free list
+// uint64 id next
+// uint64 count, uint64 * count                        id unused
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    #pragma region Internal Functions
+
+    // Compares the size and bytes of two components
+    static bool Internal_ComponentDataEquals(const ComponentData<void>& a, const ComponentData<void>& b)
+    {
+      std::size_t size_a = *reinterpret_cast<const std::size_t*>(a.get());
+      std::size_t size_b = *reinterpret_cast<const std::size_t*>(b.get());
+      return size_a == size_b && std::memcmp(Internal_GetComponentDataPtr(a), Internal_GetComponentDataPtr(b), size_a) == 0;
+    }
+
+    template <typename T>
+    static void Internal_AppendVector(std::string& out, const std::vector<T>& vec)
+    {
+      FlxBinWriter::Append<uint64_t>(out, vec.size());
+      FlxBinWriter::AppendBytes(out, vec.data(), vec.size() * sizeof(T));
+    }
+
+    // A count can't be larger than the bytes left, which guards the reserves against corrupted data
+    static std::size_t Internal_ReadCount(FlxBinCursor& cursor)
+    {
+      uint64_t count = cursor.Read<uint64_t>();
+      if (count > static_cast<uint64_t>(cursor.end - cursor.current))
+      {
+        cursor.ok = false;
+        return 0;
+      }
+      return static_cast<std::size_t>(count);
+    }
+
+    template <typename T>
+    static void Internal_ReadVector(FlxBinCursor& cursor, std::vector<T>& vec)
+    {
+      std::size_t count = Internal_ReadCount(cursor);
+      const char* bytes = cursor.ReadBytes(count * sizeof(T));
+      if (bytes == nullptr) return;
+
+      vec.resize(count);
+      std::memcpy(vec.data(), bytes, count * sizeof(T));
+    }
+
+    #pragma endregion
+
+    #pragma region ScenePatch
+
+    bool ScenePatch::IsEmpty() const
+    {
+      return removed.empty() && archetypes.empty() && strings.empty();
+    }
+
+    std::string ScenePatch::Serialize() const
+    {
+      std::string out;
+
+      Internal_AppendVector(out, removed);
+
+      FlxBinWriter::Append<uint64_t>(out, archetypes.size());
+      for (const ArchetypeDelta& delta : archetypes)
+      {
+        FlxBinWriter::Append<uint64_t>(out, delta.type.size());
+        for (const ComponentID& component : delta.type) FlxBinWriter::AppendString(out, component);
+
+        Internal_AppendVector(out, delta.added);
+
+        for (const ColumnDelta& column : delta.columns)
+        {
+          FlxBinWriter::Append<uint64_t>(out, column.entities.size());
+          for (std::size_t i = 0; i < column.entities.size(); i++)
+          {
+            FlxBinWriter::Append<EntityID>(out, column.entities[i]);
+            FlxBinWriter::AppendString(out, column.data[i]);
+          }
+        }
+      }
+
+      FlxBinWriter::Append<uint64_t>(out, strings.size());
+      for (const auto& [index, str] : strings)
+      {
+        FlxBinWriter::Append<uint64_t>(out, index);
+        FlxBinWriter::AppendString(out, str);
+      }
+      FlxBinWriter::Append<uint64_t>(out, string_storage_size);
+      Internal_AppendVector(out, string_storage_free_list);
+
+      FlxBinWriter::Append<uint64_t>(out, id_next);
+      Internal_AppendVector(out, id_unused);
+
+      return out;
+    }
+
+    bool ScenePatch::Deserialize(std::string_view data, ScenePatch& out)
+    {
+      FlxBinCursor cursor(data.data(), data.size());
+      out = ScenePatch();
+
+      Internal_ReadVector(cursor, out.removed);
+
+      std::size_t archetype_count = Internal_ReadCount(cursor);
+      out.archetypes.reserve(archetype_count);
+      for (std::size_t a = 0; a < archetype_count && cursor.ok; a++)
+      {
+        ArchetypeDelta& delta = out.archetypes.emplace_back();
+
+        std::size_t component_count = Internal_ReadCount(cursor);
+        delta.type.reserve(component_count);
+        for (std::size_t i = 0; i < component_count && cursor.ok; i++) delta.type.push_back(cursor.ReadString());
+
+        Internal_ReadVector(cursor, delta.added);
+
+        delta.columns.resize(delta.type.size());
+        for (ColumnDelta& column : delta.columns)
+        {
+          std::size_t count = Internal_ReadCount(cursor);
+          column.entities.reserve(count);
+          column.data.reserve(count);
+          for (std::size_t i = 0; i < count && cursor.ok; i++)
+          {
+            column.entities.push_back(cursor.Read<EntityID>());
+            column.data.push_back(cursor.ReadString());
+          }
+        }
+      }
+
+      std::size_t string_count = Internal_ReadCount(cursor);
+      out.strings.reserve(string_count);
+      for (std::size_t i = 0; i < string_count && cursor.ok; i++)
+      {
+        std::size_t index = static_cast<std::size_t>(cursor.Read<uint64_t>());
+        out.strings.emplace_back(index, cursor.ReadString());
+      }
+      out.string_storage_size = static_cast<std::size_t>(cursor.Read<uint64_t>());
+      Internal_ReadVector(cursor, out.string_storage_free_list);
+
+      out.id_next = cursor.Read<uint64_t>();
+      Internal_ReadVector(cursor, out.id_unused);
+
+      return cursor.ok;
+    }
+
+    #pragma endregion
+
+    #pragma region Scene Diff and Patch
+
+    ScenePatch Scene::Diff(const Scene& other) const
+    {
+      ScenePatch patch;
+
+      // gone, or moved to another archetype
+      for (const auto& [entity, record] : entity_index)
+      {
+        auto it = other.entity_index.find(entity);
+        if (it == other.entity_index.end() || it->second.archetype->type != record.archetype->type)
+        {
+          patch.removed.push_back(entity);
+        }
+      }
+
+      for (const auto& [type, archetype] : other.archetype_index)
+      {
+        if (archetype.entities.empty()) continue;
+
+        ScenePatch::ArchetypeDelta delta;
+        delta.type = type;
+        delta.columns.resize(type.size());
+        bool has_changes = false;
+
+        for (std::size_t row = 0; row < archetype.entities.size(); row++)
+        {
+          EntityID entity = archetype.entities[row];
+
+          // the same row in this scene, or nullptr if the entity is new here
+          auto it = entity_index.find(entity);
+          const Archetype* before = (it != entity_index.end() && it->second.archetype->type == type) ? it->second.archetype : nullptr;
+          if (before == nullptr) delta.added.push_back(entity);
+
+          for (std::size_t i = 0; i < archetype.archetype_table.size(); i++)
+          {
+            const ComponentData<void>& cell = archetype.archetype_table[i][row];
+            if (before != nullptr)
+            {
+              const ComponentData<void>& old_cell = before->archetype_table[i][it->second.row];
+              if (cell == old_cell || Internal_ComponentDataEquals(cell, old_cell)) continue;
+            }
+
+            std::size_t size = *reinterpret_cast<const std::size_t*>(cell.get());
+            delta.columns[i].entities.push_back(entity);
+            delta.columns[i].data.emplace_back(static_cast<const char*>(Internal_GetComponentDataPtr(cell)), size);
+            has_changes = true;
+          }
+        }
+
+        if (has_changes || !delta.added.empty()) patch.archetypes.push_back(std::move(delta));
+      }
+
+      // strings are compared slot by slot, freed slots keep their old string
+      for (std::size_t i = 0; i < other.string_storage.size(); i++)
+      {
+        if (i >= string_storage.size() || string_storage[i] != other.string_storage[i])
+        {
+          patch.strings.emplace_back(i, other.string_storage[i]);
+        }
+      }
+      patch.string_storage_size = other.string_storage.size();
+      patch.string_storage_free_list = other.string_storage_free_list;
+
+      patch.id_next = other._flx_id_next;
+      patch.id_unused = other._flx_id_unused;
+
+      return patch;
+    }
+
+    void Scene::Apply(const ScenePatch& patch)
+    {
+      // removed and moved entities are taken out the same way world streaming unloads a cell
+      std::vector<EntityID> removed;
+      removed.reserve(patch.removed.size());
+      for (EntityID entity : patch.removed)
+      {
+        if (entity_index.count(entity) != 0) removed.push_back(entity);
+      }
+      if (!removed.empty()) Internal_ExtractEntities(removed);
+
+      for (const ScenePatch::ArchetypeDelta& delta : patch.archetypes)
+      {
+        // guard: malformed delta
+        if (delta.columns.size() != delta.type.size())
+        {
+          Log::Error("Skipped a scene patch archetype with a column count mismatch.");
+          continue;
+        }
+
+        Archetype& archetype = Internal_FindOrCreateArchetype(delta.type);
+
+        // entities that have a component in each column
+        std::vector<std::unordered_set<EntityID>> column_entities(delta.added.empty() ? 0 : delta.columns.size());
+        for (std::size_t i = 0; i < column_entities.size(); i++)
+        {
+          column_entities[i].insert(delta.columns[i].entities.begin(), delta.columns[i].entities.end());
+        }
+
+        // empty rows, filled in from the columns below
+        for (EntityID entity : delta.added)
+        {
+          // guard: id collision
+          if (entity_index.count(entity) != 0)
+          {
+            Log::Warning("Skipped adding entity " + std::to_string(entity) + " from a scene patch because it already exists in the scene.");
+            continue;
+          }
+
+          // guard: a row with an empty cell would crash the next GetComponent()
+          bool is_complete = std::all_of(
+            column_entities.begin(), column_entities.end(),
+            [entity](const std::unordered_set<EntityID>& entities) { return entities.count(entity) != 0; }
+          );
+          if (!is_complete)
+          {
+            Log::Warning("Skipped adding entity " + std::to_string(entity) + " from a scene patch because some of its components are missing.");
+            continue;
+          }
+
+          for (Column& column : archetype.archetype_table) column.emplace_back();
+          archetype.entities.push_back(entity);
+          entity_index[entity] = { &archetype, archetype.id, archetype.entities.size() - 1 };
+        }
+
+        for (std::size_t i = 0; i < delta.columns.size(); i++)
+        {
+          const ScenePatch::ColumnDelta& column = delta.columns[i];
+          for (std::size_t j = 0; j < column.entities.size(); j++)
+          {
+            // guard: the patch was made for a different state of the scene
+            auto it = entity_index.find(column.entities[j]);
+            if (it == entity_index.end() || it->second.archetype != &archetype)
+            {
+              Log::Warning("Skipped a scene patch component of entity " + std::to_string(column.entities[j]) + " that isn't in the archetype.");
+              continue;
+            }
+
+            const std::string& data = column.data[j];
+            archetype.archetype_table[i][it->second.row] = Internal_CreateComponentData(data.size(), const_cast<char*>(data.data()));
+          }
+        }
+
+        // the replaced components invalidate cached component pointers
+        archetype.version++;
+      }
+
+      string_storage.resize(patch.string_storage_size);
+      for (const auto& [index, str] : patch.strings)
+      {
+        if (index < string_storage.size()) string_storage[index] = str;
+      }
+      string_storage_free_list = patch.string_storage_free_list;
+
+      _flx_id_next = patch.id_next;
+      _flx_id_unused = patch.id_unused;
+
+      // names may have changed
+      is_name_index_dirty = true;
+    }
+
+    #pragma endregion
+
+  }
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "datastructures.h" // <algorithm> <typeindex> <memory>
+
+#include <chrono>
+#include <limits>
+#include <vector>
+
+// Time-sliced iteration for systems that don't need to visit every entity every frame
+//
+// A TimeSlicedView remembers where it stopped, so each call to Run() continues from
+// there instead of starting over. Expensive systems such as AI evaluation or
+// visibility rebuilds can then be spread across frames with a per-frame budget.
+//
+// The cursor is an archetype id and a row. Rows are visited from the back to the front
+// because entity removal is swap-and-pop:
+// - Destroying the entity that is being visited moves an already visited entity into its row.
+// - Destroying any other entity between runs moves the last row, which is either already
+//   visited or gets visited again, so no entity that exists for the whole pass is skipped.
+// - New entities are appended to the back and are picked up by the next pass.
+// Archetypes are visited in order of their id, new archetypes join the current pass
+// if the cursor hasn't passed them yet.
+//
+// Usage:
+// // in the system, kept across frames
+// FlexECS::TimeSlicedView<Transform, AIState> ai_view;
+//
+// // every frame, at most 256 entities or 1 ms, whichever runs out first
+// ai_view.Run({ 256, 1.0 }, [](FlexECS::Entity entity)
+// {
+//   EvaluateAI(entity);
+// });
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    // Budget for one call to TimeSlicedView::Run()
+    // A limit of 0 means no limit. With both limits at 0, Run() finishes the current pass.
+    struct __FLX_API TimeSliceBudget
+    {
+      std::size_t max_entities = 0;
+      double max_milliseconds = 0.0;
+    };
+
+    template <typename... Ts>
+    class TimeSlicedView
+    {
+    public:
+      // Visits entities with all the components until the budget runs out or the pass ends.
+      // A single call never visits an entity twice, it stops at the end of a pass.
+      // Fn signature: void(FlexECS::Entity)
+      // Returns the number of entities visited.
+      template <typename Fn>
+      std::size_t Run(const TimeSliceBudget& budget, Fn&& fn);
+
+      // Starts the next Run() from the beginning of a new pass
+      void Reset() { m_has_cursor = false; }
+
+      // True if the last Run() reached the end of a pass
+      bool IsPassComplete() const { return m_pass_complete; }
+
+      // Number of passes completed since the view was created
+      std::size_t GetPassCount() const { return m_pass_count; }
+
+    private:
+      // Matching archetypes of the active scene, sorted by id
+      std::vector<Archetype*> Internal_GetArchetypes() const;
+
+      bool m_has_cursor = false;
+      ArchetypeID m_archetype_id = 0;
+      std::size_t m_row = 0;            // next row to visit is m_row - 1
+
+      bool m_pass_complete = false;
+      std::size_t m_pass_count = 0;
+    };
+
+    #pragma region Template Implementations
+
+    template <typename... Ts>
+    std::vector<Archetype*> TimeSlicedView<Ts...>::Internal_GetArchetypes() const
+    {
+      std::vector<Archetype*> archetypes;
+
+      for (auto& [type, archetype] : ARCHETYPE_INDEX)
+      {
+        // same check as Scene::View
+        bool has_requested_components = (
+          (std::find(
+            archetype.type.begin(),
+            archetype.type.end(),
+            Reflection::TypeResolver<Ts>::Get()->name
+          ) != archetype.type.end()) && ...
+        );
+
+        if (has_requested_components) archetypes.push_back(&archetype);
+      }
+
+      // the archetype index is unordered, the id gives a stable order across frames
+      std::sort(archetypes.begin(), archetypes.end(), [](const Archetype* a, const Archetype* b) { return a->id < b->id; });
+
+      return archetypes;
+    }
+
+    template <typename... Ts>
+    template <typename Fn>
+    std::size_t TimeSlicedView<Ts...>::Run(const TimeSliceBudget& budget, Fn&& fn)
+    {
+      using Clock = std::chrono::steady_clock;
+
+      std::size_t max_entities = (budget.max_entities == 0) ? (std::numeric_limits<std::size_t>::max)() : budget.max_entities;
+      bool is_timed = budget.max_milliseconds > 0.0;
+      Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(budget.max_milliseconds)
+      );
+
+      m_pass_complete = false;
+
+      // Archetype references stay valid while fn runs, archetypes are never removed
+      // and the archetype index doesn't move its elements when it grows.
+      std::vector<Archetype*> archetypes = Internal_GetArchetypes();
+
+      // resume from the cursor
+      // If the archetype of the cursor doesn't match anymore, continue from the next id.
+      std::size_t index = 0;
+      std::size_t row = 0;
+      if (m_has_cursor)
+      {
+        while (index < archetypes.size() && archetypes[index]->id < m_archetype_id) index++;
+        if (index < archetypes.size())
+        {
+          std::size_t size = archetypes[index]->entities.size();
+          row = (archetypes[index]->id == m_archetype_id) ? (std::min)(m_row, size) : size;
+        }
+      }
+      else if (!archetypes.empty())
+      {
+        row = archetypes[0]->entities.size();
+      }
+
+      std::size_t visited = 0;
+      while (visited < max_entities)
+      {
+        // move to the next archetype once the current one is done
+        while (index < archetypes.size() && row == 0)
+        {
+          index++;
+          if (index < archetypes.size()) row = archetypes[index]->entities.size();
+        }
+
+        // end of the pass
+        if (index >= archetypes.size())
+        {
+          m_pass_complete = true;
+          m_pass_count++;
+          m_has_cursor = false;
+          return visited;
+        }
+
+        Archetype& archetype = *archetypes[index];
+        row--;
+        fn(Entity(archetype.entities[row]));
+        visited++;
+
+        // fn may have destroyed entities in this archetype
+        row = (std::min)(row, archetype.entities.size());
+
+        if (is_timed && Clock::now() >= deadline) break;
+      }
+
+      // save the cursor for the next run
+      m_has_cursor = true;
+      m_archetype_id = archetypes[index]->id;
+      m_row = row;
+
+      return visited;
+    }
+
+    #pragma endregion
+
+  }
+}
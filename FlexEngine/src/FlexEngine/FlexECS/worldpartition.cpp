@@ -0,0 +1,451 @@
+#include "worldpartition.h"
+
+#include <cmath> // std::floor
+#include <cstdio> // std::sscanf
+#include <fstream>
+#include <limits>
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    #pragma region Constructors
+
+    WorldPartition::WorldPartition(std::shared_ptr<Scene> scene, const Path& directory, const Settings& settings)
+      : m_scene(scene), m_directory(directory), m_settings(settings)
+    {
+      // guard: the radii would make cells load and unload every update
+      if (m_settings.unload_radius < m_settings.load_radius)
+      {
+        Log::Warning("WorldPartition: unload_radius is smaller than load_radius, using load_radius.");
+        m_settings.unload_radius = m_settings.load_radius;
+      }
+
+      std::error_code ec;
+      std::filesystem::create_directories(m_directory.get(), ec);
+
+      // pick up the cells from a previous session
+      for (const auto& entry : std::filesystem::directory_iterator(m_directory.get(), ec))
+      {
+        if (entry.path().extension() != ".flxscene") continue;
+
+        CellCoord cell;
+        std::string stem = entry.path().stem().string();
+        if (std::sscanf(stem.c_str(), "cell_%d_%d_%d", &cell.x, &cell.y, &cell.z) != 3) continue;
+
+        m_cells[cell].on_disk = true;
+      }
+
+      m_worker = std::thread(&WorldPartition::Internal_WorkerLoop, this);
+    }
+
+    WorldPartition::~WorldPartition()
+    {
+      // the scene may be saved without the partition, the cells have to be on disk
+      UnloadAll();
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_job_available.notify_one();
+      m_worker.join();
+    }
+
+    #pragma endregion
+
+    #pragma region Streaming
+
+    void WorldPartition::Update(const Vector3& focus)
+    {
+      FLX_FLOW_FUNCTION();
+
+      FLX_ASSERT(m_get_position != nullptr, "WorldPartition: SetPositionComponent must be called before Update.");
+
+      Internal_ProcessCompletedJobs(m_settings.max_merges_per_update);
+
+      m_focus_cell = GetCell(focus);
+
+      std::unordered_map<CellCoord, std::vector<EntityID>> buckets = Internal_BucketEntities();
+
+      // cells that have entities but nothing on disk are resident, e.g. every cell on the first update
+      for (auto& [cell, entities] : buckets)
+      {
+        Cell& info = m_cells[cell];
+        if (info.state == CellState::Unloaded && !info.on_disk) info.state = CellState::Resident;
+      }
+
+      // unload the cells that are out of range
+      // Entities in a cell that isn't resident are strays, they are appended to the cell file.
+      for (auto& [cell, entities] : buckets)
+      {
+        if (Internal_CellDistance(cell, m_focus_cell) <= m_settings.unload_radius) continue;
+        if (m_cells[cell].state == CellState::Loading) continue; // wait for the load to be merged first
+
+        Internal_UnloadCell(cell, entities);
+      }
+      for (auto& [cell, info] : m_cells)
+      {
+        if (info.state != CellState::Resident) continue;
+        if (Internal_CellDistance(cell, m_focus_cell) <= m_settings.unload_radius) continue;
+
+        // every entity left the cell
+        Internal_UnloadCell(cell, {});
+      }
+
+      // sort by distance, ties are broken by coordinates so that loading and evicting agree
+      auto closer = [this](const CellCoord& a, const CellCoord& b)
+      {
+        int distance_a = Internal_CellDistance(a, m_focus_cell);
+        int distance_b = Internal_CellDistance(b, m_focus_cell);
+        if (distance_a != distance_b) return distance_a < distance_b;
+        if (a.x != b.x) return a.x < b.x;
+        if (a.y != b.y) return a.y < b.y;
+        return a.z < b.z;
+      };
+
+      // enforce the budget by evicting the farthest resident cells
+      std::vector<CellCoord> resident;
+      std::size_t loading_count = 0;
+      for (auto& [cell, info] : m_cells)
+      {
+        if (info.state == CellState::Resident) resident.push_back(cell);
+        else if (info.state == CellState::Loading) loading_count++;
+      }
+      if (resident.size() + loading_count > m_settings.max_resident_cells)
+      {
+        std::sort(resident.begin(), resident.end(), closer);
+        while (!resident.empty() && resident.size() + loading_count > m_settings.max_resident_cells)
+        {
+          CellCoord cell = resident.back();
+          resident.pop_back();
+
+          auto bucket_it = buckets.find(cell);
+          Internal_UnloadCell(cell, (bucket_it != buckets.end()) ? bucket_it->second : std::vector<EntityID>());
+        }
+      }
+
+      // load the closest cells in range that are on disk, as long as the budget allows
+      std::vector<CellCoord> to_load;
+      for (auto& [cell, info] : m_cells)
+      {
+        if (info.state != CellState::Unloaded || !info.on_disk) continue;
+        if (Internal_CellDistance(cell, m_focus_cell) > m_settings.load_radius) continue;
+        to_load.push_back(cell);
+      }
+      std::sort(to_load.begin(), to_load.end(), closer);
+      for (const CellCoord& cell : to_load)
+      {
+        if (resident.size() + loading_count >= m_settings.max_resident_cells) break;
+
+        m_cells[cell].state = CellState::Loading;
+        loading_count++;
+
+        Job job;
+        job.type = JobType::Load;
+        job.cell = cell;
+        Internal_QueueJob(std::move(job));
+      }
+    }
+
+    void WorldPartition::Flush()
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobs_done.wait(lock, [this]() { return m_jobs_in_flight == 0; });
+      }
+
+      Internal_ProcessCompletedJobs(std::numeric_limits<std::size_t>::max());
+    }
+
+    void WorldPartition::UnloadAll()
+    {
+      FLX_FLOW_FUNCTION();
+
+      // merge pending loads first, otherwise they would be lost
+      Flush();
+
+      std::unordered_map<CellCoord, std::vector<EntityID>> buckets = Internal_BucketEntities();
+      for (auto& [cell, entities] : buckets) Internal_UnloadCell(cell, entities);
+      for (auto& [cell, info] : m_cells)
+      {
+        if (info.state == CellState::Resident) Internal_UnloadCell(cell, {});
+      }
+
+      // wait for the saves and put back the entities of any save that failed
+      Flush();
+    }
+
+    CellCoord WorldPartition::GetCell(const Vector3& position) const
+    {
+      auto to_cell = [](float value, float cell_size)
+      {
+        return (cell_size > 0.0f) ? static_cast<int>(std::floor(value / cell_size)) : 0;
+      };
+
+      return {
+        to_cell(position.x, m_settings.cell_size.x),
+        to_cell(position.y, m_settings.cell_size.y),
+        to_cell(position.z, m_settings.cell_size.z)
+      };
+    }
+
+    bool WorldPartition::IsResident(const CellCoord& cell) const
+    {
+      auto it = m_cells.find(cell);
+      return it != m_cells.end() && it->second.state == CellState::Resident;
+    }
+
+    std::size_t WorldPartition::GetResidentCellCount() const
+    {
+      std::size_t count = 0;
+      for (auto& [cell, info] : m_cells)
+      {
+        if (info.state == CellState::Resident) count++;
+      }
+      return count;
+    }
+
+    #pragma endregion
+
+    #pragma region Internal Functions
+
+    std::unordered_map<CellCoord, std::vector<EntityID>> WorldPartition::Internal_BucketEntities() const
+    {
+      std::unordered_map<CellCoord, std::vector<EntityID>> buckets;
+
+      auto component_it = m_scene->component_index.find(m_position_component);
+      if (component_it == m_scene->component_index.end()) return buckets;
+
+      for (auto& [type, archetype] : m_scene->archetype_index)
+      {
+        auto archetype_it = component_it->second.find(archetype.id);
+        if (archetype_it == component_it->second.end()) continue;
+
+        const Column& column = archetype.archetype_table[archetype_it->second.column];
+        for (std::size_t row = 0; row < archetype.entities.size(); row++)
+        {
+          const Vector3& position = m_get_position(Internal_GetComponentDataPtr(column[row]));
+          buckets[GetCell(position)].push_back(archetype.entities[row]);
+        }
+      }
+
+      return buckets;
+    }
+
+    void WorldPartition::Internal_UnloadCell(const CellCoord& cell, const std::vector<EntityID>& entities)
+    {
+      Cell& info = m_cells[cell];
+
+      // every entity left a resident cell, its file has to go so that they aren't loaded twice
+      if (entities.empty())
+      {
+        if (info.state == CellState::Resident && info.on_disk)
+        {
+          Job job;
+          job.type = JobType::Save;
+          job.cell = cell;
+          job.scene = std::make_shared<Scene>();
+          Internal_QueueJob(std::move(job));
+          info.on_disk = false;
+        }
+        info.state = CellState::Unloaded;
+        return;
+      }
+
+      Job job;
+      // a resident cell has all of its entities in the scene, otherwise the file has entities too
+      job.type = (info.state == CellState::Resident) ? JobType::Save : JobType::Append;
+      job.cell = cell;
+      job.scene = m_scene->Internal_ExtractEntities(entities);
+      Internal_QueueJob(std::move(job));
+
+      info.state = CellState::Unloaded;
+      info.on_disk = true;
+    }
+
+    void WorldPartition::Internal_ProcessCompletedJobs(std::size_t max_merges)
+    {
+      std::size_t merges = 0;
+
+      while (true)
+      {
+        Job job;
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if (m_completed_jobs.empty()) break;
+          if (m_completed_jobs.front().type == JobType::Load && merges >= max_merges) break;
+
+          job = std::move(m_completed_jobs.front());
+          m_completed_jobs.pop_front();
+        }
+
+        Cell& info = m_cells[job.cell];
+
+        if (!job.warning.empty()) Log::Warning("WorldPartition: " + job.warning);
+
+        if (!job.error.empty())
+        {
+          Log::Error("WorldPartition: " + job.error);
+
+          if (job.type == JobType::Load)
+          {
+            // leave the file alone and stop retrying it
+            info.state = CellState::Unloaded;
+            info.on_disk = false;
+          }
+          else
+          {
+            // the entities were not written, put them back so they aren't lost
+            m_scene->Internal_MergeEntities(*job.scene);
+          }
+          continue;
+        }
+
+        if (job.type == JobType::Load)
+        {
+          // the file is kept until the cell is saved, it is never loaded again while resident
+          m_scene->Internal_MergeEntities(*job.scene);
+          info.state = CellState::Resident;
+          merges++;
+        }
+      }
+    }
+
+    void WorldPartition::Internal_QueueJob(Job&& job)
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending_jobs.push_back(std::move(job));
+        m_jobs_in_flight++;
+      }
+      m_job_available.notify_one();
+    }
+
+    void WorldPartition::Internal_WorkerLoop()
+    {
+      while (true)
+      {
+        Job job;
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_job_available.wait(lock, [this]() { return m_stop || !m_pending_jobs.empty(); });
+          if (m_pending_jobs.empty()) return; // stopped
+
+          job = std::move(m_pending_jobs.front());
+          m_pending_jobs.pop_front();
+        }
+
+        Internal_RunJob(job);
+
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_completed_jobs.push_back(std::move(job));
+          m_jobs_in_flight--;
+        }
+        m_jobs_done.notify_all();
+      }
+    }
+
+    // Runs on the worker thread.
+    // Only touches the job and the cell file, never the scene that is being streamed into.
+    // Problems are reported in the job, the logger isn't thread-safe.
+    void WorldPartition::Internal_RunJob(Job& job)
+    {
+      std::filesystem::path path = Internal_GetCellPath(job.cell);
+
+      // reads and deserializes the cell file
+      auto read_cell = [&job](const std::filesystem::path& file_path) -> std::shared_ptr<Scene>
+      {
+        std::ifstream stream(file_path, std::ios::binary);
+        if (!stream)
+        {
+          job.error = "Failed to open " + file_path.string();
+          return nullptr;
+        }
+        std::string file_data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+        // the buffer is thrown away afterwards, so the data is parsed in place
+        FlxFmtFileView flxfmtfile = FlexFormatter::ParseView(file_data, FlxFmtFileType::Scene, true);
+        std::shared_ptr<Scene> scene = flxfmtfile.IsNull() ? nullptr : Scene::Internal_DeserializeInSitu(
+          file_data.data() + (flxfmtfile.data.data() - file_data.data()), flxfmtfile.data.size()
+        );
+        if (scene == nullptr) job.error = "Failed to parse " + file_path.string();
+        return scene;
+      };
+
+      switch (job.type)
+      {
+      case JobType::Load:
+      {
+        job.scene = read_cell(path);
+        break;
+      }
+      case JobType::Append:
+      case JobType::Save:
+      {
+        std::shared_ptr<Scene> to_write = job.scene;
+
+        // a cell that was emptied has nothing to load anymore
+        std::error_code ec;
+        if (job.type == JobType::Save && to_write->entity_index.empty())
+        {
+          std::filesystem::remove(path, ec);
+          if (ec) job.error = "Failed to remove " + path.string() + ": " + ec.message();
+          break;
+        }
+
+        if (job.type == JobType::Append && std::filesystem::exists(path, ec))
+        {
+          to_write = read_cell(path);
+          if (to_write == nullptr) return;
+
+          // remember which entities came from the job, so that they can be handed back on failure
+          std::vector<EntityID> appended;
+          appended.reserve(job.scene->entity_index.size());
+          for (auto& [entity, record] : job.scene->entity_index) appended.push_back(entity);
+
+          // entities that are already in the file keep the version in the file
+          std::vector<EntityID> skipped;
+          to_write->Internal_MergeEntities(*job.scene, &skipped);
+          if (!skipped.empty()) job.warning = "Skipped " + std::to_string(skipped.size()) + " entities that already exist in " + path.string();
+          job.scene = nullptr;
+          job.appended = std::move(appended);
+        }
+
+        if (!Internal_WriteCell(path, *to_write, job.error) && job.scene == nullptr)
+        {
+          // the appended entities are all in to_write, but don't log from this thread if one isn't
+          std::vector<EntityID> missing;
+          job.scene = to_write->Internal_ExtractEntities(job.appended, &missing);
+          if (!missing.empty()) job.error += ", " + std::to_string(missing.size()) + " entities couldn't be handed back";
+        }
+        break;
+      }
+      }
+    }
+
+    // Runs on the worker thread.
+    bool WorldPartition::Internal_WriteCell(const std::filesystem::path& path, Scene& scene, std::string& error)
+    {
+      std::string data = FlexFormatter::Create(scene.Internal_Serialize(), true).Save();
+      error = Scene::Internal_WriteFileAtomic(path, data);
+      return error.empty();
+    }
+
+    std::filesystem::path WorldPartition::Internal_GetCellPath(const CellCoord& cell) const
+    {
+      return m_directory.get() /
+        ("cell_" + std::to_string(cell.x) + "_" + std::to_string(cell.y) + "_" + std::to_string(cell.z) + ".flxscene");
+    }
+
+    int WorldPartition::Internal_CellDistance(const CellCoord& a, const CellCoord& b)
+    {
+      return (std::max)({ std::abs(a.x - b.x), std::abs(a.y - b.y), std::abs(a.z - b.z) });
+    }
+
+    #pragma endregion
+
+  }
+}
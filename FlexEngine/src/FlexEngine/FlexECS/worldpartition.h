@@ -0,0 +1,228 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "datastructures.h" // <algorithm> <typeindex> <memory>
+#include "FlexMath/vector3.h"
+#include "Wrapper/path.h" // <filesystem> <iostream> <string> <exception> <unordered_map> <set>
+
+#include <condition_variable>
+#include <deque>
+#include <functional> // std::function, std::hash
+#include <mutex>
+#include <thread>
+
+// World partitioning for scenes that are too large to keep resident
+//
+// Entities that have the position component are bucketed into grid cells.
+// Every cell is stored in its own FlexFormat scene file in the partition directory,
+// named cell_x_y_z.flxscene.
+//
+// Update() is called once per frame with the focus point (usually the camera).
+// - Cells within load_radius of the focus are loaded on the background thread,
+//   then merged into the scene on the main thread, at most max_merges_per_update per call.
+// - Cells beyond unload_radius are extracted from the scene on the main thread
+//   and written to disk on the background thread.
+// - Entities that moved into a cell that isn't resident are appended to that cell's file.
+// - If more than max_resident_cells are resident, the farthest cells are unloaded.
+//
+// The cell file stays on disk while the cell is resident and is overwritten when it is unloaded,
+// so a crash only loses the changes made since the cell was loaded.
+// The destructor unloads every resident cell.
+//
+// The radii are in cells, measured as the largest distance on any axis.
+// Keep unload_radius larger than load_radius so that cells don't thrash at the border.
+//
+// Entities without the position component are never streamed.
+// Streamed entities keep their ids, the ids are not released while the entity is on disk.
+// Strings such as entity names stay in the owning scene's string storage,
+// so the cell files must be loaded together with the scene they were partitioned from.
+//
+// Usage:
+// FlexECS::WorldPartition world(scene, Path::current("saves/world"));
+// world.SetPositionComponent(&GlobalPosition::position);
+// world.Update(camera_position); // every frame
+// world.UnloadAll();              // before saving the scene
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    // Integer coordinates of a cell in the grid
+    struct __FLX_API CellCoord
+    {
+      int x = 0;
+      int y = 0;
+      int z = 0;
+
+      bool operator==(const CellCoord& other) const { return x == other.x && y == other.y && z == other.z; }
+      bool operator!=(const CellCoord& other) const { return !(*this == other); }
+    };
+
+  }
+}
+
+namespace std
+{
+  template <>
+  struct hash<FlexEngine::FlexECS::CellCoord>
+  {
+    std::size_t operator()(const FlexEngine::FlexECS::CellCoord& coord) const
+    {
+      // large primes to spread the cells across the buckets
+      return
+        (static_cast<std::size_t>(coord.x) * 73856093) ^
+        (static_cast<std::size_t>(coord.y) * 19349663) ^
+        (static_cast<std::size_t>(coord.z) * 83492791);
+    }
+  };
+}
+
+namespace FlexEngine
+{
+  namespace FlexECS
+  {
+
+    // Settings for WorldPartition, declared outside the class so that the defaults
+    // can be used as a default argument of the constructor.
+    struct __FLX_API WorldPartitionSettings
+    {
+      // Size of a cell in world units.
+      // An axis with a size of 0 is not partitioned, e.g. (64, 0, 64) for a flat world.
+      Vector3 cell_size = Vector3(64.0f, 64.0f, 64.0f);
+
+      int load_radius = 1;
+      int unload_radius = 2;
+
+      // Budget for the number of cells that have entities in the scene.
+      std::size_t max_resident_cells = 27;
+
+      // Loaded cells are merged into the scene on the main thread.
+      // This caps the cost of Update() when many cells finish loading at once.
+      std::size_t max_merges_per_update = 2;
+    };
+
+    class __FLX_API WorldPartition
+    {
+    public:
+      using Settings = WorldPartitionSettings;
+
+      // The directory is created if it doesn't exist.
+      // Existing cell files in the directory are picked up as unloaded cells.
+      WorldPartition(std::shared_ptr<Scene> scene, const Path& directory, const Settings& settings = Settings());
+
+      // Unloads every resident cell, see UnloadAll(), and waits for the writes to finish
+      ~WorldPartition();
+
+      WorldPartition(const WorldPartition&) = delete;
+      WorldPartition& operator=(const WorldPartition&) = delete;
+
+      // Sets the component used to bucket entities.
+      // Usage: world.SetPositionComponent(&GlobalPosition::position);
+      template <typename T>
+      void SetPositionComponent(Vector3 T::* member)
+      {
+        m_position_component = Reflection::TypeResolver<T>::Get()->name;
+        m_get_position = [member](const void* data) -> const Vector3&
+        {
+          return static_cast<const T*>(data)->*member;
+        };
+      }
+
+      // Streams cells in and out around the focus point.
+      void Update(const Vector3& focus);
+
+      // Blocks until every queued job is done and merges every loaded cell, ignoring max_merges_per_update.
+      void Flush();
+
+      // Writes every positioned entity to its cell file and removes them from the scene.
+      // Use this before saving the scene so that the scene file only has the unpartitioned entities.
+      void UnloadAll();
+
+      // Returns the cell that contains the position
+      CellCoord GetCell(const Vector3& position) const;
+
+      bool IsResident(const CellCoord& cell) const;
+      std::size_t GetResidentCellCount() const;
+
+      const Settings& GetSettings() const { return m_settings; }
+
+    private:
+      enum class CellState
+      {
+        Unloaded,   // on disk or empty
+        Loading,    // load job queued, waiting to be merged
+        Resident    // the entities are in the scene
+      };
+
+      struct Cell
+      {
+        CellState state = CellState::Unloaded;
+        bool on_disk = false;
+      };
+
+      enum class JobType
+      {
+        Load,     // read the file, it stays on disk until the cell is saved
+        Save,     // overwrite the file with the scene, an empty scene removes the file
+        Append    // merge the scene into the file
+      };
+
+      struct Job
+      {
+        JobType type = JobType::Load;
+        CellCoord cell;
+        std::shared_ptr<Scene> scene;   // input for Save and Append, output for Load
+                                        // on failure, holds the entities that were not written
+        std::vector<EntityID> appended; // used by Append to hand the entities back on failure
+        std::string error;              // set by the worker, logged on the main thread
+        std::string warning;            // the same, but the job still succeeded
+      };
+
+      // Buckets the positioned entities that are in the scene
+      std::unordered_map<CellCoord, std::vector<EntityID>> Internal_BucketEntities() const;
+
+      // Extracts the entities and queues a Save or Append job
+      void Internal_UnloadCell(const CellCoord& cell, const std::vector<EntityID>& entities);
+
+      // Merges completed loads and logs errors and warnings, up to max_merges
+      void Internal_ProcessCompletedJobs(std::size_t max_merges);
+
+      void Internal_QueueJob(Job&& job);
+      void Internal_WorkerLoop();
+      void Internal_RunJob(Job& job);
+
+      // Replaces the cell file with the scene, see Scene::Internal_WriteFileAtomic()
+      static bool Internal_WriteCell(const std::filesystem::path& path, Scene& scene, std::string& error);
+
+      // Returns a std::filesystem::path since the worker thread uses it directly
+      std::filesystem::path Internal_GetCellPath(const CellCoord& cell) const;
+
+      // Distance in cells, the largest distance on any axis
+      static int Internal_CellDistance(const CellCoord& a, const CellCoord& b);
+
+      std::shared_ptr<Scene> m_scene;
+      Path m_directory;
+      Settings m_settings;
+
+      ComponentID m_position_component;
+      std::function<const Vector3&(const void*)> m_get_position;
+
+      std::unordered_map<CellCoord, Cell> m_cells;
+      CellCoord m_focus_cell;
+
+      // Worker thread
+      // Jobs run in the order they are queued, so a load always sees the save before it.
+      std::thread m_worker;
+      std::mutex m_mutex;
+      std::condition_variable m_job_available;
+      std::condition_variable m_jobs_done;
+      std::deque<Job> m_pending_jobs;
+      std::deque<Job> m_completed_jobs;
+      std::size_t m_jobs_in_flight = 0;   // queued or running
+      bool m_stop = false;
+    };
+
+  }
+}
@@ -103,14 +103,6 @@ namespace FlexEngine
     m3 = _m3;
   }
 
-  Matrix4x4::Matrix4x4(const Matrix4x4& other)
-  {
-    m00 = other.m00; m01 = other.m01; m02 = other.m02; m03 = other.m03;
-    m10 = other.m10; m11 = other.m11; m12 = other.m12; m13 = other.m13;
-    m20 = other.m20; m21 = other.m21; m22 = other.m22; m23 = other.m23;
-    m30 = other.m30; m31 = other.m31; m32 = other.m32; m33 = other.m33;
-  }
-
   #pragma endregion
 
   #pragma region Operator Overloading
@@ -122,15 +114,6 @@ namespace FlexEngine
 
   //Matrix4x4 Matrix4x4::operator-() const;
 
-  Matrix4x4& Matrix4x4::operator=(const Matrix4x4& other)
-  {
-    m00 = other.m00; m01 = other.m01; m02 = other.m02; m03 = other.m03;
-    m10 = other.m10; m11 = other.m11; m12 = other.m12; m13 = other.m13;
-    m20 = other.m20; m21 = other.m21; m22 = other.m22; m23 = other.m23;
-    m30 = other.m30; m31 = other.m31; m32 = other.m32; m33 = other.m33;
-    return *this;
-  }
-
   Matrix4x4& Matrix4x4::operator+=(const Matrix4x4& other)
   {
     return *this = *this + other;
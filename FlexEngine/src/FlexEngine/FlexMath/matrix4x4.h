@@ -87,7 +87,7 @@ namespace FlexEngine
       const Vector4& _m2 = Vector4::Zero,
       const Vector4& _m3 = Vector4::Zero
     );
-    Matrix4x4(const Matrix4x4& other);
+    Matrix4x4(const Matrix4x4& other) = default;
 
 #pragma endregion
 
@@ -100,7 +100,7 @@ namespace FlexEngine
 
     //Matrix4x4 operator-() const;
 
-    Matrix4x4& operator=(const Matrix4x4& other);
+    Matrix4x4& operator=(const Matrix4x4& other) = default;
 
     Matrix4x4& operator+=(const Matrix4x4& other);
     //Matrix4x4& operator+=(const_value_type value);
@@ -155,14 +155,6 @@ namespace FlexEngine
     w = _w;
   }
 
-  Quaternion::Quaternion(const Quaternion& other)
-  {
-    x = other.x;
-    y = other.y;
-    z = other.z;
-    w = other.w;
-  }
-
   Quaternion::Quaternion(const Vector4& other)
   {
     x = other.x;
@@ -207,15 +199,6 @@ namespace FlexEngine
     return { -x, -y, -z, -w };
   }
 
-  Quaternion& Quaternion::operator=(const Quaternion& other)
-  {
-    this->x = other.x;
-    this->y = other.y;
-    this->z = other.z;
-    this->w = other.w;
-    return *this;
-  }
-
   Quaternion& Quaternion::operator+=(const Quaternion& other)
   {
     this->x += other.x;
@@ -84,7 +84,7 @@ namespace FlexEngine
 #pragma region Constructors
 
     Quaternion(value_type _x = 0.0f, value_type _y = 0.0f, value_type _z = 0.0f, value_type _w = 0.0f);
-    Quaternion(const Quaternion& other);
+    Quaternion(const Quaternion& other) = default;
 
     Quaternion(const Vector4& other);
 
@@ -102,7 +102,7 @@ namespace FlexEngine
 
     Quaternion operator-() const;
 
-    Quaternion& operator=(const Quaternion& other);
+    Quaternion& operator=(const Quaternion& other) = default;
 
     Quaternion& operator+=(const Quaternion& other);
     Quaternion& operator+=(const_value_type value);
@@ -66,12 +66,6 @@ namespace FlexEngine
     y = _y;
   }
 
-  Vector2::Vector2(const Vector2& other)
-  {
-    x = other.x;
-    y = other.y;
-  }
-
 #pragma endregion
 
 #pragma region Operator Overloading
@@ -86,13 +80,6 @@ namespace FlexEngine
     return { -x, -y };
   }
 
-  Vector2& Vector2::operator=(const Vector2& other)
-  {
-    x = other.x;
-    y = other.y;
-    return *this;
-  }
-
   Vector2& Vector2::operator+=(const Vector2& other)
   {
     x += other.x;
@@ -85,7 +85,7 @@ namespace FlexEngine
 #pragma region Constructors
 
     Vector2(value_type _x = 0.0f, value_type _y = 0.0f);
-    Vector2(const Vector2& other);
+    Vector2(const Vector2& other) = default;
 
 #pragma endregion
 
@@ -98,7 +98,7 @@ namespace FlexEngine
 
     Vector2 operator-() const;
 
-    Vector2& operator=(const Vector2& other);
+    Vector2& operator=(const Vector2& other) = default;
 
     Vector2& operator+=(const Vector2& other);
     Vector2& operator+=(const_value_type value);
@@ -74,13 +74,6 @@ namespace FlexEngine
     z = _z;
   }
 
-  Vector3::Vector3(const Vector3& other)
-  {
-    x = other.x;
-    y = other.y;
-    z = other.z;
-  }
-
   Vector3::Vector3(const Vector2& xy, value_type _z)
   {
     x = xy.x;
@@ -109,14 +102,6 @@ namespace FlexEngine
     return { -x, -y, -z };
   }
 
-  Vector3& Vector3::operator=(const Vector3& other)
-  {
-    x = other.x;
-    y = other.y;
-    z = other.z;
-    return *this;
-  }
-
   Vector3& Vector3::operator+=(const Vector3& other)
   {
     x += other.x;
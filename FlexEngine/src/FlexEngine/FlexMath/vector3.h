@@ -84,7 +84,7 @@ namespace FlexEngine
 #pragma region Constructors
 
     Vector3(value_type _x = 0.0f, value_type _y = 0.0f, value_type _z = 0.0f);
-    Vector3(const Vector3& other);
+    Vector3(const Vector3& other) = default;
     Vector3(const Vector2& xy, value_type _z = 0.0f);
     Vector3(value_type _x, const Vector2& yz);
 
@@ -99,7 +99,7 @@ namespace FlexEngine
 
     Vector3 operator-() const;
 
-    Vector3& operator=(const Vector3& other);
+    Vector3& operator=(const Vector3& other) = default;
 
     Vector3& operator+=(const Vector3& other);
     Vector3& operator+=(const_value_type value);
@@ -70,14 +70,6 @@ namespace FlexEngine
     w = _w;
   }
 
-  Vector4::Vector4(const Vector4& other)
-  {
-    x = other.x;
-    y = other.y;
-    z = other.z;
-    w = other.w;
-  }
-
   Vector4::Vector4(const Vector3& xyz, value_type _w)
   {
     x = xyz.x;
@@ -140,15 +132,6 @@ namespace FlexEngine
     return { -x, -y, -z, -w };
   }
 
-  Vector4& Vector4::operator=(const Vector4& other)
-  {
-    x = other.x;
-    y = other.y;
-    z = other.z;
-    w = other.w;
-    return *this;
-  }
-
   Vector4& Vector4::operator+=(const Vector4& other)
   {
     x += other.x;
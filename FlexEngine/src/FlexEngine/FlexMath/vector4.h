@@ -72,7 +72,7 @@ namespace FlexEngine
 #pragma region Constructors
 
     Vector4(value_type _x = 0.0f, value_type _y = 0.0f, value_type _z = 0.0f, value_type _w = 0.0f);
-    Vector4(const Vector4& other);
+    Vector4(const Vector4& other) = default;
 
     Vector4(const Vector3& xyz, value_type _w = 0.0f);
     Vector4(value_type _x, const Vector3& yzw);
@@ -93,7 +93,7 @@ namespace FlexEngine
 
     Vector4 operator-() const;
 
-    Vector4& operator=(const Vector4& other);
+    Vector4& operator=(const Vector4& other) = default;
 
     Vector4& operator+=(const Vector4& other);
     Vector4& operator+=(const_value_type value);
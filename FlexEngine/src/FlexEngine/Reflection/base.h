@@ -4,16 +4,27 @@
 
 #include "Wrapper/flexassert.h"
 #include "Wrapper/flexbase64.h"
+#include "Reflection/jsonreader.h" // <rapidjson/document.h> <rapidjson/reader.h>
+#include "Reflection/jsonwriter.h" // <rapidjson/stringbuffer.h> <rapidjson/writer.h>
+#include "Reflection/program.h"
+#include "Reflection/patch.h"
+#include "Reflection/schema.h"
 
 #include <rapidjson/document.h>
 using namespace rapidjson;
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcpy
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <type_traits>
 #include <vector>
 #include <map>
+#include <new> // placement new
+#include <atomic>
+#include <mutex> // std::call_once, std::recursive_mutex
 #include <unordered_map>
 #include <functional>
 
@@ -64,6 +75,10 @@ using namespace rapidjson;
 // Starts the registration of member variables for reflection
 // Remember to end with FLX_REFL_REGISTER_END
 // Place inside any .cpp file that includes the declaration of the custom type
+// Nothing runs during static initialization, InitReflection is called on the first
+// TypeResolver<TYPE>::Get(). See TypeDescriptor_Struct::Initialize().
+// Other registrations that run during static initialization (the FLX_ECS_REGISTER_* macros)
+// store &TypeResolver<TYPE>::Get instead of calling it, so the type is still initialized on first use.
 #define FLX_REFL_REGISTER_START(TYPE) \
   FlexEngine::Reflection::TypeDescriptor_Struct TYPE::Reflection{TYPE::InitReflection}; \
   void TYPE::InitReflection(FlexEngine::Reflection::TypeDescriptor_Struct* type_desc) \
@@ -71,7 +86,9 @@ using namespace rapidjson;
     using T = TYPE; \
     type_desc->name = #TYPE; \
     type_desc->size = sizeof(T); \
-    type_desc->members = {
+    type_desc->is_trivially_copyable = std::is_trivially_copyable_v<T>; \
+    type_desc->construct = FlexEngine::Reflection::GetConstructFunction<T>(); \
+    static const FlexEngine::Reflection::TypeDescriptor_Struct::MemberInfo member_table[] = {
 
 // Registers a member variable for reflection
 // Place inside the FLX_REFL_REGISTER_START block
@@ -81,15 +98,15 @@ using namespace rapidjson;
       { \
         #VARIABLE, \
         offsetof(T, VARIABLE), \
-        FlexEngine::Reflection::TypeResolver<decltype(T::VARIABLE)>::Get() \
+        &FlexEngine::Reflection::TypeResolver<decltype(T::VARIABLE)>::Get \
       },
 
 // Ends the reflection registration
 // Pair this with FLX_REFL_REGISTER_START
 #define FLX_REFL_REGISTER_END \
+      { nullptr, 0, nullptr } \
     }; \
-    /* Register custom type to the TypeDescriptor lookup */ \
-    TYPE_DESCRIPTOR_LOOKUP[type_desc->name] = type_desc; \
+    type_desc->SetMembers(member_table); \
   }
 
 #pragma endregion
@@ -108,6 +125,67 @@ namespace FlexEngine
     struct DefaultResolver;
     struct TypeDescriptor_Struct;
 
+    // Compact integer id of a type descriptor, assigned in registration order.
+    // Ids can differ between builds and runs, files must map them back through type names.
+    using TypeID = uint32_t;
+    constexpr TypeID INVALID_TYPE_ID = static_cast<TypeID>(-1);
+
+    // The scalar type a packed layout is made of
+    enum PackedScalar
+    {
+      PackedScalar_None,
+      PackedScalar_Int,
+      PackedScalar_Uint,
+      PackedScalar_Int64,
+      PackedScalar_Uint64,
+      PackedScalar_Float,
+      PackedScalar_Double
+    };
+
+    // Flattened layout of a trivially copyable type that is made of a single scalar type,
+    // one offset per scalar in member order. Padding is allowed, Vector3 is 3 floats in 16 bytes.
+    // Containers of such types are written as one flat array of numbers instead of
+    // one nested array per element, see TypeDescriptor_StdVector.
+    struct PackedLayout
+    {
+      PackedScalar scalar = PackedScalar_None;
+      std::vector<std::size_t> offsets;
+
+      // Returns false if the scalar doesn't match the rest of the layout
+      bool Append(PackedScalar type, std::size_t offset)
+      {
+        if (scalar != PackedScalar_None && scalar != type) return false;
+        scalar = type;
+        offsets.push_back(offset);
+        return true;
+      }
+    };
+
+    // Calls func with a value of the C++ type of the scalar
+    template <typename Func>
+    void VisitPackedScalar(PackedScalar scalar, Func&& func)
+    {
+      switch (scalar)
+      {
+      case PackedScalar_Int: func(int{}); break;
+      case PackedScalar_Uint: func(unsigned{}); break;
+      case PackedScalar_Int64: func(int64_t{}); break;
+      case PackedScalar_Uint64: func(uint64_t{}); break;
+      case PackedScalar_Float: func(float{}); break;
+      case PackedScalar_Double: func(double{}); break;
+      default: break;
+      }
+    }
+
+    // Placement new for the default value of T, nullptr if T can't be default constructed.
+    // A template so that the constructor is only instantiated for types that have one.
+    template <typename T>
+    void (*GetConstructFunction())(void*)
+    {
+      if constexpr (std::is_default_constructible_v<T>) return [](void* obj) { new (obj) T(); };
+      else return nullptr;
+    }
+
     // Base class for all type descriptors.
     // A type descriptor is a class that describes a type,
     // including its name, size, and how to serialize/deserialize it.
@@ -118,21 +196,104 @@ namespace FlexEngine
       //const char* name; // The name of the type.
       std::string name; // The name of the type.
       size_t size;      // The size of the type in bytes.
+      TypeID id = INVALID_TYPE_ID; // Index into the registry, set by Register(). Not serialized.
 
 
-      // Store a umap of all the type descriptors.
-      // This is used to deserialize the TypeDescriptor from its name.
+      // Store a vector of all the type descriptors, indexed by id.
       // This is a static member function to avoid the static initialization order fiasco.
+      // Types are registered on first use from any thread, hold initialization_mutex()
+      // while reading it or use GetByID().
+      static std::vector<TypeDescriptor*>& type_descriptor_registry()
+      {
+        static std::vector<TypeDescriptor*> type_descriptor_registry;
+        return type_descriptor_registry;
+      }
+
+      // Store a umap of all the type descriptors by their full name, ToString().
+      // This is used to deserialize the TypeDescriptor from its name when loading files,
+      // use the id everywhere else.
+      // The map is filled in lazily because the full name of a container
+      // depends on its element type, which may not be initialized yet during static init.
       // Just use the macro TYPE_DESCRIPTOR_LOOKUP to access this map.
+      // The same as the registry, hold initialization_mutex() while reading it or use FindByName().
       static std::unordered_map<std::string, TypeDescriptor*>& type_descriptor_lookup()
       {
+        std::lock_guard<std::recursive_mutex> lock(initialization_mutex());
+
         static std::unordered_map<std::string, TypeDescriptor*> type_descriptor_lookup;
+        static std::size_t registered_count = 0;
+
+        auto& registry = type_descriptor_registry();
+        for (; registered_count < registry.size(); registered_count++)
+        {
+          TypeDescriptor* type_desc = registry[registered_count];
+          type_descriptor_lookup.emplace(type_desc->ToString(), type_desc);
+        }
         return type_descriptor_lookup;
       }
       // Macro to access the type_descriptor_lookup map.
       // Usage: TYPE_DESCRIPTOR_LOOKUP["int"]
       #define TYPE_DESCRIPTOR_LOOKUP FlexEngine::Reflection::TypeDescriptor::type_descriptor_lookup()
 
+      // Assigns the next id to the type descriptor, does nothing if it already has one.
+      // The resolvers call this from the initializer of their static descriptor, so the id is
+      // published to other threads by the static's guard and never read while it is written.
+      static TypeID Register(TypeDescriptor* type_desc)
+      {
+        std::lock_guard<std::recursive_mutex> lock(initialization_mutex());
+        if (type_desc->id != INVALID_TYPE_ID) return type_desc->id;
+
+        auto& registry = type_descriptor_registry();
+        type_desc->id = static_cast<TypeID>(registry.size());
+        registry.push_back(type_desc);
+        return type_desc->id;
+      }
+
+      // O(1) lookup, returns nullptr for an unknown id
+      static TypeDescriptor* GetByID(TypeID id)
+      {
+        std::lock_guard<std::recursive_mutex> lock(initialization_mutex());
+        auto& registry = type_descriptor_registry();
+        return (id < registry.size()) ? registry[id] : nullptr;
+      }
+
+      // Lookup by full name, for loading files.
+      // Structs that haven't been used yet are initialized on the first miss.
+      // Returns nullptr for an unknown name.
+      static TypeDescriptor* FindByName(const std::string& name)
+      {
+        std::lock_guard<std::recursive_mutex> lock(initialization_mutex());
+        auto& lookup = type_descriptor_lookup();
+        auto it = lookup.find(name);
+        if (it != lookup.end()) return it->second;
+
+        // the lookup picks up the newly registered types when it is accessed again
+        InitializeAll();
+        auto& updated_lookup = type_descriptor_lookup();
+        it = updated_lookup.find(name);
+        return (it != updated_lookup.end()) ? it->second : nullptr;
+      }
+
+      // Structs that are registered with FLX_REFL_REGISTER_START, linked by their constructors.
+      // Only pointers are written during static initialization, nothing is allocated.
+      static TypeDescriptor_Struct*& struct_list()
+      {
+        static TypeDescriptor_Struct* struct_list = nullptr;
+        return struct_list;
+      }
+
+      // Guards the lazy initialization of structs, recursive because initializing a struct
+      // initializes the structs of its members.
+      static std::recursive_mutex& initialization_mutex()
+      {
+        static std::recursive_mutex initialization_mutex;
+        return initialization_mutex;
+      }
+
+      // Initializes every struct that hasn't been used yet, defined after TypeDescriptor_Struct.
+      // This is what used to happen during static initialization.
+      static void InitializeAll();
+
 
       //TypeDescriptor(const char* name, size_t size) : name{ name }, size{ size } {}
       TypeDescriptor(const std::string& name, size_t size) : name{ name }, size{ size } {}
@@ -167,10 +328,132 @@ namespace FlexEngine
         out.Parse(ss.str().c_str());
       }
 
+      // Serializes an object through a buffered JsonWriter as {"type":"...","data":...}.
+      // Faster than Serialize() and the type name is only written here at the root,
+      // everything inside is written with WriteData().
+      // The default falls back to Serialize().
+      virtual void Write(const void* obj, JsonWriter& writer) const
+      {
+        std::stringstream ss;
+        Serialize(obj, ss);
+        writer.RawValue(ss.str());
+      }
+
+      // Writes the value without the {"type":"...","data":...} wrapper,
+      // for values whose type is already known from the descriptor of their parent.
+      // The default writes the wrapped value, the deserializers accept both.
+      virtual void WriteData(const void* obj, JsonWriter& writer) const
+      {
+        Write(obj, writer);
+      }
+
+      // Appends the instructions that (de)serialize the type at base_offset to the program.
+      // The default is a call back into this descriptor.
+      // Structs and primitives override it to inline themselves, see program.h.
+      virtual void Compile(Program& program, std::size_t base_offset) const
+      {
+        program.Emit(Program::Op_Descriptor, base_offset, this);
+      }
+
+      // Appends the scalars of the type to the layout, offset by base_offset.
+      // Returns false if the type can't be packed, which is the default.
+      virtual bool GetPackedLayout(PackedLayout& /*layout*/, std::size_t /*base_offset*/) const { return false; }
+
+      // Appends the types this type is made of, for collecting schemas.
+      virtual void GetChildTypes(std::vector<const TypeDescriptor*>& /*out*/) const {}
+
+      // True if the bytes of an object are its whole value,
+      // which lets diffs compare and copy them with memcmp and memcpy.
+      virtual bool IsTriviallyCopyable() const { return false; }
+
+      // Empties a container, the stream deserializers append to what is already there.
+      virtual void Clear(void* /*obj*/) const {}
+
+      // Compares two objects by value.
+      // The default compares what WriteData() writes.
+      virtual bool Equals(const void* a, const void* b) const
+      {
+        JsonWriter writer_a;
+        JsonWriter writer_b;
+        WriteData(a, writer_a);
+        WriteData(b, writer_b);
+        return writer_a.GetSize() == writer_b.GetSize() && std::memcmp(writer_a.GetString(), writer_b.GetString(), writer_a.GetSize()) == 0;
+      }
+
+      // Records the differences from a to b, see patch.h.
+      // The default records the whole value of b if it changed.
+      virtual void Diff(const void* a, const void* b, Patch& patch) const
+      {
+        if (Equals(a, b)) return;
+
+        JsonWriter writer;
+        WriteData(b, writer);
+        patch.changes.push_back({ "", writer.ToString(), true });
+      }
+
+      // Applies a patch made by Diff() for this type.
+      // Returns false if a change doesn't fit, the changes before it stay applied.
+      virtual bool Apply(void* obj, const Patch& patch) const
+      {
+        for (const Patch::Change& change : patch.changes)
+        {
+          if (!change.path.empty() || !ApplyChange(obj, change)) return false;
+        }
+        return true;
+      }
+
+      // Sets the object to the value of a single change.
+      bool ApplyChange(void* obj, const Patch::Change& change) const
+      {
+        if (change.is_json)
+        {
+          Clear(obj);
+          JsonReader reader(change.data);
+          if (!reader.Next()) return false;
+          DeserializeStream(obj, reader);
+          return !reader.HasError();
+        }
+
+        // raw bytes, only written for trivially copyable members
+        if (!IsTriviallyCopyable() || change.data.size() != size) return false;
+        std::memcpy(obj, change.data.data(), size);
+        return true;
+      }
+
       // Deserializes an object from a json document.
       // This recursively deserializes the object from the json format
       // The deserializer uses the rapidjson library.
       virtual void Deserialize(void* obj, const json& value) const = 0;
+
+      // Deserializes an object straight from a json token stream without building a DOM.
+      // The reader is on the first token of the value and is left on its last token.
+      // Errors are reported through reader.HasError() instead of asserts.
+      // The default captures the value into a DOM and calls Deserialize(),
+      // the built-in descriptors override it to write into the target directly.
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const
+      {
+        rapidjson::Document document;
+        reader.ReadValue(document, document.GetAllocator());
+        if (!reader.HasError()) Deserialize(obj, document);
+      }
+
+    protected:
+      // The data of a wrapped value, or the value itself if it was written bare by WriteData()
+      static const json& GetData(const json& value)
+      {
+        return (value.IsObject() && value.HasMember("data")) ? value["data"] : value;
+      }
+
+      // Write() for descriptors that implement WriteData()
+      void WriteWrapped(const void* obj, JsonWriter& writer) const
+      {
+        writer.StartObject();
+        writer.Key("type");
+        writer.String(ToString());
+        writer.Key("data");
+        WriteData(obj, writer);
+        writer.EndObject();
+      }
     };
 
 
@@ -202,6 +485,7 @@ namespace FlexEngine
       template <typename T, typename std::enable_if<IsReflected<T>::value, int>::type = 0>
       static TypeDescriptor* Get()
       {
+        T::Reflection.Initialize();
         return &T::Reflection;
       }
 
@@ -290,19 +574,59 @@ namespace FlexEngine
         TypeDescriptor* type;
       };
 
+      // The table written by FLX_REFL_REGISTER_PROPERTY, made of constants only.
+      // The member types are resolved when the struct is initialized.
+      struct MemberInfo
+      {
+        const char* name;
+        size_t offset;
+        TypeDescriptor* (*get_type)();
+      };
+
       std::vector<Member> members;
+      bool is_trivially_copyable = false; // set by FLX_REFL_REGISTER_START
+      void (*construct)(void*) = nullptr; // placement new, nullptr if T isn't default constructible
 
+      // Runs during static initialization, only links the struct into the struct list
       TypeDescriptor_Struct(void (*init)(TypeDescriptor_Struct*))
-        : TypeDescriptor{ "", 0}
+        : TypeDescriptor{ "", 0}, m_init{ init }, m_next{ struct_list() }
       {
-        init(this);
+        struct_list() = this;
       }
 
       TypeDescriptor_Struct(const char*, size_t, const std::initializer_list<Member>& init)
-        : TypeDescriptor{ "", 0}, members{init}
+        : TypeDescriptor{ "", 0}, members{init}, m_is_initializing{ true }, m_is_initialized{ true }
       {
       }
 
+      // Calls InitReflection and registers the struct on first use.
+      // TypeResolver<T>::Get() calls this, after that it's a single load.
+      // A struct that contains itself through a container gets back its
+      // partially initialized descriptor, which it only keeps a pointer to.
+      void Initialize()
+      {
+        if (m_is_initialized.load(std::memory_order_acquire)) return;
+
+        std::lock_guard<std::recursive_mutex> lock(initialization_mutex());
+        if (m_is_initializing) return;
+        m_is_initializing = true;
+
+        m_init(this);
+        Register(this);
+        m_is_initialized.store(true, std::memory_order_release);
+      }
+
+      // Resolves the member table, see FLX_REFL_REGISTER_END.
+      // The table ends with a null name.
+      void SetMembers(const MemberInfo* table)
+      {
+        members.clear();
+        for (; table->name != nullptr; table++)
+        {
+          members.push_back({ table->name, table->offset, table->get_type() });
+        }
+      }
+
       virtual void Dump(const void* obj, std::ostream& os, int indent_level) const override
       {
         os << name << "\n" << std::string(4 * indent_level, ' ') << "{\n";
@@ -328,9 +652,18 @@ namespace FlexEngine
         os << "]}";
       }
 
+      virtual void Write(const void* obj, JsonWriter& writer) const override { WriteWrapped(obj, writer); }
+
+      virtual void WriteData(const void* obj, JsonWriter& writer) const override
+      {
+        writer.StartArray();
+        GetProgram().Write(obj, writer);
+        writer.EndArray();
+      }
+
       virtual void Deserialize(void* obj, const json& value) const override
       {
-        const auto& arr = value["data"].GetArray();
+        const auto& arr = GetData(value).GetArray();
 
         // guard against array size mismatch
         FLX_INTERNAL_ASSERT(arr.Size() == members.size(),
@@ -345,10 +678,132 @@ namespace FlexEngine
         }
       }
 
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const override
+      {
+        if (!reader.BeginData() || reader.GetType() != JsonReader::Token_StartArray) return reader.Fail();
+
+        // deserialize each member, a size mismatch is an error
+        // written with an older layout, the members are mapped by name, see schema.h
+        const std::vector<int>* member_map = (reader.GetSchemas() != nullptr) ? reader.GetSchemas()->GetMemberMap(this) : nullptr;
+        if (member_map != nullptr) ReadMapped(obj, *member_map, reader);
+        else GetProgram().Read(obj, reader);
+        if (reader.HasError()) return;
+
+        if (reader.Expect(JsonReader::Token_EndArray)) reader.EndData();
+      }
+
+      virtual void GetChildTypes(std::vector<const TypeDescriptor*>& out) const override
+      {
+        for (const Member& member : members) out.push_back(member.type);
+      }
+
+      // Inlines the members between a pair of brackets
+      virtual void Compile(Program& program, std::size_t base_offset) const override
+      {
+        std::size_t begin = program.Emit(Program::Op_BeginStruct, base_offset, this);
+        CompileMembers(program, base_offset);
+        program.Emit(Program::Op_EndStruct, base_offset, this);
+        program.GetInstructions()[begin].end = program.GetInstructions().size() - 1;
+      }
+
+      // The members of the struct compiled into one flat program, see program.h.
+      // Compiled on first use, by then every descriptor it reaches is initialized.
+      const Program& GetProgram() const
+      {
+        std::call_once(m_program_once, [this]() {
+          CompileMembers(m_program, 0);
+          m_program.Link();
+        });
+        return m_program;
+      }
+
+      virtual bool IsTriviallyCopyable() const override { return is_trivially_copyable; }
+
+      // One change per changed member, see Program::Diff()
+      virtual void Diff(const void* a, const void* b, Patch& patch) const override
+      {
+        GetProgram().Diff(a, b, patch);
+      }
+
+      virtual bool Equals(const void* a, const void* b) const override
+      {
+        Patch patch;
+        GetProgram().Diff(a, b, patch);
+        return patch.IsEmpty();
+      }
+
+      // Changes are looked up by member path, an empty path is the whole struct
+      virtual bool Apply(void* obj, const Patch& patch) const override
+      {
+        for (const Patch::Change& change : patch.changes)
+        {
+          bool applied = change.path.empty() ? ApplyChange(obj, change) : GetProgram().Apply(obj, change);
+          if (!applied) return false;
+        }
+        return true;
+      }
+
+      // Packable if the struct is trivially copyable and every member is
+      virtual bool GetPackedLayout(PackedLayout& layout, std::size_t base_offset) const override
+      {
+        if (!is_trivially_copyable || members.empty()) return false;
+        for (const Member& member : members)
+        {
+          if (!member.type->GetPackedLayout(layout, base_offset + member.offset)) return false;
+        }
+        return true;
+      }
+
+    private:
+      // Reads the members in the order of the file, members that were removed are skipped
+      void ReadMapped(void* obj, const std::vector<int>& member_map, JsonReader& reader) const
+      {
+        for (int index : member_map)
+        {
+          if (!reader.NextElement()) return reader.Fail();
+
+          if (index < 0) reader.Skip();
+          else members[index].type->DeserializeStream((char*)obj + members[index].offset, reader);
+          if (reader.HasError()) return;
+        }
+      }
+
+      // Compiles each member and names its first instruction for the member paths
+      void CompileMembers(Program& program, std::size_t base_offset) const
+      {
+        for (const Member& member : members)
+        {
+          std::size_t first = program.GetInstructions().size();
+          member.type->Compile(program, base_offset + member.offset);
+          program.GetInstructions()[first].name = member.name;
+        }
+      }
+
+      friend struct TypeDescriptor; // InitializeAll
+
+      void (*m_init)(TypeDescriptor_Struct*) = nullptr;
+      TypeDescriptor_Struct* m_next = nullptr; // struct list
+      bool m_is_initializing = false;
+      std::atomic<bool> m_is_initialized = false;
+
+      mutable Program m_program;
+      mutable std::once_flag m_program_once;
+
     };
 
 
 
+    inline void TypeDescriptor::InitializeAll()
+    {
+      std::lock_guard<std::recursive_mutex> lock(initialization_mutex());
+      for (TypeDescriptor_Struct* type_desc = struct_list(); type_desc != nullptr; type_desc = type_desc->m_next)
+      {
+        type_desc->Initialize();
+      }
+    }
+
+
+
     // TypeDescriptor for std::vector.
     // Specialized for std::vector.
     struct TypeDescriptor_StdVector : TypeDescriptor
@@ -357,12 +812,34 @@ namespace FlexEngine
       size_t (*get_size)(const void*);
       const void* (*get_item)(const void*, size_t);
       void* (*set_item)(void*, size_t);
+      void (*reserve)(void*, size_t);
+      void* (*push_item)(void*);
+      void (*clear)(void*);
+
+      // Only set for trivially copyable items, which can be read and written in place.
+      // nullptr otherwise.
+      const void* (*get_data)(const void*) = nullptr;
+      void* (*resize)(void*, size_t) = nullptr; // returns the data
 
       template <typename ItemType>
       TypeDescriptor_StdVector(ItemType*)
         : TypeDescriptor{ "std::vector<>", sizeof(std::vector<ItemType>) }
         , item_type{ TypeResolver<ItemType>::Get() }
       {
+        // std::vector<bool> is packed bits and has no data()
+        if constexpr (std::is_trivially_copyable_v<ItemType> && !std::is_same_v<ItemType, bool>)
+        {
+          get_data = [](const void* vec_ptr) -> const void* {
+            const auto& vec = *(const std::vector<ItemType>*) vec_ptr;
+            return vec.data();
+          };
+          resize = [](void* vec_ptr, size_t size) -> void* {
+            auto& vec = *(std::vector<ItemType>*) vec_ptr;
+            vec.resize(size);
+            return vec.data();
+          };
+        }
+
         get_size = [](const void* vec_ptr) -> size_t {
           const auto& vec = *(const std::vector<ItemType>*) vec_ptr;
           return vec.size();
@@ -376,6 +853,23 @@ namespace FlexEngine
           if (index >= vec.size()) vec.resize(index + 1);
           return &vec[index];
         };
+        reserve = [](void* vec_ptr, size_t size) {
+          auto& vec = *(std::vector<ItemType>*) vec_ptr;
+          vec.reserve(size);
+        };
+        push_item = [](void* vec_ptr) -> void* {
+          auto& vec = *(std::vector<ItemType>*) vec_ptr;
+          return &vec.emplace_back();
+        };
+        clear = [](void* vec_ptr) {
+          auto& vec = *(std::vector<ItemType>*) vec_ptr;
+          vec.clear();
+        };
+      }
+
+      virtual void GetChildTypes(std::vector<const TypeDescriptor*>& out) const override
+      {
+        out.push_back(item_type);
       }
 
       virtual std::string ToString() const override
@@ -424,16 +918,183 @@ namespace FlexEngine
         }
       }
 
+      virtual void Write(const void* obj, JsonWriter& writer) const override { WriteWrapped(obj, writer); }
+
+      virtual void WriteData(const void* obj, JsonWriter& writer) const override
+      {
+        size_t num_items = get_size(obj);
+        writer.StartArray();
+
+        // packed items are written as one flat array of numbers without a virtual call per item,
+        // std::vector<Vertex> is [x,y,z,r,g,b,...] instead of [[[x,y,z],[r,g,b],...],...]
+        PackedLayout layout;
+        if (GetItemLayout(layout))
+        {
+          const char* data = static_cast<const char*>(get_data(obj));
+          VisitPackedScalar(layout.scalar, [&](auto scalar) {
+            for (size_t index = 0; index < num_items; index++, data += item_type->size)
+            {
+              for (size_t offset : layout.offsets)
+              {
+                std::memcpy(&scalar, data + offset, sizeof(scalar));
+                writer.Number(scalar);
+              }
+            }
+          });
+        }
+        else
+        {
+          for (size_t index = 0; index < num_items; index++)
+          {
+            item_type->WriteData(get_item(obj, index), writer);
+          }
+        }
+
+        writer.EndArray();
+      }
+
+      virtual void Clear(void* obj) const override { clear(obj); }
+
+      // Packed items are compared scalar by scalar, skipping their padding
+      virtual bool Equals(const void* a, const void* b) const override
+      {
+        size_t num_items = get_size(a);
+        if (num_items != get_size(b)) return false;
+
+        PackedLayout layout;
+        if (!GetItemLayout(layout)) return TypeDescriptor::Equals(a, b);
+
+        const char* data_a = static_cast<const char*>(get_data(a));
+        const char* data_b = static_cast<const char*>(get_data(b));
+        size_t scalar_size = 0;
+        VisitPackedScalar(layout.scalar, [&](auto scalar) { scalar_size = sizeof(scalar); });
+        for (size_t index = 0; index < num_items; index++, data_a += item_type->size, data_b += item_type->size)
+        {
+          for (size_t offset : layout.offsets)
+          {
+            if (std::memcmp(data_a + offset, data_b + offset, scalar_size) != 0) return false;
+          }
+        }
+        return true;
+      }
+
       virtual void Deserialize(void* obj, const json& value) const override
       {
-        const auto& arr = value["data"].GetArray();
+        const auto& arr = GetData(value).GetArray();
+
+        // packed, see WriteData()
+        // nested arrays and wrapped values are the element per item format and read below
+        PackedLayout layout;
+        if (!arr.Empty() && arr[0].IsNumber() && GetItemLayout(layout))
+        {
+          size_t scalar_count = layout.offsets.size();
+          FLX_INTERNAL_ASSERT(arr.Size() % scalar_count == 0,
+            "Packed array size mismatch while deserializing vector\n"
+            "This is most likely caused by a corrupted .flx file"
+          );
+
+          char* data = static_cast<char*>(resize(obj, arr.Size() / scalar_count));
+          VisitPackedScalar(layout.scalar, [&](auto scalar) {
+            for (SizeType i = 0; i < arr.Size(); i++)
+            {
+              scalar = arr[i].Get<decltype(scalar)>();
+              std::memcpy(data + (i / scalar_count) * item_type->size + layout.offsets[i % scalar_count], &scalar, sizeof(scalar));
+            }
+          });
+          return;
+        }
 
+        // allocate once instead of growing with every set_item
+        reserve(obj, arr.Size());
         for (SizeType i = 0; i < arr.Size(); i++)
         {
           item_type->Deserialize(set_item(obj, i), arr[i]);
         }
       }
 
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const override
+      {
+        if (!reader.BeginData() || reader.GetType() != JsonReader::Token_StartArray) return reader.Fail();
+
+        // empty
+        if (!reader.NextElement())
+        {
+          reader.EndData();
+          return;
+        }
+
+        // packed, see WriteData()
+        PackedLayout layout;
+        JsonReader::TokenType first = reader.GetType();
+        bool is_number = first == JsonReader::Token_Int || first == JsonReader::Token_Uint || first == JsonReader::Token_Double;
+        const SchemaSet* schemas = reader.GetSchemas();
+        if (is_number && schemas != nullptr && schemas->NeedsMigration(item_type))
+        {
+          // packed with an older layout of the items, see schema.h
+          do
+          {
+            if (!schemas->ReadPacked(item_type, push_item(obj), reader)) return reader.Fail();
+          } while (reader.NextElement());
+          reader.EndData();
+          return;
+        }
+        if (is_number && GetItemLayout(layout))
+        {
+          VisitPackedScalar(layout.scalar, [&](auto scalar) { ReadPacked(obj, layout, scalar, reader); });
+          reader.EndData();
+          return;
+        }
+
+        // the size isn't known until the closing bracket, emplace_back grows geometrically
+        do
+        {
+          item_type->DeserializeStream(push_item(obj), reader);
+        } while (reader.NextElement());
+
+        reader.EndData();
+      }
+
+    private:
+      // The items are packed if they are trivially copyable and made of a single scalar type
+      bool GetItemLayout(PackedLayout& layout) const
+      {
+        return get_data != nullptr && item_type->GetPackedLayout(layout, 0);
+      }
+
+      // Reads numbers until the closing bracket straight into the items.
+      // The reader is on the first number.
+      template <typename Scalar>
+      void ReadPacked(void* obj, const PackedLayout& layout, Scalar scalar, JsonReader& reader) const
+      {
+        size_t scalar_count = layout.offsets.size();
+        size_t num_items = get_size(obj);
+        size_t capacity = num_items;
+        size_t index = 0; // scalar in the current item
+        char* data = nullptr;
+
+        do
+        {
+          // grow geometrically, the size isn't known until the closing bracket
+          if (index == 0 && num_items == capacity)
+          {
+            capacity = (capacity < 16) ? 16 : capacity * 2;
+            data = static_cast<char*>(resize(obj, capacity));
+          }
+
+          scalar = reader.GetNumber<Scalar>();
+          std::memcpy(data + num_items * item_type->size + layout.offsets[index], &scalar, sizeof(scalar));
+          if (++index == scalar_count)
+          {
+            index = 0;
+            num_items++;
+          }
+        } while (reader.NextElement());
+
+        // an incomplete item is an error
+        if (index != 0) reader.Fail();
+        resize(obj, num_items);
+      }
+
     };
 
     // Partially specialize TypeResolver for std::vectors.
@@ -443,10 +1104,7 @@ namespace FlexEngine
       static TypeDescriptor* Get()
       {
         static TypeDescriptor_StdVector type_desc{ (T*) nullptr };
-        if (TYPE_DESCRIPTOR_LOOKUP.count(type_desc.name) == 0)
-        {
-          TYPE_DESCRIPTOR_LOOKUP[type_desc.name] = &type_desc;
-        }
+        [[maybe_unused]] static const TypeID id = TypeDescriptor::Register(&type_desc);
         return &type_desc;
       }
     };
@@ -470,6 +1128,12 @@ namespace FlexEngine
       {
       }
 
+      virtual void GetChildTypes(std::vector<const TypeDescriptor*>& out) const override
+      {
+        out.push_back(key_type);
+        out.push_back(value_type);
+      }
+
       virtual std::string ToString() const override
       {
         return std::string("std::unordered_map<") + key_type->ToString() + ", " + value_type->ToString() + ">";
@@ -510,11 +1174,27 @@ namespace FlexEngine
         os << "]}";
       }
 
+      virtual void Write(const void* obj, JsonWriter& writer) const override { WriteWrapped(obj, writer); }
+
+      virtual void WriteData(const void* obj, JsonWriter& writer) const override
+      {
+        const auto& map = *(const std::unordered_map<KeyType, ValueType>*)obj;
+        writer.StartArray();
+        for (const auto& pair : map)
+        {
+          writer.StartArray();
+          key_type->WriteData(&pair.first, writer);
+          value_type->WriteData(&pair.second, writer);
+          writer.EndArray();
+        }
+        writer.EndArray();
+      }
+
       virtual void Deserialize(void* obj, const rapidjson::Value& value) const override
       {
         std::unordered_map<KeyType, ValueType>& map = *(std::unordered_map<KeyType, ValueType>*)obj;
 
-        const auto& arr = value["data"].GetArray();
+        const auto& arr = GetData(value).GetArray();
 
         for (SizeType i = 0; i < arr.Size(); i++)
         {
@@ -525,6 +1205,51 @@ namespace FlexEngine
           map[key] = val;
         }
       }
+
+      virtual void Clear(void* obj) const override
+      {
+        (*(std::unordered_map<KeyType, ValueType>*)obj).clear();
+      }
+
+      // Compared by key, the iteration order of equal maps can differ
+      virtual bool Equals(const void* a, const void* b) const override
+      {
+        const auto& map_a = *(const std::unordered_map<KeyType, ValueType>*)a;
+        const auto& map_b = *(const std::unordered_map<KeyType, ValueType>*)b;
+        if (map_a.size() != map_b.size()) return false;
+
+        for (const auto& [key, value] : map_a)
+        {
+          auto it = map_b.find(key);
+          if (it == map_b.end() || !value_type->Equals(&value, &it->second)) return false;
+        }
+        return true;
+      }
+
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const override
+      {
+        std::unordered_map<KeyType, ValueType>& map = *(std::unordered_map<KeyType, ValueType>*)obj;
+
+        if (!reader.BeginData() || reader.GetType() != JsonReader::Token_StartArray) return reader.Fail();
+
+        // each element is [key, value], the value is deserialized in place
+        while (reader.NextElement())
+        {
+          if (reader.GetType() != JsonReader::Token_StartArray || !reader.Next()) return reader.Fail();
+
+          KeyType key{};
+          key_type->DeserializeStream(&key, reader);
+          if (!reader.Next()) return reader.Fail();
+
+          auto [it, inserted] = map.try_emplace(std::move(key));
+          if (!inserted) it->second = ValueType{};
+          value_type->DeserializeStream(&it->second, reader);
+
+          if (!reader.Expect(JsonReader::Token_EndArray)) return;
+        }
+
+        reader.EndData();
+      }
     };
 
     // Partially specialize TypeResolver for std::unordered_maps.
@@ -534,10 +1259,7 @@ namespace FlexEngine
       static TypeDescriptor* Get()
       {
         static TypeDescriptor_StdUnorderedMap<KeyType, ValueType> type_desc{ (std::unordered_map<KeyType, ValueType>*)nullptr };
-        if (TYPE_DESCRIPTOR_LOOKUP.count(type_desc.name) == 0)
-        {
-          TYPE_DESCRIPTOR_LOOKUP[type_desc.name] = &type_desc;
-        }
+        [[maybe_unused]] static const TypeID id = TypeDescriptor::Register(&type_desc);
         return &type_desc;
       }
     };
@@ -557,6 +1279,11 @@ namespace FlexEngine
       {
       }
 
+      virtual void GetChildTypes(std::vector<const TypeDescriptor*>& out) const override
+      {
+        out.push_back(item_type);
+      }
+
       virtual std::string ToString() const override
       {
         return "std::shared_ptr<" + item_type->ToString() + ">";
@@ -592,6 +1319,20 @@ namespace FlexEngine
         }
       }
 
+      virtual void Write(const void* obj, JsonWriter& writer) const override
+      {
+        const auto& shared_ptr = *reinterpret_cast<const std::shared_ptr<T>*>(obj);
+        if (shared_ptr) item_type->Write(shared_ptr.get(), writer);
+        else writer.Null();
+      }
+
+      virtual void WriteData(const void* obj, JsonWriter& writer) const override
+      {
+        const auto& shared_ptr = *reinterpret_cast<const std::shared_ptr<T>*>(obj);
+        if (shared_ptr) item_type->WriteData(shared_ptr.get(), writer);
+        else writer.Null();
+      }
+
       virtual void Deserialize(void* obj, const json& value) const override
       {
         if (value.IsNull())
@@ -608,6 +1349,20 @@ namespace FlexEngine
         }
       }
 
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const override
+      {
+        if (reader.GetType() == JsonReader::Token_Null)
+        {
+          *reinterpret_cast<std::shared_ptr<T>*>(obj) = nullptr;
+        }
+        else
+        {
+          std::shared_ptr<T> shared_ptr = std::make_shared<T>();
+          item_type->DeserializeStream(shared_ptr.get(), reader);
+          *reinterpret_cast<std::shared_ptr<T>*>(obj) = std::move(shared_ptr);
+        }
+      }
+
     };
 
     // Specialization for std::shared_ptr<void>.
@@ -662,17 +1417,9 @@ namespace FlexEngine
 
           void* ptr = shared_ptr.get();
           std::size_t data_size = *static_cast<std::size_t*>(ptr);
-          BYTE* byte_ptr = static_cast<BYTE*>(ptr);
-          
-          // Get the data as a std::vector<BYTE>
-          // We get everything to encode the full data
-          std::vector<BYTE> data(
-            byte_ptr,
-            byte_ptr + sizeof(std::size_t) + data_size
-          );
 
-          // Encode the data
-          std::string serialized_data = Base64::Encode(data);
+          // Encode the full data straight from the pointer
+          std::string serialized_data = Base64::Encode(ptr, sizeof(std::size_t) + data_size);
 
           // Serialize as a json string
           os << R"({"type":")" << "std::shared_ptr<void>" << R"(","data":")" << serialized_data << R"("})";
@@ -683,6 +1430,27 @@ namespace FlexEngine
         }
       }
 
+      virtual void Write(const void* obj, JsonWriter& writer) const override
+      {
+        if (*reinterpret_cast<const std::shared_ptr<void>*>(obj)) WriteWrapped(obj, writer);
+        else writer.Null();
+      }
+
+      virtual void WriteData(const void* obj, JsonWriter& writer) const override
+      {
+        const auto& shared_ptr = *reinterpret_cast<const std::shared_ptr<void>*>(obj);
+        if (!shared_ptr)
+        {
+          writer.Null();
+          return;
+        }
+
+        // same layout as Serialize(), std::size_t + data
+        BYTE* byte_ptr = static_cast<BYTE*>(shared_ptr.get());
+        std::size_t data_size = *reinterpret_cast<std::size_t*>(byte_ptr);
+        writer.String(Base64::Encode(byte_ptr, sizeof(std::size_t) + data_size));
+      }
+
       virtual void Deserialize(void* obj, const json& value) const override
       {
         if (value.IsNull())
@@ -693,35 +1461,60 @@ namespace FlexEngine
         else
         {
           // Deserialize as a json string
-          std::string data = value["data"].Get<std::string>();
+          const json& data = GetData(value);
 
           // Decode the string
           // The decoded data will be in the format: std::size_t + data
-          std::vector<BYTE> decoded_data = Base64::Decode(data);
-          
-          // Get the size
-          void* void_ptr = reinterpret_cast<void*>(decoded_data.data());
-          std::size_t ptr_size = *static_cast<std::size_t*>(void_ptr);
-
-          // Allocate memory for the data
-          void* ptr = new char[sizeof(std::size_t) + ptr_size];
-
-          // Copy the data
-          memcpy(ptr, void_ptr, sizeof(std::size_t) + ptr_size);
-          
-          // Convert it to a std::shared_ptr<void>
-          std::shared_ptr<void> shared_ptr = std::shared_ptr<void>(
-            ptr,
-            [](void* ptr)
-            {
-              delete[] reinterpret_cast<char*>(ptr);
-            }
-          );
+          std::shared_ptr<void> shared_ptr = DecodeBlob(std::string_view(data.GetString(), data.GetStringLength()));
+          if (!shared_ptr) Log::Error("Failed to decode std::shared_ptr<void> data.");
 
           *reinterpret_cast<std::shared_ptr<void>*>(obj) = shared_ptr;
         }
       }
 
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const override
+      {
+        if (reader.GetType() == JsonReader::Token_Null)
+        {
+          *reinterpret_cast<std::shared_ptr<void>*>(obj) = nullptr;
+          return;
+        }
+
+        if (!reader.BeginData()) return;
+        std::shared_ptr<void> shared_ptr = DecodeBlob(reader.GetString());
+        if (!reader.EndData()) return;
+        if (!shared_ptr) return reader.Fail();
+
+        *reinterpret_cast<std::shared_ptr<void>*>(obj) = shared_ptr;
+      }
+
+    private:
+      // Decodes straight into the allocation, no intermediate buffer.
+      // Returns nullptr if the data isn't valid base64 or the size prefix doesn't match.
+      static std::shared_ptr<void> DecodeBlob(std::string_view data)
+      {
+        std::size_t decoded_size = Base64::GetDecodedSize(data);
+        if (decoded_size < sizeof(std::size_t)) return nullptr;
+
+        char* ptr = new char[decoded_size];
+        std::shared_ptr<void> shared_ptr = std::shared_ptr<void>(
+          ptr,
+          [](void* ptr)
+          {
+            delete[] reinterpret_cast<char*>(ptr);
+          }
+        );
+
+        if (!Base64::Decode(data, reinterpret_cast<BYTE*>(ptr), decoded_size)) return nullptr;
+
+        // guard: the size prefix must match the decoded data
+        std::size_t ptr_size = 0;
+        std::memcpy(&ptr_size, ptr, sizeof(std::size_t));
+        if (ptr_size != decoded_size - sizeof(std::size_t)) return nullptr;
+
+        return shared_ptr;
+      }
+
     };
 
     /// Partially specialize TypeResolver for std::shared_ptrs.
@@ -731,10 +1524,7 @@ namespace FlexEngine
       static TypeDescriptor* Get()
       {
         static TypeDescriptor_StdSharedPtr type_desc{ (T*) nullptr };
-        if (TYPE_DESCRIPTOR_LOOKUP.count(type_desc.name) == 0)
-        {
-          TYPE_DESCRIPTOR_LOOKUP[type_desc.name] = &type_desc;
-        }
+        [[maybe_unused]] static const TypeID id = TypeDescriptor::Register(&type_desc);
         return &type_desc;
       }
     };
@@ -756,6 +1546,12 @@ namespace FlexEngine
       {
       }
 
+      virtual void GetChildTypes(std::vector<const TypeDescriptor*>& out) const override
+      {
+        out.push_back(first_type);
+        out.push_back(second_type);
+      }
+
       virtual std::string ToString() const override
       {
         return std::string("std::pair<") + first_type->ToString() + ", " + second_type->ToString() + ">";
@@ -786,13 +1582,36 @@ namespace FlexEngine
         os << "]}";
       }
 
+      virtual void Write(const void* obj, JsonWriter& writer) const override { WriteWrapped(obj, writer); }
+
+      virtual void WriteData(const void* obj, JsonWriter& writer) const override
+      {
+        const auto& pair = *(const std::pair<FirstType, SecondType>*)obj;
+        writer.StartArray();
+        first_type->WriteData(&pair.first, writer);
+        second_type->WriteData(&pair.second, writer);
+        writer.EndArray();
+      }
+
       virtual void Deserialize(void* obj, const json& value) const override
       {
-        const auto& arr = value["data"].GetArray();
+        const auto& arr = GetData(value).GetArray();
         first_type->Deserialize(&((std::pair<FirstType, SecondType>*)obj)->first, arr[0]);
         second_type->Deserialize(&((std::pair<FirstType, SecondType>*)obj)->second, arr[1]);
       }
 
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const override
+      {
+        if (!reader.BeginData() || reader.GetType() != JsonReader::Token_StartArray) return reader.Fail();
+
+        if (!reader.NextElement()) return reader.Fail();
+        first_type->DeserializeStream(&((std::pair<FirstType, SecondType>*)obj)->first, reader);
+        if (!reader.NextElement()) return reader.Fail();
+        second_type->DeserializeStream(&((std::pair<FirstType, SecondType>*)obj)->second, reader);
+
+        if (reader.Expect(JsonReader::Token_EndArray)) reader.EndData();
+      }
+
     };
 
     // Partially specialize TypeResolver for std::pairs.
@@ -802,10 +1621,7 @@ namespace FlexEngine
       static TypeDescriptor* Get()
       {
         static TypeDescriptor_StdPair<FirstType, SecondType> type_desc{ (std::pair<FirstType, SecondType>*)nullptr };
-        if (TYPE_DESCRIPTOR_LOOKUP.count(type_desc.name) == 0)
-        {
-          TYPE_DESCRIPTOR_LOOKUP[type_desc.name] = &type_desc;
-        }
+        [[maybe_unused]] static const TypeID id = TypeDescriptor::Register(&type_desc);
         return &type_desc;
       }
     };
@@ -0,0 +1,171 @@
+#include "Reflection/jsonreader.h"
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    JsonReader::JsonReader(std::string_view json)
+      : m_buffer(json)
+      , m_size(json.size())
+      , m_stream(m_buffer.data())
+    {
+      m_reader.IterativeParseInit();
+    }
+
+    JsonReader::JsonReader(char* json, std::size_t size)
+      : m_size(size)
+      , m_stream(json)
+    {
+      m_reader.IterativeParseInit();
+    }
+
+    bool JsonReader::Next()
+    {
+      if (HasError() || m_reader.IterativeParseComplete())
+      {
+        m_type = Token_None;
+        return false;
+      }
+
+      // every call emits exactly one token to the handler
+      // the parser stops after the root value, anything after it is checked below
+      constexpr unsigned flags = rapidjson::kParseInsituFlag | rapidjson::kParseStopWhenDoneFlag;
+      if (!m_reader.IterativeParseNext<flags>(m_stream, m_handler))
+      {
+        m_type = Token_None;
+        return false;
+      }
+
+      // guard: ran past the end of a view
+      if (m_stream.Tell() > m_size)
+      {
+        Fail();
+        m_type = Token_None;
+        return false;
+      }
+
+      // guard: only whitespace can follow the root value
+      if (m_reader.IterativeParseComplete())
+      {
+        for (const char* c = m_stream.src_; c < m_stream.head_ + m_size; c++)
+        {
+          if (*c != ' ' && *c != '\n' && *c != '\r' && *c != '\t') Fail();
+        }
+      }
+      return true;
+    }
+
+    bool JsonReader::NextElement()
+    {
+      return Next() && m_type != Token_EndArray;
+    }
+
+    bool JsonReader::Expect(TokenType type)
+    {
+      if (!Next() || m_type != type)
+      {
+        Fail();
+        return false;
+      }
+      return true;
+    }
+
+    void JsonReader::Skip()
+    {
+      if (m_type != Token_StartObject && m_type != Token_StartArray) return;
+
+      int depth = 1;
+      while (depth > 0 && Next())
+      {
+        if (m_type == Token_StartObject || m_type == Token_StartArray) depth++;
+        else if (m_type == Token_EndObject || m_type == Token_EndArray) depth--;
+      }
+    }
+
+    bool JsonReader::BeginData()
+    {
+      // bare data, objects are always wrappers
+      if (m_type != Token_StartObject)
+      {
+        m_is_wrapped.push_back(false);
+        if (m_type == Token_None || m_type == Token_Key || m_type == Token_EndObject || m_type == Token_EndArray) Fail();
+        return !HasError();
+      }
+
+      m_is_wrapped.push_back(true);
+      while (Next() && m_type == Token_Key)
+      {
+        if (m_string == "data") return Next();
+
+        // skip "type" and anything else
+        Next();
+        Skip();
+      }
+
+      // reached the end of the object without data
+      Fail();
+      return false;
+    }
+
+    bool JsonReader::EndData()
+    {
+      // guard: unbalanced
+      if (m_is_wrapped.empty())
+      {
+        Fail();
+        return false;
+      }
+
+      bool is_wrapped = m_is_wrapped.back();
+      m_is_wrapped.pop_back();
+      if (!is_wrapped) return !HasError();
+
+      while (Next() && m_type == Token_Key)
+      {
+        Next();
+        Skip();
+      }
+
+      if (m_type != Token_EndObject) Fail();
+      return !HasError();
+    }
+
+    void JsonReader::ReadValue(rapidjson::Value& out, rapidjson::Document::AllocatorType& allocator)
+    {
+      switch (m_type)
+      {
+      case Token_Null: out.SetNull(); break;
+      case Token_Bool: out.SetBool(m_bool); break;
+      case Token_Int: out.SetInt64(m_int); break;
+      case Token_Uint: out.SetUint64(m_uint); break;
+      case Token_Double: out.SetDouble(m_double); break;
+      case Token_String: out.SetString(m_string.data(), static_cast<rapidjson::SizeType>(m_string.size()), allocator); break;
+      case Token_StartObject:
+        out.SetObject();
+        while (Next() && m_type == Token_Key)
+        {
+          rapidjson::Value key(m_string.data(), static_cast<rapidjson::SizeType>(m_string.size()), allocator);
+          rapidjson::Value value;
+          Next();
+          ReadValue(value, allocator);
+          out.AddMember(key, value, allocator);
+        }
+        break;
+      case Token_StartArray:
+        out.SetArray();
+        while (NextElement())
+        {
+          rapidjson::Value value;
+          ReadValue(value, allocator);
+          out.PushBack(value, allocator);
+        }
+        break;
+      default:
+        Fail();
+        break;
+      }
+    }
+
+  }
+}
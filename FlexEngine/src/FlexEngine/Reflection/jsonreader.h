@@ -0,0 +1,193 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include <rapidjson/document.h>
+#include <rapidjson/reader.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits> // std::is_floating_point_v
+#include <vector>
+
+// Pull style json reader for the reflection system.
+//
+// Document::Parse builds the whole DOM before a single value is deserialized,
+// which means the peak memory of a load includes a second copy of the scene.
+// JsonReader drives the rapidjson SAX reader one token at a time instead,
+// so TypeDescriptor::DeserializeStream can write every value straight into its target.
+//
+// Strings and keys are views into the buffer instead of a new allocation per token.
+// The buffer is parsed in situ, either a private copy of the json or, with the in situ
+// constructor, the caller's own buffer, which saves the copy but overwrites the json.
+//
+// Values written by the reflection system look like {"type":"...","data":...},
+// BeginData() and EndData() step in and out of that wrapper.
+// JsonWriter only wraps the root, nested values are bare data because the descriptor
+// of their parent already knows their type. BeginData() accepts both.
+//
+// Usage:
+// JsonReader reader(json);
+// reader.Next();
+// type_desc->DeserializeStream(obj, reader);
+// if (reader.HasError()) ...
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    class SchemaSet;
+
+    class __FLX_API JsonReader
+    {
+    public:
+      enum TokenType
+      {
+        Token_None,
+        Token_Null,
+        Token_Bool,
+        Token_Int,          // signed, stored as int64_t
+        Token_Uint,         // unsigned, stored as uint64_t
+        Token_Double,
+        Token_String,
+        Token_Key,
+        Token_StartObject,
+        Token_EndObject,
+        Token_StartArray,
+        Token_EndArray
+      };
+
+      // Copies the json, the original doesn't have to outlive the reader.
+      JsonReader(std::string_view json);
+
+      // Parses the buffer in place without copying it, the json is overwritten.
+      // The buffer must outlive the reader and be null terminated at or after size,
+      // which a view into a std::string always is.
+      JsonReader(char* json, std::size_t size);
+
+      JsonReader(const JsonReader&) = delete;
+      JsonReader& operator=(const JsonReader&) = delete;
+
+      // Moves to the next token.
+      // Returns false at the end of the document or if there is an error.
+      bool Next();
+
+      // Moves to the next element of the array the reader is in.
+      // Returns false on the closing bracket or if there is an error.
+      bool NextElement();
+
+      // Moves to the next token and checks its type, sets the error flag on a mismatch.
+      bool Expect(TokenType type);
+
+      // Skips the value that starts at the current token.
+      // Leaves the reader on the last token of the value.
+      void Skip();
+
+      // Steps into {"type":"...","data":...} and leaves the reader on the first token of data.
+      // Other members are skipped.
+      // Bare data isn't wrapped and the reader stays where it is.
+      bool BeginData();
+
+      // Steps out of the wrapper that the matching BeginData() stepped into, if there was one.
+      bool EndData();
+
+      // Copies the value that starts at the current token into a DOM value.
+      // Used as the fallback for type descriptors that don't implement DeserializeStream.
+      void ReadValue(rapidjson::Value& out, rapidjson::Document::AllocatorType& allocator);
+
+      // Marks the document as malformed, every following Next() returns false.
+      void Fail() { m_has_error = true; }
+
+      bool HasError() const { return m_has_error || m_reader.HasParseError(); }
+      TokenType GetType() const { return m_type; }
+
+      // The schemas of the file when some of its types changed, see schema.h.
+      // Structs of a changed type map their members by name instead of by position.
+      void SetSchemas(const SchemaSet* schemas) { m_schemas = schemas; }
+      const SchemaSet* GetSchemas() const { return m_schemas; }
+
+      #pragma region Token values
+
+      bool GetBool()
+      {
+        if (m_type != Token_Bool) Fail();
+        return m_bool;
+      }
+
+      // Valid until the reader is destroyed
+      std::string_view GetString()
+      {
+        if (m_type != Token_String && m_type != Token_Key) Fail();
+        return m_string;
+      }
+
+      // Converts the current number token to T.
+      // Integers are accepted for floating point targets, the same as rapidjson's Get<float>().
+      template <typename T>
+      T GetNumber()
+      {
+        switch (m_type)
+        {
+        case Token_Int: return static_cast<T>(m_int);
+        case Token_Uint: return static_cast<T>(m_uint);
+        case Token_Double:
+          if constexpr (std::is_floating_point_v<T>) return static_cast<T>(m_double);
+          else break;
+        default: break;
+        }
+        Fail();
+        return T{};
+      }
+
+      #pragma endregion
+
+    private:
+      // rapidjson handler that stores the token in the reader
+      struct Handler
+      {
+        JsonReader& reader;
+
+        bool Null() { reader.m_type = Token_Null; return true; }
+        bool Bool(bool b) { reader.m_type = Token_Bool; reader.m_bool = b; return true; }
+        bool Int(int i) { reader.m_type = Token_Int; reader.m_int = i; return true; }
+        bool Uint(unsigned u) { reader.m_type = Token_Uint; reader.m_uint = u; return true; }
+        bool Int64(int64_t i) { reader.m_type = Token_Int; reader.m_int = i; return true; }
+        bool Uint64(uint64_t u) { reader.m_type = Token_Uint; reader.m_uint = u; return true; }
+        bool Double(double d) { reader.m_type = Token_Double; reader.m_double = d; return true; }
+        bool RawNumber(const char*, rapidjson::SizeType, bool) { return false; }
+        bool String(const char* str, rapidjson::SizeType length, bool)
+        {
+          reader.m_type = Token_String; reader.m_string = std::string_view(str, length); return true;
+        }
+        bool Key(const char* str, rapidjson::SizeType length, bool)
+        {
+          reader.m_type = Token_Key; reader.m_string = std::string_view(str, length); return true;
+        }
+        bool StartObject() { reader.m_type = Token_StartObject; return true; }
+        bool EndObject(rapidjson::SizeType) { reader.m_type = Token_EndObject; return true; }
+        bool StartArray() { reader.m_type = Token_StartArray; return true; }
+        bool EndArray(rapidjson::SizeType) { reader.m_type = Token_EndArray; return true; }
+      };
+
+      std::string m_buffer; // only used when copying
+      std::size_t m_size = 0;
+      rapidjson::Reader m_reader;
+      rapidjson::InsituStringStream m_stream;
+      Handler m_handler{ *this };
+
+      TokenType m_type = Token_None;
+      bool m_has_error = false;
+      const SchemaSet* m_schemas = nullptr;
+      std::vector<bool> m_is_wrapped; // one per BeginData() that hasn't ended
+
+      bool m_bool = false;
+      int64_t m_int = 0;
+      uint64_t m_uint = 0;
+      double m_double = 0.0;
+      std::string_view m_string; // points into m_buffer
+    };
+
+  }
+}
@@ -0,0 +1,42 @@
+#include "Reflection/jsonwriter.h"
+
+#include <charconv> // std::to_chars
+#include <cmath> // std::isfinite
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    JsonWriter::JsonWriter()
+      : m_writer(m_buffer)
+    {
+    }
+
+    void JsonWriter::Clear()
+    {
+      m_buffer.Clear();
+      m_writer.Reset(m_buffer);
+    }
+
+    void JsonWriter::Float(float f)
+    {
+      // json has no nan or infinity
+      if (!std::isfinite(f)) f = 0.0f;
+
+      // shortest text that reads back to the same float
+      char buffer[32];
+      std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), f);
+      m_writer.RawValue(buffer, static_cast<std::size_t>(result.ptr - buffer), rapidjson::kNumberType);
+    }
+
+    void JsonWriter::Double(double d)
+    {
+      // json has no nan or infinity
+      if (!std::isfinite(d)) d = 0.0;
+
+      m_writer.Double(d);
+    }
+
+  }
+}
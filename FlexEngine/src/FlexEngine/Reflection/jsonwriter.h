@@ -0,0 +1,84 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Buffered json writer for the reflection system.
+//
+// TypeDescriptor::Serialize builds the json with std::ostream and operator<<,
+// which goes through the locale machinery for every number and repeats the type name
+// of every value. JsonWriter writes into one growing buffer through rapidjson::Writer,
+// which also escapes strings properly.
+//
+// Numbers are written as the shortest text that reads back to the same value,
+// floats through std::to_chars and doubles through rapidjson's Grisu2.
+//
+// Usage:
+// JsonWriter writer;
+// type_desc->Write(obj, writer);
+// std::string json = writer.ToString();
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    class __FLX_API JsonWriter
+    {
+    public:
+      JsonWriter();
+
+      JsonWriter(const JsonWriter&) = delete;
+      JsonWriter& operator=(const JsonWriter&) = delete;
+
+      // Clears the buffer and keeps its memory for the next document
+      void Clear();
+
+      const char* GetString() const { return m_buffer.GetString(); }
+      std::size_t GetSize() const { return m_buffer.GetSize(); }
+      std::string ToString() const { return std::string(GetString(), GetSize()); }
+
+      #pragma region Values
+
+      void Null() { m_writer.Null(); }
+      void Bool(bool b) { m_writer.Bool(b); }
+      void Int(int i) { m_writer.Int(i); }
+      void Uint(unsigned u) { m_writer.Uint(u); }
+      void Int64(int64_t i) { m_writer.Int64(i); }
+      void Uint64(uint64_t u) { m_writer.Uint64(u); }
+      void Float(float f);
+      void Double(double d);
+
+      // Overloads for templated callers
+      void Number(int i) { Int(i); }
+      void Number(unsigned u) { Uint(u); }
+      void Number(int64_t i) { Int64(i); }
+      void Number(uint64_t u) { Uint64(u); }
+      void Number(float f) { Float(f); }
+      void Number(double d) { Double(d); }
+
+      void String(std::string_view str) { m_writer.String(str.data(), static_cast<rapidjson::SizeType>(str.size())); }
+      void Key(std::string_view str) { m_writer.Key(str.data(), static_cast<rapidjson::SizeType>(str.size())); }
+      void StartObject() { m_writer.StartObject(); }
+      void EndObject() { m_writer.EndObject(); }
+      void StartArray() { m_writer.StartArray(); }
+      void EndArray() { m_writer.EndArray(); }
+
+      // Inserts json that was written elsewhere
+      void RawValue(std::string_view json) { m_writer.RawValue(json.data(), json.size(), rapidjson::kObjectType); }
+
+      #pragma endregion
+
+    private:
+      rapidjson::StringBuffer m_buffer;
+      rapidjson::Writer<rapidjson::StringBuffer> m_writer;
+    };
+
+  }
+}
@@ -0,0 +1,46 @@
+#include "Reflection/patch.h"
+
+#include "flexformatterbinary.h" // FlxBinWriter, FlxBinCursor
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    // [uint64 change count]
+    // per change: [uint64 size][path] [uint8 is_json] [uint64 size][data]
+    std::string Patch::Serialize() const
+    {
+      std::string out;
+      FlxBinWriter::Append<uint64_t>(out, changes.size());
+      for (const Change& change : changes)
+      {
+        FlxBinWriter::AppendString(out, change.path);
+        FlxBinWriter::Append<uint8_t>(out, change.is_json ? 1 : 0);
+        FlxBinWriter::AppendString(out, change.data);
+      }
+      return out;
+    }
+
+    bool Patch::Deserialize(std::string_view data, Patch& out)
+    {
+      FlxBinCursor cursor(data.data(), data.size());
+
+      std::size_t count = static_cast<std::size_t>(cursor.Read<uint64_t>());
+      if (count > data.size()) return false; // can't have more changes than bytes
+
+      out.changes.clear();
+      out.changes.reserve(count);
+      for (std::size_t i = 0; i < count && cursor.ok; i++)
+      {
+        Change& change = out.changes.emplace_back();
+        change.path = cursor.ReadString();
+        change.is_json = cursor.Read<uint8_t>() != 0;
+        change.data = cursor.ReadString();
+      }
+
+      return cursor.ok;
+    }
+
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Differences between two objects of the same type, made by TypeDescriptor::Diff().
+//
+// Structs record one change per changed member, keyed by the member path from the root,
+// "transform.position.x". Scalars store their new bytes, containers and strings store
+// their new value as json. Members that didn't change take no space at all,
+// so an undo step or an autosave of a few edits is a few bytes instead of a full copy.
+//
+// Usage:
+// Patch patch;
+// type_desc->Diff(&before, &after, patch);
+// type_desc->Apply(&before, patch); // before == after
+// type_desc->Diff(&after, &before, undo); // the reverse patch
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    struct __FLX_API Patch
+    {
+      struct Change
+      {
+        std::string path;     // member path, empty for the whole object
+        std::string data;     // the new value, raw bytes or json
+        bool is_json = false;
+      };
+
+      std::vector<Change> changes;
+
+      bool IsEmpty() const { return changes.empty(); }
+
+      // Compact binary form for undo history and autosave files
+      std::string Serialize() const;
+
+      // Returns false if the data isn't a serialized patch
+      static bool Deserialize(std::string_view data, Patch& out);
+    };
+
+  }
+}
@@ -5,7 +5,8 @@
 // TypeDescriptor for primitive types
 // Supports the same types that rapidjson supports except const char*
 // Abstracted for easy editing
-#define TYPE_DESCRIPTOR(NAME, TYPE) \
+// WRITE is the JsonWriter function for the type, and names its PackedScalar and Program::OpCode
+#define TYPE_DESCRIPTOR(NAME, TYPE, WRITE) \
   struct __FLX_API TypeDescriptor_##NAME : TypeDescriptor \
   { \
     TypeDescriptor_##NAME() : TypeDescriptor{ #TYPE, sizeof(TYPE) } {} \
@@ -17,22 +18,39 @@
     { \
       os << R"({"type":")" << #TYPE << R"(","data":)" << *(const TYPE*)obj << "}"; \
     } \
+    virtual void Write(const void* obj, JsonWriter& writer) const override { WriteWrapped(obj, writer); } \
+    virtual void WriteData(const void* obj, JsonWriter& writer) const override \
+    { \
+      writer.WRITE(*(const TYPE*)obj); \
+    } \
     virtual void Deserialize(void* obj, const json& value) const override \
     { \
-      TYPE data = value["data"].Get<TYPE>(); \
+      TYPE data = GetData(value).Get<TYPE>(); \
       *(TYPE*)obj = data; \
       /**reinterpret_cast<TYPE*>(obj) = data;*/ \
     } \
+    virtual void DeserializeStream(void* obj, JsonReader& reader) const override \
+    { \
+      if (!reader.BeginData()) return; \
+      *(TYPE*)obj = reader.GetNumber<TYPE>(); \
+      reader.EndData(); \
+    } \
+    virtual bool GetPackedLayout(PackedLayout& layout, std::size_t base_offset) const override \
+    { \
+      return layout.Append(PackedScalar_##WRITE, base_offset); \
+    } \
+    virtual void Compile(Program& program, std::size_t base_offset) const override \
+    { \
+      program.Emit(Program::Op_##WRITE, base_offset, this); \
+    } \
+    virtual bool IsTriviallyCopyable() const override { return true; } \
   }; \
   template <> \
   __FLX_API TypeDescriptor* GetPrimitiveDescriptor<TYPE>() \
   { \
     static TypeDescriptor_##NAME type_desc; \
-    if (TYPE_DESCRIPTOR_LOOKUP.count(type_desc.name) == 0) \
-    { \
-      /* Register the type descriptor in the lookup table. */ \
-      TYPE_DESCRIPTOR_LOOKUP[type_desc.name] = &type_desc; \
-    } \
+    /* Register the type descriptor once, the static's guard makes it thread safe. */ \
+    [[maybe_unused]] static const TypeID id = TypeDescriptor::Register(&type_desc); \
     return &type_desc; \
   }
 
@@ -57,12 +75,12 @@ namespace FlexEngine
 
     // Primitive type registration
     //TYPE_DESCRIPTOR(Bool, bool) // specialized below
-    TYPE_DESCRIPTOR(Int, int)
-    TYPE_DESCRIPTOR(Unsigned, unsigned)
-    TYPE_DESCRIPTOR(LongLong, int64_t) // long long
-    TYPE_DESCRIPTOR(UnsignedLongLong, uint64_t) // unsigned long long
-    TYPE_DESCRIPTOR(Double, double)
-    TYPE_DESCRIPTOR(Float, float)
+    TYPE_DESCRIPTOR(Int, int, Int)
+    TYPE_DESCRIPTOR(Unsigned, unsigned, Uint)
+    TYPE_DESCRIPTOR(LongLong, int64_t, Int64) // long long
+    TYPE_DESCRIPTOR(UnsignedLongLong, uint64_t, Uint64) // unsigned long long
+    TYPE_DESCRIPTOR(Double, double, Double)
+    TYPE_DESCRIPTOR(Float, float, Float)
     // no support for const char*, just use std::string
     //TYPE_DESCRIPTOR(StdString, std::string) // specialized below
 
@@ -84,19 +102,32 @@ namespace FlexEngine
       {
         os << R"({"type":")" << "bool" << R"(","data":)" << ((*(const bool*)obj) ? "true" : "false") << "}";
       }
+      virtual void Write(const void* obj, JsonWriter& writer) const override { WriteWrapped(obj, writer); }
+      virtual void WriteData(const void* obj, JsonWriter& writer) const override
+      {
+        writer.Bool(*(const bool*)obj);
+      }
       virtual void Deserialize(void* obj, const json& value) const override
       {
-        bool data = value["data"].Get<bool>(); *(bool*)obj = data;
+        bool data = GetData(value).Get<bool>(); *(bool*)obj = data;
+      }
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const override
+      {
+        if (!reader.BeginData()) return;
+        *(bool*)obj = reader.GetBool();
+        reader.EndData();
+      }
+      virtual void Compile(Program& program, std::size_t base_offset) const override
+      {
+        program.Emit(Program::Op_Bool, base_offset, this);
       }
+      virtual bool IsTriviallyCopyable() const override { return true; }
     };
     template <>
     __FLX_API TypeDescriptor* GetPrimitiveDescriptor<bool>()
     {
       static TypeDescriptor_Bool type_desc;
-      if (TYPE_DESCRIPTOR_LOOKUP.count(type_desc.name) == 0)
-      {
-        TYPE_DESCRIPTOR_LOOKUP[type_desc.name] = &type_desc;
-      }
+      [[maybe_unused]] static const TypeID id = TypeDescriptor::Register(&type_desc);
       return &type_desc;
     }
 
@@ -132,11 +163,52 @@ namespace FlexEngine
         // Serialize
         os << R"({"type":")" << "std::string" << R"(","data":")" << data << R"("})";
       }
+      virtual void Write(const void* obj, JsonWriter& writer) const override { WriteWrapped(obj, writer); }
+      virtual void WriteData(const void* obj, JsonWriter& writer) const override
+      {
+        // the writer escapes the json, `\\` is still doubled like Serialize() does
+        // because Deserialize() unescapes it
+        const std::string& data = *(const std::string*)obj;
+        if (data.find('\\') == std::string::npos)
+        {
+          writer.String(data);
+          return;
+        }
+
+        std::string escaped = data;
+        for (size_t i = 0; i < escaped.size(); ++i)
+        {
+          if (escaped[i] == '\\')
+          {
+            escaped.insert(i, "\\");
+            ++i;
+          }
+        }
+        writer.String(escaped);
+      }
       virtual void Deserialize(void* obj, const json& value) const override
       {
-        std::string data = value["data"].Get<std::string>();
+        std::string data = GetData(value).Get<std::string>();
+        Unescape(data);
+        *(std::string*)obj = data;
+      }
+      virtual void DeserializeStream(void* obj, JsonReader& reader) const override
+      {
+        if (!reader.BeginData()) return;
+        std::string& data = *(std::string*)obj;
+        data.assign(reader.GetString());
+        Unescape(data);
+        reader.EndData();
+      }
+      virtual bool Equals(const void* a, const void* b) const override
+      {
+        return *(const std::string*)a == *(const std::string*)b;
+      }
 
-        // Unescape all `\\` characters in the string.
+    private:
+      // Unescape all `\\` characters in the string.
+      static void Unescape(std::string& data)
+      {
         for (size_t i = 0; i < data.size(); ++i)
         {
           if (data[i] == '\\' && i + 1 < data.size() && data[i + 1] == '\\')
@@ -144,18 +216,13 @@ namespace FlexEngine
             data.erase(i, 1);
           }
         }
-
-        *(std::string*)obj = data;
       }
     };
     template <>
     __FLX_API TypeDescriptor* GetPrimitiveDescriptor<std::string>()
     {
       static TypeDescriptor_StdString type_desc;
-      if (TYPE_DESCRIPTOR_LOOKUP.count(type_desc.name) == 0)
-      {
-        TYPE_DESCRIPTOR_LOOKUP[type_desc.name] = &type_desc;
-      }
+      [[maybe_unused]] static const TypeID id = TypeDescriptor::Register(&type_desc);
       return &type_desc;
     }
 
@@ -0,0 +1,204 @@
+#include "Reflection/program.h"
+
+#include "Reflection/base.h"
+
+#include <cstring> // std::memcpy
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    #pragma region Internal Functions
+
+    // Reads the number at the current token into obj.
+    // Wrapped values are read by their descriptor.
+    template <typename T>
+    static void Internal_ReadNumber(char* obj, const Program::Instruction& instruction, JsonReader& reader)
+    {
+      if (reader.GetType() == JsonReader::Token_StartObject)
+      {
+        instruction.type->DeserializeStream(obj, reader);
+        return;
+      }
+
+      T value = reader.GetNumber<T>();
+      std::memcpy(obj, &value, sizeof(T));
+    }
+
+    template <typename T>
+    static void Internal_WriteNumber(const char* obj, JsonWriter& writer)
+    {
+      T value;
+      std::memcpy(&value, obj, sizeof(T));
+      writer.Number(value);
+    }
+
+    #pragma endregion
+
+    std::size_t Program::Emit(OpCode op, std::size_t offset, const TypeDescriptor* type)
+    {
+      m_instructions.push_back({ op, offset, type });
+      return m_instructions.size() - 1;
+    }
+
+    void Program::Link()
+    {
+      // path of the struct each instruction is in
+      std::vector<std::string> prefixes(1);
+
+      for (std::size_t pc = 0; pc < m_instructions.size(); pc++)
+      {
+        Instruction& instruction = m_instructions[pc];
+
+        if (instruction.op == Op_EndStruct)
+        {
+          prefixes.pop_back();
+          continue;
+        }
+
+        const char* name = (instruction.name != nullptr) ? instruction.name : "";
+        instruction.path = prefixes.back().empty() ? name : prefixes.back() + "." + name;
+        m_path_index.emplace(instruction.path, pc);
+
+        if (instruction.op == Op_BeginStruct)
+        {
+          prefixes.push_back(instruction.path);
+
+          // containers inside the struct own heap memory, their bytes can't be compared
+          instruction.is_trivial = instruction.type->IsTriviallyCopyable();
+          for (std::size_t i = pc; i < instruction.end && instruction.is_trivial; i++)
+          {
+            if (m_instructions[i].op == Op_Descriptor) instruction.is_trivial = false;
+          }
+        }
+      }
+    }
+
+    std::size_t Program::FindPath(const std::string& path) const
+    {
+      auto it = m_path_index.find(path);
+      return (it != m_path_index.end()) ? it->second : static_cast<std::size_t>(-1);
+    }
+
+    void Program::Write(const void* obj, JsonWriter& writer) const
+    {
+      const char* base = static_cast<const char*>(obj);
+
+      for (const Instruction& instruction : m_instructions)
+      {
+        const char* ptr = base + instruction.offset;
+
+        switch (instruction.op)
+        {
+        case Op_BeginStruct: writer.StartArray(); break;
+        case Op_EndStruct: writer.EndArray(); break;
+        case Op_Bool: writer.Bool(*reinterpret_cast<const bool*>(ptr)); break;
+        case Op_Int: Internal_WriteNumber<int>(ptr, writer); break;
+        case Op_Uint: Internal_WriteNumber<unsigned>(ptr, writer); break;
+        case Op_Int64: Internal_WriteNumber<int64_t>(ptr, writer); break;
+        case Op_Uint64: Internal_WriteNumber<uint64_t>(ptr, writer); break;
+        case Op_Float: Internal_WriteNumber<float>(ptr, writer); break;
+        case Op_Double: Internal_WriteNumber<double>(ptr, writer); break;
+        case Op_Descriptor: instruction.type->WriteData(ptr, writer); break;
+        }
+      }
+    }
+
+    void Program::Read(void* obj, JsonReader& reader) const
+    {
+      char* base = static_cast<char*>(obj);
+      const SchemaSet* schemas = reader.GetSchemas();
+
+      for (std::size_t pc = 0; pc < m_instructions.size(); pc++)
+      {
+        const Instruction& instruction = m_instructions[pc];
+        char* ptr = base + instruction.offset;
+
+        // the closing bracket of an inlined struct, a size mismatch is an error
+        if (instruction.op == Op_EndStruct)
+        {
+          if (!reader.Expect(JsonReader::Token_EndArray)) return;
+          continue;
+        }
+
+        // every other instruction is a value, move to it
+        if (!reader.NextElement()) return reader.Fail();
+
+        switch (instruction.op)
+        {
+        case Op_BeginStruct:
+          // a wrapped struct or one written with an older layout is read by its descriptor,
+          // skip the inlined members
+          if (reader.GetType() != JsonReader::Token_StartArray || (schemas != nullptr && schemas->NeedsMigration(instruction.type)))
+          {
+            instruction.type->DeserializeStream(ptr, reader);
+            pc = instruction.end;
+          }
+          break;
+        case Op_Bool:
+          if (reader.GetType() == JsonReader::Token_StartObject) instruction.type->DeserializeStream(ptr, reader);
+          else *reinterpret_cast<bool*>(ptr) = reader.GetBool();
+          break;
+        case Op_Int: Internal_ReadNumber<int>(ptr, instruction, reader); break;
+        case Op_Uint: Internal_ReadNumber<unsigned>(ptr, instruction, reader); break;
+        case Op_Int64: Internal_ReadNumber<int64_t>(ptr, instruction, reader); break;
+        case Op_Uint64: Internal_ReadNumber<uint64_t>(ptr, instruction, reader); break;
+        case Op_Float: Internal_ReadNumber<float>(ptr, instruction, reader); break;
+        case Op_Double: Internal_ReadNumber<double>(ptr, instruction, reader); break;
+        case Op_Descriptor: instruction.type->DeserializeStream(ptr, reader); break;
+        default: break;
+        }
+
+        if (reader.HasError()) return;
+      }
+    }
+
+    void Program::Diff(const void* a, const void* b, Patch& patch) const
+    {
+      const char* base_a = static_cast<const char*>(a);
+      const char* base_b = static_cast<const char*>(b);
+
+      for (std::size_t pc = 0; pc < m_instructions.size(); pc++)
+      {
+        const Instruction& instruction = m_instructions[pc];
+        const char* ptr_a = base_a + instruction.offset;
+        const char* ptr_b = base_b + instruction.offset;
+
+        switch (instruction.op)
+        {
+        case Op_BeginStruct:
+          // padding can differ while the members don't, so a mismatch only means look closer
+          if (instruction.is_trivial && std::memcmp(ptr_a, ptr_b, instruction.type->size) == 0) pc = instruction.end;
+          break;
+        case Op_EndStruct:
+          break;
+        case Op_Descriptor:
+          if (!instruction.type->Equals(ptr_a, ptr_b))
+          {
+            JsonWriter writer;
+            instruction.type->WriteData(ptr_b, writer);
+            patch.changes.push_back({ instruction.path, writer.ToString(), true });
+          }
+          break;
+        default:
+          if (std::memcmp(ptr_a, ptr_b, instruction.type->size) != 0)
+          {
+            patch.changes.push_back({ instruction.path, std::string(ptr_b, instruction.type->size), false });
+          }
+          break;
+        }
+      }
+    }
+
+    bool Program::Apply(void* obj, const Patch::Change& change) const
+    {
+      std::size_t pc = FindPath(change.path);
+      if (pc == static_cast<std::size_t>(-1)) return false;
+
+      const Instruction& instruction = m_instructions[pc];
+      return instruction.type->ApplyChange(static_cast<char*>(obj) + instruction.offset, change);
+    }
+
+  }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "Reflection/jsonreader.h"
+#include "Reflection/jsonwriter.h"
+#include "Reflection/patch.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiled reflection programs
+//
+// Serializing a struct walks its members and makes a virtual call into the descriptor
+// of each member, which does the same for its own members, and so on.
+// A Program flattens that tree once per type into a list of instructions,
+// "write the float at offset 16", "start an array", "call the descriptor at offset 40".
+// Run by a single loop, nested structs cost no calls at all.
+//
+// Structs and primitives are inlined, everything else (containers, strings, pointers)
+// stays a call into its descriptor, which runs its own program for its items.
+// See TypeDescriptor::Compile() and TypeDescriptor_Struct::GetProgram().
+//
+// Diff() walks the same instructions, comparing trivially copyable structs with one memcmp
+// and only looking at their members if something in them changed.
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    struct TypeDescriptor;
+
+    class __FLX_API Program
+    {
+    public:
+      enum OpCode : uint8_t
+      {
+        Op_BeginStruct, // start of an inlined struct, end is the index of its Op_EndStruct
+        Op_EndStruct,
+        Op_Bool,
+        Op_Int,
+        Op_Uint,
+        Op_Int64,
+        Op_Uint64,
+        Op_Float,
+        Op_Double,
+        Op_Descriptor   // call into the type descriptor
+      };
+
+      struct Instruction
+      {
+        OpCode op{};
+        std::size_t offset = 0;               // from the start of the object the program runs on
+        const TypeDescriptor* type = nullptr; // the type at offset
+        std::size_t end = 0;                  // Op_BeginStruct only
+
+        // set by Link()
+        const char* name = nullptr;           // member name, set by the struct that owns the member
+        std::string path{};                   // member names from the root joined by '.'
+        bool is_trivial = false;              // Op_BeginStruct only, the struct can be compared with memcmp
+      };
+
+      // Appends an instruction and returns its index
+      std::size_t Emit(OpCode op, std::size_t offset, const TypeDescriptor* type);
+
+      // Resolves the member paths, call once after compiling.
+      void Link();
+
+      // Returns the index of the instruction for the member path, or -1
+      std::size_t FindPath(const std::string& path) const;
+
+      const std::vector<Instruction>& GetInstructions() const { return m_instructions; }
+      std::vector<Instruction>& GetInstructions() { return m_instructions; }
+
+      // Writes the members as bare data, the caller writes the brackets around them.
+      void Write(const void* obj, JsonWriter& writer) const;
+
+      // Reads the members, the reader is on the token before the first member.
+      // Values wrapped as {"type":"...","data":...} by the old serializer are handed
+      // to their descriptor, which steps into the wrapper.
+      void Read(void* obj, JsonReader& reader) const;
+
+      // Records the members that differ from a to b, keyed by their path.
+      void Diff(const void* a, const void* b, Patch& patch) const;
+
+      // Applies a change made by Diff(), returns false if the path doesn't exist
+      // or the data doesn't fit the member.
+      bool Apply(void* obj, const Patch::Change& change) const;
+
+    private:
+      std::vector<Instruction> m_instructions;
+      std::unordered_map<std::string, std::size_t> m_path_index;
+    };
+
+  }
+}
@@ -0,0 +1,501 @@
+#include "Reflection/schema.h"
+
+#include "Reflection/base.h"
+#include "flexformatterbinary.h" // FlxBinWriter, FlxBinCursor
+#include "flexlogger.h"
+
+namespace FlexEngine
+{
+  namespace Reflection
+  {
+
+    #pragma region Internal Functions
+
+    // FNV-1a
+    static void Internal_Hash(uint64_t& hash, const void* data, std::size_t size)
+    {
+      const unsigned char* bytes = static_cast<const unsigned char*>(data);
+      for (std::size_t i = 0; i < size; i++)
+      {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+      }
+    }
+
+    static void Internal_Hash(uint64_t& hash, const std::string& str)
+    {
+      Internal_Hash(hash, str.data(), str.size() + 1); // the null separates the strings
+    }
+
+    // The version isn't part of the hash, a migration can be added without a layout change
+    static uint64_t Internal_HashSchema(const Schema& schema)
+    {
+      uint64_t hash = 14695981039346656037ull;
+      Internal_Hash(hash, schema.type);
+      Internal_Hash(hash, &schema.size, sizeof(schema.size));
+      for (const Schema::Member& member : schema.members)
+      {
+        Internal_Hash(hash, member.name);
+        Internal_Hash(hash, member.type);
+        Internal_Hash(hash, &member.offset, sizeof(member.offset));
+        Internal_Hash(hash, &member.size, sizeof(member.size));
+      }
+      return hash;
+    }
+
+    // FindByName only knows primitives that were used, a member of an old schema may be
+    // the only place its type appears
+    static const TypeDescriptor* Internal_FindType(const std::string& name)
+    {
+      static const bool s_primitives_registered = (
+        TypeResolver<int>::Get(), TypeResolver<unsigned>::Get(),
+        TypeResolver<int64_t>::Get(), TypeResolver<uint64_t>::Get(),
+        TypeResolver<float>::Get(), TypeResolver<double>::Get(), true
+      );
+      (void)s_primitives_registered;
+      return TypeDescriptor::FindByName(name);
+    }
+
+    // The scalar a primitive is made of, PackedScalar_None for everything else
+    static PackedScalar Internal_GetScalar(const TypeDescriptor* type_desc)
+    {
+      PackedLayout layout;
+      if (type_desc == nullptr || !type_desc->GetPackedLayout(layout, 0) || layout.offsets.size() != 1) return PackedScalar_None;
+      return layout.scalar;
+    }
+
+    #pragma endregion
+
+    #pragma region Schema
+
+    Schema Schema::FromType(const TypeDescriptor* type_desc)
+    {
+      Schema schema;
+      schema.type = type_desc->ToString();
+      schema.version = Migration::GetVersion(schema.type);
+      schema.size = type_desc->size;
+
+      if (auto* struct_desc = dynamic_cast<const TypeDescriptor_Struct*>(type_desc))
+      {
+        schema.members.reserve(struct_desc->members.size());
+        for (const TypeDescriptor_Struct::Member& member : struct_desc->members)
+        {
+          schema.members.push_back({ member.name, member.type->ToString(), member.offset, member.type->size });
+        }
+      }
+
+      schema.hash = Internal_HashSchema(schema);
+      return schema;
+    }
+
+    const Schema::Member* Schema::Find(const std::string& name) const
+    {
+      for (const Member& member : members)
+      {
+        if (member.name == name) return &member;
+      }
+      return nullptr;
+    }
+
+    void Schema::WriteBinary(std::string& out) const
+    {
+      FlxBinWriter::AppendString(out, type);
+      FlxBinWriter::Append<uint32_t>(out, version);
+      FlxBinWriter::Append<uint64_t>(out, size);
+      FlxBinWriter::Append<uint64_t>(out, hash);
+      FlxBinWriter::Append<uint64_t>(out, members.size());
+      for (const Member& member : members)
+      {
+        FlxBinWriter::AppendString(out, member.name);
+        FlxBinWriter::AppendString(out, member.type);
+        FlxBinWriter::Append<uint64_t>(out, member.offset);
+        FlxBinWriter::Append<uint64_t>(out, member.size);
+      }
+    }
+
+    bool Schema::ReadBinary(FlxBinCursor& cursor)
+    {
+      type = cursor.ReadString();
+      version = cursor.Read<uint32_t>();
+      size = cursor.Read<uint64_t>();
+      hash = cursor.Read<uint64_t>();
+
+      uint64_t member_count = cursor.Read<uint64_t>();
+      if (member_count > static_cast<uint64_t>(cursor.end - cursor.current)) return cursor.ok = false;
+
+      members.resize(static_cast<std::size_t>(member_count));
+      for (Member& member : members)
+      {
+        member.name = cursor.ReadString();
+        member.type = cursor.ReadString();
+        member.offset = cursor.Read<uint64_t>();
+        member.size = cursor.Read<uint64_t>();
+      }
+      return cursor.ok;
+    }
+
+    void Schema::WriteJson(JsonWriter& writer) const
+    {
+      writer.StartArray();
+      writer.String(type);
+      writer.Uint(version);
+      writer.Uint64(size);
+      writer.Uint64(hash);
+      writer.StartArray();
+      for (const Member& member : members)
+      {
+        writer.StartArray();
+        writer.String(member.name);
+        writer.String(member.type);
+        writer.Uint64(member.offset);
+        writer.Uint64(member.size);
+        writer.EndArray();
+      }
+      writer.EndArray();
+      writer.EndArray();
+    }
+
+    bool Schema::ReadJson(JsonReader& reader)
+    {
+      if (reader.GetType() != JsonReader::Token_StartArray) return false;
+
+      if (!reader.NextElement()) return false;
+      type = std::string(reader.GetString());
+      if (!reader.NextElement()) return false;
+      version = reader.GetNumber<uint32_t>();
+      if (!reader.NextElement()) return false;
+      size = reader.GetNumber<uint64_t>();
+      if (!reader.NextElement()) return false;
+      hash = reader.GetNumber<uint64_t>();
+
+      if (!reader.NextElement() || reader.GetType() != JsonReader::Token_StartArray) return false;
+      members.clear();
+      while (reader.NextElement())
+      {
+        if (reader.GetType() != JsonReader::Token_StartArray) return false;
+
+        Member& member = members.emplace_back();
+        if (!reader.NextElement()) return false;
+        member.name = std::string(reader.GetString());
+        if (!reader.NextElement()) return false;
+        member.type = std::string(reader.GetString());
+        if (!reader.NextElement()) return false;
+        member.offset = reader.GetNumber<uint64_t>();
+        if (!reader.NextElement()) return false;
+        member.size = reader.GetNumber<uint64_t>();
+        if (!reader.Expect(JsonReader::Token_EndArray)) return false;
+      }
+
+      return reader.Expect(JsonReader::Token_EndArray) && !reader.HasError();
+    }
+
+    #pragma endregion
+
+    #pragma region Migration
+
+    Migration::Migration(const char* type, uint32_t from_version, uint32_t to_version, MigrationFunction function)
+      : type{ type }, from_version{ from_version }, to_version{ to_version }, function{ function }, next{ list() }
+    {
+      list() = this;
+    }
+
+    Migration*& Migration::list()
+    {
+      static Migration* list = nullptr;
+      return list;
+    }
+
+    uint32_t Migration::GetVersion(const std::string& type)
+    {
+      uint32_t version = 0;
+      for (Migration* migration = list(); migration != nullptr; migration = migration->next)
+      {
+        if (migration->type == type && migration->to_version > version) version = migration->to_version;
+      }
+      return version;
+    }
+
+    #pragma endregion
+
+    #pragma region SchemaSet
+
+    void SchemaSet::Collect(const TypeDescriptor* type_desc)
+    {
+      std::vector<const TypeDescriptor*> stack{ type_desc };
+      while (!stack.empty())
+      {
+        const TypeDescriptor* current = stack.back();
+        stack.pop_back();
+        if (current == nullptr) continue;
+
+        // containers have no schema, their name already says what is in them
+        if (dynamic_cast<const TypeDescriptor_Struct*>(current) != nullptr)
+        {
+          std::string name = current->ToString();
+          if (m_index.count(name) != 0) continue; // also stops recursive types
+          m_index.emplace(name, m_schemas.size());
+          m_schemas.push_back(Schema::FromType(current));
+        }
+
+        current->GetChildTypes(stack);
+      }
+    }
+
+    const Schema* SchemaSet::Find(const std::string& type) const
+    {
+      auto it = m_index.find(type);
+      return (it != m_index.end()) ? &m_schemas[it->second] : nullptr;
+    }
+
+    bool SchemaSet::Resolve()
+    {
+      m_index.clear();
+      m_plans.clear();
+      for (std::size_t i = 0; i < m_schemas.size(); i++) m_index[m_schemas[i].type] = i;
+
+      for (std::size_t i = 0; i < m_schemas.size(); i++)
+      {
+        const Schema& old_schema = m_schemas[i];
+
+        // unknown types and types that didn't change are read as they are
+        auto* struct_desc = dynamic_cast<TypeDescriptor_Struct*>(TypeDescriptor::FindByName(old_schema.type));
+        if (struct_desc == nullptr) continue;
+
+        Schema current = Schema::FromType(struct_desc);
+        if (current.hash == old_schema.hash && current.version == old_schema.version) continue;
+
+        Plan plan;
+        plan.schema = i;
+
+        // json, by name, scalars read into whatever scalar the member is now
+        plan.member_map.reserve(old_schema.members.size());
+        for (const Schema::Member& old_member : old_schema.members)
+        {
+          int index = -1;
+          for (std::size_t m = 0; m < struct_desc->members.size(); m++)
+          {
+            const TypeDescriptor_Struct::Member& member = struct_desc->members[m];
+            if (old_member.name != member.name) continue;
+
+            bool same_type = member.type->ToString() == old_member.type;
+            bool both_scalar = Internal_GetScalar(member.type) != PackedScalar_None && Internal_GetScalar(Internal_FindType(old_member.type)) != PackedScalar_None;
+            if (same_type || both_scalar) index = static_cast<int>(m);
+            break;
+          }
+          plan.member_map.push_back(index);
+        }
+
+        // raw bytes
+        BuildOps(old_schema, struct_desc, 0, 0, plan.ops, 0);
+        if (!BuildPacked(old_schema, 0, plan.packed, 0)) plan.packed.clear();
+
+        for (uint32_t version = old_schema.version; version < current.version;)
+        {
+          Migration* found = nullptr;
+          for (Migration* migration = Migration::list(); migration != nullptr; migration = migration->next)
+          {
+            if (migration->type == old_schema.type && migration->from_version == version) found = migration;
+          }
+
+          // guard: gap in the migrations
+          if (found == nullptr || found->to_version <= version)
+          {
+            Log::Warning("No migration for " + old_schema.type + " from version " + std::to_string(version) + ".");
+            break;
+          }
+
+          plan.migrations.push_back(found->function);
+          version = found->to_version;
+        }
+
+        m_plans.emplace(struct_desc, std::move(plan));
+      }
+
+      return HasChanges();
+    }
+
+    void SchemaSet::BuildOps(const Schema& old_schema, const TypeDescriptor_Struct* type_desc, uint64_t old_base, uint64_t new_base, std::vector<CopyOp>& ops, int depth) const
+    {
+      for (const Schema::Member& old_member : old_schema.members)
+      {
+        // guard: member outside the object
+        if (old_member.offset + old_member.size > old_schema.size) continue;
+
+        const TypeDescriptor_Struct::Member* member = nullptr;
+        for (const TypeDescriptor_Struct::Member& current : type_desc->members)
+        {
+          if (old_member.name == current.name) member = &current;
+        }
+        if (member == nullptr) continue; // removed
+
+        uint64_t old_offset = old_base + old_member.offset;
+        uint64_t new_offset = new_base + member->offset;
+
+        if (member->type->ToString() == old_member.type)
+        {
+          // a nested struct that changed is mapped by name as well
+          auto* nested = dynamic_cast<const TypeDescriptor_Struct*>(member->type);
+          const Schema* nested_schema = Find(old_member.type);
+          if (nested != nullptr && nested_schema != nullptr && depth < 32 && nested_schema->hash != Schema::FromType(nested).hash)
+          {
+            BuildOps(*nested_schema, nested, old_offset, new_offset, ops, depth + 1);
+            continue;
+          }
+
+          if (old_member.size != member->type->size || !member->type->IsTriviallyCopyable()) continue;
+
+          // merge with the previous copy if both sides are contiguous
+          if (!ops.empty())
+          {
+            CopyOp& last = ops.back();
+            if (last.old_scalar == PackedScalar_None && last.old_offset + last.size == old_offset && last.new_offset + last.size == new_offset)
+            {
+              last.size += old_member.size;
+              continue;
+            }
+          }
+          ops.push_back({ old_offset, new_offset, old_member.size, PackedScalar_None, PackedScalar_None });
+          continue;
+        }
+
+        // int to float and the like
+        PackedScalar old_scalar = Internal_GetScalar(Internal_FindType(old_member.type));
+        PackedScalar new_scalar = Internal_GetScalar(member->type);
+        if (old_scalar != PackedScalar_None && new_scalar != PackedScalar_None)
+        {
+          ops.push_back({ old_offset, new_offset, old_member.size, old_scalar, new_scalar });
+        }
+      }
+    }
+
+    bool SchemaSet::BuildPacked(const Schema& old_schema, uint64_t old_base, std::vector<std::pair<uint64_t, int>>& packed, int depth) const
+    {
+      // the same order as TypeDescriptor_Struct::GetPackedLayout
+      for (const Schema::Member& old_member : old_schema.members)
+      {
+        PackedScalar scalar = Internal_GetScalar(Internal_FindType(old_member.type));
+        if (scalar != PackedScalar_None)
+        {
+          packed.emplace_back(old_base + old_member.offset, scalar);
+          continue;
+        }
+
+        const Schema* nested_schema = Find(old_member.type);
+        if (nested_schema == nullptr || depth >= 32 || !BuildPacked(*nested_schema, old_base + old_member.offset, packed, depth + 1)) return false;
+      }
+      return true;
+    }
+
+    const std::vector<int>* SchemaSet::GetMemberMap(const TypeDescriptor* type_desc) const
+    {
+      auto it = m_plans.find(type_desc);
+      return (it != m_plans.end()) ? &it->second.member_map : nullptr;
+    }
+
+    bool SchemaSet::Migrate(const TypeDescriptor* type_desc, const void* old_data, std::size_t old_size, void* new_data) const
+    {
+      auto it = m_plans.find(type_desc);
+      if (it == m_plans.end())
+      {
+        if (old_size != type_desc->size) return false;
+        std::memcpy(new_data, old_data, old_size);
+        return true;
+      }
+
+      const Plan& plan = it->second;
+      const Schema& old_schema = m_schemas[plan.schema];
+      if (old_size != old_schema.size) return false;
+
+      // new members keep their default value
+      auto* struct_desc = static_cast<const TypeDescriptor_Struct*>(type_desc);
+      if (struct_desc->construct != nullptr) struct_desc->construct(new_data);
+      else std::memset(new_data, 0, type_desc->size);
+
+      const char* from = static_cast<const char*>(old_data);
+      char* to = static_cast<char*>(new_data);
+      for (const CopyOp& op : plan.ops)
+      {
+        if (op.old_scalar == PackedScalar_None)
+        {
+          std::memcpy(to + op.new_offset, from + op.old_offset, static_cast<std::size_t>(op.size));
+          continue;
+        }
+
+        VisitPackedScalar(static_cast<PackedScalar>(op.old_scalar), [&](auto old_value) {
+          std::memcpy(&old_value, from + op.old_offset, sizeof(old_value));
+          VisitPackedScalar(static_cast<PackedScalar>(op.new_scalar), [&](auto new_value) {
+            new_value = static_cast<decltype(new_value)>(old_value);
+            std::memcpy(to + op.new_offset, &new_value, sizeof(new_value));
+          });
+        });
+      }
+
+      for (MigrationFunction migration : plan.migrations) migration(old_schema, old_data, new_data);
+      return true;
+    }
+
+    bool SchemaSet::ReadPacked(const TypeDescriptor* type_desc, void* obj, JsonReader& reader) const
+    {
+      auto it = m_plans.find(type_desc);
+      if (it == m_plans.end() || it->second.packed.empty()) return false;
+
+      const Plan& plan = it->second;
+      std::vector<char> old_data(static_cast<std::size_t>(m_schemas[plan.schema].size));
+      for (std::size_t i = 0; i < plan.packed.size(); i++)
+      {
+        if (i > 0 && !reader.NextElement()) return false;
+
+        auto [offset, scalar] = plan.packed[i];
+        if (offset >= old_data.size()) return false;
+        VisitPackedScalar(static_cast<PackedScalar>(scalar), [&](auto value) {
+          value = reader.GetNumber<decltype(value)>();
+          if (offset + sizeof(value) <= old_data.size()) std::memcpy(old_data.data() + offset, &value, sizeof(value));
+        });
+      }
+
+      return !reader.HasError() && Migrate(type_desc, old_data.data(), old_data.size(), obj);
+    }
+
+    void SchemaSet::WriteBinary(std::string& out) const
+    {
+      FlxBinWriter::Append<uint64_t>(out, m_schemas.size());
+      for (const Schema& schema : m_schemas) schema.WriteBinary(out);
+    }
+
+    bool SchemaSet::ReadBinary(FlxBinCursor& cursor)
+    {
+      uint64_t count = cursor.Read<uint64_t>();
+      if (count > static_cast<uint64_t>(cursor.end - cursor.current)) return cursor.ok = false;
+
+      for (uint64_t i = 0; i < count && cursor.ok; i++)
+      {
+        Schema schema;
+        if (schema.ReadBinary(cursor)) Add(std::move(schema));
+      }
+      return cursor.ok;
+    }
+
+    void SchemaSet::WriteJson(JsonWriter& writer) const
+    {
+      writer.StartArray();
+      for (const Schema& schema : m_schemas) schema.WriteJson(writer);
+      writer.EndArray();
+    }
+
+    bool SchemaSet::ReadJson(JsonReader& reader)
+    {
+      if (reader.GetType() != JsonReader::Token_StartArray) return false;
+
+      while (reader.NextElement())
+      {
+        Schema schema;
+        if (!schema.ReadJson(reader)) return false;
+        Add(std::move(schema));
+      }
+      return !reader.HasError();
+    }
+
+    #pragma endregion
+
+  }
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "Reflection/jsonreader.h"
+#include "Reflection/jsonwriter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcpy
+#include <string>
+#include <unordered_map>
+#include <utility> // std::pair
+#include <vector>
+
+// Schema evolution
+//
+// Files store the schema of every struct in them: the members by name with their type,
+// offset and size, a hash of all of it and the version of the type.
+// Loading compares the hashes with the current types. Types that didn't change are
+// read the same way as before, at full speed. Changed types are read through a plan
+// that maps their members by name:
+// - json structs read the members that still exist and skip the rest
+// - packed vectors (see TypeDescriptor_StdVector::WriteData) read the numbers of each
+//   item into the old layout and convert it like raw bytes
+// - raw component bytes are copied member by member into the new layout,
+//   scalars are converted if their type changed
+// New members keep their default value.
+//
+// A change that can't be done by name, like a split or a unit change, is written as
+// a migration that runs after the mapping:
+//
+// static void MigrateTransform_1_2(const Schema& old_schema, const void* old_data, void* new_data)
+// {
+//   Transform& transform = *static_cast<Transform*>(new_data);
+//   transform.rotation = Quaternion::FromEuler(old_schema.Get<Vector3>(old_data, "euler"));
+// }
+// FLX_REFL_REGISTER_MIGRATION(Transform, 1, 2, MigrateTransform_1_2)
+//
+// The version of a type is the highest version its migrations go to, 0 without any.
+// Migrations need the old bytes, so they run for raw component data and not for json structs.
+
+#define FLX_REFL_INTERNAL_CONCAT_IMPL(A, B) A##B
+#define FLX_REFL_INTERNAL_CONCAT(A, B) FLX_REFL_INTERNAL_CONCAT_IMPL(A, B)
+
+// Registers a migration of TYPE from one version to the next.
+// Place in the .cpp file next to FLX_REFL_REGISTER_START for the type.
+// Only links a node into a list during static initialization, nothing is allocated.
+#define FLX_REFL_REGISTER_MIGRATION(TYPE, FROM_VERSION, TO_VERSION, FUNCTION) \
+  static FlexEngine::Reflection::Migration FLX_REFL_INTERNAL_CONCAT(_flx_refl_migration_, __LINE__) \
+    { #TYPE, FROM_VERSION, TO_VERSION, FUNCTION };
+
+namespace FlexEngine
+{
+  struct FlxBinCursor;
+
+  namespace Reflection
+  {
+
+    struct TypeDescriptor;
+    struct TypeDescriptor_Struct;
+
+    // The layout of a struct as it was when a file was written
+    struct __FLX_API Schema
+    {
+      struct Member
+      {
+        std::string name;
+        std::string type; // full type name
+        uint64_t offset = 0;
+        uint64_t size = 0;
+      };
+
+      std::string type;
+      uint32_t version = 0;
+      uint64_t size = 0;
+      uint64_t hash = 0;
+      std::vector<Member> members;
+
+      // The current layout of a type, only structs have members
+      static Schema FromType(const TypeDescriptor* type_desc);
+
+      // Returns nullptr if there is no member with the name
+      const Member* Find(const std::string& name) const;
+
+      // Reads a member of an object in this layout, for migrations.
+      // Returns T{} if the member doesn't exist or has a different size.
+      template <typename T>
+      T Get(const void* data, const std::string& name) const
+      {
+        T value{};
+        const Member* member = Find(name);
+        if (member != nullptr && member->size == sizeof(T))
+        {
+          std::memcpy(&value, static_cast<const char*>(data) + member->offset, sizeof(T));
+        }
+        return value;
+      }
+
+      void WriteBinary(std::string& out) const;
+      bool ReadBinary(FlxBinCursor& cursor);
+
+      // ["type",version,size,hash,[["name","type",offset,size],...]]
+      void WriteJson(JsonWriter& writer) const;
+
+      // The reader is on the opening bracket
+      bool ReadJson(JsonReader& reader);
+    };
+
+    // Runs after the members were mapped by name.
+    // new_data is the object in the current layout, old_data in the layout of old_schema.
+    using MigrationFunction = void (*)(const Schema& old_schema, const void* old_data, void* new_data);
+
+    // Registered with FLX_REFL_REGISTER_MIGRATION
+    struct __FLX_API Migration
+    {
+      const char* type;
+      uint32_t from_version;
+      uint32_t to_version;
+      MigrationFunction function;
+      Migration* next = nullptr;
+
+      Migration(const char* type, uint32_t from_version, uint32_t to_version, MigrationFunction function);
+
+      static Migration*& list();
+
+      // The highest version the migrations of the type go to
+      static uint32_t GetVersion(const std::string& type);
+    };
+
+    // The schemas of a file and the plans for the types that changed since it was written.
+    //
+    // Writing:
+    // SchemaSet schemas;
+    // schemas.Collect(type_desc);
+    // schemas.WriteJson(writer);
+    //
+    // Reading:
+    // schemas.ReadJson(reader);
+    // if (schemas.Resolve()) reader.SetSchemas(&schemas);
+    class __FLX_API SchemaSet
+    {
+    public:
+      // Adds the schema of every struct reachable from the type
+      void Collect(const TypeDescriptor* type_desc);
+
+      void Add(Schema schema) { m_schemas.push_back(std::move(schema)); }
+      const std::vector<Schema>& GetSchemas() const { return m_schemas; }
+
+      // Compares the schemas with the current types and builds the plans for the changed ones.
+      // Returns true if any type changed. Call once after every schema was added.
+      bool Resolve();
+
+      bool HasChanges() const { return !m_plans.empty(); }
+
+      // True if objects of the type written with this schema set have to be migrated
+      bool NeedsMigration(const TypeDescriptor* type_desc) const { return m_plans.count(type_desc) != 0; }
+
+      // For json structs, the index of the current member for each member in the file, -1 to skip.
+      // Returns nullptr if the type didn't change.
+      const std::vector<int>* GetMemberMap(const TypeDescriptor* type_desc) const;
+
+      // Converts an object in the file layout to the current layout.
+      // new_data must hold type_desc->size bytes, old_size has to match the file schema.
+      bool Migrate(const TypeDescriptor* type_desc, const void* old_data, std::size_t old_size, void* new_data) const;
+
+      // Reads the numbers of one packed item written with the file schema and converts it.
+      // The reader is on the first number and is left on the last one.
+      bool ReadPacked(const TypeDescriptor* type_desc, void* obj, JsonReader& reader) const;
+
+      void WriteBinary(std::string& out) const;
+      bool ReadBinary(FlxBinCursor& cursor);
+      void WriteJson(JsonWriter& writer) const;
+      bool ReadJson(JsonReader& reader);
+
+    private:
+      // Copies a member, converting the scalar if its type changed
+      struct CopyOp
+      {
+        uint64_t old_offset;
+        uint64_t new_offset;
+        uint64_t size;
+        int old_scalar; // PackedScalar, None for a plain copy
+        int new_scalar;
+      };
+
+      struct Plan
+      {
+        std::size_t schema; // index into m_schemas
+        std::vector<int> member_map;
+        std::vector<CopyOp> ops;
+        std::vector<MigrationFunction> migrations;
+        std::vector<std::pair<uint64_t, int>> packed; // offset and PackedScalar of each number of a packed item
+      };
+
+      const Schema* Find(const std::string& type) const;
+      void BuildOps(const Schema& old_schema, const TypeDescriptor_Struct* type_desc, uint64_t old_base, uint64_t new_base, std::vector<CopyOp>& ops, int depth) const;
+      bool BuildPacked(const Schema& old_schema, uint64_t old_base, std::vector<std::pair<uint64_t, int>>& packed, int depth) const;
+
+      std::vector<Schema> m_schemas;
+      std::unordered_map<std::string, std::size_t> m_index; // by type name
+      std::unordered_map<const TypeDescriptor*, Plan> m_plans;
+    };
+
+  }
+}
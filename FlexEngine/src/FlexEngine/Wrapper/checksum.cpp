@@ -0,0 +1,102 @@
+#include "pch.h"
+
+#include "checksum.h"
+
+#include "simd.h" // <immintrin.h>
+
+#include <array>
+#include <cstring> // std::memcpy
+
+namespace FlexEngine
+{
+  namespace Checksum
+  {
+
+    #pragma region Internal Functions
+
+    // reflected Castagnoli polynomial
+    static constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78u;
+
+    using Internal_Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+    // tables[k][b] is the crc of byte b followed by k zero bytes
+    static Internal_Tables Internal_BuildTables()
+    {
+      Internal_Tables tables{};
+      for (uint32_t b = 0; b < 256; b++)
+      {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        tables[0][b] = crc;
+      }
+      for (std::size_t k = 1; k < tables.size(); k++)
+      {
+        for (uint32_t b = 0; b < 256; b++) tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+      }
+      return tables;
+    }
+
+    static const Internal_Tables& Internal_GetTables()
+    {
+      static const Internal_Tables tables = Internal_BuildTables();
+      return tables;
+    }
+
+    // slicing-by-8, 8 table lookups per 8 bytes
+    static uint32_t Internal_CRC32CScalar(const uint8_t* data, std::size_t size, uint32_t crc)
+    {
+      const Internal_Tables& t = Internal_GetTables();
+
+      for (; size >= 8; size -= 8, data += 8)
+      {
+        uint32_t lo, hi;
+        std::memcpy(&lo, data, sizeof(lo));
+        std::memcpy(&hi, data + 4, sizeof(hi));
+        lo ^= crc;
+        crc =
+          t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+      }
+      for (; size > 0; size--, data++) crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+
+      return crc;
+    }
+
+    // the crc32 instruction implements the same polynomial
+    SIMD_TARGET_SSE42 static uint32_t Internal_CRC32CSSE42(const uint8_t* data, std::size_t size, uint32_t crc)
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+      uint64_t crc64 = crc;
+      for (; size >= 8; size -= 8, data += 8)
+      {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        crc64 = _mm_crc32_u64(crc64, value);
+      }
+      crc = static_cast<uint32_t>(crc64);
+#endif
+      for (; size >= 4; size -= 4, data += 4)
+      {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        crc = _mm_crc32_u32(crc, value);
+      }
+      for (; size > 0; size--, data++) crc = _mm_crc32_u8(crc, *data);
+
+      return crc;
+    }
+
+    #pragma endregion
+
+    __FLX_API uint32_t CRC32C(const void* data, std::size_t size, uint32_t crc)
+    {
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+
+      // the state is inverted before and after, so that checksums chain
+      crc = ~crc;
+      crc = SIMD::HasSSE42() ? Internal_CRC32CSSE42(bytes, size, crc) : Internal_CRC32CScalar(bytes, size, crc);
+      return ~crc;
+    }
+
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// CRC32C (Castagnoli) checksums for FlexFormat files.
+//
+// Uses the SSE4.2 crc32 instruction when the CPU supports it, 8 bytes per instruction,
+// and a slicing-by-8 table otherwise. Both paths give the same result.
+// Checksums can be chained, pass the previous result as crc to continue it.
+// Nothing here logs, so it can run on any thread.
+
+namespace FlexEngine
+{
+  namespace Checksum
+  {
+
+    __FLX_API uint32_t CRC32C(const void* data, std::size_t size, uint32_t crc = 0);
+
+    inline uint32_t CRC32C(std::string_view data, uint32_t crc = 0)
+    {
+      return CRC32C(data.data(), data.size(), crc);
+    }
+
+  }
+}
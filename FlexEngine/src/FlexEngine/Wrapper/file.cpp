@@ -2,6 +2,8 @@
 
 #include "file.h"
 
+#include "flexcompression.h"
+
 namespace FlexEngine
 {
 
@@ -72,6 +74,17 @@ namespace FlexEngine
       return data = ""; // return an empty string in case data was partially read/corrupted
     }
 
+    // compressed containers are detected by their magic bytes
+    if (FlxCompression::IsCompressed(data))
+    {
+      is_compressed = true;
+      if (!FlxCompression::Decompress(data, data))
+      {
+        Log::Error("Failed to decompress file: " + std::to_string(path));
+        return data = "";
+      }
+    }
+
     return data;
   }
 
@@ -96,7 +109,8 @@ namespace FlexEngine
     }
 
     data = _data;
-    file << data;
+    if (is_compressed) file << FlxCompression::Compress(data);
+    else file << data;
 
     if (file.fail())
     {
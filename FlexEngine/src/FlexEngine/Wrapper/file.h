@@ -30,6 +30,11 @@ namespace FlexEngine
     Path path;
     std::string data;
 
+    // Write() compresses the data into a container (flexcompression.h), data itself is never compressed.
+    // Read() sets it when the file on disk is compressed, so the file stays compressed when it is written back.
+    // Set it before Write() to compress a file, clear it to write plain data.
+    bool is_compressed = false;
+
     #pragma region File Registry Management Functions
 
     // Adds a file to the registry if it doesn't exist
@@ -2,7 +2,16 @@
 
 #include "flexbase64.h"
 
-#include <wincrypt.h> // CryptBinaryToStringA, CryptStringToBinaryA
+#include "simd.h" // <immintrin.h>
+
+#include <cstring> // std::memcpy
+
+// The SIMD paths follow Wojciech Muła's base64 algorithms.
+// References:
+//  Base64 encoding with SIMD instructions
+//    http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+//  Base64 decoding with SIMD instructions
+//    http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html
 
 namespace FlexEngine
 {
@@ -11,106 +20,342 @@ namespace FlexEngine
 
     #pragma region Internal Function
 
-    bool Internal_ValidateBase64(const std::string& data)
+    static const char* s_encode_table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // 0xFF marks characters that aren't base64, '=' included
+    struct Internal_DecodeTable
     {
-      // guard
-      if (data.empty()) return false;
+      uint8_t values[256];
 
-      static const std::string base64_chars =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-        "abcdefghijklmnopqrstuvwxyz"
-        "0123456789+/"
-      ;
+      Internal_DecodeTable()
+      {
+        std::memset(values, 0xFF, sizeof(values));
+        for (uint8_t i = 0; i < 64; i++) values[static_cast<uint8_t>(s_encode_table[i])] = i;
+      }
+    };
+    static const Internal_DecodeTable s_decode_table;
 
-      // check if the data is a valid base64 string
-      for (char c : data)
+    // Encodes whole 3 byte groups, returns the number of bytes consumed
+    static std::size_t Internal_EncodeScalar(const BYTE* in, std::size_t size, char* out)
+    {
+      std::size_t i = 0;
+      for (; i + 3 <= size; i += 3)
       {
-        if (base64_chars.find(c) == std::string::npos && c != '=') return false;
+        uint32_t value = (uint32_t(in[i]) << 16) | (uint32_t(in[i + 1]) << 8) | in[i + 2];
+        *out++ = s_encode_table[(value >> 18) & 63];
+        *out++ = s_encode_table[(value >> 12) & 63];
+        *out++ = s_encode_table[(value >> 6) & 63];
+        *out++ = s_encode_table[value & 63];
       }
+      return i;
+    }
 
-      return true;
+    // Decodes whole 4 character groups without padding.
+    // Returns false if a character is invalid.
+    static bool Internal_DecodeScalar(const char* in, std::size_t size, BYTE* out)
+    {
+      uint8_t invalid = 0;
+      for (std::size_t i = 0; i + 4 <= size; i += 4)
+      {
+        uint8_t a = s_decode_table.values[static_cast<uint8_t>(in[i])];
+        uint8_t b = s_decode_table.values[static_cast<uint8_t>(in[i + 1])];
+        uint8_t c = s_decode_table.values[static_cast<uint8_t>(in[i + 2])];
+        uint8_t d = s_decode_table.values[static_cast<uint8_t>(in[i + 3])];
+        invalid |= a | b | c | d;
+
+        uint32_t value = (uint32_t(a) << 18) | (uint32_t(b) << 12) | (uint32_t(c) << 6) | d;
+        *out++ = static_cast<BYTE>(value >> 16);
+        *out++ = static_cast<BYTE>(value >> 8);
+        *out++ = static_cast<BYTE>(value);
+      }
+
+      // every valid value is below 64, 0xFF sets the top bits
+      return (invalid & 0xC0) == 0;
     }
 
-    std::string Internal_GetErrorMessage()
+    #pragma region SSSE3
+
+    // 6 bit indices to ascii, 16 at a time
+    SIMD_TARGET_SSSE3 static inline __m128i Internal_EncodeLookupSSSE3(__m128i indices)
     {
-      DWORD error_code = GetLastError();
-      LPSTR message_buffer = nullptr;
-      DWORD size = FormatMessageA(
-        FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-        nullptr, error_code, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&message_buffer, 0, nullptr
+      // 0..25 -> 'A', 26..51 -> 'a', 52..61 -> '0', 62 -> '+', 63 -> '/'
+      __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+      __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+      result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+
+      const __m128i shift_lut = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0
       );
-      std::string message(message_buffer, size);
-      LocalFree(message_buffer);
-      return message;
+      result = _mm_shuffle_epi8(shift_lut, result);
+      return _mm_add_epi8(result, indices);
+    }
+
+    // 12 bytes to 16 characters per iteration, reads 16 bytes
+    SIMD_TARGET_SSSE3 static std::size_t Internal_EncodeSSSE3(const BYTE* in, std::size_t size, char* out)
+    {
+      std::size_t i = 0;
+      for (; i + 16 <= size; i += 12)
+      {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+        // spread 3 bytes over 4 lanes and extract the 6 bit indices
+        block = _mm_shuffle_epi8(block, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        __m128i t0 = _mm_and_si128(block, _mm_set1_epi32(0x0FC0FC00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(block, _mm_set1_epi32(0x003F03F0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(t1, t3);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), Internal_EncodeLookupSSSE3(indices));
+        out += 16;
+      }
+      return i;
+    }
+
+    // 16 characters to 12 bytes per iteration.
+    // Returns the number of characters consumed, stops early on an invalid block.
+    SIMD_TARGET_SSSE3 static std::size_t Internal_DecodeSSSE3(const char* in, std::size_t size, BYTE* out)
+    {
+      const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+      const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+      const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m128i mask_2f = _mm_set1_epi8(0x2F);
+      const __m128i pack_shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+      std::size_t i = 0;
+      for (; i + 16 <= size; i += 16)
+      {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+        // validate, lo & hi is non-zero for every character outside the alphabet
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(block, 4), mask_2f);
+        __m128i lo_nibbles = _mm_and_si128(block, mask_2f);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF) break;
+
+        // ascii to 6 bit values
+        __m128i eq_2f = _mm_cmpeq_epi8(block, mask_2f);
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+        block = _mm_add_epi8(block, roll);
+
+        // pack 4 x 6 bits into 3 bytes
+        block = _mm_maddubs_epi16(block, _mm_set1_epi32(0x01400140));
+        block = _mm_madd_epi16(block, _mm_set1_epi32(0x00011000));
+        block = _mm_shuffle_epi8(block, pack_shuffle);
+
+        // exactly 12 bytes
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), block);
+        uint32_t tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(block, 8)));
+        std::memcpy(out + 8, &tail, sizeof(tail));
+        out += 12;
+      }
+      return i;
     }
 
     #pragma endregion
 
-    __FLX_API std::string Encode(const std::vector<BYTE>& data)
+    #pragma region AVX2
+
+    // 24 bytes to 32 characters per iteration, reads 28 bytes
+    SIMD_TARGET_AVX2 static std::size_t Internal_EncodeAVX2(const BYTE* in, std::size_t size, char* out)
     {
-      // guard
-      if (data.empty()) return "";
+      std::size_t i = 0;
+      for (; i + 28 <= size; i += 24)
+      {
+        // 12 bytes per lane
+        __m128i lo_half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi_half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12));
+        __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(lo_half), hi_half, 1);
+
+        block = _mm256_shuffle_epi8(block, _mm256_set_epi8(
+          10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+          10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+        ));
+        __m256i t0 = _mm256_and_si256(block, _mm256_set1_epi32(0x0FC0FC00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(block, _mm256_set1_epi32(0x003F03F0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t1, t3);
 
-      DWORD data_size = static_cast<DWORD>(data.size());
-      DWORD size = 0;
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        const __m256i shift_lut = _mm256_setr_epi8(
+          'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+          '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+          'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+          '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0
+        );
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, result), indices);
 
-      DWORD flags = CRYPT_STRING_BASE64 | CRYPT_STRING_NOCRLF;
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), result);
+        out += 32;
+      }
+      return i;
+    }
 
-      // get size
-      if (!CryptBinaryToStringA(data.data(), data_size, flags, nullptr, &size))
+    // 32 characters to 24 bytes per iteration.
+    // Returns the number of characters consumed, stops early on an invalid block.
+    SIMD_TARGET_AVX2 static std::size_t Internal_DecodeAVX2(const char* in, std::size_t size, BYTE* out)
+    {
+      const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+      );
+      const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+      );
+      const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+      );
+      const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+      const __m256i pack_shuffle = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+      );
+      const __m256i pack_lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+      std::size_t i = 0;
+      for (; i + 32 <= size; i += 32)
       {
-        Log::Error("Base64 encoding: Failed to get the size of the encoded data." + Internal_GetErrorMessage());
-        return "";
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(block, 4), mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(block, mask_2f);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != -1) break;
+
+        __m256i eq_2f = _mm256_cmpeq_epi8(block, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        block = _mm256_add_epi8(block, roll);
+
+        block = _mm256_maddubs_epi16(block, _mm256_set1_epi32(0x01400140));
+        block = _mm256_madd_epi16(block, _mm256_set1_epi32(0x00011000));
+        block = _mm256_shuffle_epi8(block, pack_shuffle);
+
+        // 12 bytes per lane, move them together and store exactly 24 bytes
+        block = _mm256_permutevar8x32_epi32(block, pack_lanes);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(block));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 16), _mm256_extracti128_si256(block, 1));
+        out += 24;
       }
+      return i;
+    }
 
-      // allocate
-      std::string result(size, '\0');
+    #pragma endregion
+
+    #pragma endregion
 
-      // encode
-      if (!CryptBinaryToStringA(data.data(), data_size, flags, &result[0], &size))
+    __FLX_API std::size_t GetEncodedSize(std::size_t size)
+    {
+      return (size + 2) / 3 * 4;
+    }
+
+    __FLX_API std::size_t GetDecodedSize(std::string_view data)
+    {
+      std::size_t size = data.size();
+      if (size % 4 == 1) return 0;
+
+      std::size_t padding = 0;
+      if (size % 4 == 0 && size >= 4)
       {
-        Log::Error("Base64 encoding: Failed to encode the data." + Internal_GetErrorMessage());
-        return "";
+        if (data[size - 1] == '=') padding++;
+        if (data[size - 2] == '=') padding++;
       }
 
-      // CryptBinaryToStringA includes the null terminator in the string.
-      // This removes it.
-      result.pop_back();
+      // unpadded input, a trailing group of 2 or 3 characters holds 1 or 2 bytes
+      std::size_t remainder = size % 4;
+      return size / 4 * 3 - padding + ((remainder != 0) ? remainder - 1 : 0);
+    }
 
-      return result;
+    __FLX_API std::string Encode(const std::vector<BYTE>& data)
+    {
+      return Encode(data.data(), data.size());
     }
 
-    __FLX_API std::vector<BYTE> Decode(const std::string& data)
+    __FLX_API std::string Encode(const void* data, std::size_t size)
     {
       // guard
-      if (data.empty()) return {};
+      if (size == 0) return "";
+
+      const BYTE* in = static_cast<const BYTE*>(data);
+      std::string result(GetEncodedSize(size), '\0');
+      char* out = result.data();
+
+      // widest path first, each path returns how far it got
+      std::size_t consumed = 0;
+      if (SIMD::HasAVX2()) consumed = Internal_EncodeAVX2(in, size, out);
+      if (SIMD::HasSSSE3()) consumed += Internal_EncodeSSSE3(in + consumed, size - consumed, out + consumed / 3 * 4);
+      consumed += Internal_EncodeScalar(in + consumed, size - consumed, out + consumed / 3 * 4);
+      out += consumed / 3 * 4;
 
-      // validate
-      if (!Internal_ValidateBase64(data))
+      // last 1 or 2 bytes with padding
+      std::size_t remaining = size - consumed;
+      if (remaining > 0)
       {
-        Log::Error("Base64 decoding: The input data is not a valid base64 string.");
-        return {};
+        uint32_t value = uint32_t(in[consumed]) << 16;
+        if (remaining == 2) value |= uint32_t(in[consumed + 1]) << 8;
+        *out++ = s_encode_table[(value >> 18) & 63];
+        *out++ = s_encode_table[(value >> 12) & 63];
+        *out++ = (remaining == 2) ? s_encode_table[(value >> 6) & 63] : '=';
+        *out++ = '=';
       }
 
-      DWORD data_size = static_cast<DWORD>(data.size() + 1);
-      DWORD size = 0;
+      return result;
+    }
+
+    __FLX_API bool Decode(std::string_view data, BYTE* out, std::size_t out_size)
+    {
+      std::size_t decoded_size = GetDecodedSize(data);
+      if (data.empty() || decoded_size == 0 || out_size < decoded_size) return false;
+
+      // the last group may hold padding, the fast paths only see whole groups before it
+      std::size_t size = data.size();
+      std::size_t body_size = (size % 4 == 0) ? size - 4 : size - size % 4;
+      const char* in = data.data();
+
+      std::size_t consumed = 0;
+      if (SIMD::HasAVX2()) consumed = Internal_DecodeAVX2(in, body_size, out);
+      if (SIMD::HasSSSE3()) consumed += Internal_DecodeSSSE3(in + consumed, body_size - consumed, out + consumed / 4 * 3);
 
-      DWORD flags = CRYPT_STRING_BASE64;// | CRYPT_STRING_NOCRLF;
+      // the scalar path finishes the body and finds the invalid character if a fast path stopped early
+      if (!Internal_DecodeScalar(in + consumed, body_size - consumed, out + consumed / 4 * 3)) return false;
+      out += body_size / 4 * 3;
 
-      // get size
-      if (!CryptStringToBinaryA(data.c_str(), data_size, flags, nullptr, &size, nullptr, nullptr))
+      // last group, 2 to 4 characters
+      char tail[4] = { 'A', 'A', 'A', 'A' };
+      std::size_t tail_size = size - body_size;
+      std::size_t tail_bytes = decoded_size - body_size / 4 * 3;
+      std::memcpy(tail, in + body_size, tail_size);
+      if (tail_size == 4)
       {
-        Log::Error("Base64 decoding: Failed to get the size of the decoded data. " + Internal_GetErrorMessage());
-        return {};
+        // '=' is only allowed as padding at the end
+        if (tail[3] == '=') tail[3] = 'A';
+        if (tail[2] == '=' && tail_bytes == 1) tail[2] = 'A';
       }
 
-      // allocate
-      std::vector<BYTE> result(size);
+      BYTE tail_out[3];
+      if (!Internal_DecodeScalar(tail, 4, tail_out)) return false;
+      std::memcpy(out, tail_out, tail_bytes);
+
+      return true;
+    }
+
+    __FLX_API std::vector<BYTE> Decode(const std::string& data)
+    {
+      // guard
+      if (data.empty()) return {};
 
-      // decode
-      if (!CryptStringToBinaryA(data.c_str(), data_size, flags, result.data(), &size, nullptr, nullptr))
+      std::vector<BYTE> result(GetDecodedSize(data));
+      if (!Decode(data, result.data(), result.size()))
       {
-        Log::Error("Base64 decoding: Failed to decode the data. " + Internal_GetErrorMessage());
+        Log::Error("Base64 decoding: The input data is not a valid base64 string.");
         return {};
       }
 
@@ -118,4 +363,4 @@ namespace FlexEngine
     }
 
   }
-}
\ No newline at end of file
+}
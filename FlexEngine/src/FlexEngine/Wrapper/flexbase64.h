@@ -1,18 +1,46 @@
 #pragma once
 
 #include "flx_api.h"
+
+#ifdef _WIN32
 #include "flx_windows.h" // BYTE
+#else
+typedef unsigned char BYTE;
+#endif
 
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// Standard base64 (RFC 4648) with + and / and = padding.
+//
+// The codec is self-contained and picks the fastest path the CPU supports at runtime,
+// AVX2 (32 characters at a time), SSSE3 (16 characters at a time) or scalar.
+// Decoding validates the input in the same pass, there is no separate validation step.
+
 namespace FlexEngine
 {
   namespace Base64
   {
 
     __FLX_API std::string Encode(const std::vector<BYTE>& data);
+    __FLX_API std::string Encode(const void* data, std::size_t size);
+
+    // Returns an empty vector and logs an error if the input isn't valid base64.
     __FLX_API std::vector<BYTE> Decode(const std::string& data);
 
+    // Number of characters Encode() writes for size bytes
+    __FLX_API std::size_t GetEncodedSize(std::size_t size);
+
+    // Number of bytes the input decodes to, padding is taken into account.
+    // Returns 0 if the length can't be base64.
+    __FLX_API std::size_t GetDecodedSize(std::string_view data);
+
+    // Decodes into a caller provided buffer of at least GetDecodedSize(data) bytes.
+    // Returns false without logging if the input isn't valid base64,
+    // the contents of out are unspecified in that case.
+    __FLX_API bool Decode(std::string_view data, BYTE* out, std::size_t out_size);
+
   }
 }
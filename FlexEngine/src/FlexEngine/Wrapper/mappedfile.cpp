@@ -0,0 +1,107 @@
+#include "pch.h"
+
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include "flx_windows.h"
+#else
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close
+#endif
+
+namespace FlexEngine
+{
+
+#ifdef _WIN32
+
+  std::shared_ptr<MappedFile> MappedFile::Open(const Path& path)
+  {
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->m_path = path.get();
+
+    HANDLE file = CreateFileW(
+      path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE)
+    {
+      Log::Warning("Failed to open file for mapping: " + path.string());
+      return nullptr;
+    }
+    mapped->m_file_handle = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return nullptr;
+    mapped->m_size = static_cast<std::size_t>(size.QuadPart);
+
+    // PAGE_WRITECOPY + FILE_MAP_COPY gives a private copy-on-write view
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+      Log::Warning("Failed to map file: " + path.string());
+      return nullptr;
+    }
+    mapped->m_mapping_handle = mapping;
+
+    mapped->m_data = reinterpret_cast<char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+    if (mapped->m_data == nullptr)
+    {
+      Log::Warning("Failed to map view of file: " + path.string());
+      return nullptr;
+    }
+
+    return mapped;
+  }
+
+  MappedFile::~MappedFile()
+  {
+    if (m_data != nullptr) UnmapViewOfFile(m_data);
+    if (m_mapping_handle != nullptr) CloseHandle(reinterpret_cast<HANDLE>(m_mapping_handle));
+    if (m_file_handle != nullptr) CloseHandle(reinterpret_cast<HANDLE>(m_file_handle));
+  }
+
+#else
+
+  std::shared_ptr<MappedFile> MappedFile::Open(const Path& path)
+  {
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->m_path = path.get();
+
+    int file = open(path.string().c_str(), O_RDONLY);
+    if (file < 0)
+    {
+      Log::Warning("Failed to open file for mapping: " + path.string());
+      return nullptr;
+    }
+
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+      close(file);
+      return nullptr;
+    }
+    mapped->m_size = static_cast<std::size_t>(file_stat.st_size);
+
+    // MAP_PRIVATE with PROT_WRITE gives a private copy-on-write view
+    void* data = mmap(nullptr, mapped->m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file); // the mapping keeps its own reference to the file
+    if (data == MAP_FAILED)
+    {
+      Log::Warning("Failed to map file: " + path.string());
+      return nullptr;
+    }
+    mapped->m_data = reinterpret_cast<char*>(data);
+
+    return mapped;
+  }
+
+  MappedFile::~MappedFile()
+  {
+    if (m_data != nullptr) munmap(m_data, m_size);
+  }
+
+#endif
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "path.h" // <filesystem> <iostream> <string> <exception> <unordered_map> <set>
+
+#include <memory>
+
+namespace FlexEngine
+{
+
+  // Read-only view of a file that is mapped into memory instead of read into a string.
+  // The pages are loaded by the OS on first access and are shared with the file cache,
+  // so opening a large file costs almost nothing until the data is used.
+  //
+  // The mapping is private and copy-on-write (MAP_PRIVATE / FILE_MAP_COPY).
+  // Writing to Data() is allowed, the written pages are copied and the file is never changed.
+  //
+  // On Windows the file can't be written, truncated or replaced while it is mapped.
+  // Scenes loaded with Scene::LoadMapped() copy their rows out of the mapping before they
+  // are saved over the same file, see Scene::Internal_ReleaseMappedFile().
+  //
+  // Usage:
+  // std::shared_ptr<MappedFile> mapped = MappedFile::Open(path);
+  // if (mapped) Parse(mapped->Data(), mapped->Size());
+  class __FLX_API MappedFile
+  {
+  public:
+    // Returns nullptr if the file can't be mapped.
+    // Empty files can't be mapped and also return nullptr.
+    static std::shared_ptr<MappedFile> Open(const Path& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* Data() const { return m_data; }
+    std::size_t Size() const { return m_size; }
+    const std::filesystem::path& GetPath() const { return m_path; }
+
+  private:
+    MappedFile() = default;
+
+    char* m_data = nullptr;
+    std::size_t m_size = 0;
+    std::filesystem::path m_path;
+
+    // platform handles
+    void* m_file_handle = nullptr;
+    void* m_mapping_handle = nullptr;
+  };
+
+}
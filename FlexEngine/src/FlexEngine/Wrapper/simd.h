@@ -2,6 +2,12 @@
 
 #include <immintrin.h>
 
+#ifdef _MSC_VER
+  #include <intrin.h> // __cpuid, __cpuidex, _xgetbv
+#else
+  #include <cpuid.h> // __get_cpuid, __get_cpuid_count
+#endif
+
 // Wrapper for SIMD operations.
 // 
 // __m128 is a 128-bit SIMD register type.
@@ -40,3 +46,99 @@
       SIMD_SET(BX, BY, BZ, BW) \
     ) \
   )
+
+
+// GCC and Clang refuse to inline intrinsics into functions that weren't compiled for the
+// instruction set, MSVC doesn't care. Mark functions that use AVX2/SSSE3 intrinsics with these.
+#ifdef _MSC_VER
+  #define SIMD_TARGET_SSSE3
+  #define SIMD_TARGET_SSE42
+  #define SIMD_TARGET_AVX2
+#else
+  #define SIMD_TARGET_SSSE3 __attribute__((target("ssse3")))
+  #define SIMD_TARGET_SSE42 __attribute__((target("sse4.2")))
+  #define SIMD_TARGET_AVX2  __attribute__((target("avx2")))
+#endif
+
+namespace FlexEngine
+{
+  namespace SIMD
+  {
+
+    // Runtime CPU feature detection.
+    // The results are cached after the first call.
+    // Use these to select a code path, the engine is not compiled with /arch:AVX2.
+
+    struct CPUFeatures
+    {
+      bool ssse3 = false;
+      bool sse42 = false;
+      bool avx2 = false;
+    };
+
+    inline CPUFeatures Internal_DetectCPUFeatures()
+    {
+      CPUFeatures features;
+
+#ifdef _MSC_VER
+      int info[4]{};
+      __cpuid(info, 0);
+      int max_leaf = info[0];
+
+      __cpuid(info, 1);
+      unsigned ecx1 = static_cast<unsigned>(info[2]);
+
+      unsigned ebx7 = 0;
+      if (max_leaf >= 7)
+      {
+        __cpuidex(info, 7, 0);
+        ebx7 = static_cast<unsigned>(info[1]);
+      }
+#else
+      unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+      unsigned max_leaf = __get_cpuid_max(0, nullptr);
+
+      __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+      unsigned ecx1 = ecx;
+
+      unsigned ebx7 = 0;
+      if (max_leaf >= 7)
+      {
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+        ebx7 = ebx;
+      }
+#endif
+
+      features.ssse3 = (ecx1 & (1u << 9)) != 0;
+      features.sse42 = (ecx1 & (1u << 20)) != 0;
+
+      // AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0)
+      bool osxsave = (ecx1 & (1u << 27)) != 0;
+      bool avx = (ecx1 & (1u << 28)) != 0;
+      if (osxsave && avx)
+      {
+#ifdef _MSC_VER
+        unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned xcr0_lo = 0, xcr0_hi = 0;
+        __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        unsigned long long xcr0 = (static_cast<unsigned long long>(xcr0_hi) << 32) | xcr0_lo;
+#endif
+        features.avx2 = ((xcr0 & 0x6) == 0x6) && ((ebx7 & (1u << 5)) != 0);
+      }
+
+      return features;
+    }
+
+    inline const CPUFeatures& GetCPUFeatures()
+    {
+      static const CPUFeatures features = Internal_DetectCPUFeatures();
+      return features;
+    }
+
+    inline bool HasSSSE3() { return GetCPUFeatures().ssse3; }
+    inline bool HasSSE42() { return GetCPUFeatures().sse42; }
+    inline bool HasAVX2() { return GetCPUFeatures().avx2; }
+
+  }
+}
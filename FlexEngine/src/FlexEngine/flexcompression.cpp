@@ -0,0 +1,328 @@
+#include "pch.h"
+
+#include "flexcompression.h"
+
+#include "DataStructures/parallelfor.h" // ParallelFor
+
+#include <cstring> // std::memcpy, std::memcmp
+
+namespace FlexEngine
+{
+
+  #pragma region Internal Functions
+
+  static constexpr std::size_t MIN_MATCH = 4;
+  static constexpr std::size_t LAST_LITERALS = 5;   // a block always ends in literals
+  static constexpr std::size_t MATCH_FIND_LIMIT = 12; // no match starts in the last bytes
+  static constexpr std::size_t MAX_OFFSET = 65535;
+  static constexpr int HASH_LOG = 16;
+
+  static uint32_t Internal_Read32(const uint8_t* ptr)
+  {
+    uint32_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+  }
+
+  // Knuth's multiplicative hash of the next 4 bytes
+  static uint32_t Internal_Hash(uint32_t sequence)
+  {
+    return (sequence * 2654435761u) >> (32 - HASH_LOG);
+  }
+
+  // Lengths of 15 and more continue in bytes of 255
+  static uint8_t* Internal_WriteLength(uint8_t* out, std::size_t length)
+  {
+    while (length >= 255)
+    {
+      *out++ = 255;
+      length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+  }
+
+  static bool Internal_ReadLength(const uint8_t*& in, const uint8_t* end, std::size_t& length)
+  {
+    uint8_t byte;
+    do
+    {
+      if (in >= end) return false;
+      byte = *in++;
+      length += byte;
+    } while (byte == 255);
+    return true;
+  }
+
+  #pragma endregion
+
+  #pragma region FlxCompression
+
+  bool FlxCompression::IsCompressed(const char* data, std::size_t size)
+  {
+    return size >= sizeof(FlxZipHeader) && std::memcmp(data, FLXZIP_MAGIC, 4) == 0;
+  }
+
+  std::size_t FlxCompression::CompressBlock(const char* src, std::size_t size, char* dst)
+  {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+    const uint8_t* end = in + size;
+    const uint8_t* anchor = in;
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+
+    if (size > MATCH_FIND_LIMIT)
+    {
+      // position of the last occurrence of each hashed sequence
+      std::vector<uint32_t> table(std::size_t(1) << HASH_LOG, 0);
+
+      const uint8_t* match_limit = end - MATCH_FIND_LIMIT;
+      const uint8_t* match_end = end - LAST_LITERALS;
+      const uint8_t* ip = in;
+
+      // data that doesn't compress is skipped faster the longer there is no match
+      std::size_t misses = 0;
+
+      while (ip < match_limit)
+      {
+        uint32_t sequence = Internal_Read32(ip);
+        uint32_t& slot = table[Internal_Hash(sequence)];
+        const uint8_t* ref = in + slot;
+        slot = static_cast<uint32_t>(ip - in);
+
+        if (ref >= ip || static_cast<std::size_t>(ip - ref) > MAX_OFFSET || Internal_Read32(ref) != sequence)
+        {
+          ip += 1 + (misses++ >> 6);
+          continue;
+        }
+        misses = 0;
+
+        std::size_t match_length = MIN_MATCH;
+        while (ip + match_length < match_end && ref[match_length] == ip[match_length]) match_length++;
+
+        // [token][literal length][literals][offset][match length]
+        std::size_t literal_length = static_cast<std::size_t>(ip - anchor);
+        uint8_t* token = out++;
+        *token = static_cast<uint8_t>(((literal_length < 15) ? literal_length : 15) << 4);
+        if (literal_length >= 15) out = Internal_WriteLength(out, literal_length - 15);
+        std::memcpy(out, anchor, literal_length);
+        out += literal_length;
+
+        uint16_t offset = static_cast<uint16_t>(ip - ref);
+        *out++ = static_cast<uint8_t>(offset & 0xFF);
+        *out++ = static_cast<uint8_t>(offset >> 8);
+
+        std::size_t extra_length = match_length - MIN_MATCH;
+        *token |= static_cast<uint8_t>((extra_length < 15) ? extra_length : 15);
+        if (extra_length >= 15) out = Internal_WriteLength(out, extra_length - 15);
+
+        ip += match_length;
+        anchor = ip;
+      }
+    }
+
+    // the rest is literals, without an offset
+    std::size_t literal_length = static_cast<std::size_t>(end - anchor);
+    *out++ = static_cast<uint8_t>(((literal_length < 15) ? literal_length : 15) << 4);
+    if (literal_length >= 15) out = Internal_WriteLength(out, literal_length - 15);
+    std::memcpy(out, anchor, literal_length);
+    out += literal_length;
+
+    return static_cast<std::size_t>(out - reinterpret_cast<uint8_t*>(dst));
+  }
+
+  bool FlxCompression::DecompressBlock(const char* src, std::size_t src_size, char* dst, std::size_t dst_size)
+  {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+    const uint8_t* in_end = in + src_size;
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    uint8_t* out_begin = out;
+    uint8_t* out_end = out + dst_size;
+
+    while (in < in_end)
+    {
+      uint8_t token = *in++;
+
+      std::size_t literal_length = token >> 4;
+      if (literal_length == 15 && !Internal_ReadLength(in, in_end, literal_length)) return false;
+
+      // guard: overruns
+      if (literal_length > static_cast<std::size_t>(in_end - in) || literal_length > static_cast<std::size_t>(out_end - out)) return false;
+      std::memcpy(out, in, literal_length);
+      in += literal_length;
+      out += literal_length;
+
+      // the last sequence has no match
+      if (in == in_end) break;
+
+      if (in_end - in < 2) return false;
+      std::size_t offset = static_cast<std::size_t>(in[0]) | (static_cast<std::size_t>(in[1]) << 8);
+      in += 2;
+
+      std::size_t match_length = token & 15;
+      if (match_length == 15 && !Internal_ReadLength(in, in_end, match_length)) return false;
+      match_length += MIN_MATCH;
+
+      // guard: the match is outside of the block
+      if (offset == 0 || offset > static_cast<std::size_t>(out - out_begin) || match_length > static_cast<std::size_t>(out_end - out)) return false;
+
+      // the match can overlap the bytes it writes, which repeats them
+      const uint8_t* match = out - offset;
+      if (offset >= match_length)
+      {
+        std::memcpy(out, match, match_length);
+        out += match_length;
+      }
+      else
+      {
+        for (std::size_t i = 0; i < match_length; i++) *out++ = *match++;
+      }
+    }
+
+    return out == out_end;
+  }
+
+  std::string FlxCompression::Compress(std::string_view data, std::size_t block_size)
+  {
+    // guard: the block size is stored in 32 bits and a stored block uses the high bit
+    if (block_size == 0 || block_size >= FLXZIP_STORED_BLOCK) block_size = FLXZIP_DEFAULT_BLOCK_SIZE;
+
+    std::size_t block_count = (data.size() + block_size - 1) / block_size;
+
+    std::vector<std::string> blocks(block_count);
+    std::vector<uint32_t> stored_sizes(block_count);
+    ParallelFor(block_count, [&](std::size_t i)
+    {
+      std::size_t offset = i * block_size;
+      std::size_t size = (std::min)(block_size, data.size() - offset);
+
+      std::string& block = blocks[i];
+      block.resize(GetMaxBlockSize(size));
+      std::size_t compressed_size = CompressBlock(data.data() + offset, size, block.data());
+
+      if (compressed_size >= size)
+      {
+        block.assign(data.data() + offset, size);
+        stored_sizes[i] = static_cast<uint32_t>(size) | FLXZIP_STORED_BLOCK;
+      }
+      else
+      {
+        block.resize(compressed_size);
+        stored_sizes[i] = static_cast<uint32_t>(compressed_size);
+      }
+    }, (block_count > 1) ? 0 : 1);
+
+    FlxZipHeader header{};
+    std::memcpy(header.magic, FLXZIP_MAGIC, sizeof(header.magic));
+    header.format_version = FLXZIP_VERSION;
+    header.raw_size = data.size();
+    header.block_size = static_cast<uint32_t>(block_size);
+    header.block_count = static_cast<uint32_t>(block_count);
+
+    std::size_t total_size = sizeof(FlxZipHeader) + sizeof(uint32_t) * block_count;
+    for (const std::string& block : blocks) total_size += block.size();
+
+    std::string out;
+    out.reserve(total_size);
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    // empty data has no blocks, and an empty vector may not have a data pointer
+    if (block_count > 0) out.append(reinterpret_cast<const char*>(stored_sizes.data()), sizeof(uint32_t) * block_count);
+    for (const std::string& block : blocks) out += block;
+
+    return out;
+  }
+
+  bool FlxCompression::Decompress(std::string_view data, std::string& out)
+  {
+    // out may be the data, it is only written once the data was read
+    FlxZipReader reader(data);
+    if (!reader.IsValid())
+    {
+      out.clear();
+      return false;
+    }
+
+    std::string decompressed(reader.GetRawSize(), '\0');
+    std::vector<char> block_ok(reader.GetBlockCount(), 0);
+    ParallelFor(reader.GetBlockCount(), [&](std::size_t i)
+    {
+      block_ok[i] = reader.DecompressBlock(i, decompressed.data() + i * reader.GetBlockSize());
+    }, (reader.GetBlockCount() > 1) ? 0 : 1);
+
+    for (char ok : block_ok)
+    {
+      if (!ok)
+      {
+        out.clear();
+        return false;
+      }
+    }
+
+    out = std::move(decompressed);
+    return true;
+  }
+
+  #pragma endregion
+
+  #pragma region FlxZipReader
+
+  FlxZipReader::FlxZipReader(std::string_view data)
+    : m_data(data)
+  {
+    if (!FlxCompression::IsCompressed(data)) return;
+
+    std::memcpy(&m_header, data.data(), sizeof(FlxZipHeader));
+
+    // guard: unknown version or a header that doesn't add up
+    if (m_header.format_version != FLXZIP_VERSION || m_header.block_size == 0 || m_header.block_size >= FLXZIP_STORED_BLOCK) return;
+    uint64_t expected_block_count = (m_header.raw_size + m_header.block_size - 1) / m_header.block_size;
+    if (m_header.block_count != expected_block_count) return;
+
+    // guard: a block can't expand more than 255 times, this catches absurd sizes before allocating
+    if (m_header.raw_size / 255 > data.size()) return;
+
+    std::size_t table_size = sizeof(uint32_t) * m_header.block_count;
+    if (data.size() - sizeof(FlxZipHeader) < table_size) return;
+
+    m_stored_sizes.resize(m_header.block_count);
+    if (table_size > 0) std::memcpy(m_stored_sizes.data(), data.data() + sizeof(FlxZipHeader), table_size);
+
+    // guard: blocks past the end of the data
+    m_offsets.resize(m_header.block_count);
+    std::size_t offset = sizeof(FlxZipHeader) + table_size;
+    for (std::size_t i = 0; i < m_stored_sizes.size(); i++)
+    {
+      m_offsets[i] = offset;
+      offset += m_stored_sizes[i] & ~FLXZIP_STORED_BLOCK;
+      if (offset > data.size()) return;
+    }
+
+    m_is_valid = true;
+  }
+
+  std::size_t FlxZipReader::GetRawBlockSize(std::size_t index) const
+  {
+    std::size_t offset = index * m_header.block_size;
+    return (std::min)(static_cast<std::size_t>(m_header.block_size), GetRawSize() - offset);
+  }
+
+  bool FlxZipReader::DecompressBlock(std::size_t index, char* out) const
+  {
+    if (!m_is_valid || index >= m_stored_sizes.size()) return false;
+
+    const char* block = m_data.data() + m_offsets[index];
+    std::size_t stored_size = m_stored_sizes[index] & ~FLXZIP_STORED_BLOCK;
+    std::size_t raw_size = GetRawBlockSize(index);
+
+    if (m_stored_sizes[index] & FLXZIP_STORED_BLOCK)
+    {
+      if (stored_size != raw_size) return false;
+      std::memcpy(out, block, raw_size);
+      return true;
+    }
+
+    return FlxCompression::DecompressBlock(block, stored_size, out, raw_size);
+  }
+
+  #pragma endregion
+
+}
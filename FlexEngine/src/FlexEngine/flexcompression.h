@@ -0,0 +1,129 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compressed container for FlexFormat files.
+//
+// Json scenes are mostly base64 and repeated keys and compress about 10:1,
+// which is less to read from slow storage than it costs to decompress.
+//
+// The data is split into blocks that are compressed on their own with an LZ4 style codec:
+// sequences of [token][literal length][literals][offset][match length],
+// the token holds 4 bits of each length, longer lengths continue in bytes of 255.
+// Matches are at least 4 bytes long and at most 65535 bytes back, the last 5 bytes
+// of a block are always literals. A block that doesn't shrink is stored as is.
+// Independent blocks can be decompressed in parallel or one at a time while streaming.
+//
+// Layout:
+// [FlxZipHeader]
+// uint32 stored size of each block, the high bit is set if the block is stored uncompressed
+// [block data] * block_count
+//
+// File::Read() detects the magic bytes and decompresses transparently,
+// File::Write() compresses again if the file was compressed, see File::is_compressed.
+// Nothing here logs, so it can run on any thread.
+
+// Compressed container metadata.
+// Do not change these values!
+#define FLXZIP_MAGIC              "FLXZ"
+#define FLXZIP_VERSION            1
+#define FLXZIP_STORED_BLOCK       0x80000000u
+#define FLXZIP_DEFAULT_BLOCK_SIZE (256 * 1024)
+
+namespace FlexEngine
+{
+
+  #pragma region Structures
+
+  struct __FLX_API FlxZipHeader
+  {
+    char magic[4];
+    uint32_t format_version;
+    uint64_t raw_size;
+    uint32_t block_size;        // of every block but the last
+    uint32_t block_count;
+  };
+  static_assert(sizeof(FlxZipHeader) == 24, "FlxZipHeader layout changed");
+
+  #pragma endregion
+
+  #pragma region FlxCompression
+
+  class __FLX_API FlxCompression
+  {
+  public:
+    // Checks for the magic bytes
+    static bool IsCompressed(const char* data, std::size_t size);
+    static bool IsCompressed(std::string_view data) { return IsCompressed(data.data(), data.size()); }
+
+    // Blocks are compressed in parallel when there is more than one.
+    static std::string Compress(std::string_view data, std::size_t block_size = FLXZIP_DEFAULT_BLOCK_SIZE);
+
+    // Returns false if the data isn't a valid container, out is left empty.
+    // Blocks are decompressed in parallel when there is more than one.
+    static bool Decompress(std::string_view data, std::string& out);
+
+    // Block codec
+
+    // The largest size a block of the given size can compress to
+    static std::size_t GetMaxBlockSize(std::size_t size) { return size + size / 255 + 16; }
+
+    // dst must hold GetMaxBlockSize(size) bytes. Returns the compressed size.
+    static std::size_t CompressBlock(const char* src, std::size_t size, char* dst);
+
+    // Decompresses exactly dst_size bytes. Returns false if the block is corrupted,
+    // never reads or writes out of bounds.
+    static bool DecompressBlock(const char* src, std::size_t src_size, char* dst, std::size_t dst_size);
+  };
+
+  #pragma endregion
+
+  #pragma region FlxZipReader
+
+  // Reads a container block by block, for streaming.
+  // Doesn't copy, the data must outlive the reader.
+  //
+  // Usage:
+  // FlxZipReader reader(data);
+  // std::string block(reader.GetBlockSize(), '\0');
+  // for (std::size_t i = 0; i < reader.GetBlockCount(); i++)
+  // {
+  //   std::size_t size = reader.GetRawBlockSize(i);
+  //   if (!reader.DecompressBlock(i, block.data())) break;
+  //   consume(block.data(), size);
+  // }
+  class __FLX_API FlxZipReader
+  {
+  public:
+    // Check IsValid() after construction
+    explicit FlxZipReader(std::string_view data);
+
+    bool IsValid() const { return m_is_valid; }
+
+    std::size_t GetRawSize() const { return static_cast<std::size_t>(m_header.raw_size); }
+    std::size_t GetBlockSize() const { return m_header.block_size; }
+    std::size_t GetBlockCount() const { return m_header.block_count; }
+
+    // The last block can be shorter than the block size
+    std::size_t GetRawBlockSize(std::size_t index) const;
+
+    // out must hold GetRawBlockSize(index) bytes
+    bool DecompressBlock(std::size_t index, char* out) const;
+
+  private:
+    std::string_view m_data;
+    FlxZipHeader m_header{};
+    std::vector<uint32_t> m_stored_sizes;
+    std::vector<std::size_t> m_offsets; // of each block in the data
+    bool m_is_valid = false;
+  };
+
+  #pragma endregion
+
+}
@@ -2,6 +2,10 @@
 
 #include "flexformatter.h"
 
+#include "Wrapper/checksum.h"
+
+#include <RapidJSON/memorystream.h>
+
 namespace rapidjson
 {
   const char* GetParseErrorString(ParseErrorCode code)
@@ -73,6 +77,7 @@ namespace FlexEngine
       R"("created":)"         + R"(")" + metadata.created.ToString()                      + R"(")" + R"(,)" +
       R"("last_edited":)"     + R"(")" + metadata.last_edited.ToString()                  + R"(")" + R"(,)" +
       R"("save_version":)"             + std::to_string(metadata.save_version)                     + R"(,)" +
+      R"("checksum":)"                 + std::to_string(Checksum::CRC32C(data))                    + R"(,)" +
       R"("data":)"            + R"([)" + data                                             + R"(])"
       "}"
     ;
@@ -121,11 +126,9 @@ namespace FlexEngine
     return file;
   }
 
-  FlxFmtFile FlexFormatter::Parse(FlexEngine::File& file, FlxFmtFileType expected_file_type)
+  // Extension and emptiness checks shared by the File overloads
+  bool FlexFormatter::ValidateFile(FlexEngine::File& file, FlxFmtFileType expected_file_type)
   {
-    // read file into file.data
-    file.Read();
-
     // guard: wrong file extension
     // only .flx files are supported
     std::string extension = file.path.extension().string();
@@ -133,39 +136,149 @@ namespace FlexEngine
     if (extension.substr(0, 4) != ".flx")
     {
       Log::Warning("Unsupported file extension: " + file.path.string());
-      return FlxFmtFile::Null;
+      return false;
     }
 
     // get file type from extension
-    FlxFmtFileType file_type = FlxFmtFileType::Other;
     extension = extension.substr(4);
-    file_type = FlxFmtFileType_Lookup(extension);
+    FlxFmtFileType file_type = FlxFmtFileType_Lookup(extension);
 
     // guard: wrong file type
     if (file_type != expected_file_type)
     {
       Log::Warning("File type mismatch: " + extension);
       Log::Warning("Expected:           " + FlxFmtFileType_ReverseLookup(expected_file_type));
-      return FlxFmtFile::Null;
+      return false;
     }
 
     // guard: empty file
     if (file.data.empty())
     {
       Log::Warning("Empty file: " + file.path.string());
-      return FlxFmtFile::Null;
+      return false;
     }
 
-    // parse file into document
-    Document document;
-    document.Parse(file.data.c_str());
+    return true;
+  }
+
+  // Date strings are stored as yyyy-mm-dd
+  static Date Internal_ParseDate(const std::string& date)
+  {
+    return Date(
+      std::stoi(date.substr(0, 4)),
+      std::stoi(date.substr(5, 2)),
+      std::stoi(date.substr(8, 2))
+    );
+  }
+
+  // rapidjson handler for the header, keeps the last token
+  struct Internal_HeaderHandler : BaseReaderHandler<UTF8<>, Internal_HeaderHandler>
+  {
+    enum TokenType { Token_Other, Token_Int, Token_String, Token_Key, Token_StartObject, Token_StartArray };
+
+    TokenType type = Token_Other;
+    int64_t int_value = 0;
+    std::string string_value;
+
+    bool Default() { type = Token_Other; return true; }
+    bool Int(int i) { type = Token_Int; int_value = i; return true; }
+    bool Uint(unsigned u) { type = Token_Int; int_value = u; return true; }
+    bool String(const char* str, SizeType length, bool) { type = Token_String; string_value.assign(str, length); return true; }
+    bool Key(const char* str, SizeType length, bool) { type = Token_Key; string_value.assign(str, length); return true; }
+    bool StartObject() { type = Token_StartObject; return true; }
+    bool StartArray() { type = Token_StartArray; return true; }
+  };
+
+  FlxFmtFile FlexFormatter::Parse(FlexEngine::File& file, FlxFmtFileType expected_file_type)
+  {
+    // read file into file.data
+    file.Read();
+
+    if (!ValidateFile(file, expected_file_type)) return FlxFmtFile::Null;
+
+    return Parse(file.data, expected_file_type);
+  }
+
+  FlxFmtFile FlexFormatter::Parse(const std::string& file_data, FlxFmtFileType file_type)
+  {
+    FlxFmtFileView view = ParseView(file_data, file_type);
+    if (view.IsNull()) return FlxFmtFile::Null;
+
+    FlxFmtFile flxfmtfile = FlxFmtFile::Null;
+    flxfmtfile.metadata = view.metadata;
+    flxfmtfile.data = std::string(view.data);
+    return flxfmtfile;
+  }
+
+  FlxFmtFileView FlexFormatter::ParseView(FlexEngine::File& file, FlxFmtFileType expected_file_type)
+  {
+    if (!ValidateFile(file, expected_file_type)) return FlxFmtFileView();
+
+    return ParseView(file.data, expected_file_type);
+  }
+
+  FlxFmtFileView FlexFormatter::ParseView(std::string_view file_data, FlxFmtFileType file_type, bool quiet)
+  {
+    auto log_info = [quiet](const std::string& message) { if (!quiet) Log::Info(message); };
+    auto log_warning = [quiet](const std::string& message) { if (!quiet) Log::Warning(message); };
+    auto log_error = [quiet](const std::string& message) { if (!quiet) Log::Error(message); };
+
+    // guard: empty file
+    if (file_data.empty())
+    {
+      log_warning("Empty FlexFormat data.");
+      return FlxFmtFileView();
+    }
+
+    // tokenize the header one token at a time until the data member
+    // {"format":"flxfmt","format_version":1,"created":"...","last_edited":"...","save_version":1,"checksum":123,"data":[...]}
+    Reader reader;
+    MemoryStream stream(file_data.data(), file_data.size());
+    Internal_HeaderHandler handler;
+    reader.IterativeParseInit();
+
+    auto next = [&]() -> bool
+    {
+      return !reader.IterativeParseComplete() && reader.IterativeParseNext<kParseDefaultFlags>(stream, handler);
+    };
+
+    std::unordered_map<std::string, Internal_HeaderHandler> header;
+    bool has_data = false;
+
+    if (next() && handler.type == Internal_HeaderHandler::Token_StartObject)
+    {
+      while (next() && handler.type == Internal_HeaderHandler::Token_Key)
+      {
+        std::string key = handler.string_value;
+        if (!next()) break;
+
+        if (key == "data")
+        {
+          has_data = (handler.type == Internal_HeaderHandler::Token_StartArray);
+          break;
+        }
+
+        // guard: the header only holds strings and numbers
+        if (handler.type != Internal_HeaderHandler::Token_String && handler.type != Internal_HeaderHandler::Token_Int) break;
+        header[key] = handler;
+      }
+    }
 
     // check for parse errors
-    // if there is an error, return an empty rapidjson::Document
-    if (document.HasParseError())
+    if (reader.HasParseError())
+    {
+      log_error(std::string("Parse error while parsing file into FlxFmtFile: ") + GetParseErrorString(reader.GetParseErrorCode()));
+      return FlxFmtFileView();
+    }
+
+    // the data is everything between the [ after "data": and the ] in front of the closing }
+    std::size_t data_begin = stream.Tell();
+    std::size_t data_end = file_data.find_last_not_of(" \t\r\n");
+    if (data_end != std::string_view::npos && file_data[data_end] == '}') data_end = file_data.find_last_not_of(" \t\r\n", data_end - 1);
+    if (!has_data || data_end == std::string_view::npos || file_data[data_end] != ']' || data_end < data_begin)
     {
-      Log::Error(std::string("Parse error while parsing file into FlxFmtFile: ") + GetParseErrorString(document.GetParseError()));
-      return FlxFmtFile::Null;
+      log_warning("Missing data in file.");
+      return FlxFmtFileView();
     }
 
     // format checking
@@ -177,83 +290,82 @@ namespace FlexEngine
     // format version check
     // TODO: versioning updates
 
+    auto has = [&header](const char* key, Internal_HeaderHandler::TokenType type) -> bool
+    {
+      auto it = header.find(key);
+      return it != header.end() && it->second.type == type;
+    };
+
     if (
-      !document.HasMember("format") ||
-      !document.HasMember("format_version") ||
-      !document.HasMember("created") ||
-      !document.HasMember("last_edited") ||
-      !document.HasMember("save_version")
+      !has("format", Internal_HeaderHandler::Token_String) ||
+      !has("format_version", Internal_HeaderHandler::Token_Int) ||
+      !has("created", Internal_HeaderHandler::Token_String) ||
+      !has("last_edited", Internal_HeaderHandler::Token_String) ||
+      !has("save_version", Internal_HeaderHandler::Token_Int)
     )
     {
-      Log::Warning("Missing metadata in file.");
-      return FlxFmtFile::Null;
+      log_warning("Missing metadata in file.");
+      return FlxFmtFileView();
     }
 
-    std::string format = document["format"].GetString();
+    std::string format = header["format"].string_value;
     if (format != FLXFMT_NAME)
     {
-      Log::Warning("File format mismatch: " + format);
-      return FlxFmtFile::Null;
+      log_warning("File format mismatch: " + format);
+      return FlxFmtFileView();
     }
 
-    int format_version = document["format_version"].GetInt();
+    int format_version = static_cast<int>(header["format_version"].int_value);
 
     if (format_version != FLXFMT_VERSION)
     {
-      Log::Info("File format version mismatch: " + std::to_string(format_version));
-      Log::Info("Current version:              " + std::to_string(FLXFMT_VERSION));
+      log_info("File format version mismatch: " + std::to_string(format_version));
+      log_info("Current version:              " + std::to_string(FLXFMT_VERSION));
       if (format_version > FLXFMT_VERSION)
       {
-        Log::Warning("Forward compatibility is not supported.");
-        return FlxFmtFile::Null;
+        log_warning("Forward compatibility is not supported.");
+        return FlxFmtFileView();
       }
       else
       {
-        Log::Warning("Backward compatibility is not supported.");
-        return FlxFmtFile::Null;
+        log_warning("Backward compatibility is not supported.");
+        return FlxFmtFileView();
       }
     }
 #else
     #error "Unsupported FLXFMT_VERSION"
 #endif
 
-    // save metadata
+    // guard: corrupted data
+    // the checksum was added after version 1, files without one are loaded as they are
+    FlxFmtFileView view;
+    std::string_view data = file_data.substr(data_begin, data_end - data_begin);
 
-    FlxFmtFile flxfmtfile = FlxFmtFile::Null;
+    if (has("checksum", Internal_HeaderHandler::Token_Int))
+    {
+      view.checksum = Checksum::CRC32C(data);
+      view.has_checksum = true;
+      if (static_cast<int64_t>(view.checksum) != header["checksum"].int_value)
+      {
+        log_warning("File data is corrupted, the checksum doesn't match.");
+        return FlxFmtFileView();
+      }
+    }
+
+    // save metadata
 
     if (format_version == 1)
     {
-      flxfmtfile.metadata.format = format;
-      flxfmtfile.metadata.format_version = format_version;
-      std::string created = document["created"].GetString();
-      flxfmtfile.metadata.created = Date(
-        std::stoi(created.substr(0, 4)),
-        std::stoi(created.substr(5, 2)),
-        std::stoi(created.substr(8, 2))
-      );
-      std::string last_edited = document["last_edited"].GetString();
-      flxfmtfile.metadata.last_edited = Date(
-        std::stoi(last_edited.substr(0, 4)),
-        std::stoi(last_edited.substr(5, 2)),
-        std::stoi(last_edited.substr(8, 2))
-      );
-      flxfmtfile.metadata.save_version = document["save_version"].GetInt();
-      flxfmtfile.metadata.file_type = file_type;
-
-      // Find the first [ and last ] and extract the string in between.
-      // This is a temporary hack to get the data since the data is not a string.
-      // 
-      // This requires that the data is the only element in the "data" array.
-      // Which is usually the case since the data only stores one thing.
-      // 
-      // flxfmtfile.data is thus a string representation of the json object which
-      // can be parsed using rapidjson into an object.
-      std::size_t first_bracket = file.data.find_first_of('[');
-      std::size_t last_bracket = file.data.find_last_of(']');
-      flxfmtfile.data = file.data.substr(first_bracket + 1, last_bracket - first_bracket - 1);
+      view.metadata.format = format;
+      view.metadata.format_version = format_version;
+      view.metadata.created = Internal_ParseDate(header["created"].string_value);
+      view.metadata.last_edited = Internal_ParseDate(header["last_edited"].string_value);
+      view.metadata.save_version = static_cast<FlxFmtMetadata::Version>(header["save_version"].int_value);
+      view.metadata.file_type = file_type;
+      view.data = data;
     }
 
-    return flxfmtfile;
+    return view;
   }
 
   #pragma endregion
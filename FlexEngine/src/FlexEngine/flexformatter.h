@@ -6,6 +6,7 @@
 #include "Wrapper/file.h" // <filesystem> <iostream> <string> <exception> <unordered_map> <set> <fstream>
 
 #include <sstream>
+#include <string_view>
 
 #include <RapidJSON/document.h>
 #include <RapidJSON/istreamwrapper.h>
@@ -73,6 +74,7 @@ namespace FlexEngine
     std::string data = "";
 
     // Converts into a std::string for writing to a file.
+    // The header holds the CRC32C of the data, see FlexFormatter::ParseView().
     // Use Save() instead to increment the save version.
     // This is more for debugging purposes.
     std::string ToString() const;
@@ -94,6 +96,25 @@ namespace FlexEngine
 
   #pragma endregion
 
+  #pragma region FlxFmtFileView
+
+  // FlxFmtFile without the copy of the data.
+  // data is a view into the buffer that was parsed and is only valid as long as that buffer.
+  class __FLX_API FlxFmtFileView
+  {
+  public:
+    FlxFmtMetadata metadata;
+    std::string_view data;
+
+    // CRC32C of the data, verified by ParseView(). Files written before checksums were added have none.
+    uint32_t checksum = 0;
+    bool has_checksum = false;
+
+    bool IsNull() const { return data.data() == nullptr; }
+  };
+
+  #pragma endregion
+
   #pragma region FlexFormatter
 
   // Formatter for the FlexFormat file specification.
@@ -108,6 +129,28 @@ namespace FlexEngine
     // If there is a parse error, an empty FlxFmtFile is returned.
     // Usage: FlxFmtFile flxfmtfile_scene = FlexFormatter::Parse(file_scene, FlxFmtFileType::Scene);
     static FlxFmtFile Parse(FlexEngine::File& file, FlxFmtFileType expected_file_type);
+
+    // Parses data that was already read from a file.
+    // The file extension isn't available here, so the caller is trusted to pass the right file type.
+    // This doesn't touch the File registry, so it is safe to call from worker threads.
+    static FlxFmtFile Parse(const std::string& file_data, FlxFmtFileType file_type);
+
+    // Reads the metadata and returns the data as a view into file_data.
+    // The writer always puts the metadata in front of the data, so only that header is
+    // tokenized and the data is left for its owner to parse, the file is only parsed once.
+    // Syntax errors in the data aren't detected here, but the checksum of the data is verified
+    // before it is handed out, so a corrupted file never reaches the parser.
+    // Returns a null view if the header isn't valid or the checksum doesn't match.
+    // Quiet doesn't log why, for worker threads that report errors themselves.
+    static FlxFmtFileView ParseView(std::string_view file_data, FlxFmtFileType file_type, bool quiet = false);
+
+    // Same as above with the file extension checks of Parse(File&).
+    // Doesn't read the file, call file.Read() first. The view points into file.data.
+    static FlxFmtFileView ParseView(FlexEngine::File& file, FlxFmtFileType expected_file_type);
+
+    // The file extension and emptiness checks of the File overloads, logs why the file isn't valid.
+    // Readers of the binary format (flexformatterbinary.h) use it so that both formats accept the same files.
+    static bool ValidateFile(FlexEngine::File& file, FlxFmtFileType expected_file_type);
   };
 
   #pragma endregion
@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include "flexformatterbinary.h"
+
+#include "Wrapper/checksum.h"
+
+namespace FlexEngine
+{
+
+  // Dates are stored as yyyymmdd
+  static uint32_t Internal_PackDate(const Date& date)
+  {
+    return static_cast<uint32_t>(date.year * 10000 + date.month * 100 + date.day);
+  }
+
+  static Date Internal_UnpackDate(uint32_t packed)
+  {
+    return Date(static_cast<int>(packed / 10000), static_cast<int>(packed / 100 % 100), static_cast<int>(packed % 100));
+  }
+
+  #pragma region FlxBinWriter
+
+  FlxBinWriter::FlxBinWriter(FlxFmtFileType file_type)
+    : m_file_type(file_type)
+  {
+  }
+
+  std::string& FlxBinWriter::AddSection(uint32_t type)
+  {
+    m_sections.emplace_back(type, std::string());
+    return m_sections.back().second;
+  }
+
+  void FlxBinWriter::SetPreviousMetadata(const Date& created, uint32_t save_version)
+  {
+    m_created = created;
+    m_save_version = save_version;
+  }
+
+  std::string FlxBinWriter::Save()
+  {
+    FlxBinHeader header{};
+    std::memcpy(header.magic, FLXBIN_MAGIC, sizeof(header.magic));
+    header.format_version = FLXBIN_VERSION;
+    header.file_type = static_cast<uint32_t>(m_file_type);
+    header.save_version = m_save_version + 1;
+    header.section_count = static_cast<uint32_t>(m_sections.size());
+    header.created = Internal_PackDate(m_created);
+    header.last_edited = Internal_PackDate(Date::Now());
+
+    // lay out the sections after the table
+    std::size_t offset = sizeof(FlxBinHeader) + sizeof(FlxBinSectionEntry) * m_sections.size();
+    std::size_t total_size = offset;
+    std::vector<FlxBinSectionEntry> table;
+    table.reserve(m_sections.size());
+    for (auto& [type, data] : m_sections)
+    {
+      offset = (offset + FLXBIN_ALIGNMENT - 1) / FLXBIN_ALIGNMENT * FLXBIN_ALIGNMENT;
+      table.push_back({ type, Checksum::CRC32C(data.data(), data.size()), offset, data.size() });
+      offset += data.size();
+      total_size = offset;
+    }
+
+    // write everything into one preallocated buffer
+    std::string out;
+    out.reserve(total_size);
+    Append(out, header);
+    for (const FlxBinSectionEntry& entry : table) Append(out, entry);
+    for (std::size_t i = 0; i < m_sections.size(); i++)
+    {
+      out.append(static_cast<std::size_t>(table[i].offset) - out.size(), '\0');
+      out.append(m_sections[i].second);
+    }
+
+    return out;
+  }
+
+  #pragma endregion
+
+  #pragma region FlxBinReader
+
+  bool FlxBinReader::IsBinary(const char* data, std::size_t size)
+  {
+    return size >= sizeof(FlxBinHeader) && std::memcmp(data, FLXBIN_MAGIC, 8) == 0;
+  }
+
+  bool FlxBinReader::Parse(const char* data, std::size_t size, FlxFmtFileType expected_file_type, bool quiet)
+  {
+    auto log_warning = [quiet](const std::string& message) { if (!quiet) Log::Warning(message); };
+
+    m_data = data;
+    m_size = size;
+    m_sections.clear();
+
+    // guard: magic
+    if (!IsBinary(data, size))
+    {
+      log_warning("Not a binary FlexFormat file.");
+      return false;
+    }
+
+    std::memcpy(&m_header, data, sizeof(FlxBinHeader));
+
+    // guard: version
+    if (m_header.format_version < FLXBIN_MIN_VERSION || m_header.format_version > FLXBIN_VERSION)
+    {
+      log_warning("Binary FlexFormat version mismatch: " + std::to_string(m_header.format_version));
+      return false;
+    }
+
+    // guard: file type
+    if (m_header.file_type != static_cast<uint32_t>(expected_file_type))
+    {
+      log_warning("File type mismatch: " + FlxFmtFileType_ReverseLookup(static_cast<FlxFmtFileType>(m_header.file_type)));
+      return false;
+    }
+
+    // guard: section table and sections are within the file
+    std::size_t table_end = sizeof(FlxBinHeader) + sizeof(FlxBinSectionEntry) * static_cast<std::size_t>(m_header.section_count);
+    if (table_end > size)
+    {
+      log_warning("Binary FlexFormat section table is truncated.");
+      return false;
+    }
+
+    m_sections.resize(m_header.section_count);
+    std::memcpy(m_sections.data(), data + sizeof(FlxBinHeader), sizeof(FlxBinSectionEntry) * m_sections.size());
+
+    for (const FlxBinSectionEntry& section : m_sections)
+    {
+      if (section.offset < table_end || section.offset > size || section.size > size - section.offset)
+      {
+        log_warning("Binary FlexFormat section is out of bounds.");
+        m_sections.clear();
+        return false;
+      }
+    }
+
+    // guard: corrupted data, checked before the owner decodes anything
+    if (HasChecksums())
+    {
+      for (const FlxBinSectionEntry& section : m_sections)
+      {
+        if (Checksum::CRC32C(data + section.offset, static_cast<std::size_t>(section.size)) != section.checksum)
+        {
+          log_warning("Binary FlexFormat section " + std::to_string(section.type) + " is corrupted, the checksum doesn't match.");
+          m_sections.clear();
+          return false;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  Date FlxBinReader::GetCreated() const
+  {
+    return Internal_UnpackDate(m_header.created);
+  }
+
+  #pragma endregion
+
+}
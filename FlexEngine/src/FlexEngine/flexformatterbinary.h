@@ -0,0 +1,219 @@
+#pragma once
+
+#include "flx_api.h"
+
+#include "flexformatter.h" // FlxFmtFileType, Date
+
+#include <cstdint>
+#include <cstring> // std::memcpy
+#include <string>
+#include <type_traits> // std::is_trivially_copyable_v
+#include <vector>
+
+// Binary variant of the FlexFormat file specification.
+//
+// The json format is easy to read and diff but slow to load, every component blob is
+// base64 encoded and the whole file goes through a DOM parse.
+// The binary format stores the data as sections of raw bytes that can be read in bulk.
+//
+// Layout:
+// [FlxBinHeader]
+// [FlxBinSectionEntry] * section_count
+// [section data]       * section_count, each starting on a FLXBIN_ALIGNMENT boundary
+//
+// All values are little-endian and use the sizes of the fixed width types below.
+// The owner of the file type decides what the sections contain, see scenebinary.cpp.
+// Readers skip section types they don't know, so new sections can be added without
+// bumping the format version.
+//
+// Since version 2 every section entry holds the CRC32C of its data (Wrapper/checksum.h).
+// Parse() verifies them before anything is decoded, so a corrupted file is rejected
+// at memory bandwidth instead of failing halfway through, or not at all.
+// The checksums also tell which sections changed between two versions of a file,
+// see Scene::Reload(). Version 1 files are still read, without verification.
+
+// Binary Flex Formatter metadata.
+// Do not change these values!
+// The \r\n catches files that went through a text mode copy, like the png signature.
+#define FLXBIN_MAGIC        "FLXBIN\r\n"
+#define FLXBIN_VERSION      2
+#define FLXBIN_MIN_VERSION  1   // oldest version that can still be read
+#define FLXBIN_ALIGNMENT    16
+
+namespace FlexEngine
+{
+
+  #pragma region Structures
+
+  struct __FLX_API FlxBinHeader
+  {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t file_type;         // FlxFmtFileType
+    uint32_t save_version;      // 0 = version not saved
+    uint32_t section_count;
+    uint32_t created;           // yyyymmdd
+    uint32_t last_edited;       // yyyymmdd
+  };
+  static_assert(sizeof(FlxBinHeader) == 32, "FlxBinHeader layout changed");
+
+  struct __FLX_API FlxBinSectionEntry
+  {
+    uint32_t type;              // defined by the owner of the file type
+    uint32_t checksum;          // CRC32C of the data, 0 in version 1
+    uint64_t offset;            // from the start of the file
+    uint64_t size;
+  };
+  static_assert(sizeof(FlxBinSectionEntry) == 24, "FlxBinSectionEntry layout changed");
+
+  #pragma endregion
+
+  #pragma region FlxBinWriter
+
+  // Builds a binary FlexFormat file in memory.
+  // Usage:
+  // FlxBinWriter writer(FlxFmtFileType::Scene);
+  // std::string& section = writer.AddSection(1);
+  // FlxBinWriter::Append(section, value);
+  // file.Write(writer.Save());
+  class __FLX_API FlxBinWriter
+  {
+  public:
+    FlxBinWriter(FlxFmtFileType file_type);
+
+    // Returns the buffer of a new section to append into.
+    // The reference is valid until the next call to AddSection.
+    std::string& AddSection(uint32_t type);
+
+    // Creation date and save version carried over from an existing file
+    void SetPreviousMetadata(const Date& created, uint32_t save_version);
+
+    // Lays out the header, the section table and the sections.
+    std::string Save();
+
+    #pragma region Helpers
+
+    template <typename T>
+    static void Append(std::string& out, const T& value)
+    {
+      static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be appended");
+      out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static void AppendBytes(std::string& out, const void* data, std::size_t size)
+    {
+      out.append(reinterpret_cast<const char*>(data), size);
+    }
+
+    // Length prefixed string
+    static void AppendString(std::string& out, const std::string& str)
+    {
+      Append<uint64_t>(out, str.size());
+      out.append(str);
+    }
+
+    // Pads with zeros to the alignment, relative to the start of the section.
+    // Sections start on a FLXBIN_ALIGNMENT boundary, so this is also aligned in the file.
+    static void Pad(std::string& out, std::size_t alignment = FLXBIN_ALIGNMENT)
+    {
+      out.append((alignment - out.size() % alignment) % alignment, '\0');
+    }
+
+    #pragma endregion
+
+  private:
+    FlxFmtFileType m_file_type;
+    Date m_created = Date::Now();
+    uint32_t m_save_version = 0;
+    std::vector<std::pair<uint32_t, std::string>> m_sections;
+  };
+
+  #pragma endregion
+
+  #pragma region FlxBinReader
+
+  // Bounds checked reader over a section.
+  // Reading past the end sets ok to false and returns zeros, check ok once at the end.
+  struct __FLX_API FlxBinCursor
+  {
+    const char* current = nullptr;
+    const char* end = nullptr;
+    const char* begin = nullptr;
+    bool ok = true;
+
+    FlxBinCursor() = default;
+    FlxBinCursor(const char* data, std::size_t size) : current(data), end(data + size), begin(data) {}
+
+    template <typename T>
+    T Read()
+    {
+      T value{};
+      const char* bytes = ReadBytes(sizeof(T));
+      if (bytes != nullptr) std::memcpy(&value, bytes, sizeof(T));
+      return value;
+    }
+
+    // Returns a pointer into the file data, or nullptr if there aren't enough bytes
+    const char* ReadBytes(std::size_t size)
+    {
+      if (!ok || static_cast<std::size_t>(end - current) < size)
+      {
+        ok = false;
+        return nullptr;
+      }
+      const char* bytes = current;
+      current += size;
+      return bytes;
+    }
+
+    std::string ReadString()
+    {
+      uint64_t size = Read<uint64_t>();
+      const char* bytes = ReadBytes(static_cast<std::size_t>(size));
+      return (bytes != nullptr) ? std::string(bytes, static_cast<std::size_t>(size)) : std::string();
+    }
+
+    // Skips to the next alignment boundary, relative to the start of the section
+    void Align(std::size_t alignment = FLXBIN_ALIGNMENT)
+    {
+      std::size_t offset = static_cast<std::size_t>(current - begin);
+      ReadBytes((alignment - offset % alignment) % alignment);
+    }
+  };
+
+  // Validates a binary FlexFormat file and gives access to its sections.
+  // Doesn't copy, the data must outlive the reader.
+  class __FLX_API FlxBinReader
+  {
+  public:
+    // Checks for the magic bytes
+    static bool IsBinary(const char* data, std::size_t size);
+    static bool IsBinary(const std::string& data) { return IsBinary(data.data(), data.size()); }
+
+    // Returns false and logs a warning if the file isn't valid or a section checksum doesn't match.
+    // Quiet doesn't log, the same as FlexFormatter::ParseView().
+    bool Parse(const char* data, std::size_t size, FlxFmtFileType expected_file_type, bool quiet = false);
+
+    const FlxBinHeader& GetHeader() const { return m_header; }
+    const std::vector<FlxBinSectionEntry>& GetSections() const { return m_sections; }
+
+    Date GetCreated() const;
+
+    // Version 1 files have no checksums
+    bool HasChecksums() const { return m_header.format_version >= 2; }
+
+    FlxBinCursor GetSection(const FlxBinSectionEntry& section) const
+    {
+      return FlxBinCursor(m_data + section.offset, static_cast<std::size_t>(section.size));
+    }
+
+  private:
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+    FlxBinHeader m_header{};
+    std::vector<FlxBinSectionEntry> m_sections;
+  };
+
+  #pragma endregion
+
+}
@@ -26,6 +26,7 @@ namespace MicroChess
   FLX_REFL_REGISTER_START(Shader)
     FLX_REFL_REGISTER_PROPERTY(shader)
   FLX_REFL_REGISTER_END;
+  FLX_ECS_REGISTER_STRING_MEMBER(Shader, shader)
   
   FLX_REFL_REGISTER_START(Sprite)
     FLX_REFL_REGISTER_PROPERTY(texture)
@@ -34,5 +35,6 @@ namespace MicroChess
     FLX_REFL_REGISTER_PROPERTY(color_to_multiply)
     FLX_REFL_REGISTER_PROPERTY(alignment)
   FLX_REFL_REGISTER_END;
+  FLX_ECS_REGISTER_STRING_MEMBER(Sprite, texture)
 
 }
\ No newline at end of file
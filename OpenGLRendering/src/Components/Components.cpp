@@ -31,6 +31,7 @@ namespace OpenGLRendering
   FLX_REFL_REGISTER_START(Shader)
     FLX_REFL_REGISTER_PROPERTY(shader)
   FLX_REFL_REGISTER_END;
+  FLX_ECS_REGISTER_STRING_MEMBER(Shader, shader)
 
   //FLX_REFL_REGISTER_START(Texture)
   //  FLX_REFL_REGISTER_PROPERTY(texture)
@@ -52,16 +53,19 @@ namespace OpenGLRendering
     FLX_REFL_REGISTER_PROPERTY(color_to_multiply)
     FLX_REFL_REGISTER_PROPERTY(alignment)
   FLX_REFL_REGISTER_END;
+  FLX_ECS_REGISTER_STRING_MEMBER(Sprite, texture)
 
   FLX_REFL_REGISTER_START(Text)
     FLX_REFL_REGISTER_PROPERTY(font)
     FLX_REFL_REGISTER_PROPERTY(font_size)
     FLX_REFL_REGISTER_PROPERTY(text)
   FLX_REFL_REGISTER_END;
+  FLX_ECS_REGISTER_STRING_MEMBER(Text, font)
 
   FLX_REFL_REGISTER_START(Model)
     FLX_REFL_REGISTER_PROPERTY(model)
   FLX_REFL_REGISTER_END;
+  FLX_ECS_REGISTER_STRING_MEMBER(Model, model)
 
   FLX_REFL_REGISTER_START(Camera)
     FLX_REFL_REGISTER_PROPERTY(is_dirty)
@@ -1,7 +1,5 @@
 #include "mainlayer.h"
 
-#include "Components/Components.h"
-
 namespace OpenGLRendering
 {
 
@@ -55,6 +53,11 @@ namespace OpenGLRendering
       { 1.0f, 1.0f, 1.0f }
     });
 
+    main_camera_position.Reset(main_camera);
+    main_camera_rotation.Reset(main_camera);
+    main_camera_camera.Reset(main_camera);
+    directional_light_data.Reset(directional_light);
+
     point_lights[0].AddComponent<GlobalPosition>({ { -2.0f, 0.0f, 0.0f } });
     point_lights[0].AddComponent<PointLight>({
       { 0.0f, 0.0f, 0.0f },
@@ -434,9 +437,9 @@ ImGui::EndMainMenuBar();
       // camera
       if (ImGui::CollapsingHeader("Main Camera", tree_node_flags))
       {
-        auto& global_position = main_camera.GetComponent<GlobalPosition>()->position;
-        auto& rotation = main_camera.GetComponent<Rotation>()->rotation;
-        auto camera = main_camera.GetComponent<Camera>();
+        auto& global_position = main_camera_position->position;
+        auto& rotation = main_camera_rotation->rotation;
+        auto camera = main_camera_camera.Get();
 
         ImGui::PushID("camera");
 
@@ -485,10 +488,10 @@ ImGui::EndMainMenuBar();
       // directional light
       if (ImGui::CollapsingHeader("Directional Light", tree_node_flags))
       {
-        auto& direction = directional_light.GetComponent<DirectionalLight>()->direction;
-        auto& ambient = directional_light.GetComponent<DirectionalLight>()->ambient;
-        auto& diffuse = directional_light.GetComponent<DirectionalLight>()->diffuse;
-        auto& specular = directional_light.GetComponent<DirectionalLight>()->specular;
+        auto& direction = directional_light_data->direction;
+        auto& ambient = directional_light_data->ambient;
+        auto& diffuse = directional_light_data->diffuse;
+        auto& specular = directional_light_data->specular;
 
         ImGui::PushID("directional_light");
         ImGui::DragFloat3("Direction", direction.begin(), 0.01f, -1.0f, 1.0f, "%.2f");
@@ -1016,9 +1019,9 @@ ImGui::EndMainMenuBar();
     #if 0
     {
       // cache camera
-      auto camera = main_camera.GetComponent<Camera>();
+      auto camera = main_camera_camera.Get();
       // cache directional light
-      auto dir_light = directional_light.GetComponent<DirectionalLight>();
+      auto dir_light = directional_light_data.Get();
       // cache point lights
       std::vector<Vector3> pt_light_pos;
       std::vector<PointLight*> pt_light;
@@ -1096,10 +1099,10 @@ ImGui::EndMainMenuBar();
     #if 1
     {
       // cache camera
-      auto camera = main_camera.GetComponent<Camera>();
+      auto camera = main_camera_camera.Get();
       auto projection_view_matrix = camera->projection * camera->view;
       // cache directional light
-      auto dir_light = directional_light.GetComponent<DirectionalLight>();
+      auto dir_light = directional_light_data.Get();
       // cache point lights
       std::vector<Vector3> pt_light_pos;
       std::vector<PointLight*> pt_light;
@@ -3,6 +3,8 @@
 #include <FlexEngine.h>
 using namespace FlexEngine;
 
+#include "Components/Components.h"
+
 namespace OpenGLRendering
 {
 
@@ -16,6 +18,12 @@ namespace OpenGLRendering
     FlexECS::Entity sprite;
     FlexECS::Entity text;
 
+    // cached components that are accessed every frame
+    FlexECS::ComponentRef<GlobalPosition> main_camera_position;
+    FlexECS::ComponentRef<Rotation> main_camera_rotation;
+    FlexECS::ComponentRef<Camera> main_camera_camera;
+    FlexECS::ComponentRef<DirectionalLight> directional_light_data;
+
     const Path default_save_directory = Path::current("saves");
     const std::string default_save_name = "default";
     Path current_save_directory = default_save_directory;
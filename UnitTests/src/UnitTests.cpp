@@ -4,6 +4,7 @@
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 #include <FlexEngine.h>
+#include <FlexEngine/Wrapper/flexbase64.h> // not part of FlexEngine.h
 using namespace FlexEngine;
 
 #pragma warning(disable: 4189) // local variable is initialized but not referenced
@@ -2980,3 +2981,2281 @@ namespace T_FlexID
   };
 
 }
+
+namespace T_Reflection
+{
+
+  // Each test uses its own type so that the order the tests run in doesn't matter
+  struct LazyPoint { FLX_REFL_SERIALIZABLE float x; float y; };
+  struct LazyLine { FLX_REFL_SERIALIZABLE LazyPoint start; LazyPoint end; };
+  struct LazyName { FLX_REFL_SERIALIZABLE std::string name; };
+  struct LazyUnused { FLX_REFL_SERIALIZABLE std::vector<LazyPoint> points; }; // never resolved, only InitializeAll registers it
+  struct SchemaPoint { FLX_REFL_SERIALIZABLE float x; float y; float z = 1.0f; };
+  struct PatchObject { FLX_REFL_SERIALIZABLE LazyPoint point; std::string name; std::vector<int> values; double weight; };
+  struct StreamObject { FLX_REFL_SERIALIZABLE LazyPoint point; std::string path; std::vector<LazyName> names; std::vector<std::string> tags; double weight; bool enabled; uint64_t id; int64_t offset; };
+  struct PackedVertex { FLX_REFL_SERIALIZABLE Vector3 position; float u; float v; }; // Vector3 is padded to 16 bytes
+  struct PackedItem { FLX_REFL_SERIALIZABLE int id; float weight; };                // two scalar types, never packed
+  struct PackedMesh { FLX_REFL_SERIALIZABLE std::vector<PackedVertex> vertices; std::vector<unsigned> indices; std::vector<PackedItem> items; };
+
+}
+
+FLX_REFL_REGISTER_START(T_Reflection::LazyPoint)
+  FLX_REFL_REGISTER_PROPERTY(x)
+  FLX_REFL_REGISTER_PROPERTY(y)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::LazyLine)
+  FLX_REFL_REGISTER_PROPERTY(start)
+  FLX_REFL_REGISTER_PROPERTY(end)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::LazyName)
+  FLX_REFL_REGISTER_PROPERTY(name)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::LazyUnused)
+  FLX_REFL_REGISTER_PROPERTY(points)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::SchemaPoint)
+  FLX_REFL_REGISTER_PROPERTY(x)
+  FLX_REFL_REGISTER_PROPERTY(y)
+  FLX_REFL_REGISTER_PROPERTY(z)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::PatchObject)
+  FLX_REFL_REGISTER_PROPERTY(point)
+  FLX_REFL_REGISTER_PROPERTY(name)
+  FLX_REFL_REGISTER_PROPERTY(values)
+  FLX_REFL_REGISTER_PROPERTY(weight)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::StreamObject)
+  FLX_REFL_REGISTER_PROPERTY(point)
+  FLX_REFL_REGISTER_PROPERTY(path)
+  FLX_REFL_REGISTER_PROPERTY(names)
+  FLX_REFL_REGISTER_PROPERTY(tags)
+  FLX_REFL_REGISTER_PROPERTY(weight)
+  FLX_REFL_REGISTER_PROPERTY(enabled)
+  FLX_REFL_REGISTER_PROPERTY(id)
+  FLX_REFL_REGISTER_PROPERTY(offset)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::PackedVertex)
+  FLX_REFL_REGISTER_PROPERTY(position)
+  FLX_REFL_REGISTER_PROPERTY(u)
+  FLX_REFL_REGISTER_PROPERTY(v)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::PackedItem)
+  FLX_REFL_REGISTER_PROPERTY(id)
+  FLX_REFL_REGISTER_PROPERTY(weight)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_Reflection::PackedMesh)
+  FLX_REFL_REGISTER_PROPERTY(vertices)
+  FLX_REFL_REGISTER_PROPERTY(indices)
+  FLX_REFL_REGISTER_PROPERTY(items)
+FLX_REFL_REGISTER_END;
+
+namespace T_Reflection
+{
+
+  TEST_CLASS(T_LazyRegistration)
+  {
+  public:
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    TEST_METHOD(T_NotRegisteredBeforeFirstUse)
+    {
+      Assert::AreEqual(Reflection::INVALID_TYPE_ID, LazyLine::Reflection.id);
+      Assert::IsTrue(LazyLine::Reflection.members.empty());
+
+      Reflection::TypeDescriptor* type_desc = Reflection::TypeResolver<LazyLine>::Get();
+      Assert::IsTrue(type_desc->name == "T_Reflection::LazyLine");
+      Assert::AreEqual((size_t)2, LazyLine::Reflection.members.size());
+      Assert::IsTrue(type_desc == Reflection::TypeDescriptor::GetByID(type_desc->id));
+
+      // members are initialized with the struct
+      Assert::AreNotEqual(Reflection::INVALID_TYPE_ID, LazyPoint::Reflection.id);
+    }
+
+    TEST_METHOD(T_FindByName_InitializesOnMiss)
+    {
+      Reflection::TypeDescriptor* type_desc = Reflection::TypeDescriptor::FindByName("T_Reflection::LazyName");
+      Assert::IsNotNull(type_desc);
+      Assert::IsTrue(type_desc == &LazyName::Reflection);
+      Assert::IsNull(Reflection::TypeDescriptor::FindByName("T_Reflection::DoesNotExist"));
+    }
+
+    // Checks that InitializeAll registers the structs nothing has used yet,
+    // and logs what the registration that used to run during static initialization costs.
+    TEST_METHOD(T_InitializeAll_RegistersUnusedStructs)
+    {
+      using Clock = std::chrono::steady_clock;
+
+      auto registry_size = []()
+      {
+        std::lock_guard<std::recursive_mutex> lock(Reflection::TypeDescriptor::initialization_mutex());
+        return Reflection::TypeDescriptor::type_descriptor_registry().size();
+      };
+
+      std::size_t registered_before = registry_size();
+
+      Clock::time_point start = Clock::now();
+      Reflection::TypeDescriptor::InitializeAll();
+      double initialize_all_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+      // registered with its member types even though TypeResolver<LazyUnused> was never called
+      Assert::AreNotEqual(Reflection::INVALID_TYPE_ID, LazyUnused::Reflection.id);
+      Assert::IsTrue(&LazyUnused::Reflection == Reflection::TypeDescriptor::GetByID(LazyUnused::Reflection.id));
+      Assert::IsTrue(LazyUnused::Reflection.name == "T_Reflection::LazyUnused");
+      Assert::AreEqual((size_t)1, LazyUnused::Reflection.members.size());
+      Assert::AreNotEqual(Reflection::INVALID_TYPE_ID, LazyUnused::Reflection.members[0].type->id);
+
+      std::size_t registered = registry_size();
+      Assert::IsTrue(registered >= registered_before);
+
+      // a second call has nothing left to do
+      Reflection::TypeDescriptor::InitializeAll();
+      Assert::AreEqual(registered, registry_size());
+
+      // after the first use a lookup is a single load
+      start = Clock::now();
+      for (int i = 0; i < 1000000; i++) Reflection::TypeResolver<LazyPoint>::Get();
+      double resolve_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+      std::string message =
+        "Registered before: " + std::to_string(registered_before) +
+        ", after InitializeAll: " + std::to_string(registered) +
+        ", InitializeAll: " + std::to_string(initialize_all_ms) + "ms" +
+        ", 1M TypeResolver::Get: " + std::to_string(resolve_ms) + "ms\n";
+      Logger::WriteMessage(message.c_str());
+    }
+
+  };
+
+  TEST_CLASS(T_SchemaEvolution)
+  {
+  public:
+
+    // SchemaPoint as it was saved: { int x; float y; } with the members in the other order
+    static Reflection::Schema OldSchemaPoint()
+    {
+      Reflection::Schema schema;
+      schema.type = "T_Reflection::SchemaPoint";
+      schema.size = 8;
+      schema.members = { { "y", "float", 0, 4 }, { "x", "int", 4, 4 } };
+      return schema;
+    }
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    TEST_METHOD(T_UnchangedTypeHasNoPlan)
+    {
+      Reflection::SchemaSet schemas;
+      schemas.Collect(Reflection::TypeResolver<SchemaPoint>::Get());
+      Assert::IsFalse(schemas.Resolve());
+    }
+
+    TEST_METHOD(T_MigrateRawBytes)
+    {
+      Reflection::SchemaSet schemas;
+      schemas.Add(OldSchemaPoint());
+      Assert::IsTrue(schemas.Resolve());
+
+      Reflection::TypeDescriptor* type_desc = Reflection::TypeResolver<SchemaPoint>::Get();
+      Assert::IsTrue(schemas.NeedsMigration(type_desc));
+
+      char old_data[8];
+      float y = 2.5f;
+      int x = 3;
+      std::memcpy(old_data, &y, 4);
+      std::memcpy(old_data + 4, &x, 4);
+
+      SchemaPoint point;
+      Assert::IsTrue(schemas.Migrate(type_desc, old_data, sizeof(old_data), &point));
+      Assert::AreEqual(3.0f, point.x);
+      Assert::AreEqual(2.5f, point.y);
+      Assert::AreEqual(1.0f, point.z); // new member keeps its default
+
+      Assert::IsFalse(schemas.Migrate(type_desc, old_data, 4, &point));
+    }
+
+    TEST_METHOD(T_JsonMembersMappedByName)
+    {
+      Reflection::SchemaSet schemas;
+      schemas.Add(OldSchemaPoint());
+      schemas.Resolve();
+
+      Reflection::JsonReader reader(std::string_view("[2.5,3]"));
+      reader.SetSchemas(&schemas);
+      reader.Next();
+
+      SchemaPoint point;
+      Reflection::TypeResolver<SchemaPoint>::Get()->DeserializeStream(&point, reader);
+      Assert::IsFalse(reader.HasError());
+      Assert::AreEqual(3.0f, point.x);
+      Assert::AreEqual(2.5f, point.y);
+      Assert::AreEqual(1.0f, point.z);
+    }
+
+  };
+
+  TEST_CLASS(T_JsonStream)
+  {
+  public:
+
+    StreamObject object;
+    Reflection::TypeDescriptor* type_desc = nullptr;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      type_desc = Reflection::TypeResolver<StreamObject>::Get();
+      object = { { 1.5f, -2.25f }, "C:\\assets\\stream.png", { { "first" }, { "second" } }, { "a", "", "c" }, 0.5, true, 1099511627776ull, -42 };
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    std::string SerializeObject()
+    {
+      std::stringstream ss;
+      type_desc->Serialize(&object, ss);
+      return ss.str();
+    }
+
+    TEST_METHOD(T_MatchesDom)
+    {
+      std::string json = SerializeObject();
+
+      StreamObject from_dom{};
+      rapidjson::Document document;
+      document.Parse(json.c_str());
+      type_desc->Deserialize(&from_dom, document);
+
+      StreamObject from_stream{};
+      Reflection::JsonReader reader(json);
+      Assert::IsTrue(reader.Next());
+      type_desc->DeserializeStream(&from_stream, reader);
+      Assert::IsFalse(reader.HasError());
+
+      Assert::IsTrue(type_desc->Equals(&from_dom, &from_stream));
+      Assert::IsTrue(type_desc->Equals(&object, &from_stream));
+      Assert::IsTrue(from_stream.path == object.path);
+    }
+
+    TEST_METHOD(T_InSitu)
+    {
+      std::string json = SerializeObject();
+
+      StreamObject from_stream{};
+      Reflection::JsonReader reader(json.data(), json.size());
+      reader.Next();
+      type_desc->DeserializeStream(&from_stream, reader);
+      Assert::IsFalse(reader.HasError());
+      Assert::IsTrue(type_desc->Equals(&object, &from_stream));
+    }
+
+    TEST_METHOD(T_Malformed)
+    {
+      Reflection::TypeDescriptor* point_desc = Reflection::TypeResolver<LazyPoint>::Get();
+      const char* malformed[] = {
+        "[1.0,",                                    // truncated
+        "[\"a\",2]",                                // string instead of a number
+        "[1,2,3]",                                  // too many members
+        "[1]",                                      // too few members
+        "{\"type\":\"T_Reflection::LazyPoint\"}"    // no data
+      };
+
+      for (const char* json : malformed)
+      {
+        LazyPoint point{};
+        Reflection::JsonReader reader(std::string_view{ json });
+        reader.Next();
+        point_desc->DeserializeStream(&point, reader);
+        Assert::IsTrue(reader.HasError());
+      }
+
+      // the rest of the document isn't read after an error
+      std::string json = SerializeObject();
+      json.resize(json.size() / 2);
+      StreamObject from_stream{};
+      Reflection::JsonReader reader(json);
+      reader.Next();
+      type_desc->DeserializeStream(&from_stream, reader);
+      Assert::IsTrue(reader.HasError());
+      Assert::IsFalse(reader.Next());
+    }
+
+    TEST_METHOD(T_WriterMatchesSerialize)
+    {
+      Reflection::JsonWriter writer;
+      type_desc->Write(&object, writer);
+      std::string written = writer.ToString();
+
+      // Both outputs read back to the same object with either reader
+      for (const std::string& json : { SerializeObject(), written })
+      {
+        StreamObject from_dom{};
+        rapidjson::Document document;
+        document.Parse(json.c_str());
+        type_desc->Deserialize(&from_dom, document);
+        Assert::IsTrue(type_desc->Equals(&object, &from_dom));
+
+        StreamObject from_stream{};
+        Reflection::JsonReader reader(json);
+        reader.Next();
+        type_desc->DeserializeStream(&from_stream, reader);
+        Assert::IsFalse(reader.HasError());
+        Assert::IsTrue(type_desc->Equals(&object, &from_stream));
+      }
+
+      // Only the root is wrapped
+      Assert::AreEqual((size_t)0, written.find("{\"type\":\"T_Reflection::StreamObject\",\"data\":"));
+      Assert::AreEqual(std::string::npos, written.find("\"type\"", 2));
+    }
+
+    TEST_METHOD(T_WriterFloatsRoundTrip)
+    {
+      // Values that don't survive the 6 digits of an ostream
+      object.point = { 0.1f, 1.0f / 3.0f };
+      object.weight = 1.0 / 3.0;
+      object.offset = std::numeric_limits<int64_t>::min();
+      object.id = std::numeric_limits<uint64_t>::max();
+
+      Reflection::JsonWriter writer;
+      type_desc->Write(&object, writer);
+
+      StreamObject from_stream{};
+      Reflection::JsonReader reader(writer.ToString());
+      reader.Next();
+      type_desc->DeserializeStream(&from_stream, reader);
+      Assert::IsFalse(reader.HasError());
+      Assert::AreEqual(object.point.x, from_stream.point.x);
+      Assert::AreEqual(object.point.y, from_stream.point.y);
+      Assert::AreEqual(object.weight, from_stream.weight);
+      Assert::AreEqual(object.offset, from_stream.offset);
+      Assert::AreEqual(object.id, from_stream.id);
+    }
+
+  };
+
+  TEST_CLASS(T_PackedVector)
+  {
+  public:
+
+    PackedMesh mesh;
+    Reflection::TypeDescriptor* type_desc = nullptr;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      type_desc = Reflection::TypeResolver<PackedMesh>::Get();
+      mesh = PackedMesh();
+      for (int i = 0; i < 4; i++)
+      {
+        PackedVertex vertex;
+        vertex.position.x = (float)i;
+        vertex.position.y = i * 0.5f;
+        vertex.position.z = -1.0f;
+        vertex.u = 0.25f;
+        vertex.v = i * 0.125f;
+        mesh.vertices.push_back(vertex);
+      }
+      mesh.indices = { 0, 1, 2, 2, 3, 0 };
+      mesh.items = { { 1, 0.5f }, { 2, 1.5f } };
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    std::string WriteMesh()
+    {
+      Reflection::JsonWriter writer;
+      type_desc->Write(&mesh, writer);
+      return writer.ToString();
+    }
+
+    PackedMesh ReadMeshStream(const std::string& json)
+    {
+      PackedMesh loaded;
+      Reflection::JsonReader reader(json);
+      reader.Next();
+      type_desc->DeserializeStream(&loaded, reader);
+      Assert::IsFalse(reader.HasError());
+      return loaded;
+    }
+
+    PackedMesh ReadMeshDom(const std::string& json)
+    {
+      PackedMesh loaded;
+      rapidjson::Document document;
+      document.Parse(json.c_str());
+      type_desc->Deserialize(&loaded, document);
+      return loaded;
+    }
+
+    TEST_METHOD(T_FlatArray)
+    {
+      Reflection::JsonWriter vertices;
+      Reflection::TypeResolver<std::vector<PackedVertex>>::Get()->WriteData(&mesh.vertices, vertices);
+      Assert::AreEqual(std::string("[0,0,-1,0.25,0,1,0.5,-1,0.25,0.125,2,1,-1,0.25,0.25,3,1.5,-1,0.25,0.375]"), vertices.ToString());
+
+      Reflection::JsonWriter indices;
+      Reflection::TypeResolver<std::vector<unsigned>>::Get()->WriteData(&mesh.indices, indices);
+      Assert::AreEqual(std::string("[0,1,2,2,3,0]"), indices.ToString());
+
+      // Items with more than one scalar type keep the element per item format
+      Reflection::JsonWriter items;
+      Reflection::TypeResolver<std::vector<PackedItem>>::Get()->WriteData(&mesh.items, items);
+      Assert::AreEqual(std::string("[[1,0.5],[2,1.5]]"), items.ToString());
+    }
+
+    TEST_METHOD(T_RoundTrip)
+    {
+      std::string json = WriteMesh();
+
+      PackedMesh from_stream = ReadMeshStream(json);
+      Assert::IsTrue(type_desc->Equals(&mesh, &from_stream));
+
+      PackedMesh from_dom = ReadMeshDom(json);
+      Assert::IsTrue(type_desc->Equals(&mesh, &from_dom));
+    }
+
+    TEST_METHOD(T_ReadsPerItemFormat)
+    {
+      // Serialize() writes every item as its own wrapped value, the format before packing
+      std::stringstream ss;
+      type_desc->Serialize(&mesh, ss);
+
+      PackedMesh from_stream = ReadMeshStream(ss.str());
+      Assert::IsTrue(type_desc->Equals(&mesh, &from_stream));
+
+      PackedMesh from_dom = ReadMeshDom(ss.str());
+      Assert::IsTrue(type_desc->Equals(&mesh, &from_dom));
+    }
+
+    TEST_METHOD(T_PartialItem)
+    {
+      // 21 numbers for items of 5
+      std::string json = WriteMesh();
+      std::size_t end = json.find("],[0,1,2");
+      json.insert(end, ",1");
+
+      PackedMesh loaded;
+      Reflection::JsonReader reader(json);
+      reader.Next();
+      type_desc->DeserializeStream(&loaded, reader);
+      Assert::IsTrue(reader.HasError());
+    }
+
+  };
+
+  TEST_CLASS(T_Patch)
+  {
+  public:
+
+    PatchObject before;
+    PatchObject after;
+    Reflection::TypeDescriptor* type_desc = nullptr;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      type_desc = Reflection::TypeResolver<PatchObject>::Get();
+      before = { { 1.0f, 2.0f }, "before", { 1, 2, 3 }, 0.5 };
+      after = before;
+      after.point.y = 9.0f;
+      after.name = "after";
+      after.values.push_back(4);
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    TEST_METHOD(T_Diff_OnlyChangedMembers)
+    {
+      Reflection::Patch patch;
+      type_desc->Diff(&before, &after, patch);
+      Assert::AreEqual((size_t)3, patch.changes.size());
+      Assert::IsTrue(patch.changes[0].path == "point.y");
+      Assert::IsFalse(patch.changes[0].is_json);
+      Assert::IsTrue(patch.changes[1].path == "name");
+      Assert::IsTrue(patch.changes[2].path == "values");
+
+      Reflection::Patch none;
+      type_desc->Diff(&before, &before, none);
+      Assert::IsTrue(none.IsEmpty());
+    }
+
+    TEST_METHOD(T_Apply_AndUndo)
+    {
+      Reflection::Patch patch;
+      Reflection::Patch undo;
+      type_desc->Diff(&before, &after, patch);
+      type_desc->Diff(&after, &before, undo);
+
+      PatchObject obj = before;
+      Assert::IsTrue(type_desc->Apply(&obj, patch));
+      Assert::IsTrue(type_desc->Equals(&obj, &after));
+
+      Assert::IsTrue(type_desc->Apply(&obj, undo));
+      Assert::IsTrue(type_desc->Equals(&obj, &before));
+    }
+
+    TEST_METHOD(T_SerializeRoundTrip)
+    {
+      Reflection::Patch patch;
+      type_desc->Diff(&before, &after, patch);
+
+      Reflection::Patch loaded;
+      Assert::IsTrue(Reflection::Patch::Deserialize(patch.Serialize(), loaded));
+      Assert::AreEqual(patch.changes.size(), loaded.changes.size());
+
+      PatchObject obj = before;
+      Assert::IsTrue(type_desc->Apply(&obj, loaded));
+      Assert::IsTrue(type_desc->Equals(&obj, &after));
+
+      Assert::IsFalse(Reflection::Patch::Deserialize("not a patch", loaded));
+    }
+
+    TEST_METHOD(T_Apply_UnknownMember)
+    {
+      Reflection::Patch patch;
+      patch.changes.push_back({ "does_not_exist", "", false });
+
+      PatchObject obj = before;
+      Assert::IsFalse(type_desc->Apply(&obj, patch));
+    }
+
+  };
+
+}
+
+namespace T_FlexFormatter
+{
+
+  TEST_CLASS(T_ParseView)
+  {
+  public:
+
+    std::string data = "{\"a\":[1,2,3],\"b\":\"text\"},[4,5]";
+    std::string text;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      FlxFmtFile file = FlexFormatter::Create(data, true);
+      file.Save();
+      text = file.Save();
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    TEST_METHOD(T_MatchesDom)
+    {
+      FlxFmtFileView view = FlexFormatter::ParseView(text, FlxFmtFileType::Scene, true);
+      Assert::IsFalse(view.IsNull());
+
+      rapidjson::Document document;
+      document.Parse(text.c_str());
+      Assert::IsTrue(view.metadata.format == document["format"].GetString());
+      Assert::AreEqual(document["format_version"].GetUint(), view.metadata.format_version);
+      Assert::IsTrue(view.metadata.created.ToString() == document["created"].GetString());
+      Assert::IsTrue(view.metadata.last_edited.ToString() == document["last_edited"].GetString());
+      Assert::AreEqual(document["save_version"].GetUint(), view.metadata.save_version);
+      Assert::AreEqual((FlxFmtMetadata::Version)3, view.metadata.save_version);
+      Assert::IsTrue(view.metadata.file_type == FlxFmtFileType::Scene);
+
+      // The data is a view into the text, without the brackets of "data":[...]
+      Assert::IsTrue(view.data == data);
+      Assert::IsTrue(view.data.data() > text.data() && view.data.data() < text.data() + text.size());
+
+      std::string data_array = "[" + std::string(view.data) + "]";
+      rapidjson::Document data_document;
+      data_document.Parse(data_array.c_str());
+      Assert::IsTrue(data_document == document["data"]);
+    }
+
+    TEST_METHOD(T_MatchesParse)
+    {
+      FlxFmtFile file = FlexFormatter::Parse(text, FlxFmtFileType::Scene);
+      FlxFmtFileView view = FlexFormatter::ParseView(text, FlxFmtFileType::Scene, true);
+      Assert::IsTrue(file.data == view.data);
+      Assert::IsTrue(file.metadata.created == view.metadata.created);
+      Assert::AreEqual(file.metadata.save_version, view.metadata.save_version);
+
+      // Trailing whitespace after the closing brace
+      FlxFmtFileView trailing = FlexFormatter::ParseView(text + "\r\n  ", FlxFmtFileType::Scene, true);
+      Assert::IsTrue(trailing.data == data);
+    }
+
+    TEST_METHOD(T_InvalidHeader)
+    {
+      auto is_null = [](const std::string& file_data)
+      {
+        return FlexFormatter::ParseView(file_data, FlxFmtFileType::Scene, true).IsNull();
+      };
+
+      Assert::IsTrue(is_null(""));
+      Assert::IsTrue(is_null("not json"));
+      Assert::IsTrue(is_null("{\"data\":[1]}"));                           // no metadata
+      Assert::IsTrue(is_null(text.substr(0, text.find("\"data\":"))));     // no data
+      Assert::IsTrue(is_null(text.substr(0, text.size() - 2)));            // truncated
+
+      std::string other_format = text;
+      other_format.replace(other_format.find("flxfmt"), 6, "flxfmx");
+      Assert::IsTrue(is_null(other_format));
+
+      std::string other_version = text;
+      other_version.replace(other_version.find("\"format_version\":1"), 18, "\"format_version\":2");
+      Assert::IsTrue(is_null(other_version));
+    }
+
+  };
+
+}
+
+namespace T_FlxCompression
+{
+
+  TEST_CLASS(T_Codec)
+  {
+  public:
+
+    std::string text;   // compresses well, like a json scene
+    std::string noise;  // doesn't compress, stored as is
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      text.clear();
+      for (int i = 0; i < 2000; i++) text += "{\"name\":\"Entity " + std::to_string(i) + "\",\"position\":[" + std::to_string(i % 7) + ",1,2]},";
+
+      noise.resize(20000);
+      uint32_t state = 12345;
+      for (char& c : noise)
+      {
+        state = state * 1664525u + 1013904223u;
+        c = static_cast<char>(state >> 24);
+      }
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    TEST_METHOD(T_RoundTrip)
+    {
+      // empty, shorter than a match, one block, many blocks with a short last block
+      const std::string inputs[] = { "", "abc", text, text + noise };
+      const std::size_t block_sizes[] = { FLXZIP_DEFAULT_BLOCK_SIZE, 1000 };
+
+      for (const std::string& input : inputs)
+      {
+        for (std::size_t block_size : block_sizes)
+        {
+          std::string compressed = FlxCompression::Compress(input, block_size);
+          Assert::IsTrue(FlxCompression::IsCompressed(compressed));
+
+          std::string decompressed;
+          Assert::IsTrue(FlxCompression::Decompress(compressed, decompressed));
+          Assert::IsTrue(decompressed == input);
+        }
+      }
+
+      Assert::IsTrue(FlxCompression::Compress(text).size() < text.size() / 4);
+
+      // noise is stored, it only costs the header and the block table
+      Assert::IsTrue(FlxCompression::Compress(noise).size() <= noise.size() + sizeof(FlxZipHeader) + sizeof(uint32_t));
+    }
+
+    TEST_METHOD(T_Reader_BlockByBlock)
+    {
+      std::string input = text + noise;
+      std::string compressed = FlxCompression::Compress(input, 4096);
+
+      FlxZipReader reader(compressed);
+      Assert::IsTrue(reader.IsValid());
+      Assert::AreEqual(input.size(), reader.GetRawSize());
+      Assert::AreEqual((input.size() + 4095) / 4096, reader.GetBlockCount());
+
+      std::string streamed;
+      std::string block(reader.GetBlockSize(), '\0');
+      for (std::size_t i = 0; i < reader.GetBlockCount(); i++)
+      {
+        Assert::IsTrue(reader.DecompressBlock(i, block.data()));
+        streamed.append(block.data(), reader.GetRawBlockSize(i));
+      }
+      Assert::IsTrue(streamed == input);
+      Assert::IsFalse(reader.DecompressBlock(reader.GetBlockCount(), block.data()));
+    }
+
+    TEST_METHOD(T_Decompress_CorruptData)
+    {
+      std::string compressed = FlxCompression::Compress(text, 4096);
+      std::string out;
+
+      // not a container
+      Assert::IsFalse(FlxCompression::IsCompressed(text));
+      Assert::IsFalse(FlxCompression::Decompress(text, out));
+      Assert::IsTrue(out.empty());
+
+      // cut off in the block table and in the last block
+      Assert::IsFalse(FlxCompression::Decompress(compressed.substr(0, sizeof(FlxZipHeader) + 2), out));
+      Assert::IsFalse(FlxCompression::Decompress(compressed.substr(0, compressed.size() - 1), out));
+
+      // a header that doesn't add up
+      std::string bad_header = compressed;
+      FlxZipHeader header;
+      std::memcpy(&header, bad_header.data(), sizeof(header));
+      header.raw_size *= 2;
+      std::memcpy(bad_header.data(), &header, sizeof(header));
+      Assert::IsFalse(FlxCompression::Decompress(bad_header, out));
+
+      // flipped bits in the blocks are caught or decode to the right size, never out of bounds
+      for (std::size_t i = sizeof(FlxZipHeader) + 32; i < compressed.size(); i += 97)
+      {
+        std::string corrupt = compressed;
+        corrupt[i] ^= 0x5A;
+        if (FlxCompression::Decompress(corrupt, out)) Assert::AreEqual(text.size(), out.size());
+      }
+
+      // a block that doesn't decode to exactly the expected size
+      std::string block(FlxCompression::GetMaxBlockSize(text.size()), '\0');
+      std::size_t block_size = FlxCompression::CompressBlock(text.data(), text.size(), block.data());
+      std::string decoded(text.size() + 1, '\0');
+      Assert::IsTrue(FlxCompression::DecompressBlock(block.data(), block_size, decoded.data(), text.size()));
+      Assert::IsFalse(FlxCompression::DecompressBlock(block.data(), block_size, decoded.data(), text.size() + 1));
+      Assert::IsFalse(FlxCompression::DecompressBlock(block.data(), block_size, decoded.data(), text.size() - 1));
+    }
+
+  };
+
+}
+
+namespace T_Checksum
+{
+
+  TEST_CLASS(T_CRC32C)
+  {
+  public:
+
+    // Bit by bit, the definition the fast paths have to match
+    static uint32_t Reference(const unsigned char* data, std::size_t size)
+    {
+      uint32_t crc = 0xFFFFFFFFu;
+      for (std::size_t i = 0; i < size; i++)
+      {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0u);
+      }
+      return ~crc;
+    }
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    TEST_METHOD(T_CheckValue)
+    {
+      Assert::AreEqual(0xE3069283u, Checksum::CRC32C("123456789", 9));
+      Assert::AreEqual(0u, Checksum::CRC32C("", 0));
+    }
+
+    // Unaligned starts and every length around the 8 byte steps
+    TEST_METHOD(T_MatchesReference)
+    {
+      unsigned char data[200];
+      for (int i = 0; i < 200; i++) data[i] = static_cast<unsigned char>(i * 131 + 7);
+
+      for (std::size_t offset = 0; offset < 8; offset++)
+      {
+        for (std::size_t size = 0; size + offset <= sizeof(data); size += 3)
+        {
+          Assert::AreEqual(Reference(data + offset, size), Checksum::CRC32C(data + offset, size));
+        }
+      }
+    }
+
+    TEST_METHOD(T_Chained)
+    {
+      std::string data = "The quick brown fox jumps over the lazy dog, 0123456789.";
+      uint32_t whole = Checksum::CRC32C(data);
+      for (std::size_t split = 0; split <= data.size(); split++)
+      {
+        uint32_t first = Checksum::CRC32C(std::string_view(data).substr(0, split));
+        Assert::AreEqual(whole, Checksum::CRC32C(std::string_view(data).substr(split), first));
+      }
+    }
+
+  };
+
+  TEST_CLASS(T_FileChecksums)
+  {
+  public:
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    TEST_METHOD(T_Json_Verified)
+    {
+      FlxFmtFile file = FlexFormatter::Create("{\"a\":[1,2,3],\"b\":\"text\"}", true);
+      std::string text = file.Save();
+
+      FlxFmtFileView view = FlexFormatter::ParseView(text, FlxFmtFileType::Scene, true);
+      Assert::IsFalse(view.IsNull());
+      Assert::IsTrue(view.has_checksum);
+      Assert::AreEqual(Checksum::CRC32C(file.data), view.checksum);
+
+      // one changed character in the data
+      std::string corrupt = text;
+      corrupt[corrupt.rfind("text")] = 'T';
+      Assert::IsTrue(FlexFormatter::ParseView(corrupt, FlxFmtFileType::Scene, true).IsNull());
+
+      // files written before checksums were added are still accepted
+      std::string old = text;
+      std::size_t start = old.find(",\"checksum\":");
+      old.erase(start, old.find(',', start + 1) - start);
+      FlxFmtFileView old_view = FlexFormatter::ParseView(old, FlxFmtFileType::Scene, true);
+      Assert::IsFalse(old_view.IsNull());
+      Assert::IsFalse(old_view.has_checksum);
+    }
+
+    TEST_METHOD(T_Binary_Verified)
+    {
+      std::shared_ptr<FlexECS::Scene> scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      for (int i = 0; i < 100; i++) FlexECS::Scene::CreateEntity("Entity " + std::to_string(i)).AddComponent<Vector3>({ (float)i, 1.0f, 2.0f });
+
+      std::string data = scene->Internal_SerializeBinary();
+      std::shared_ptr<FlexECS::Scene> loaded = FlexECS::Scene::Internal_DeserializeBinary(data.data(), data.size());
+      Assert::IsTrue(loaded != nullptr);
+      Assert::AreEqual(scene->entity_index.size(), loaded->entity_index.size());
+
+      for (std::size_t i = data.size() / 4; i < data.size(); i += data.size() / 4)
+      {
+        std::string corrupt = data;
+        corrupt[i] ^= 1;
+        Assert::IsTrue(FlexECS::Scene::Internal_DeserializeBinary(corrupt.data(), corrupt.size()) == nullptr);
+      }
+    }
+
+  };
+
+}
+
+namespace T_Base64
+{
+
+  TEST_CLASS(T_Codec)
+  {
+  public:
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    // RFC 4648 test vectors
+    TEST_METHOD(T_Encode_KnownValues)
+    {
+      Assert::AreEqual(std::string(""), Base64::Encode("", 0));
+      Assert::AreEqual(std::string("Zg=="), Base64::Encode("f", 1));
+      Assert::AreEqual(std::string("Zm8="), Base64::Encode("fo", 2));
+      Assert::AreEqual(std::string("Zm9v"), Base64::Encode("foo", 3));
+      Assert::AreEqual(std::string("Zm9vYg=="), Base64::Encode("foob", 4));
+      Assert::AreEqual(std::string("Zm9vYmE="), Base64::Encode("fooba", 5));
+      Assert::AreEqual(std::string("Zm9vYmFy"), Base64::Encode("foobar", 6));
+    }
+
+    // Every size up to a few SIMD blocks, so that the vector paths and the scalar tails are both used
+    TEST_METHOD(T_RoundTrip)
+    {
+      std::vector<BYTE> data(300);
+      for (std::size_t i = 0; i < data.size(); i++) data[i] = static_cast<BYTE>(i * 37 + 11);
+
+      for (std::size_t size = 1; size <= data.size(); size++)
+      {
+        std::string encoded = Base64::Encode(data.data(), size);
+        Assert::AreEqual(Base64::GetEncodedSize(size), encoded.size());
+        Assert::AreEqual(size, Base64::GetDecodedSize(encoded));
+
+        std::vector<BYTE> decoded(size);
+        Assert::IsTrue(Base64::Decode(encoded, decoded.data(), decoded.size()));
+        Assert::IsTrue(std::equal(decoded.begin(), decoded.end(), data.begin()));
+      }
+    }
+
+    TEST_METHOD(T_Decode_InvalidInput)
+    {
+      BYTE out[64];
+
+      // unpadded input is accepted, but a single character can't hold a byte
+      Assert::AreEqual((size_t)2, Base64::GetDecodedSize("Zm9"));
+      Assert::AreEqual((size_t)0, Base64::GetDecodedSize("Zm9vY"));
+      Assert::IsFalse(Base64::Decode(std::string_view("Zm9vY"), out, sizeof(out)));
+
+      // the buffer is too small
+      Assert::IsFalse(Base64::Decode(std::string_view("Zm9vYmFy"), out, 5));
+
+      // characters outside the alphabet, in the scalar tail and in a SIMD block
+      Assert::IsFalse(Base64::Decode(std::string_view("Zm9v*mFy"), out, sizeof(out)));
+      std::string long_input = Base64::Encode(std::string(45, 'a').data(), 45);
+      long_input[10] = '-';
+      Assert::IsFalse(Base64::Decode(std::string_view(long_input), out, sizeof(out)));
+
+      // padding in the middle
+      Assert::IsFalse(Base64::Decode(std::string_view("Zg==Zm9v"), out, sizeof(out)));
+
+      // the logging overload returns an empty vector
+      Assert::IsTrue(Base64::Decode(std::string("Zm9v*mFy")).empty());
+    }
+
+  };
+
+}
+
+namespace T_FlexECS
+{
+
+  // A component with an entity reference and a string, for Merge()
+  struct MergeLink { FLX_REFL_SERIALIZABLE FlexECS::Entity target; FlexECS::Scene::StringIndex label; };
+
+  // Replicated components
+  struct ReplicatedBody { FLX_REFL_SERIALIZABLE Vector3 position; int health; bool alive; };
+  struct ReplicatedTeam { FLX_REFL_SERIALIZABLE int team; };
+
+  // Simulation state components, PaddedState has padding bytes between its members
+  struct SimulationBody { FLX_REFL_SERIALIZABLE float x; float y; float velocity_y; int bounces; };
+  struct PaddedState { FLX_REFL_SERIALIZABLE bool flag; double value; };
+
+}
+
+FLX_REFL_REGISTER_START(T_FlexECS::MergeLink)
+  FLX_REFL_REGISTER_PROPERTY(target)
+  FLX_REFL_REGISTER_PROPERTY(label)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_FlexECS::ReplicatedBody)
+  FLX_REFL_REGISTER_PROPERTY(position)
+  FLX_REFL_REGISTER_PROPERTY(health)
+  FLX_REFL_REGISTER_PROPERTY(alive)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_FlexECS::ReplicatedTeam)
+  FLX_REFL_REGISTER_PROPERTY(team)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_FlexECS::SimulationBody)
+  FLX_REFL_REGISTER_PROPERTY(x)
+  FLX_REFL_REGISTER_PROPERTY(y)
+  FLX_REFL_REGISTER_PROPERTY(velocity_y)
+  FLX_REFL_REGISTER_PROPERTY(bounces)
+FLX_REFL_REGISTER_END;
+
+FLX_REFL_REGISTER_START(T_FlexECS::PaddedState)
+  FLX_REFL_REGISTER_PROPERTY(flag)
+  FLX_REFL_REGISTER_PROPERTY(value)
+FLX_REFL_REGISTER_END;
+
+namespace T_FlexECS
+{
+
+  FLX_ECS_REGISTER_STRING_MEMBER(MergeLink, label)
+  FLX_ECS_REGISTER_REPLICATED(ReplicatedBody, 0.01)
+  FLX_ECS_REGISTER_REPLICATED(ReplicatedTeam, 1)
+  FLX_ECS_REGISTER_SIMULATION_STATE(SimulationBody)
+  FLX_ECS_REGISTER_SIMULATION_STATE(PaddedState)
+
+  // The component of an entity in a scene that isn't the active scene, nullptr if it doesn't have it
+  template <typename T>
+  static T* FindComponent(FlexECS::Scene& scene, FlexECS::EntityID entity)
+  {
+    auto entity_it = scene.entity_index.find(entity);
+    if (entity_it == scene.entity_index.end()) return nullptr;
+
+    auto component_it = scene.component_index.find(Reflection::TypeResolver<T>::Get()->name);
+    if (component_it == scene.component_index.end()) return nullptr;
+
+    FlexECS::EntityRecord& record = entity_it->second;
+    auto archetype_it = component_it->second.find(record.archetype->id);
+    if (archetype_it == component_it->second.end()) return nullptr;
+
+    return reinterpret_cast<T*>(FlexECS::Internal_GetComponentDataPtr(record.archetype->archetype_table[archetype_it->second.column][record.row]));
+  }
+
+  // Entity id to its components and name, independent of the archetype order
+  static std::unordered_map<FlexECS::EntityID, std::string> SceneContents(FlexECS::Scene& scene)
+  {
+    std::unordered_map<FlexECS::EntityID, std::string> contents;
+    for (auto& [entity, record] : scene.entity_index)
+    {
+      std::string row = scene.GetEntityName(entity);
+      for (std::size_t i = 0; i < record.archetype->type.size(); i++)
+      {
+        auto [size, data] = FlexECS::Internal_GetComponentData(record.archetype->archetype_table[i][record.row]);
+        row += "|" + record.archetype->type[i] + ":" + std::string(reinterpret_cast<const char*>(data), size);
+      }
+      contents[entity] = row;
+    }
+    return contents;
+  }
+
+  TEST_CLASS(T_TimeSlicedView)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      for (int i = 0; i < 100; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        entity.AddComponent<int>(i);
+        entities.push_back(entity);
+      }
+
+      // Entities the view doesn't match
+      for (int i = 0; i < 20; i++) FlexECS::Scene::CreateEntity("Other " + std::to_string(i)).AddComponent<float>(1.0f);
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+      scene = nullptr;
+    }
+
+    TEST_METHOD(T_BudgetCarriesOver)
+    {
+      FlexECS::TimeSlicedView<int> view;
+      std::unordered_map<FlexECS::EntityID, int> visits;
+      auto visit = [&visits](FlexECS::Entity entity) { visits[entity]++; };
+
+      // Each run continues where the last one stopped
+      Assert::AreEqual((size_t)30, view.Run({ 30, 0.0 }, visit));
+      Assert::IsFalse(view.IsPassComplete());
+      Assert::AreEqual((size_t)30, view.Run({ 30, 0.0 }, visit));
+      Assert::AreEqual((size_t)30, view.Run({ 30, 0.0 }, visit));
+      Assert::IsFalse(view.IsPassComplete());
+      Assert::AreEqual((size_t)10, view.Run({ 30, 0.0 }, visit));
+      Assert::IsTrue(view.IsPassComplete());
+      Assert::AreEqual((size_t)1, view.GetPassCount());
+
+      // Every matching entity exactly once
+      Assert::AreEqual(entities.size(), visits.size());
+      for (FlexECS::Entity& entity : entities) Assert::AreEqual(1, visits[entity]);
+
+      // The next run starts a new pass
+      Assert::AreEqual((size_t)30, view.Run({ 30, 0.0 }, visit));
+      Assert::IsFalse(view.IsPassComplete());
+    }
+
+    TEST_METHOD(T_UnlimitedBudget)
+    {
+      FlexECS::TimeSlicedView<int> view;
+      std::size_t visited = 0;
+      auto visit = [&visited](FlexECS::Entity) { visited++; };
+
+      // Finishes the current pass and doesn't start the next one
+      Assert::AreEqual((size_t)40, view.Run({ 40, 0.0 }, visit));
+      Assert::AreEqual((size_t)60, view.Run({}, visit));
+      Assert::IsTrue(view.IsPassComplete());
+      Assert::AreEqual((size_t)100, view.Run({}, visit));
+      Assert::AreEqual((size_t)200, visited);
+      Assert::AreEqual((size_t)2, view.GetPassCount());
+    }
+
+    TEST_METHOD(T_TimeBudget)
+    {
+      FlexECS::TimeSlicedView<int> view;
+      std::unordered_map<FlexECS::EntityID, int> visits;
+      auto visit = [&visits](FlexECS::Entity entity)
+      {
+        visits[entity]++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      };
+
+      // The time is checked after each entity, so a slow entity ends the run
+      for (int i = 0; i < 10; i++) Assert::AreEqual((size_t)1, view.Run({ 0, 1.0 }, visit));
+      Assert::AreEqual((size_t)10, visits.size());
+    }
+
+    TEST_METHOD(T_DestroyBetweenRuns)
+    {
+      FlexECS::TimeSlicedView<int> view;
+      std::unordered_map<FlexECS::EntityID, int> visits;
+      auto visit = [&visits](FlexECS::Entity entity) { visits[entity]++; };
+
+      view.Run({ 50, 0.0 }, visit);
+
+      // Visited and unvisited entities, each destroy moves the last row
+      std::unordered_set<FlexECS::EntityID> destroyed;
+      for (std::size_t i = 0; i < entities.size(); i += 10)
+      {
+        destroyed.insert(entities[i]);
+        FlexECS::Scene::DestroyEntity(entities[i]);
+      }
+
+      view.Run({}, visit);
+      Assert::IsTrue(view.IsPassComplete());
+
+      for (FlexECS::Entity& entity : entities)
+      {
+        if (destroyed.count(entity)) continue;
+        Assert::IsTrue(visits[entity] >= 1);
+      }
+    }
+
+    TEST_METHOD(T_CreateBetweenRuns)
+    {
+      FlexECS::TimeSlicedView<int> view;
+      std::unordered_map<FlexECS::EntityID, int> visits;
+      auto visit = [&visits](FlexECS::Entity entity) { visits[entity]++; };
+
+      view.Run({ 50, 0.0 }, visit);
+
+      std::vector<FlexECS::Entity> created;
+      for (int i = 0; i < 5; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Created " + std::to_string(i));
+        entity.AddComponent<int>(100 + i);
+        created.push_back(entity);
+      }
+
+      // New entities wait for the next pass
+      Assert::AreEqual((size_t)50, view.Run({}, visit));
+      for (FlexECS::Entity& entity : created) Assert::AreEqual((size_t)0, visits.count(entity));
+
+      Assert::AreEqual((size_t)105, view.Run({}, visit));
+      for (FlexECS::Entity& entity : created) Assert::AreEqual(1, visits[entity]);
+    }
+
+  };
+
+  TEST_CLASS(T_ComponentRef)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      for (int i = 0; i < 10; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        entity.AddComponent<int>(i);
+        entities.push_back(entity);
+      }
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+      scene = nullptr;
+    }
+
+    TEST_METHOD(T_SwapAndPop)
+    {
+      // The last row, destroying the first entity moves it into the first row
+      FlexECS::ComponentRef<int> ref = entities[9];
+      Assert::AreEqual(9, *ref);
+
+      FlexECS::Scene::DestroyEntity(entities[0]);
+      Assert::IsTrue(ref.Get() == entities[9].GetComponent<int>());
+      Assert::AreEqual(9, *ref);
+
+      *ref = 90;
+      Assert::AreEqual(90, *entities[9].GetComponent<int>());
+    }
+
+    TEST_METHOD(T_Migration)
+    {
+      FlexECS::ComponentRef<int> ref = entities[3];
+      Assert::AreEqual(3, *ref);
+
+      // Moves the entity to another archetype
+      entities[3].AddComponent<float>(1.5f);
+      Assert::IsTrue(ref.Get() == entities[3].GetComponent<int>());
+      Assert::AreEqual(3, *ref);
+
+      entities[3].RemoveComponent<int>();
+      Assert::IsFalse((bool)ref);
+    }
+
+    TEST_METHOD(T_Destroyed)
+    {
+      FlexECS::ComponentRef<int> ref = entities[4];
+      Assert::IsTrue((bool)ref);
+
+      FlexECS::Scene::DestroyEntity(entities[4]);
+      Assert::IsNull(ref.Get());
+    }
+
+    TEST_METHOD(T_ActiveSceneChanged)
+    {
+      FlexECS::ComponentRef<int> ref = entities[5];
+      Assert::AreEqual(5, *ref);
+
+      // The entity doesn't exist in the other scene
+      std::shared_ptr<FlexECS::Scene> other = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(other);
+      Assert::IsNull(ref.Get());
+
+      FlexECS::Scene::SetActiveScene(scene);
+      Assert::IsTrue(ref.Get() == entities[5].GetComponent<int>());
+      Assert::AreEqual(5, *ref);
+    }
+
+  };
+
+  TEST_CLASS(T_NameIndex)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      for (int i = 0; i < 10; i++) entities.push_back(FlexECS::Scene::CreateEntity("Entity " + std::to_string(i)));
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+      scene = nullptr;
+    }
+
+    TEST_METHOD(T_FindByName)
+    {
+      Assert::IsTrue(scene->FindByName("Entity 3") == entities[3]);
+      Assert::IsTrue(scene->FindByName("Missing") == FlexECS::Entity::Null);
+
+      FlexECS::Entity duplicate = FlexECS::Scene::CreateEntity("Entity 3");
+      std::vector<FlexECS::Entity> found = scene->FindAllByName("Entity 3");
+      Assert::AreEqual((size_t)2, found.size());
+      Assert::IsTrue(std::find(found.begin(), found.end(), entities[3]) != found.end());
+      Assert::IsTrue(std::find(found.begin(), found.end(), duplicate) != found.end());
+    }
+
+    TEST_METHOD(T_Rename)
+    {
+      // Once before the rename so that the index is built
+      Assert::IsTrue(scene->FindByName("Entity 3") == entities[3]);
+
+      scene->SetEntityName(entities[3], "Renamed");
+      Assert::AreEqual(std::string("Renamed"), scene->GetEntityName(entities[3]));
+      Assert::IsTrue(scene->FindByName("Entity 3") == FlexECS::Entity::Null);
+      Assert::IsTrue(scene->FindByName("Renamed") == entities[3]);
+
+      // Taking the name of another entity
+      scene->SetEntityName(entities[4], "Renamed");
+      Assert::AreEqual((size_t)2, scene->FindAllByName("Renamed").size());
+      Assert::IsTrue(scene->FindByName("Entity 4") == FlexECS::Entity::Null);
+    }
+
+    TEST_METHOD(T_Destroy)
+    {
+      Assert::IsTrue(scene->FindByName("Entity 4") == entities[4]);
+
+      FlexECS::Scene::DestroyEntity(entities[4]);
+      Assert::IsTrue(scene->FindByName("Entity 4") == FlexECS::Entity::Null);
+      Assert::IsTrue(scene->FindAllByName("Entity 4").empty());
+
+      // The name can be reused
+      FlexECS::Entity created = FlexECS::Scene::CreateEntity("Entity 4");
+      Assert::IsTrue(scene->FindByName("Entity 4") == created);
+    }
+
+    TEST_METHOD(T_SortByName)
+    {
+      scene->SetEntityName(entities[0], "Charlie");
+      scene->SetEntityName(entities[1], "Alpha");
+      scene->SetEntityName(entities[2], "Bravo");
+      scene->SetEntityName(entities[3], "Alpha");
+
+      std::vector<FlexECS::Entity> sorted = { entities[0], entities[1], entities[2], entities[3] };
+      scene->SortByName(sorted);
+
+      // Entities with the same name keep their order
+      std::vector<FlexECS::Entity> expected = { entities[1], entities[3], entities[2], entities[0] };
+      Assert::IsTrue(sorted == expected);
+    }
+
+  };
+
+  TEST_CLASS(T_BinaryScene)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "flx_unittest_binary.flxscene";
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      for (int i = 0; i < 100; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        entity.AddComponent<Vector3>({ (float)i, 1.0f, 2.0f });
+        if (i % 3 == 0) entity.AddComponent<int>(i);
+        entities.push_back(entity);
+      }
+      FlexECS::Scene::DestroyEntity(entities[50]);
+
+      std::ofstream(path).close();
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+      scene = nullptr;
+      File::Close(path);
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+    }
+
+    TEST_METHOD(T_SaveLoad)
+    {
+      File& file = File::Open(path);
+      scene->SaveBinary(file);
+      Assert::IsTrue(FlxBinReader::IsBinary(file.Read()));
+
+      std::shared_ptr<FlexECS::Scene> loaded = FlexECS::Scene::Load(file);
+      Assert::IsTrue(SceneContents(*scene) == SceneContents(*loaded));
+
+      // New entities don't reuse the ids of the loaded ones
+      FlexECS::Scene::SetActiveScene(loaded);
+      FlexECS::Entity created = FlexECS::Scene::CreateEntity("Created");
+      Assert::AreEqual((size_t)0, scene->entity_index.count(created));
+    }
+
+    TEST_METHOD(T_MatchesJson)
+    {
+      File& file = File::Open(path);
+      scene->Save(file);
+      Assert::IsFalse(FlxBinReader::IsBinary(file.Read()));
+      std::shared_ptr<FlexECS::Scene> from_json = FlexECS::Scene::Load(file);
+
+      scene->SaveBinary(file);
+      std::shared_ptr<FlexECS::Scene> from_binary = FlexECS::Scene::Load(file);
+
+      Assert::IsTrue(SceneContents(*from_json) == SceneContents(*from_binary));
+    }
+
+    std::string ReadFileBytes()
+    {
+      std::ifstream stream(path, std::ios::binary);
+      return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+
+    TEST_METHOD(T_LoadMapped)
+    {
+      File& file = File::Open(path);
+      scene->SaveBinary(file);
+
+      std::shared_ptr<FlexECS::Scene> mapped = FlexECS::Scene::LoadMapped(Path(path));
+      Assert::IsTrue(SceneContents(*scene) == SceneContents(*mapped));
+    }
+
+    TEST_METHOD(T_LoadMapped_EditDoesNotChangeFile)
+    {
+      File& file = File::Open(path);
+      scene->SaveBinary(file);
+      std::string before = ReadFileBytes();
+
+      std::shared_ptr<FlexECS::Scene> mapped = FlexECS::Scene::LoadMapped(Path(path));
+      FindComponent<Vector3>(*mapped, entities[5])->x = -1.0f;
+      *FindComponent<int>(*mapped, entities[6]) = -6;
+
+      Assert::IsTrue(before == ReadFileBytes());
+      Assert::AreEqual(-1.0f, FindComponent<Vector3>(*mapped, entities[5])->x);
+    }
+
+    TEST_METHOD(T_LoadMapped_SaveOverMappedFile)
+    {
+      File& file = File::Open(path);
+      scene->SaveBinary(file);
+
+      std::shared_ptr<FlexECS::Scene> mapped = FlexECS::Scene::LoadMapped(Path(path));
+      FindComponent<Vector3>(*mapped, entities[5])->x = -1.0f;
+      mapped->Save(file);
+
+      // The mapped scene still has its rows after the file is replaced
+      Assert::AreEqual(10.0f, FindComponent<Vector3>(*mapped, entities[10])->x);
+
+      std::shared_ptr<FlexECS::Scene> loaded = FlexECS::Scene::Load(file);
+      Assert::IsTrue(FlxBinReader::IsBinary(file.data));
+      Assert::IsTrue(SceneContents(*mapped) == SceneContents(*loaded));
+      Assert::AreEqual(-1.0f, FindComponent<Vector3>(*loaded, entities[5])->x);
+    }
+
+  };
+
+  TEST_CLASS(T_ParallelSerialization)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+
+      // Enough rows for the parallel path, spread over four archetypes
+      for (int i = 0; i < (int)FlexECS::Scene::PARALLEL_SERIALIZATION_MIN_ROWS + 1000; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        if (i % 4 != 3) entity.AddComponent<Vector3>({ (float)i, i * 0.25f, -1.0f });
+        if (i % 4 == 1 || i % 4 == 3) entity.AddComponent<int>(i);
+        if (i % 4 == 2) entity.AddComponent<MergeLink>({ FlexECS::Entity(entity), scene->Internal_StringStorage_New("link " + std::to_string(i)) });
+      }
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+      scene = nullptr;
+    }
+
+    TEST_METHOD(T_JsonMatchesSerial)
+    {
+      Assert::AreEqual((size_t)0, FlexECS::Scene::Internal_GetSerializationThreadCount(scene->entity_index.size()));
+      std::string json = scene->Internal_Serialize();
+
+      // The data of the wrapper is what the scene's descriptor writes on one thread
+      Reflection::JsonWriter serial;
+      Reflection::TypeResolver<FlexECS::Scene>::Get()->WriteData(scene.get(), serial);
+      std::string suffix = "\"data\":" + serial.ToString() + "}";
+      Assert::IsTrue(json.size() > suffix.size());
+      Assert::IsTrue(json.compare(json.size() - suffix.size(), suffix.size(), suffix) == 0);
+
+      std::shared_ptr<FlexECS::Scene> loaded = FlexECS::Scene::Internal_Deserialize(json);
+      Assert::IsTrue(loaded != nullptr);
+      Assert::IsTrue(SceneContents(*scene) == SceneContents(*loaded));
+    }
+
+    TEST_METHOD(T_BinaryRoundTrip)
+    {
+      Date created = Date::Now();
+      std::string data = scene->Internal_SerializeBinary(created);
+      Assert::IsTrue(data == scene->Internal_SerializeBinary(created));
+
+      std::shared_ptr<FlexECS::Scene> loaded = FlexECS::Scene::Internal_DeserializeBinary(data.data(), data.size());
+      Assert::IsTrue(loaded != nullptr);
+      Assert::IsTrue(SceneContents(*scene) == SceneContents(*loaded));
+    }
+
+  };
+
+  TEST_CLASS(T_SaveAsync)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "flx_unittest_async.flxscene";
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      for (int i = 0; i < 100; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        entity.AddComponent<Vector3>({ (float)i, 1.0f, 2.0f });
+        entities.push_back(entity);
+      }
+
+      std::ofstream(path).close();
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+      FlexECS::Scene::WaitForAsyncSaves();
+      scene = nullptr;
+      File::Close(path);
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+    }
+
+    std::string ReadFileBytes()
+    {
+      std::ifstream stream(path, std::ios::binary);
+      return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+
+    // Changes a component, saves asynchronously and loads the file back
+    std::shared_ptr<FlexECS::Scene> EditAndSaveAsync(File& file)
+    {
+      entities[5].GetComponent<Vector3>()->x = -1.0f;
+
+      FlexECS::SceneSaveResult result = scene->SaveAsync(file).get();
+      Assert::IsTrue(result.success);
+      Assert::IsTrue(result.error.empty());
+
+      std::shared_ptr<FlexECS::Scene> loaded = FlexECS::Scene::Load(file);
+      Assert::AreEqual(-1.0f, FindComponent<Vector3>(*loaded, entities[5])->x);
+      return loaded;
+    }
+
+    TEST_METHOD(T_KeepsJson)
+    {
+      File& file = File::Open(path);
+      scene->Save(file);
+
+      EditAndSaveAsync(file);
+      std::string bytes = ReadFileBytes();
+      Assert::IsFalse(FlxBinReader::IsBinary(bytes));
+      Assert::IsFalse(FlxCompression::IsCompressed(bytes));
+      Assert::IsFalse(FlexFormatter::ParseView(bytes, FlxFmtFileType::Scene, true).IsNull());
+    }
+
+    TEST_METHOD(T_KeepsBinary)
+    {
+      File& file = File::Open(path);
+      scene->SaveBinary(file);
+
+      EditAndSaveAsync(file);
+      Assert::IsTrue(FlxBinReader::IsBinary(ReadFileBytes()));
+
+      // The same for the synchronous save
+      scene->Save(file);
+      Assert::IsTrue(FlxBinReader::IsBinary(ReadFileBytes()));
+    }
+
+    TEST_METHOD(T_KeepsCompression)
+    {
+      File& file = File::Open(path);
+      scene->Save(file);
+      file.is_compressed = true;
+      file.Write(file.data);
+      Assert::IsTrue(FlxCompression::IsCompressed(ReadFileBytes()));
+
+      EditAndSaveAsync(file);
+      std::string bytes = ReadFileBytes();
+      Assert::IsTrue(FlxCompression::IsCompressed(bytes));
+
+      std::string decompressed;
+      Assert::IsTrue(FlxCompression::Decompress(bytes, decompressed));
+      Assert::IsFalse(FlexFormatter::ParseView(decompressed, FlxFmtFileType::Scene, true).IsNull());
+    }
+
+    TEST_METHOD(T_KeepsMetadata)
+    {
+      File& file = File::Open(path);
+      scene->Save(file);
+      std::string bytes_before = ReadFileBytes();
+      FlxFmtFileView before = FlexFormatter::ParseView(bytes_before, FlxFmtFileType::Scene, true);
+
+      EditAndSaveAsync(file);
+      std::string bytes_after = ReadFileBytes();
+      FlxFmtFileView after = FlexFormatter::ParseView(bytes_after, FlxFmtFileType::Scene, true);
+      Assert::IsTrue(before.metadata.created == after.metadata.created);
+      Assert::AreEqual(before.metadata.save_version + 1, after.metadata.save_version);
+    }
+
+    TEST_METHOD(T_Snapshot)
+    {
+      File& file = File::Open(path);
+      scene->SaveBinary(file);
+
+      // Changes after SaveAsync() returns aren't saved
+      std::future<FlexECS::SceneSaveResult> future = scene->SaveAsync(file);
+      entities[5].GetComponent<Vector3>()->x = -1.0f;
+      FlexECS::Scene::DestroyEntity(entities[6]);
+      Assert::IsTrue(future.get().success);
+
+      std::shared_ptr<FlexECS::Scene> loaded = FlexECS::Scene::Load(file);
+      Assert::AreEqual(5.0f, FindComponent<Vector3>(*loaded, entities[5])->x);
+      Assert::AreEqual((size_t)100, loaded->entity_index.size());
+    }
+
+  };
+
+  TEST_CLASS(T_ScenePatch)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      for (int i = 0; i < 100; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        entity.AddComponent<Vector3>({ (float)i, 1.0f, 2.0f });
+        entities.push_back(entity);
+      }
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+      scene = nullptr;
+    }
+
+    // Changes components, destroys and creates entities, moves one to another archetype and renames one
+    void Edit()
+    {
+      entities[5].GetComponent<Vector3>()->x = -1.0f;
+      FlexECS::Scene::DestroyEntity(entities[7]);
+      FlexECS::Entity created = FlexECS::Scene::CreateEntity("Created");
+      created.AddComponent<int>(3);
+      entities[9].AddComponent<int>(5);
+      scene->SetEntityName(entities[11].Get(), "Renamed");
+    }
+
+    TEST_METHOD(T_Diff_Unchanged)
+    {
+      std::shared_ptr<FlexECS::Scene> copy = scene->Internal_Snapshot();
+      Assert::IsTrue(copy->Diff(*scene).IsEmpty());
+    }
+
+    TEST_METHOD(T_Diff_Apply)
+    {
+      std::shared_ptr<FlexECS::Scene> before = scene->Internal_Snapshot();
+      Edit();
+
+      FlexECS::ScenePatch patch = before->Diff(*scene);
+      Assert::IsFalse(patch.IsEmpty());
+
+      before->Apply(patch);
+      Assert::IsTrue(SceneContents(*before) == SceneContents(*scene));
+      Assert::IsTrue(before->Diff(*scene).IsEmpty());
+    }
+
+    TEST_METHOD(T_Undo)
+    {
+      std::shared_ptr<FlexECS::Scene> before = scene->Internal_Snapshot();
+      Edit();
+
+      FlexECS::ScenePatch undo = scene->Diff(*before);
+      scene->Apply(undo);
+      Assert::IsTrue(SceneContents(*scene) == SceneContents(*before));
+    }
+
+    TEST_METHOD(T_SerializeRoundTrip)
+    {
+      std::shared_ptr<FlexECS::Scene> before = scene->Internal_Snapshot();
+      Edit();
+
+      FlexECS::ScenePatch patch = before->Diff(*scene);
+      std::string data = patch.Serialize();
+
+      // a few edits are much smaller than the scene
+      Assert::IsTrue(data.size() < scene->Internal_Serialize().size() / 10);
+
+      FlexECS::ScenePatch loaded;
+      Assert::IsTrue(FlexECS::ScenePatch::Deserialize(data, loaded));
+      before->Apply(loaded);
+      Assert::IsTrue(SceneContents(*before) == SceneContents(*scene));
+
+      Assert::IsFalse(FlexECS::ScenePatch::Deserialize("abc", loaded));
+      Assert::IsFalse(FlexECS::ScenePatch::Deserialize(std::string_view(data.data(), data.size() / 2), loaded));
+    }
+
+    TEST_METHOD(T_Apply_MissingComponent)
+    {
+      std::shared_ptr<FlexECS::Scene> before = scene->Internal_Snapshot();
+      Edit();
+      FlexECS::EntityID created = scene->FindByName("Created").Get();
+
+      // a patch that adds an entity without one of its components
+      FlexECS::ScenePatch patch = before->Diff(*scene);
+      for (FlexECS::ScenePatch::ArchetypeDelta& delta : patch.archetypes)
+      {
+        if (std::find(delta.added.begin(), delta.added.end(), created) == delta.added.end()) continue;
+        FlexECS::ScenePatch::ColumnDelta& column = delta.columns[0];
+        std::size_t index = std::find(column.entities.begin(), column.entities.end(), created) - column.entities.begin();
+        column.entities.erase(column.entities.begin() + index);
+        column.data.erase(column.data.begin() + index);
+      }
+
+      // the entity is skipped, the rest of the patch is applied
+      before->Apply(patch);
+      Assert::IsTrue(before->entity_index.count(created) == 0);
+      Assert::AreEqual(-1.0f, FindComponent<Vector3>(*before, entities[5].Get())->x);
+      Assert::AreEqual((size_t)(SceneContents(*scene).size() - 1), SceneContents(*before).size());
+    }
+
+  };
+
+  TEST_CLASS(T_SceneJournal)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+    std::filesystem::path path;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      path = std::filesystem::temp_directory_path() / "flx_unittest_journal.flxscene";
+      Cleanup();
+
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      for (int i = 0; i < 100; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        entity.AddComponent<Vector3>({ (float)i, 1.0f, 2.0f });
+        entities.push_back(entity);
+      }
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+      std::filesystem::remove(path.string() + ".journal", ec);
+    }
+
+    // Writes the snapshot and two records, returns the scene as of the first record
+    std::shared_ptr<FlexECS::Scene> SaveTwoRecords(FlexECS::SceneJournal& journal)
+    {
+      Assert::IsTrue(journal.Save(*scene));
+      Assert::AreEqual((size_t)0, journal.GetRecordCount());
+
+      entities[5].GetComponent<Vector3>()->x = -5.0f;
+      Assert::IsTrue(journal.Save(*scene));
+      std::shared_ptr<FlexECS::Scene> first_record = scene->Internal_Snapshot();
+
+      FlexECS::Scene::DestroyEntity(entities[7]);
+      FlexECS::Scene::CreateEntity("Created").AddComponent<int>(3);
+      Assert::IsTrue(journal.Save(*scene));
+      Assert::AreEqual((size_t)2, journal.GetRecordCount());
+
+      return first_record;
+    }
+
+    TEST_METHOD(T_Replay)
+    {
+      FlexECS::SceneJournal journal(path);
+      SaveTwoRecords(journal);
+
+      // only the changes are appended
+      Assert::IsTrue(std::filesystem::file_size(path.string() + ".journal") < std::filesystem::file_size(path) / 10);
+
+      FlexECS::SceneJournal loader(path);
+      std::shared_ptr<FlexECS::Scene> loaded = loader.Load();
+      Assert::AreEqual((size_t)2, loader.GetRecordCount());
+      Assert::IsTrue(SceneContents(*loaded) == SceneContents(*scene));
+    }
+
+    TEST_METHOD(T_Replay_TruncatedTail)
+    {
+      FlexECS::SceneJournal journal(path);
+      std::shared_ptr<FlexECS::Scene> first_record = SaveTwoRecords(journal);
+
+      // a crash in the middle of writing the second record
+      std::filesystem::path journal_path = journal.GetJournalPath();
+      std::filesystem::resize_file(journal_path, std::filesystem::file_size(journal_path) - 3);
+
+      FlexECS::SceneJournal loader(path);
+      std::shared_ptr<FlexECS::Scene> loaded = loader.Load();
+      Assert::AreEqual((size_t)1, loader.GetRecordCount());
+      Assert::IsTrue(SceneContents(*loaded) == SceneContents(*first_record));
+
+      // the torn record is cut off, the next record is appended after the good one
+      FlexECS::Scene::SetActiveScene(loaded);
+      entities[6].GetComponent<Vector3>()->x = -6.0f;
+      Assert::IsTrue(loader.Save(*loaded));
+
+      FlexECS::SceneJournal reloader(path);
+      std::shared_ptr<FlexECS::Scene> reloaded = reloader.Load();
+      Assert::AreEqual((size_t)2, reloader.GetRecordCount());
+      Assert::IsTrue(SceneContents(*reloaded) == SceneContents(*loaded));
+    }
+
+    TEST_METHOD(T_Compact)
+    {
+      FlexECS::SceneJournal journal(path);
+      SaveTwoRecords(journal);
+
+      Assert::IsTrue(journal.Compact(*scene));
+      Assert::AreEqual((size_t)0, journal.GetRecordCount());
+      Assert::AreEqual((uintmax_t)0, std::filesystem::file_size(journal.GetJournalPath()));
+
+      FlexECS::SceneJournal loader(path);
+      std::shared_ptr<FlexECS::Scene> loaded = loader.Load();
+      Assert::IsTrue(SceneContents(*loaded) == SceneContents(*scene));
+    }
+
+  };
+
+  TEST_CLASS(T_SceneMerge)
+  {
+  public:
+
+    // A and B point at each other, C points at an entity that isn't in the prefab
+    std::shared_ptr<FlexECS::Scene> prefab;
+    std::vector<FlexECS::Entity> prefab_entities;
+    FlexECS::EntityID outside = 1000000;
+
+    std::shared_ptr<FlexECS::Scene> scene;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      prefab = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(prefab);
+      FlexECS::Entity a = FlexECS::Scene::CreateEntity("A");
+      FlexECS::Entity b = FlexECS::Scene::CreateEntity("B");
+      FlexECS::Entity c = FlexECS::Scene::CreateEntity("C");
+      a.AddComponent<MergeLink>({ b, prefab->Internal_StringStorage_New("to B") });
+      b.AddComponent<MergeLink>({ a, prefab->Internal_StringStorage_New("to A") });
+      c.AddComponent<MergeLink>({ FlexECS::Entity(outside), prefab->Internal_StringStorage_New("outside") });
+      prefab_entities = { a, b, c };
+
+      // the scene already has entities and strings, the prefab's indices mean something else here
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      for (int i = 0; i < 10; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Existing " + std::to_string(i));
+        entity.AddComponent<MergeLink>({ entity, scene->Internal_StringStorage_New("existing") });
+      }
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    // Checks one instance of the prefab, the entities are in the order of prefab_entities
+    void CheckInstance(std::vector<FlexECS::Entity> instance)
+    {
+      Assert::AreEqual((size_t)3, instance.size());
+      for (FlexECS::Entity& entity : instance) Assert::IsTrue(scene->entity_index.count(entity.Get()) == 1);
+
+      Assert::IsTrue(scene->GetEntityName(instance[0].Get()) == "A");
+      Assert::IsTrue(scene->GetEntityName(instance[1].Get()) == "B");
+      Assert::IsTrue(scene->GetEntityName(instance[2].Get()) == "C");
+
+      MergeLink* a = instance[0].GetComponent<MergeLink>();
+      MergeLink* b = instance[1].GetComponent<MergeLink>();
+      MergeLink* c = instance[2].GetComponent<MergeLink>();
+
+      // references inside the prefab point at the copies, others are kept
+      Assert::AreEqual(instance[1].Get(), a->target.Get());
+      Assert::AreEqual(instance[0].Get(), b->target.Get());
+      Assert::AreEqual(outside, c->target.Get());
+
+      Assert::IsTrue(scene->Internal_StringStorage_Get(a->label) == "to B");
+      Assert::IsTrue(scene->Internal_StringStorage_Get(b->label) == "to A");
+      Assert::IsTrue(scene->Internal_StringStorage_Get(c->label) == "outside");
+    }
+
+    TEST_METHOD(T_Merge_RemapsReferences)
+    {
+      std::vector<FlexECS::Entity> merged = scene->Merge(*prefab, 3);
+      Assert::AreEqual((size_t)9, merged.size());
+      Assert::AreEqual((size_t)19, scene->entity_index.size());
+
+      for (std::size_t i = 0; i < 3; i++)
+      {
+        CheckInstance(std::vector<FlexECS::Entity>(merged.begin() + i * 3, merged.begin() + i * 3 + 3));
+      }
+
+      // every instance has its own entities and strings
+      Assert::AreNotEqual(merged[0].Get(), merged[3].Get());
+      Assert::AreNotEqual(merged[0].GetComponent<MergeLink>()->label, merged[3].GetComponent<MergeLink>()->label);
+
+      // the existing entities are untouched and the prefab is unchanged
+      for (auto& [entity, record] : scene->entity_index)
+      {
+        if (scene->GetEntityName(entity).rfind("Existing", 0) != 0) continue;
+        MergeLink* link = FlexECS::Entity(entity).GetComponent<MergeLink>();
+        Assert::AreEqual(entity, link->target.Get());
+        Assert::IsTrue(scene->Internal_StringStorage_Get(link->label) == "existing");
+      }
+      Assert::AreEqual((size_t)3, prefab->entity_index.size());
+    }
+
+    TEST_METHOD(T_InstantiatePrefab)
+    {
+      std::filesystem::path path = std::filesystem::temp_directory_path() / "flx_unittest_merge.flxprefab";
+
+      // json and binary prefabs
+      for (int binary = 0; binary < 2; binary++)
+      {
+        std::ofstream(path).close();
+        File& file = File::Open(path);
+        if (binary) prefab->SaveBinary(file);
+        else prefab->Save(file);
+
+        std::size_t size_before = scene->entity_index.size();
+        std::vector<FlexECS::Entity> instantiated = scene->InstantiatePrefab(file, 2);
+        Assert::AreEqual((size_t)6, instantiated.size());
+        Assert::AreEqual(size_before + 6, scene->entity_index.size());
+
+        CheckInstance(std::vector<FlexECS::Entity>(instantiated.begin(), instantiated.begin() + 3));
+        CheckInstance(std::vector<FlexECS::Entity>(instantiated.begin() + 3, instantiated.end()));
+      }
+
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+    }
+
+  };
+
+  TEST_CLASS(T_Replication)
+  {
+  public:
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      for (int i = 0; i < 200; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        entity.AddComponent<ReplicatedBody>({ { i * 0.5f, 1.0f, 2.0f }, i, true });
+        if (i % 2 == 0) entity.AddComponent<ReplicatedTeam>({ i % 4 });
+        entities.push_back(entity);
+      }
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    // Every replicated entity of the scene is in the client scene with the same components, and nothing else is
+    void CheckConverged(FlexECS::Scene& client_scene)
+    {
+      std::size_t replicated_count = 0;
+      for (auto& [entity, record] : scene->entity_index)
+      {
+        ReplicatedBody* body = FindComponent<ReplicatedBody>(*scene, entity);
+        ReplicatedTeam* team = FindComponent<ReplicatedTeam>(*scene, entity);
+        if (body == nullptr && team == nullptr) continue;
+        replicated_count++;
+
+        ReplicatedBody* client_body = FindComponent<ReplicatedBody>(client_scene, entity);
+        ReplicatedTeam* client_team = FindComponent<ReplicatedTeam>(client_scene, entity);
+        Assert::AreEqual(body == nullptr, client_body == nullptr);
+        Assert::AreEqual(team == nullptr, client_team == nullptr);
+
+        if (body != nullptr)
+        {
+          AreEqualVector(body->position, client_body->position, 0.005f + EPSILONf);
+          Assert::AreEqual(body->health, client_body->health);
+          Assert::AreEqual(body->alive, client_body->alive);
+        }
+        if (team != nullptr) Assert::AreEqual(team->team, client_team->team);
+      }
+      Assert::AreEqual(replicated_count, client_scene.entity_index.size());
+    }
+
+    TEST_METHOD(T_Quantization)
+    {
+      auto [server_end, client_end] = FlexECS::LoopbackTransport::CreatePair();
+      FlexECS::ReplicationServer server;
+      FlexECS::ReplicationServer::ClientID client_id = server.AddClient(server_end);
+      FlexECS::ReplicationClient client(client_end, std::make_shared<FlexECS::Scene>());
+
+      ReplicatedBody* body = entities[3].GetComponent<ReplicatedBody>();
+      body->position.x = 1.23456f;
+      body->position.y = -7.891f;
+      body->position.z = 1000.004f;
+      server.Tick(*scene);
+      Assert::AreEqual((size_t)1, client.Update());
+      std::size_t full_size = server.GetLastPacketSize(client_id);
+
+      // floats arrive as multiples of the precision
+      // component rows are only 8-byte aligned, Vector3 is read in place instead of copied
+      const Vector3& position = FindComponent<ReplicatedBody>(*client.GetScene(), entities[3].Get())->position;
+      AreEqualVector(Vector3(1.23f, -7.89f, 1000.0f), position, 0.0001f);
+      CheckConverged(*client.GetScene());
+
+      // nothing changed, nothing but the header is sent
+      server.Tick(*scene);
+      client.Update();
+      Assert::IsTrue(server.GetLastPacketSize(client_id) < full_size / 50);
+
+      // a change smaller than the precision isn't sent either
+      body->position.x += 0.0004f;
+      server.Tick(*scene);
+      client.Update();
+      Assert::IsTrue(server.GetLastPacketSize(client_id) < full_size / 50);
+      Assert::AreEqual(1.23f, FindComponent<ReplicatedBody>(*client.GetScene(), entities[3].Get())->position.x, 0.0001f);
+    }
+
+    TEST_METHOD(T_Lossy_Converges)
+    {
+      auto [server_end, client_end] = FlexECS::LoopbackTransport::CreatePair();
+      FlexECS::ReplicationServer server;
+      server.AddClient(server_end);
+      FlexECS::ReplicationClient client(client_end, std::make_shared<FlexECS::Scene>());
+
+      // lose some packets and some acknowledgements
+      server_end->SetDropEvery(4);
+      client_end->SetDropEvery(3);
+
+      for (int tick = 0; tick < 40; tick++)
+      {
+        for (int i = 0; i < 20; i++)
+        {
+          FlexECS::Entity& entity = entities[(tick * 31 + i * 7) % entities.size()];
+          if (entity.HasComponent<ReplicatedBody>()) entity.GetComponent<ReplicatedBody>()->position.z += 0.25f * tick;
+        }
+
+        // structural changes
+        if (tick % 5 == 0)
+        {
+          std::size_t index = static_cast<std::size_t>(tick) * 4;
+          FlexECS::Scene::DestroyEntity(entities[index]);
+          entities[index] = FlexECS::Scene::CreateEntity("Created");
+          entities[index].AddComponent<ReplicatedBody>({ { -1.0f, -2.0f, (float)tick }, tick, false });
+          if (entities[index + 1].HasComponent<ReplicatedTeam>()) entities[index + 1].RemoveComponent<ReplicatedTeam>();
+          else entities[index + 1].AddComponent<ReplicatedTeam>({ tick });
+        }
+
+        server.Tick(*scene);
+        client.Update();
+      }
+
+      // once packets arrive again the client catches up
+      server_end->SetDropEvery(0);
+      client_end->SetDropEvery(0);
+      server.Tick(*scene);
+      client.Update();
+      server.Tick(*scene);
+      client.Update();
+
+      CheckConverged(*client.GetScene());
+      Assert::AreEqual(server.GetTick(), client.GetTick());
+    }
+
+    TEST_METHOD(T_FullState_AfterHistory)
+    {
+      constexpr std::size_t HISTORY_SIZE = 4;
+
+      auto [server_end, client_end] = FlexECS::LoopbackTransport::CreatePair();
+      FlexECS::ReplicationServer server(HISTORY_SIZE);
+      server.AddClient(server_end);
+      FlexECS::ReplicationClient client(client_end, std::make_shared<FlexECS::Scene>(), HISTORY_SIZE);
+
+      server.Tick(*scene);
+      client.Update();
+      CheckConverged(*client.GetScene());
+
+      // every acknowledgement is lost, the client's baseline falls out of the history
+      client_end->SetDropEvery(1);
+      for (std::size_t tick = 0; tick < HISTORY_SIZE; tick++)
+      {
+        server.Tick(*scene);
+        client.Update();
+      }
+
+      // the full state has to remove these from the client too
+      FlexECS::Scene::DestroyEntity(entities[0]);
+      entities[2].RemoveComponent<ReplicatedTeam>();
+      entities[4].GetComponent<ReplicatedBody>()->health = -1;
+
+      for (std::size_t tick = 0; tick < 2 * HISTORY_SIZE; tick++)
+      {
+        server.Tick(*scene);
+        client.Update();
+      }
+
+      CheckConverged(*client.GetScene());
+      Assert::IsTrue(client.GetScene()->entity_index.count(entities[0].Get()) == 0);
+    }
+
+  };
+
+  TEST_CLASS(T_Rollback)
+  {
+  public:
+
+    static constexpr std::size_t HISTORY_SIZE = 16;
+
+    std::shared_ptr<FlexECS::Scene> scene;
+    std::vector<FlexECS::Entity> entities;
+    bool is_deterministic = true;
+
+    TEST_METHOD_INITIALIZE(Initialize)
+    {
+      scene = FlexECS::Scene::CreateScene();
+      FlexECS::Scene::SetActiveScene(scene);
+      entities.clear();
+      is_deterministic = true;
+      for (int i = 0; i < 100; i++)
+      {
+        FlexECS::Entity entity = FlexECS::Scene::CreateEntity("Entity " + std::to_string(i));
+        entity.AddComponent<SimulationBody>({ (float)i, 10.0f, (float)(i % 7), 0 });
+        entities.push_back(entity);
+      }
+    }
+
+    TEST_METHOD_CLEANUP(Cleanup)
+    {
+    }
+
+    // Bouncing bodies, is_deterministic = false changes what frame 20 does
+    void SetBounce(FlexECS::FixedStepSimulation& simulation)
+    {
+      simulation.SetStepFunction([this](FlexECS::Scene&, uint64_t frame, double step)
+      {
+        for (FlexECS::Entity& entity : entities)
+        {
+          SimulationBody* body = entity.GetComponent<SimulationBody>();
+          body->velocity_y -= 9.8f * (float)step;
+          body->y += body->velocity_y * (float)step;
+          if (body->y < 0.0f)
+          {
+            body->y = -body->y;
+            body->velocity_y = -body->velocity_y * 0.9f;
+            body->bounces++;
+          }
+        }
+        if (!is_deterministic && frame == 20) entities[3].GetComponent<SimulationBody>()->x += 0.001f;
+      });
+    }
+
+    TEST_METHOD(T_Rewind_RestoresState)
+    {
+      FlexECS::FixedStepSimulation simulation(scene, 1.0 / 60.0, HISTORY_SIZE);
+      SetBounce(simulation);
+      while (simulation.GetFrame() < 30) simulation.Step();
+
+      uint32_t hash_20 = 0;
+      Assert::IsTrue(simulation.GetHistory().GetHash(20, hash_20));
+      uint32_t hash_30 = simulation.GetHash();
+
+      Assert::IsTrue(simulation.Rewind(20));
+      Assert::AreEqual((uint64_t)20, simulation.GetFrame());
+      Assert::AreEqual(hash_20, FlexECS::HashSimulationState(*scene));
+      Assert::IsFalse(simulation.GetHistory().HasFrame(21));
+      float y_20 = entities[5].GetComponent<SimulationBody>()->y;
+
+      // simulating the same frames again gets the same state
+      while (simulation.GetFrame() < 30) simulation.Step();
+      Assert::AreEqual(hash_30, simulation.GetHash());
+      Assert::AreNotEqual(y_20, entities[5].GetComponent<SimulationBody>()->y);
+
+      Assert::IsTrue(simulation.Resimulate(25));
+      Assert::AreEqual((uint64_t)30, simulation.GetFrame());
+      Assert::AreEqual(hash_30, simulation.GetHash());
+    }
+
+    TEST_METHOD(T_Rewind_OutOfHistory)
+    {
+      FlexECS::FixedStepSimulation simulation(scene, 1.0 / 60.0, HISTORY_SIZE);
+      SetBounce(simulation);
+      while (simulation.GetFrame() < 30) simulation.Step();
+
+      CheckHistory(simulation.GetHistory());
+
+      uint32_t hash_30 = simulation.GetHash();
+      Assert::IsFalse(simulation.Rewind(5));
+      Assert::IsFalse(simulation.Resimulate(5));
+      Assert::AreEqual((uint64_t)30, simulation.GetFrame());
+      Assert::AreEqual(hash_30, FlexECS::HashSimulationState(*scene));
+    }
+
+    // The buffer holds the last HISTORY_SIZE frames
+    static void CheckHistory(FlexECS::RollbackBuffer& history)
+    {
+      Assert::AreEqual(HISTORY_SIZE, history.GetFrameCount());
+      Assert::AreEqual((uint64_t)30, history.GetNewestFrame());
+      Assert::AreEqual((uint64_t)(30 - HISTORY_SIZE + 1), history.GetOldestFrame());
+      Assert::IsFalse(history.HasFrame(30 - HISTORY_SIZE));
+    }
+
+    TEST_METHOD(T_Rewind_StructureChanged)
+    {
+      FlexECS::RollbackBuffer history(HISTORY_SIZE);
+      history.Save(*scene, 1);
+
+      entities[1].GetComponent<SimulationBody>()->x = -1.0f;
+      entities[2].AddComponent<int>(2);
+
+      // the entity that moved to another archetype is reported, the others are still restored
+      Assert::IsFalse(history.Rewind(*scene, 1));
+      Assert::AreEqual(1.0f, entities[1].GetComponent<SimulationBody>()->x);
+    }
+
+    TEST_METHOD(T_Hash_IgnoresPadding)
+    {
+      FlexECS::Entity entity = entities[0];
+      entity.AddComponent<PaddedState>({ true, 0.5 });
+      uint32_t hash = FlexECS::HashSimulationState(*scene);
+
+      // garbage in the padding after flag
+      PaddedState* state = entity.GetComponent<PaddedState>();
+      std::memset(state, 0xAB, sizeof(PaddedState));
+      state->flag = true;
+      state->value = 0.5;
+      Assert::AreEqual(hash, FlexECS::HashSimulationState(*scene));
+
+      FlexECS::RollbackBuffer history(HISTORY_SIZE);
+      Assert::AreEqual(hash, history.Save(*scene, 1));
+
+      state->value = 0.25;
+      Assert::AreNotEqual(hash, FlexECS::HashSimulationState(*scene));
+    }
+
+    TEST_METHOD(T_VerifyDeterminism)
+    {
+      FlexECS::FixedStepSimulation simulation(scene, 1.0 / 60.0, HISTORY_SIZE);
+      SetBounce(simulation);
+      while (simulation.GetFrame() < 30) simulation.Step();
+
+      Assert::AreEqual((uint64_t)0, simulation.VerifyDeterminism(15));
+
+      is_deterministic = false;
+      Assert::AreEqual((uint64_t)20, simulation.VerifyDeterminism(15));
+    }
+
+  };
+
+}